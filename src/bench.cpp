@@ -0,0 +1,343 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <ctime>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "opengl_helpers_memory.h"
+#include "cpu_profiler.h"
+#include "demo_list.h"
+#include "headless.h"
+#include "json_write.h"
+
+#include "bench.h"
+
+namespace
+{
+    // Samples of a metric in insertion order
+    struct metric_samples
+    {
+        std::string Name;
+        std::string Unit;
+        std::vector<double> Samples;
+    };
+
+    struct metric_set
+    {
+        std::vector<metric_samples> Metrics;
+
+        std::vector<double>& Get(const std::string& Name, const char* Unit)
+        {
+            for (metric_samples& Metric : Metrics)
+            {
+                if (Metric.Name == Name)
+                    return Metric.Samples;
+            }
+            Metrics.push_back({ Name, Unit, {} });
+            return Metrics.back().Samples;
+        }
+    };
+
+    // Linear interpolation between closest ranks, Sorted is not empty
+    double Percentile(const std::vector<double>& Sorted, double P)
+    {
+        double Rank = P * (double)(Sorted.size() - 1);
+        size_t Low = (size_t)Rank;
+        size_t High = std::min(Low + 1, Sorted.size() - 1);
+        return Sorted[Low] + (Sorted[High] - Sorted[Low]) * (Rank - (double)Low);
+    }
+
+    bench_metric Summarize(const metric_samples& Metric)
+    {
+        std::vector<double> Sorted = Metric.Samples;
+        std::sort(Sorted.begin(), Sorted.end());
+
+        bench_metric Result = {};
+        Result.Name = Metric.Name;
+        Result.Unit = Metric.Unit;
+        Result.Count = (int)Sorted.size();
+        if (Sorted.empty())
+            return Result;
+
+        double Sum = 0.0;
+        for (double Sample : Sorted)
+            Sum += Sample;
+        Result.Mean = Sum / (double)Sorted.size();
+        Result.Min = Sorted.front();
+        Result.P50 = Percentile(Sorted, 0.50);
+        Result.P95 = Percentile(Sorted, 0.95);
+        Result.P99 = Percentile(Sorted, 0.99);
+        Result.Max = Sorted.back();
+        return Result;
+    }
+
+    void AddFrameStats(metric_set& Set, const GL::frame_stats& Stats)
+    {
+        Set.Get("draw_calls", "count").push_back((double)Stats.DrawCalls);
+        Set.Get("instances", "count").push_back((double)Stats.Instances);
+        Set.Get("vertices", "count").push_back((double)Stats.Vertices);
+        Set.Get("triangles", "count").push_back((double)Stats.Triangles);
+        Set.Get("program_binds", "count").push_back((double)Stats.ProgramBinds);
+        Set.Get("vertex_array_binds", "count").push_back((double)Stats.VertexArrayBinds);
+        Set.Get("texture_binds", "count").push_back((double)Stats.TextureBinds);
+        Set.Get("framebuffer_binds", "count").push_back((double)Stats.FramebufferBinds);
+        Set.Get("uniform_calls", "count").push_back((double)Stats.UniformCalls);
+        Set.Get("buffer_upload_bytes", "bytes").push_back((double)Stats.BufferUploadBytes);
+        Set.Get("texture_upload_bytes", "bytes").push_back((double)Stats.TextureUploadBytes);
+        Set.Get("visible_objects", "count").push_back((double)Stats.VisibleObjects);
+        Set.Get("culled_objects", "count").push_back((double)Stats.CulledObjects);
+    }
+
+    void AddMemoryHighWater(metric_set& Set)
+    {
+        static const char* CategoryNames[] = { "texture", "renderbuffer", "buffer", "cpu" };
+        static_assert(sizeof(CategoryNames) / sizeof(CategoryNames[0]) == (int)GL::memory_category::COUNT, "Missing category name");
+
+        const GL::memory_totals& Totals = GL::GetMemoryTotals();
+        for (int i = 0; i < (int)GL::memory_category::COUNT; ++i)
+            Set.Get(std::string("memory_high_water/") + CategoryNames[i], "bytes").push_back((double)Totals.HighWaterBytes[i]);
+        Set.Get("memory_high_water/total", "bytes").push_back((double)Totals.HighWaterTotal);
+    }
+
+    const bench_metric* FindMetric(const bench_demo_result& Result, const std::string& Name)
+    {
+        for (const bench_metric& Metric : Result.Metrics)
+        {
+            if (Metric.Name == Name)
+                return &Metric;
+        }
+        return nullptr;
+    }
+
+    const bench_metric* FindMetric(const std::vector<bench_demo_result>& Results, const std::string& Demo, const std::string& Name)
+    {
+        for (const bench_demo_result& Result : Results)
+        {
+            if (Result.Demo == Demo)
+                return FindMetric(Result, Name);
+        }
+        return nullptr;
+    }
+}
+
+bool RunBenchmark(const bench_options& Options, bench_results* Results)
+{
+    headless_app App(Options.App);
+    if (!App.Init())
+        return false;
+
+    Results->GLRenderer = (const char*)glGetString(GL_RENDERER);
+    Results->GLVersion = (const char*)glGetString(GL_VERSION);
+
+    int DemoCount;
+    const demo_info* Demos = GetDemoInfos(&DemoCount);
+
+    std::vector<int> DemoIds;
+    for (const std::string& Demo : Options.Demos)
+        DemoIds.push_back(FindDemo(Demo.c_str()));
+    if (DemoIds.empty())
+    {
+        for (int i = 0; i < DemoCount; ++i)
+            DemoIds.push_back(i);
+    }
+
+    std::vector<GL::gpu_profiler::scope_timing> GPUTimings;
+    for (int DemoId : DemoIds)
+    {
+        PROFILE_SCOPE_DETAIL("Benchmark demo", Demos[DemoId].Name);
+
+        // High-water marks of this demo only (shared caches included)
+        App.UnloadDemo();
+        GL::ResetMemoryHighWater();
+        App.LoadDemo(DemoId);
+
+        for (int i = 0; i < Options.WarmupFrames; ++i)
+            App.RunFrame();
+
+        metric_set Set;
+        GL::gpu_profiler& Profiler = App.GetGLDebug().Profiler;
+        int ResolvedFrameCount = Profiler.GetResolvedFrameCount();
+        for (int i = 0; i < Options.MeasuredFrames; ++i)
+        {
+            App.RunFrame();
+            Set.Get("cpu_frame_ms", "ms").push_back(App.GetLastFrameMs());
+            AddFrameStats(Set, App.GetLastFrameStats());
+
+            // GPU frames resolve FRAME_LATENCY frames late: the first ones come from the warm-up
+            if (Profiler.GetResolvedFrameCount() != ResolvedFrameCount)
+            {
+                ResolvedFrameCount = Profiler.GetResolvedFrameCount();
+                Profiler.GetLastFrameTimings(&GPUTimings);
+                for (const GL::gpu_profiler::scope_timing& Timing : GPUTimings)
+                    Set.Get("gpu_ms/" + Timing.Path, "ms").push_back(Timing.Ms);
+            }
+        }
+        AddMemoryHighWater(Set);
+
+        bench_demo_result Result;
+        Result.Demo = Demos[DemoId].Name;
+        for (const metric_samples& Metric : Set.Metrics)
+            Result.Metrics.push_back(Summarize(Metric));
+
+        const bench_metric* CPU = FindMetric(Result, "cpu_frame_ms");
+        const bench_metric* GPU = FindMetric(Result, "gpu_ms/Frame");
+        printf("%-18s CPU p50 %7.3f p95 %7.3f p99 %7.3f ms | GPU p50 %7.3f p95 %7.3f p99 %7.3f ms\n", Result.Demo.c_str(),
+            CPU->P50, CPU->P95, CPU->P99, GPU ? GPU->P50 : 0.0, GPU ? GPU->P95 : 0.0, GPU ? GPU->P99 : 0.0);
+
+        Results->Demos.push_back(Result);
+    }
+
+    return true;
+}
+
+bool WriteBenchJSON(const char* Filename, const bench_options& Options, const bench_results& Results)
+{
+    FILE* File = fopen(Filename, "w");
+    if (File == nullptr)
+    {
+        fprintf(stderr, "Cannot write benchmark results '%s'\n", Filename);
+        return false;
+    }
+
+    char Date[64];
+    time_t Now = time(nullptr);
+    strftime(Date, sizeof(Date), "%Y-%m-%dT%H:%M:%S", localtime(&Now));
+
+    fprintf(File, "{\n  \"date\": \"%s\",\n  \"build\": \"%s %s\",\n", Date, __DATE__, __TIME__);
+    fprintf(File, "  \"gl_renderer\": ");
+    WriteJSONString(File, Results.GLRenderer.c_str());
+    fprintf(File, ",\n  \"gl_version\": ");
+    WriteJSONString(File, Results.GLVersion.c_str());
+    fprintf(File, ",\n  \"camera_path\": ");
+    WriteJSONString(File, Options.App.ReplayCameraPath.c_str());
+    fprintf(File, ",\n  \"width\": %d,\n  \"height\": %d,\n  \"warmup_frames\": %d,\n  \"measured_frames\": %d,\n",
+        Options.App.Width, Options.App.Height, Options.WarmupFrames, Options.MeasuredFrames);
+    fprintf(File, "  \"tavern_lights\": %d,\n  \"light_clusters\": %s,\n  \"light_volumes\": %s,\n  \"frustum_culling\": %s,\n  \"occlusion_culling\": %s,\n  \"software_occlusion\": %s,\n  \"instance_animation\": \"%s\",\n  \"demos\": [\n",
+        Options.App.TavernLights, Options.App.LightClusters ? "true" : "false", Options.App.LightVolumes ? "true" : "false",
+        Options.App.FrustumCulling ? "true" : "false", Options.App.OcclusionCulling ? "true" : "false",
+        Options.App.SoftwareOcclusion ? "true" : "false", Options.App.InstanceAnimation.c_str());
+
+    for (size_t i = 0; i < Results.Demos.size(); ++i)
+    {
+        fprintf(File, "    {\n      \"name\": ");
+        WriteJSONString(File, Results.Demos[i].Demo.c_str());
+        fprintf(File, ",\n      \"metrics\": [\n");
+        const std::vector<bench_metric>& Metrics = Results.Demos[i].Metrics;
+        for (size_t j = 0; j < Metrics.size(); ++j)
+        {
+            const bench_metric& Metric = Metrics[j];
+            fprintf(File, "        { \"name\": ");
+            WriteJSONString(File, Metric.Name.c_str());
+            fprintf(File, ", \"unit\": \"%s\", \"count\": %d, \"mean\": %.6g, \"min\": %.6g, \"p50\": %.6g, \"p95\": %.6g, \"p99\": %.6g, \"max\": %.6g }%s\n",
+                Metric.Unit.c_str(), Metric.Count, Metric.Mean, Metric.Min, Metric.P50, Metric.P95, Metric.P99, Metric.Max, j + 1 < Metrics.size() ? "," : "");
+        }
+        fprintf(File, "      ]\n    }%s\n", i + 1 < Results.Demos.size() ? "," : "");
+    }
+    fprintf(File, "  ]\n}\n");
+    fclose(File);
+
+    printf("Benchmark results written to '%s'\n", Filename);
+    return true;
+}
+
+bool WriteBenchCSV(const char* Filename, const std::vector<bench_demo_result>& Results)
+{
+    FILE* File = fopen(Filename, "w");
+    if (File == nullptr)
+    {
+        fprintf(stderr, "Cannot write benchmark results '%s'\n", Filename);
+        return false;
+    }
+
+    fprintf(File, "demo,metric,unit,count,mean,min,p50,p95,p99,max\n");
+    for (const bench_demo_result& Result : Results)
+    {
+        for (const bench_metric& Metric : Result.Metrics)
+        {
+            fprintf(File, "%s,%s,%s,%d,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g\n", Result.Demo.c_str(), Metric.Name.c_str(), Metric.Unit.c_str(),
+                Metric.Count, Metric.Mean, Metric.Min, Metric.P50, Metric.P95, Metric.P99, Metric.Max);
+        }
+    }
+    fclose(File);
+
+    printf("Benchmark results written to '%s'\n", Filename);
+    return true;
+}
+
+bool ReadBenchCSV(const char* Filename, std::vector<bench_demo_result>* Results)
+{
+    std::ifstream File(Filename);
+    if (!File.is_open())
+    {
+        fprintf(stderr, "Cannot read benchmark results '%s'\n", Filename);
+        return false;
+    }
+
+    std::string Line;
+    std::getline(File, Line); // Header
+    while (std::getline(File, Line))
+    {
+        std::vector<std::string> Fields;
+        std::stringstream Stream(Line);
+        std::string Field;
+        while (std::getline(Stream, Field, ','))
+            Fields.push_back(Field);
+        if (Fields.size() != 10)
+            continue;
+
+        if (Results->empty() || Results->back().Demo != Fields[0])
+            Results->push_back({ Fields[0], {} });
+
+        bench_metric Metric = {};
+        Metric.Name = Fields[1];
+        Metric.Unit = Fields[2];
+        Metric.Count = atoi(Fields[3].c_str());
+        Metric.Mean = atof(Fields[4].c_str());
+        Metric.Min = atof(Fields[5].c_str());
+        Metric.P50 = atof(Fields[6].c_str());
+        Metric.P95 = atof(Fields[7].c_str());
+        Metric.P99 = atof(Fields[8].c_str());
+        Metric.Max = atof(Fields[9].c_str());
+        Results->back().Metrics.push_back(Metric);
+    }
+
+    return true;
+}
+
+int CompareBenchResults(const std::vector<bench_demo_result>& Base, const std::vector<bench_demo_result>& Current, double ThresholdPercent, double MinDeltaMs)
+{
+    int RegressionCount = 0;
+    printf("%-18s %-48s %12s %12s %9s\n", "demo", "metric (p50)", "base", "current", "delta");
+    for (const bench_demo_result& Result : Current)
+    {
+        for (const bench_metric& Metric : Result.Metrics)
+        {
+            const bench_metric* BaseMetric = FindMetric(Base, Result.Demo, Metric.Name);
+            if (BaseMetric == nullptr)
+                continue;
+
+            double Delta = Metric.P50 - BaseMetric->P50;
+            double DeltaPercent = BaseMetric->P50 != 0.0 ? 100.0 * Delta / BaseMetric->P50 : (Delta != 0.0 ? 100.0 : 0.0);
+
+            // Every metric is "lower is better"
+            bool Regression = DeltaPercent > ThresholdPercent && (Metric.Unit != "ms" || Delta > MinDeltaMs);
+            bool Improvement = DeltaPercent < -ThresholdPercent && (Metric.Unit != "ms" || -Delta > MinDeltaMs);
+            if (Regression)
+                RegressionCount++;
+
+            printf("%-18s %-48s %12.4g %12.4g %+8.1f%%%s\n", Result.Demo.c_str(), Metric.Name.c_str(), BaseMetric->P50, Metric.P50, DeltaPercent,
+                Regression ? "  REGRESSION" : (Improvement ? "  improved" : ""));
+        }
+    }
+
+    for (const bench_demo_result& Result : Base)
+    {
+        if (FindMetric(Current, Result.Demo, "cpu_frame_ms") == nullptr)
+            printf("%-18s missing from the current results\n", Result.Demo.c_str());
+    }
+
+    printf("%d regression(s) above %.1f%%\n", RegressionCount, ThresholdPercent);
+    return RegressionCount;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "command_line.h"
+
+// Summary of the per frame samples of one metric
+struct bench_metric
+{
+    std::string Name; // "cpu_frame_ms", "gpu_ms/Frame/Demo/Bloom", "draw_calls", "memory_high_water/texture"...
+    std::string Unit; // "ms", "count" or "bytes"
+    int Count;
+    double Mean;
+    double Min;
+    double P50;
+    double P95;
+    double P99;
+    double Max;
+};
+
+struct bench_demo_result
+{
+    std::string Demo;
+    std::vector<bench_metric> Metrics;
+};
+
+struct bench_results
+{
+    std::string GLRenderer;
+    std::string GLVersion;
+    std::vector<bench_demo_result> Demos;
+};
+
+struct bench_options
+{
+    app_options App;                // Resolution and output directory (vsync and ImGui off)
+    std::vector<std::string> Demos; // Names or indices, every demo when empty
+    int WarmupFrames = 60;          // Shader compilation, caches, GPU profiler latency
+    int MeasuredFrames = 300;
+    std::string Name = "bench";     // Results written to <Name>.json and <Name>.csv
+};
+
+// Run each demo headless, false if no context can be created
+bool RunBenchmark(const bench_options& Options, bench_results* Results);
+
+bool WriteBenchJSON(const char* Filename, const bench_options& Options, const bench_results& Results);
+bool WriteBenchCSV(const char* Filename, const std::vector<bench_demo_result>& Results);
+bool ReadBenchCSV(const char* Filename, std::vector<bench_demo_result>* Results);
+
+// Print the p50 of the metrics found in both results
+// Metrics growing by more than ThresholdPercent (and MinDeltaMs for timings) are regressions, returns their count
+int CompareBenchResults(const std::vector<bench_demo_result>& Base, const std::vector<bench_demo_result>& Current, double ThresholdPercent, double MinDeltaMs);
@@ -0,0 +1,153 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <algorithm>
+
+#include "cpu_profiler.h"
+#include "demo_list.h"
+#include "command_line.h"
+#include "bench.h"
+#include "tavern_scene.h"
+#include "demo_deferred_shading.h"
+#include "demo_instancing.h"
+#include "culling.h"
+
+// ibr_bench: headless benchmark of the demos, or comparison of two result files
+
+static void PrintBenchUsage(const char* ExeName)
+{
+    printf("Usage: %s [options]\n", ExeName);
+    printf("       %s --compare <base.csv> <current.csv> [--threshold <percent>] [--min-delta <ms>]\n", ExeName);
+    printf("  --demos <a,b,...>   Demos to run (names or indices), all by default\n");
+    printf("  --warmup <count>    Frames rendered before measuring\n");
+    printf("  --frames <count>    Measured frames\n");
+    printf("  --width <pixels>    Offscreen framebuffer width\n");
+    printf("  --height <pixels>   Offscreen framebuffer height\n");
+    printf("  --output <dir>      Directory of the results\n");
+    printf("  --name <name>       Results written to <name>.json and <name>.csv\n");
+    printf("  --replay-camera <f> Camera inputs replayed from each demo load\n");
+    printf("  --trace [file]      Record a CPU trace of the whole run\n");
+    printf("  --tavern-lights <n> Extra animated point lights in the tavern scenes (clustered shading)\n");
+    printf("  --no-light-clusters Shade every tavern light on every pixel (reference)\n");
+    printf("  --light-volumes     Deferred shading draws the tavern point lights as stencil light volumes\n");
+    printf("  --no-frustum-culling Submit every object, visible or not\n");
+    printf("  --occlusion-culling Test the tavern submeshes with occlusion queries\n");
+    printf("  --software-occlusion Test the tavern submeshes against a CPU rasterized depth buffer\n");
+    printf("  --instance-animation <cpu|gpu|soa> Instancing demo animation: uploaded matrices, procedural or SoA on the job pool\n");
+    printf("  --threshold <pct>   Compare: p50 growth reported as regression (default 5)\n");
+    printf("  --min-delta <ms>    Compare: timings must also grow by this much (default 0.05)\n");
+    printf("Compare exits with 1 when a regression is found\n");
+}
+
+int main(int argc, char* argv[])
+{
+    bench_options Options;
+    Options.App.VSync = false;
+    Options.App.ImGui = false;
+
+    const char* CompareFiles[2] = {};
+    double ThresholdPercent = 5.0;
+    double MinDeltaMs = 0.05;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* Arg = argv[i];
+        bool HasValue = i + 1 < argc && argv[i + 1][0] != '-';
+
+        if (strcmp(Arg, "--compare") == 0 && i + 2 < argc)
+        {
+            CompareFiles[0] = argv[++i];
+            CompareFiles[1] = argv[++i];
+        }
+        else if (strcmp(Arg, "--trace") == 0)
+        {
+            Options.App.Trace = true;
+            if (HasValue)
+                Options.App.TraceFilename = argv[++i];
+        }
+        else if (HasValue && strcmp(Arg, "--demos") == 0)
+        {
+            std::stringstream Stream(argv[++i]);
+            std::string Demo;
+            while (std::getline(Stream, Demo, ','))
+            {
+                if (FindDemo(Demo.c_str()) < 0)
+                {
+                    fprintf(stderr, "Unknown demo '%s'\n", Demo.c_str());
+                    return 1;
+                }
+                Options.Demos.push_back(Demo);
+            }
+        }
+        else if (HasValue && strcmp(Arg, "--warmup") == 0)    Options.WarmupFrames = atoi(argv[++i]);
+        else if (HasValue && strcmp(Arg, "--frames") == 0)    Options.MeasuredFrames = atoi(argv[++i]);
+        else if (HasValue && strcmp(Arg, "--width") == 0)     Options.App.Width = atoi(argv[++i]);
+        else if (HasValue && strcmp(Arg, "--height") == 0)    Options.App.Height = atoi(argv[++i]);
+        else if (HasValue && strcmp(Arg, "--output") == 0)    Options.App.OutputDir = argv[++i];
+        else if (HasValue && strcmp(Arg, "--name") == 0)      Options.Name = argv[++i];
+        else if (HasValue && strcmp(Arg, "--replay-camera") == 0) Options.App.ReplayCameraPath = argv[++i];
+        else if (HasValue && strcmp(Arg, "--tavern-lights") == 0) Options.App.TavernLights = atoi(argv[++i]);
+        else if (strcmp(Arg, "--no-light-clusters") == 0) Options.App.LightClusters = false;
+        else if (strcmp(Arg, "--light-volumes") == 0) Options.App.LightVolumes = true;
+        else if (strcmp(Arg, "--no-frustum-culling") == 0) Options.App.FrustumCulling = false;
+        else if (strcmp(Arg, "--occlusion-culling") == 0) Options.App.OcclusionCulling = true;
+        else if (strcmp(Arg, "--software-occlusion") == 0) Options.App.SoftwareOcclusion = true;
+        else if (HasValue && strcmp(Arg, "--instance-animation") == 0) Options.App.InstanceAnimation = argv[++i];
+        else if (HasValue && strcmp(Arg, "--threshold") == 0) ThresholdPercent = atof(argv[++i]);
+        else if (HasValue && strcmp(Arg, "--min-delta") == 0) MinDeltaMs = atof(argv[++i]);
+        else
+        {
+            if (strcmp(Arg, "--help") != 0 && strcmp(Arg, "-h") != 0)
+                fprintf(stderr, "Unknown option or missing value: %s\n", Arg);
+            PrintBenchUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (CompareFiles[0])
+    {
+        std::vector<bench_demo_result> Base;
+        std::vector<bench_demo_result> Current;
+        if (!ReadBenchCSV(CompareFiles[0], &Base) || !ReadBenchCSV(CompareFiles[1], &Current))
+            return 1;
+        return CompareBenchResults(Base, Current, ThresholdPercent, MinDeltaMs) > 0 ? 1 : 0;
+    }
+
+    if (Options.App.Width <= 0 || Options.App.Height <= 0 || Options.WarmupFrames < 0 || Options.MeasuredFrames <= 0)
+    {
+        fprintf(stderr, "Invalid resolution or frame count\n");
+        return 1;
+    }
+
+    tavern_scene::DefaultExtraLightCount = std::max(Options.App.TavernLights, 0);
+    tavern_scene::DefaultClusteredLights = Options.App.LightClusters;
+    demo_deferred_shading::DefaultLightVolumes = Options.App.LightVolumes;
+    Culling::Enabled = Options.App.FrustumCulling;
+    tavern_scene::DefaultOcclusionCulling = Options.App.OcclusionCulling;
+    tavern_scene::DefaultSoftwareOcclusion = Options.App.SoftwareOcclusion;
+    if (!demo_instancing::FindAnimation(Options.App.InstanceAnimation.c_str(), &demo_instancing::DefaultAnimation))
+    {
+        fprintf(stderr, "Unknown instance animation '%s'\n", Options.App.InstanceAnimation.c_str());
+        return 1;
+    }
+
+    CPUProfiler::SetThreadName("Main");
+    if (Options.App.Trace)
+        CPUProfiler::StartRecording();
+
+    bench_results Results;
+    if (!RunBenchmark(Options, &Results))
+        return 1;
+
+    WriteBenchJSON(GetOutputPath(Options.App, Options.Name + ".json").c_str(), Options, Results);
+    WriteBenchCSV(GetOutputPath(Options.App, Options.Name + ".csv").c_str(), Results.Demos);
+
+    if (CPUProfiler::IsRecording())
+    {
+        CPUProfiler::StopRecording();
+        CPUProfiler::WriteTrace(GetOutputPath(Options.App, Options.App.TraceFilename).c_str());
+    }
+
+    return 0;
+}
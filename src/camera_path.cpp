@@ -0,0 +1,84 @@
+#include <cstdio>
+#include <cstring>
+
+#include "camera_path.h"
+
+void camera_path::Clear()
+{
+    Frames.clear();
+}
+
+void camera_path::Record(const camera_inputs& Inputs)
+{
+    Frames.push_back(Inputs);
+}
+
+camera_inputs camera_path::GetInputs(int Frame) const
+{
+    if (Frame < 0 || Frame >= (int)Frames.size())
+        return {};
+    return Frames[Frame];
+}
+
+bool camera_path::Save(const char* Filename) const
+{
+    FILE* File = fopen(Filename, "w");
+    if (File == nullptr)
+    {
+        fprintf(stderr, "Cannot write camera path '%s'\n", Filename);
+        return false;
+    }
+
+    fprintf(File, "ibr_camera_path 1\n");
+    fprintf(File, "demo %s\n", Demo.empty() ? "-" : Demo.c_str());
+    fprintf(File, "frames %d\n", (int)Frames.size());
+    // Round-trip precision so that the replay is exact
+    for (const camera_inputs& Inputs : Frames)
+        fprintf(File, "%.17g %d %.9g %.9g\n", Inputs.DeltaTime, Inputs.KeyInputsMask, Inputs.MouseDX, Inputs.MouseDY);
+    fclose(File);
+
+    printf("Camera path written to '%s' (%d frames)\n", Filename, (int)Frames.size());
+    return true;
+}
+
+bool camera_path::Load(const char* Filename)
+{
+    FILE* File = fopen(Filename, "r");
+    if (File == nullptr)
+    {
+        fprintf(stderr, "Cannot read camera path '%s'\n", Filename);
+        return false;
+    }
+
+    int Version = 0;
+    char DemoName[128] = {};
+    int FrameCount = 0;
+    if (fscanf(File, "ibr_camera_path %d demo %127s frames %d", &Version, DemoName, &FrameCount) != 3 || Version != 1 || FrameCount < 0)
+    {
+        fprintf(stderr, "Invalid camera path '%s'\n", Filename);
+        fclose(File);
+        return false;
+    }
+
+    Demo = strcmp(DemoName, "-") == 0 ? "" : DemoName;
+    Frames.resize(FrameCount);
+    for (int i = 0; i < FrameCount; ++i)
+    {
+        camera_inputs& Inputs = Frames[i];
+        if (fscanf(File, "%lf %d %f %f", &Inputs.DeltaTime, &Inputs.KeyInputsMask, &Inputs.MouseDX, &Inputs.MouseDY) != 4)
+        {
+            fprintf(stderr, "Camera path '%s' truncated at frame %d\n", Filename, i);
+            Frames.resize(i);
+            break;
+        }
+    }
+    fclose(File);
+
+    return true;
+}
+
+void CameraPathSetFixedTime(platform_io* IO, int Frame)
+{
+    IO->DeltaTime = camera_path::FIXED_DELTA_TIME;
+    IO->Time = (Frame + 1) * camera_path::FIXED_DELTA_TIME;
+}
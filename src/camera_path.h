@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "platform.h"
+
+// Camera inputs recorded frame by frame and replayed with a fixed time step
+// Replaying the inputs from the demo construction gives the same camera (and the same IO.Time) on every frame
+class camera_path
+{
+public:
+    static constexpr double FIXED_DELTA_TIME = 1.0 / 60.0;
+
+    void Clear();
+    void Record(const camera_inputs& Inputs);
+    int GetFrameCount() const { return (int)Frames.size(); }
+    // No input past the end
+    camera_inputs GetInputs(int Frame) const;
+
+    // Text file, one frame per line
+    bool Save(const char* Filename) const;
+    bool Load(const char* Filename);
+
+    std::string Demo; // Demo recorded (empty if unknown)
+
+private:
+    std::vector<camera_inputs> Frames;
+};
+
+// Time of Frame in fixed time step mode (recording and replay)
+void CameraPathSetFixedTime(platform_io* IO, int Frame);
@@ -0,0 +1,191 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <filesystem>
+
+#include "demo_list.h"
+#include "demo_instancing.h"
+
+#include "command_line.h"
+
+void PrintUsage(const char* ExeName)
+{
+    printf("Usage: %s [options]\n", ExeName);
+    printf("  --headless          Render offscreen without visible window\n");
+    printf("  --demo <name|index> Demo to start with\n");
+    printf("  --width <pixels>    Window or offscreen framebuffer width\n");
+    printf("  --height <pixels>   Window or offscreen framebuffer height\n");
+    printf("  --frames <count>    Frames to render in headless mode\n");
+    printf("  --vsync <0|1>       Swap interval (headless: throttle to 60 Hz)\n");
+    printf("  --no-imgui          Do not render the ImGui overlay (headless)\n");
+    printf("  --output <dir>      Directory of the traces, reports and captures\n");
+    printf("  --trace [file]      Record a CPU trace from startup, written on exit\n");
+    printf("  --record-camera <f> Record the camera inputs with a fixed time step, written on exit\n");
+    printf("  --replay-camera <f> Replay recorded camera inputs with a fixed time step\n");
+    printf("  --golden <dir>      Compare a frame of every demo (or --demo) with the golden images of <dir>\n");
+    printf("  --update-golden     Write the golden images instead of comparing\n");
+    printf("  --startup-trace     Time the startup phases and assets until interactive, keep a history\n");
+    printf("  --cold-start        Delete the mesh and program caches before starting\n");
+    printf("  --tavern-lights <n> Extra animated point lights in the tavern scenes (clustered shading)\n");
+    printf("  --no-light-clusters Shade every tavern light on every pixel (reference)\n");
+    printf("  --light-volumes     Deferred shading draws the tavern point lights as stencil light volumes\n");
+    printf("  --no-frustum-culling Submit every object, visible or not\n");
+    printf("  --occlusion-culling Test the tavern submeshes with occlusion queries\n");
+    printf("  --software-occlusion Test the tavern submeshes against a CPU rasterized depth buffer\n");
+    printf("  --instance-animation <cpu|gpu|soa> Instancing demo animation: uploaded matrices, procedural or SoA on the job pool\n");
+    printf("  --help              Print this message\n");
+
+    int DemoCount;
+    const demo_info* Demos = GetDemoInfos(&DemoCount);
+    printf("Demos:");
+    for (int i = 0; i < DemoCount; ++i)
+        printf(" %s", Demos[i].Name);
+    printf("\n");
+}
+
+bool ParseCommandLine(int argc, char* argv[], app_options* Options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* Arg = argv[i];
+        bool HasValue = i + 1 < argc && argv[i + 1][0] != '-';
+        const char* Value = HasValue ? argv[i + 1] : nullptr;
+
+        // Options with a mandatory value
+        if (strcmp(Arg, "--demo") == 0 || strcmp(Arg, "--width") == 0 || strcmp(Arg, "--height") == 0
+            || strcmp(Arg, "--frames") == 0 || strcmp(Arg, "--vsync") == 0 || strcmp(Arg, "--output") == 0
+            || strcmp(Arg, "--record-camera") == 0 || strcmp(Arg, "--replay-camera") == 0
+            || strcmp(Arg, "--golden") == 0 || strcmp(Arg, "--tavern-lights") == 0 || strcmp(Arg, "--instance-animation") == 0)
+        {
+            if (!HasValue)
+            {
+                fprintf(stderr, "Missing value for %s\n", Arg);
+                PrintUsage(argv[0]);
+                return false;
+            }
+            ++i;
+
+            if (strcmp(Arg, "--demo") == 0)        Options->Demo = Value;
+            else if (strcmp(Arg, "--width") == 0)  Options->Width = atoi(Value);
+            else if (strcmp(Arg, "--height") == 0) Options->Height = atoi(Value);
+            else if (strcmp(Arg, "--frames") == 0) Options->FrameCount = atoi(Value);
+            else if (strcmp(Arg, "--vsync") == 0)  Options->VSync = atoi(Value) != 0;
+            else if (strcmp(Arg, "--output") == 0) Options->OutputDir = Value;
+            else if (strcmp(Arg, "--record-camera") == 0) Options->RecordCameraPath = Value;
+            else if (strcmp(Arg, "--replay-camera") == 0) Options->ReplayCameraPath = Value;
+            else if (strcmp(Arg, "--golden") == 0) Options->GoldenDir = Value;
+            else if (strcmp(Arg, "--tavern-lights") == 0) Options->TavernLights = atoi(Value);
+            else if (strcmp(Arg, "--instance-animation") == 0) Options->InstanceAnimation = Value;
+        }
+        else if (strcmp(Arg, "--help") == 0 || strcmp(Arg, "-h") == 0)
+        {
+            PrintUsage(argv[0]);
+            return false;
+        }
+        else if (strcmp(Arg, "--headless") == 0)
+        {
+            Options->Headless = true;
+        }
+        else if (strcmp(Arg, "--no-imgui") == 0)
+        {
+            Options->ImGui = false;
+        }
+        else if (strcmp(Arg, "--startup-trace") == 0)
+        {
+            Options->StartupTrace = true;
+        }
+        else if (strcmp(Arg, "--cold-start") == 0)
+        {
+            Options->ColdStart = true;
+        }
+        else if (strcmp(Arg, "--no-light-clusters") == 0)
+        {
+            Options->LightClusters = false;
+        }
+        else if (strcmp(Arg, "--light-volumes") == 0)
+        {
+            Options->LightVolumes = true;
+        }
+        else if (strcmp(Arg, "--no-frustum-culling") == 0)
+        {
+            Options->FrustumCulling = false;
+        }
+        else if (strcmp(Arg, "--occlusion-culling") == 0)
+        {
+            Options->OcclusionCulling = true;
+        }
+        else if (strcmp(Arg, "--software-occlusion") == 0)
+        {
+            Options->SoftwareOcclusion = true;
+        }
+        else if (strcmp(Arg, "--update-golden") == 0)
+        {
+            Options->UpdateGolden = true;
+        }
+        else if (strcmp(Arg, "--trace") == 0)
+        {
+            Options->Trace = true;
+            if (HasValue)
+                Options->TraceFilename = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", Arg);
+            PrintUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if (Options->Width <= 0 || Options->Height <= 0 || Options->FrameCount < -1)
+    {
+        fprintf(stderr, "Invalid resolution or frame count\n");
+        return false;
+    }
+
+    if (Options->TavernLights < 0)
+    {
+        fprintf(stderr, "Invalid light count\n");
+        return false;
+    }
+
+    demo_instancing::animation Animation;
+    if (!demo_instancing::FindAnimation(Options->InstanceAnimation.c_str(), &Animation))
+    {
+        fprintf(stderr, "Unknown instance animation '%s'\n", Options->InstanceAnimation.c_str());
+        return false;
+    }
+
+    if (!Options->Demo.empty() && FindDemo(Options->Demo.c_str()) < 0)
+    {
+        fprintf(stderr, "Unknown demo '%s'\n", Options->Demo.c_str());
+        PrintUsage(argv[0]);
+        return false;
+    }
+
+    if (!Options->RecordCameraPath.empty() && !Options->ReplayCameraPath.empty())
+    {
+        fprintf(stderr, "Cannot record and replay the camera at the same time\n");
+        return false;
+    }
+
+    if (Options->UpdateGolden && Options->GoldenDir.empty())
+    {
+        fprintf(stderr, "--update-golden needs --golden <dir>\n");
+        return false;
+    }
+
+    if (!Options->GoldenDir.empty())
+    {
+        Options->Headless = true;
+        Options->ImGui = false; // Timings and counters change every run
+    }
+
+    return true;
+}
+
+std::string GetOutputPath(const app_options& Options, const std::string& Filename)
+{
+    std::error_code Error;
+    std::filesystem::create_directories(Options.OutputDir, Error);
+    return (std::filesystem::path(Options.OutputDir) / Filename).string();
+}
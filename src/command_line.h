@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+
+// Options shared by the windowed app and the headless runner
+struct app_options
+{
+    bool Headless = false;
+    std::string Demo;           // Name or index (first demo when empty)
+    int Width = 1440;
+    int Height = 900;
+    int FrameCount = -1;        // Headless only, -1: replayed path length or 100
+    bool VSync = true;          // Headless: throttle to 60 Hz
+    bool ImGui = true;          // Headless: render the ImGui overlay into the frames
+    std::string OutputDir = ".";
+
+    // Camera inputs recorded from the first frame (written on exit) or replayed, both with a fixed time step
+    std::string RecordCameraPath;
+    std::string ReplayCameraPath;
+
+    // Golden image test: capture frame FrameCount (-1: replayed path length or 60) of every demo (or Demo) and compare
+    // with <GoldenDir>/<demo>.png, or overwrite the goldens with UpdateGolden. Implies Headless without ImGui
+    std::string GoldenDir;
+    bool UpdateGolden = false;
+
+    // Startup phases and assets timed until interactive, reported to startup.json and appended to startup_history.csv
+    bool StartupTrace = false;
+    // Delete the .obj and program binary caches before starting (cold run)
+    bool ColdStart = false;
+
+    // Extra animated point lights of the tavern scenes (base and deferred shading demos), culled in light clusters or not
+    int TavernLights = 0;
+    bool LightClusters = true;
+    // Deferred shading demo draws the local tavern lights as stencil-tested volumes instead of the clustered pass
+    bool LightVolumes = false;
+
+    // Demos submit only the objects (tavern submeshes) intersecting the view frustum
+    bool FrustumCulling = true;
+    // Tavern submeshes are also tested with occlusion queries (base and deferred shading demos)
+    bool OcclusionCulling = false;
+    // Tavern submeshes are tested against a CPU depth buffer of the largest triangles before submission
+    bool SoftwareOcclusion = false;
+
+    // Instancing demo animation: "cpu" matrices uploaded every frame, "gpu" procedural transforms or "soa" transforms on the job pool
+    std::string InstanceAnimation = "cpu";
+
+    // CPU trace recorded from startup and written on exit
+    bool Trace = false;
+    std::string TraceFilename = "trace.json";
+};
+
+// Returns false (after printing the usage) on unknown or malformed options
+bool ParseCommandLine(int argc, char* argv[], app_options* Options);
+void PrintUsage(const char* ExeName);
+
+// Path inside the output directory (created if needed)
+std::string GetOutputPath(const app_options& Options, const std::string& Filename);
@@ -0,0 +1,157 @@
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "cpu_profiler.h"
+#include "json_write.h"
+
+std::atomic<bool> CPUProfiler::gRecording(false);
+
+namespace
+{
+    struct event
+    {
+        const char* Name;
+        uint64_t Start;
+        uint64_t End;
+        char Detail[40];
+    };
+
+    const uint64_t EVENT_CAPACITY = 1 << 15; // Per thread, older events are overwritten
+
+    // Written by its thread only, read by WriteTrace()
+    struct thread_buffer
+    {
+        std::unique_ptr<event[]> Events;
+        std::atomic<uint64_t> WriteCount{ 0 };
+        std::atomic<uint64_t> FirstEvent{ 0 }; // Events before belong to a previous recording
+        int ThreadId = 0;
+        std::string Name;
+    };
+
+    // Taken on thread registration and dump only
+    std::mutex ThreadsMutex;
+    std::vector<std::unique_ptr<thread_buffer>> ThreadBuffers;
+    thread_local thread_buffer* CurrentThreadBuffer = nullptr;
+
+    const std::chrono::steady_clock::time_point StartTime = std::chrono::steady_clock::now();
+
+    thread_buffer* GetThreadBuffer()
+    {
+        if (CurrentThreadBuffer == nullptr)
+        {
+            std::unique_ptr<thread_buffer> Buffer = std::make_unique<thread_buffer>();
+            Buffer->Events = std::make_unique<event[]>(EVENT_CAPACITY);
+
+            std::lock_guard<std::mutex> Lock(ThreadsMutex);
+            Buffer->ThreadId = (int)ThreadBuffers.size();
+            Buffer->Name = "Thread " + std::to_string(Buffer->ThreadId);
+            CurrentThreadBuffer = Buffer.get();
+            ThreadBuffers.push_back(std::move(Buffer));
+        }
+        return CurrentThreadBuffer;
+    }
+}
+
+void CPUProfiler::StartRecording()
+{
+    {
+        std::lock_guard<std::mutex> Lock(ThreadsMutex);
+        for (std::unique_ptr<thread_buffer>& Buffer : ThreadBuffers)
+            Buffer->FirstEvent.store(Buffer->WriteCount.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+    gRecording.store(true);
+}
+
+void CPUProfiler::StopRecording()
+{
+    gRecording.store(false);
+}
+
+uint64_t CPUProfiler::GetTimestamp()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - StartTime).count();
+}
+
+void CPUProfiler::AddScope(const char* Name, const char* Detail, uint64_t Start, uint64_t End)
+{
+    thread_buffer* Buffer = GetThreadBuffer();
+    uint64_t Index = Buffer->WriteCount.load(std::memory_order_relaxed);
+
+    event& Event = Buffer->Events[Index % EVENT_CAPACITY];
+    Event.Name = Name;
+    Event.Start = Start;
+    Event.End = End;
+    Event.Detail[0] = '\0';
+    if (Detail)
+    {
+        // Keep the end of the string (file names)
+        size_t Length = strlen(Detail);
+        size_t Offset = Length >= sizeof(Event.Detail) ? Length - sizeof(Event.Detail) + 1 : 0;
+        memcpy(Event.Detail, Detail + Offset, Length - Offset + 1);
+    }
+
+    // Publish the event to WriteTrace()
+    Buffer->WriteCount.store(Index + 1, std::memory_order_release);
+}
+
+void CPUProfiler::SetThreadName(const char* Name)
+{
+    thread_buffer* Buffer = GetThreadBuffer();
+    std::lock_guard<std::mutex> Lock(ThreadsMutex);
+    Buffer->Name = Name;
+}
+
+bool CPUProfiler::WriteTrace(const char* Filename)
+{
+    FILE* File = fopen(Filename, "w");
+    if (File == nullptr)
+    {
+        fprintf(stderr, "Cannot write trace '%s'\n", Filename);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> Lock(ThreadsMutex);
+
+    int EventCount = 0;
+    fprintf(File, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (std::unique_ptr<thread_buffer>& Buffer : ThreadBuffers)
+    {
+        fprintf(File, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", Buffer->ThreadId);
+        WriteJSONString(File, Buffer->Name.c_str());
+        fprintf(File, "}},\n");
+
+        // Events of a thread that keeps recording during the dump may be overwritten, the dump happens between frames
+        uint64_t End = Buffer->WriteCount.load(std::memory_order_acquire);
+        uint64_t Begin = std::max(Buffer->FirstEvent.load(std::memory_order_relaxed), End > EVENT_CAPACITY ? End - EVENT_CAPACITY : 0);
+        for (uint64_t i = Begin; i < End; ++i)
+        {
+            const event& Event = Buffer->Events[i % EVENT_CAPACITY];
+            fprintf(File, "{\"name\":");
+            WriteJSONString(File, Event.Name);
+            // Timestamps are in microseconds
+            fprintf(File, ",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                Buffer->ThreadId, Event.Start / 1000.0, (Event.End - Event.Start) / 1000.0);
+            if (Event.Detail[0])
+            {
+                fprintf(File, ",\"args\":{\"detail\":");
+                WriteJSONString(File, Event.Detail);
+                fprintf(File, "}");
+            }
+            fprintf(File, "},\n");
+            EventCount++;
+        }
+    }
+    // Last event without trailing comma
+    fprintf(File, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"ibr\"}}\n]}\n");
+    fclose(File);
+
+    printf("CPU trace written to '%s' (%d events)\n", Filename, EventCount);
+    return true;
+}
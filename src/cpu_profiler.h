@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Define IBR_CPU_PROFILER to 0 to compile every PROFILE_* macro out
+#ifndef IBR_CPU_PROFILER
+#define IBR_CPU_PROFILER 1
+#endif
+
+// Instrumented CPU profiler
+// Scopes are written by their thread into its own ring buffer (no lock, no allocation once the thread is registered)
+// and dumped as trace events JSON (chrome://tracing, ui.perfetto.dev)
+// Recording is off by default: a disabled scope costs one relaxed atomic load
+namespace CPUProfiler
+{
+    extern std::atomic<bool> gRecording;
+
+    inline bool IsRecording() { return gRecording.load(std::memory_order_relaxed); }
+    // Starting a recording drops the events of the previous one
+    void StartRecording();
+    void StopRecording();
+
+    // Nanoseconds since the profiler start
+    uint64_t GetTimestamp();
+
+    // Name must outlive the dump (string literal), Detail is copied (truncated to its last characters)
+    void AddScope(const char* Name, const char* Detail, uint64_t Start, uint64_t End);
+
+    // Thread name in the trace viewer
+    void SetThreadName(const char* Name);
+
+    // Write the recorded events of every thread, returns false if the file cannot be opened
+    bool WriteTrace(const char* Filename);
+
+    class scope
+    {
+    public:
+        scope(const char* Name, const char* Detail = nullptr)
+        {
+            if (IsRecording())
+            {
+                this->Name = Name;
+                this->Detail = Detail;
+                Start = GetTimestamp();
+            }
+        }
+
+        ~scope()
+        {
+            if (Name)
+                AddScope(Name, Detail, Start, GetTimestamp());
+        }
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+    private:
+        const char* Name = nullptr;
+        const char* Detail = nullptr;
+        uint64_t Start = 0;
+    };
+}
+
+#if IBR_CPU_PROFILER
+#define PROFILE_CONCAT_(A, B) A##B
+#define PROFILE_CONCAT(A, B) PROFILE_CONCAT_(A, B)
+#define PROFILE_SCOPE(Name) CPUProfiler::scope PROFILE_CONCAT(ProfileScope, __LINE__)(Name)
+#define PROFILE_SCOPE_DETAIL(Name, Detail) CPUProfiler::scope PROFILE_CONCAT(ProfileScope, __LINE__)(Name, Detail)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#else
+#define PROFILE_SCOPE(Name)
+#define PROFILE_SCOPE_DETAIL(Name, Detail)
+#define PROFILE_FUNCTION()
+#endif
@@ -0,0 +1,194 @@
+#include <cmath>
+
+#include <xmmintrin.h>
+
+#include "maths.h"
+#include "culling.h"
+
+bool Culling::Enabled = true;
+
+Culling::frustum Culling::ExtractFrustum(const mat4& ViewProjection)
+{
+    // Columns to rows
+    __m128 Row0 = _mm_loadu_ps(ViewProjection.c[0].e);
+    __m128 Row1 = _mm_loadu_ps(ViewProjection.c[1].e);
+    __m128 Row2 = _mm_loadu_ps(ViewProjection.c[2].e);
+    __m128 Row3 = _mm_loadu_ps(ViewProjection.c[3].e);
+    _MM_TRANSPOSE4_PS(Row0, Row1, Row2, Row3);
+
+    __m128 Planes[8] =
+    {
+        _mm_add_ps(Row3, Row0), _mm_sub_ps(Row3, Row0), // Left, right
+        _mm_add_ps(Row3, Row1), _mm_sub_ps(Row3, Row1), // Bottom, top
+        _mm_add_ps(Row3, Row2), _mm_sub_ps(Row3, Row2), // Near, far
+    };
+
+    // Normalize by the length of the normal
+    for (int i = 0; i < 6; ++i)
+    {
+        __m128 Squared = _mm_mul_ps(Planes[i], Planes[i]);
+        alignas(16) float S[4];
+        _mm_store_ps(S, Squared);
+        float Length = std::sqrt(S[0] + S[1] + S[2]);
+        Planes[i] = _mm_div_ps(Planes[i], _mm_set1_ps(Length > 0.f ? Length : 1.f));
+    }
+
+    // Padding planes accept everything
+    Planes[6] = Planes[7] = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
+
+    // AoS to SoA
+    frustum Frustum;
+    for (int i = 0; i < 8; i += 4)
+    {
+        __m128 P0 = Planes[i + 0], P1 = Planes[i + 1], P2 = Planes[i + 2], P3 = Planes[i + 3];
+        _MM_TRANSPOSE4_PS(P0, P1, P2, P3);
+        _mm_store_ps(Frustum.X + i, P0);
+        _mm_store_ps(Frustum.Y + i, P1);
+        _mm_store_ps(Frustum.Z + i, P2);
+        _mm_store_ps(Frustum.W + i, P3);
+    }
+    return Frustum;
+}
+
+void Culling::bounds_soa::Clear()
+{
+    CenterX.clear(); CenterY.clear(); CenterZ.clear();
+    ExtentX.clear(); ExtentY.clear(); ExtentZ.clear();
+    Radius.clear();
+}
+
+void Culling::bounds_soa::Add(const Mesh::bounds& Bounds)
+{
+    v3 Extent = (Bounds.Max - Bounds.Min) * 0.5f;
+    CenterX.push_back(Bounds.Center.x);
+    CenterY.push_back(Bounds.Center.y);
+    CenterZ.push_back(Bounds.Center.z);
+    ExtentX.push_back(Extent.x);
+    ExtentY.push_back(Extent.y);
+    ExtentZ.push_back(Extent.z);
+    Radius.push_back(Bounds.Radius);
+}
+
+Mesh::bounds Culling::TransformBounds(const Mesh::bounds& Bounds, const mat4& Transform)
+{
+    v3 Center = (Bounds.Min + Bounds.Max) * 0.5f;
+    v3 Extent = (Bounds.Max - Bounds.Min) * 0.5f;
+
+    v4 NewCenter = Transform * v4{ Center.x, Center.y, Center.z, 1.f };
+    v3 NewExtent = {};
+    for (int Row = 0; Row < 3; ++Row)
+    {
+        NewExtent.e[Row] = std::fabs(Transform.c[0].e[Row]) * Extent.x
+                         + std::fabs(Transform.c[1].e[Row]) * Extent.y
+                         + std::fabs(Transform.c[2].e[Row]) * Extent.z;
+    }
+
+    Mesh::bounds Result;
+    Result.Center = { NewCenter.x, NewCenter.y, NewCenter.z };
+    Result.Min = Result.Center - NewExtent;
+    Result.Max = Result.Center + NewExtent;
+    Result.Radius = Vec3::Length(NewExtent);
+    return Result;
+}
+
+// Signed distances of 4 points to plane p of the frustum
+static inline __m128 PlaneDistances(const Culling::frustum& Frustum, int p, __m128 X, __m128 Y, __m128 Z)
+{
+    __m128 Distance = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(Frustum.X[p]), X), _mm_set1_ps(Frustum.W[p]));
+    Distance = _mm_add_ps(Distance, _mm_mul_ps(_mm_set1_ps(Frustum.Y[p]), Y));
+    return _mm_add_ps(Distance, _mm_mul_ps(_mm_set1_ps(Frustum.Z[p]), Z));
+}
+
+int Culling::CullBoxes(const frustum& Frustum, const bounds_soa& Bounds, uint8_t* Visible)
+{
+    int Count = Bounds.GetCount();
+    int VisibleCount = 0;
+    const __m128 SignMask = _mm_set1_ps(-0.f);
+
+    int i = 0;
+    for (; i + 4 <= Count; i += 4)
+    {
+        __m128 CX = _mm_loadu_ps(&Bounds.CenterX[i]);
+        __m128 CY = _mm_loadu_ps(&Bounds.CenterY[i]);
+        __m128 CZ = _mm_loadu_ps(&Bounds.CenterZ[i]);
+        __m128 EX = _mm_loadu_ps(&Bounds.ExtentX[i]);
+        __m128 EY = _mm_loadu_ps(&Bounds.ExtentY[i]);
+        __m128 EZ = _mm_loadu_ps(&Bounds.ExtentZ[i]);
+
+        __m128 Outside = _mm_setzero_ps();
+        for (int p = 0; p < 6; ++p)
+        {
+            // Box radius along the plane normal: |n| . extent
+            __m128 ProjectedRadius = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(_mm_andnot_ps(SignMask, _mm_set1_ps(Frustum.X[p])), EX),
+                _mm_mul_ps(_mm_andnot_ps(SignMask, _mm_set1_ps(Frustum.Y[p])), EY)),
+                _mm_mul_ps(_mm_andnot_ps(SignMask, _mm_set1_ps(Frustum.Z[p])), EZ));
+            __m128 Distance = _mm_add_ps(PlaneDistances(Frustum, p, CX, CY, CZ), ProjectedRadius);
+            Outside = _mm_or_ps(Outside, _mm_cmplt_ps(Distance, _mm_setzero_ps()));
+        }
+
+        int OutsideMask = _mm_movemask_ps(Outside);
+        for (int j = 0; j < 4; ++j)
+        {
+            Visible[i + j] = (OutsideMask & (1 << j)) ? 0 : 1;
+            VisibleCount += Visible[i + j];
+        }
+    }
+
+    // Remainder
+    for (; i < Count; ++i)
+    {
+        bool Outside = false;
+        for (int p = 0; p < 6 && !Outside; ++p)
+        {
+            float Distance = Frustum.X[p] * Bounds.CenterX[i] + Frustum.Y[p] * Bounds.CenterY[i] + Frustum.Z[p] * Bounds.CenterZ[i] + Frustum.W[p];
+            float ProjectedRadius = std::fabs(Frustum.X[p]) * Bounds.ExtentX[i] + std::fabs(Frustum.Y[p]) * Bounds.ExtentY[i] + std::fabs(Frustum.Z[p]) * Bounds.ExtentZ[i];
+            Outside = Distance + ProjectedRadius < 0.f;
+        }
+        Visible[i] = Outside ? 0 : 1;
+        VisibleCount += Visible[i];
+    }
+
+    return VisibleCount;
+}
+
+int Culling::CullSpheres(const frustum& Frustum, const bounds_soa& Bounds, uint8_t* Visible)
+{
+    int Count = Bounds.GetCount();
+    int VisibleCount = 0;
+
+    int i = 0;
+    for (; i + 4 <= Count; i += 4)
+    {
+        __m128 CX = _mm_loadu_ps(&Bounds.CenterX[i]);
+        __m128 CY = _mm_loadu_ps(&Bounds.CenterY[i]);
+        __m128 CZ = _mm_loadu_ps(&Bounds.CenterZ[i]);
+        __m128 R = _mm_loadu_ps(&Bounds.Radius[i]);
+
+        __m128 Outside = _mm_setzero_ps();
+        for (int p = 0; p < 6; ++p)
+            Outside = _mm_or_ps(Outside, _mm_cmplt_ps(_mm_add_ps(PlaneDistances(Frustum, p, CX, CY, CZ), R), _mm_setzero_ps()));
+
+        int OutsideMask = _mm_movemask_ps(Outside);
+        for (int j = 0; j < 4; ++j)
+        {
+            Visible[i + j] = (OutsideMask & (1 << j)) ? 0 : 1;
+            VisibleCount += Visible[i + j];
+        }
+    }
+
+    // Remainder
+    for (; i < Count; ++i)
+    {
+        bool Outside = false;
+        for (int p = 0; p < 6 && !Outside; ++p)
+        {
+            float Distance = Frustum.X[p] * Bounds.CenterX[i] + Frustum.Y[p] * Bounds.CenterY[i] + Frustum.Z[p] * Bounds.CenterZ[i] + Frustum.W[p];
+            Outside = Distance + Bounds.Radius[i] < 0.f;
+        }
+        Visible[i] = Outside ? 0 : 1;
+        VisibleCount += Visible[i];
+    }
+
+    return VisibleCount;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "types.h"
+#include "mesh.h"
+
+// View frustum culling of world-space bounds, 4 bounds per SSE instruction
+namespace Culling
+{
+    // Frustum culling in the demos (--no-frustum-culling, toggled in the render stats)
+    extern bool Enabled;
+
+    // Left, right, bottom, top, near and far planes, normalized, pointing inside, in SoA (2 padding planes)
+    struct frustum
+    {
+        alignas(16) float X[8];
+        alignas(16) float Y[8];
+        alignas(16) float Z[8];
+        alignas(16) float W[8];
+    };
+
+    // Gribb-Hartmann extraction from a projection * view (* model) matrix
+    frustum ExtractFrustum(const mat4& ViewProjection);
+
+    // Bounds of the culled objects in SoA (box center and half extents, sphere radius)
+    struct bounds_soa
+    {
+        std::vector<float> CenterX, CenterY, CenterZ;
+        std::vector<float> ExtentX, ExtentY, ExtentZ;
+        std::vector<float> Radius;
+
+        void Clear();
+        void Add(const Mesh::bounds& Bounds);
+        int GetCount() const { return (int)CenterX.size(); }
+    };
+
+    // Axis-aligned bounds of the transformed box (Arvo)
+    Mesh::bounds TransformBounds(const Mesh::bounds& Bounds, const mat4& Transform);
+
+    // Visible[i] = 1 when the bounds i intersect the frustum (conservative near the corners), returns the visible count
+    int CullBoxes(const frustum& Frustum, const bounds_soa& Bounds, uint8_t* Visible);
+    int CullSpheres(const frustum& Frustum, const bounds_soa& Bounds, uint8_t* Visible);
+}
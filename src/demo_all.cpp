@@ -6,6 +6,7 @@
 #include <filesystem>
 
 #include "color.h"
+#include "cpu_profiler.h"
 #include "stb_image.h"
 
 //#define PROJECT_DIR (std::filesystem::current_path().string() + "\\")
@@ -24,6 +25,8 @@ const std::string skyboxFaces[6] = {
 demo_all::demo_all(const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug)
     : GLDebug(GLDebug)
 {
+    PROFILE_FUNCTION();
+
     UberProgram.ID = GL::CreateProgramFromFiles("src/shaders/uber_shader.vert", "src/shaders/uber_shader.frag");
 
     // Gen meshes
@@ -4,6 +4,7 @@
 #include <imgui.h>
 
 #include "opengl_helpers.h"
+#include "cpu_profiler.h"
 #include "opengl_helpers_wireframe.h"
 
 #include "color.h"
@@ -12,7 +13,7 @@
 
 #include "demo_base.h"
 
-const int LIGHT_BLOCK_BINDING_POINT = 0;
+const int LIGHT_CLUSTERS_TEXTURE_UNIT = 2;
 
 static const char* gVertexShaderStr = R"GLSL(
 #version 330 core
@@ -55,32 +56,13 @@ uniform vec3 uViewPosition;
 uniform sampler2D uDiffuseTexture;
 uniform sampler2D uEmissiveTexture;
 
-// Uniform blocks
-layout(std140) uniform uLightBlock
-{
-	light uLight[LIGHT_COUNT];
-};
-
 // Shader outputs
 out vec4 oColor;
 
-light_shade_result get_lights_shading()
-{
-    light_shade_result lightResult = light_shade_result(vec3(0.0), vec3(0.0), vec3(0.0));
-	for (int i = 0; i < LIGHT_COUNT; ++i)
-    {
-        light_shade_result light = light_shade(uLight[i], gDefaultMaterial.shininess, uViewPosition, vPos, normalize(vNormal));
-        lightResult.ambient  += light.ambient;
-        lightResult.diffuse  += light.diffuse;
-        lightResult.specular += light.specular;
-    }
-    return lightResult;
-}
-
 void main()
 {
-    // Compute phong shading
-    light_shade_result lightResult = get_lights_shading();
+    // Compute phong shading (lights of the fragment cluster, view depth is the clip w)
+    light_shade_result lightResult = clustered_lights_shade(gDefaultMaterial.shininess, uViewPosition, vPos, normalize(vNormal), gl_FragCoord.xy, 1.0 / gl_FragCoord.w);
     
     vec3 diffuseColor  = gDefaultMaterial.diffuse * lightResult.diffuse * texture(uDiffuseTexture, vUV).rgb;
     vec3 ambientColor  = gDefaultMaterial.ambient * lightResult.ambient;
@@ -94,13 +76,13 @@ void main()
 demo_base::demo_base(GL::cache& GLCache, GL::debug& GLDebug)
     : GLDebug(GLDebug), TavernScene(GLCache)
 {
+    PROFILE_FUNCTION();
+
     // Create shader
     {
-        // Assemble fragment shader strings (defines + code)
-        char FragmentShaderConfig[] = "#define LIGHT_COUNT %d\n";
-        snprintf(FragmentShaderConfig, ARRAY_SIZE(FragmentShaderConfig), "#define LIGHT_COUNT %d\n", TavernScene.LightCount);
+        // Assemble fragment shader strings (light clusters + code)
         const char* FragmentShaderStrs[2] = {
-            FragmentShaderConfig,
+            GL::light_clusters::GetShaderStr(),
             gFragmentShaderStr,
         };
 
@@ -128,7 +110,6 @@ demo_base::demo_base(GL::cache& GLCache, GL::debug& GLDebug)
         glUseProgram(Program);
         glUniform1i(glGetUniformLocation(Program, "uDiffuseTexture"), 0);
         glUniform1i(glGetUniformLocation(Program, "uEmissiveTexture"), 1);
-        glUniformBlockBinding(Program, glGetUniformBlockIndex(Program, "uLightBlock"), LIGHT_BLOCK_BINDING_POINT);
     }
 }
 
@@ -154,6 +135,8 @@ void demo_base::Update(const platform_io& IO)
     mat4 ViewMatrix = CameraGetInverseMatrix(Camera);
     mat4 ModelMatrix = Mat4::Translate({ 0.f, 0.f, 0.f });
 
+    TavernScene.UpdateLightClusters(IO, ViewMatrix, Math::ToRadians(60.f), AspectRatio, 0.1f, 100.f);
+
     // Render tavern
     this->RenderTavern(ProjectionMatrix, ViewMatrix, ModelMatrix);
 
@@ -182,6 +165,8 @@ void demo_base::DisplayDebugUI()
             ImGui::TreePop();
         }
         TavernScene.InspectLights();
+        TavernScene.InspectLightClusters();
+        TavernScene.InspectOcclusionCulling();
 
         ImGui::TreePop();
     }
@@ -202,15 +187,15 @@ void demo_base::RenderTavern(const mat4& ProjectionMatrix, const mat4& ViewMatri
     glUniformMatrix4fv(glGetUniformLocation(Program, "uModelNormalMatrix"), 1, GL_FALSE, NormalMatrix.e);
     glUniform3fv(glGetUniformLocation(Program, "uViewPosition"), 1, Camera.Position.e);
     
-    // Bind uniform buffer and textures
-    glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING_POINT, TavernScene.LightsUniformBuffer);
+    // Bind light clusters and textures
+    TavernScene.LightClusters.Bind(Program, LIGHT_CLUSTERS_TEXTURE_UNIT);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, TavernScene.DiffuseTexture);
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, TavernScene.EmissiveTexture);
     glActiveTexture(GL_TEXTURE0); // Reset active texture just in case
     
-    // Draw mesh
+    // Draw the visible submeshes
     glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLES, 0, TavernScene.MeshVertexCount);
+    TavernScene.DrawSubmeshes(ProjectionMatrix * ViewMatrix * ModelMatrix);
 }
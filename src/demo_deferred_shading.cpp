@@ -4,6 +4,7 @@
 #include <imgui.h>
 
 #include "opengl_helpers.h"
+#include "cpu_profiler.h"
 #include "opengl_helpers_wireframe.h"
 
 #include "color.h"
@@ -12,7 +13,9 @@
 
 #include "demo_deferred_shading.h"
 
-const int LIGHT_BLOCK_BINDING_POINT = 0;
+const int LIGHT_CLUSTERS_TEXTURE_UNIT = 4;
+
+bool demo_deferred_shading::DefaultLightVolumes = false;
 
 static const char* gGeoVertexShaderStr = R"GLSL(
 #version 330 core
@@ -30,14 +33,12 @@ uniform mat4 uModelNormalMatrix;
 
 // Varyings
 out vec2 vUV;
-out vec3 vPos;    // Vertex position in view-space
-out vec3 vNormal; // Vertex normal in view-space
+out vec3 vNormal; // Vertex normal in world-space
 
 void main()
 {
     vUV = aUV;
     vec4 pos4 = (uModel * vec4(aPosition, 1.0));
-    vPos = pos4.xyz;
 
     vNormal = (uModelNormalMatrix * vec4(aNormal, 0.0)).xyz;
     gl_Position = uProjection * uView * pos4;
@@ -45,30 +46,37 @@ void main()
 
 static const char* gGeoFragmentShaderStr = R"GLSL(
 // Varyings
-in vec3 vPos;
 in vec2 vUV;
 in vec3 vNormal;
 
 uniform sampler2D uDiffuseTexture;
 uniform sampler2D uEmissiveTexture;
 
-// Shader outputs
-layout (location = 0) out vec3 oPosition;
-layout (location = 1) out vec3 oNormal;
-layout (location = 2) out vec4 oAlbedo;
-layout (location = 3) out vec4 oEmissive;
+// Shader outputs (position is rebuilt from the depth buffer)
+layout (location = 0) out vec2 oNormal;   // RG16, octahedral
+layout (location = 1) out vec4 oAlbedo;   // RGBA8 sRGB
+layout (location = 2) out vec3 oEmissive; // R11G11B10F
 
-void main()
+vec2 octWrap(vec2 v)
 {
-    oPosition = vPos;
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
 
-    oNormal = normalize(vNormal);
+// Unit vector to [0, 1]^2: projection on the octahedron, lower half folded over the upper one
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    n.xy = n.z >= 0.0 ? n.xy : octWrap(n.xy);
+    return n.xy * 0.5 + 0.5;
+}
+
+void main()
+{
+    oNormal = encodeNormal(normalize(vNormal));
 
-    // Apply light color
     oAlbedo = texture(uDiffuseTexture, vUV);
 
-    // Apply light color
-    oEmissive = texture(uEmissiveTexture, vUV);
+    oEmissive = texture(uEmissiveTexture, vUV).rgb;
 })GLSL";
 
 static const char* gLightVertexShaderStr = R"GLSL(
@@ -87,50 +95,67 @@ void main()
     gl_Position = vec4(aPosition, 1.0);
 })GLSL";
 
-static const char* gLightFragmentShaderStr = R"GLSL(
-// Varyings
-in vec2 vUV;
-in vec3 vPos;
-
-uniform sampler2D uPosition;
+// G-buffer decoding shared by the lighting shaders
+static const char* gGBufferShaderStr = R"GLSL(
+uniform sampler2D uDepth;
 uniform sampler2D uNormal;
 uniform sampler2D uAlbedo;
 uniform sampler2D uEmissive;
 
 // Uniforms
 uniform vec3 uViewPosition;
+uniform mat4 uInverseProjection;
+uniform mat4 uInverseView;
 
-// Uniform blocks
-layout(std140) uniform uLightBlock
+vec3 decodeNormal(vec2 f)
 {
-	light uLight[LIGHT_COUNT];
-};
+    f = f * 2.0 - 1.0;
+    vec3 n = vec3(f.xy, 1.0 - abs(f.x) - abs(f.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+// View-space position from the depth, then world-space like the lights
+vec3 getFragPosition(float depth, out float viewDepth)
+{
+    vec4 clipPos = vec4(vec3(gl_FragCoord.xy / vec2(textureSize(uDepth, 0)), depth) * 2.0 - 1.0, 1.0);
+    vec4 viewPos = uInverseProjection * clipPos;
+    viewPos.xyz /= viewPos.w;
+    viewDepth = -viewPos.z;
+    return (uInverseView * vec4(viewPos.xyz, 1.0)).xyz;
+}
+)GLSL";
+
+static const char* gLightFragmentShaderStr = R"GLSL(
+// Varyings
+in vec2 vUV;
 
 // Shader outputs
 out vec4 oColor;
 
-light_shade_result get_lights_shading(in vec3 fragPos, in vec3 normal)
+void main()
 {
-    light_shade_result lightResult = light_shade_result(vec3(0.0), vec3(0.0), vec3(0.0));
-	for (int i = 0; i < LIGHT_COUNT; ++i)
+    // G-buffer and screen have the same size
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(uDepth, texel, 0).r;
+
+    // Background
+    if (depth == 1.0)
     {
-        light_shade_result currLight = light_shade(uLight[i], gDefaultMaterial.shininess, uViewPosition, fragPos, normal);
-        lightResult.ambient  += currLight.ambient;
-        lightResult.diffuse  += currLight.diffuse;
-        lightResult.specular += currLight.specular;
+        oColor = vec4(gDefaultMaterial.emission, 1.0);
+        return;
     }
-    return lightResult;
-}
 
-void main()
-{
-    vec3 fragPos = texture(uPosition, vUV).rgb;
-    vec3 normal = texture(uNormal, vUV).rgb;
-    vec3 albedo = texture(uAlbedo, vUV).rgb;
-    vec3 emissive = texture(uEmissive, vUV).rgb;
+    float viewDepth;
+    vec3 fragPos = getFragPosition(depth, viewDepth);
 
-    // Compute phong shading
-    light_shade_result lightResult = get_lights_shading(fragPos, normal);
+    vec3 normal = decodeNormal(texelFetch(uNormal, texel, 0).rg);
+    vec3 albedo = texelFetch(uAlbedo, texel, 0).rgb;
+    vec3 emissive = texelFetch(uEmissive, texel, 0).rgb;
+
+    // Compute phong shading (lights of the pixel cluster)
+    light_shade_result lightResult = clustered_lights_shade(gDefaultMaterial.shininess, uViewPosition, fragPos, normal, gl_FragCoord.xy, viewDepth);
     
     vec3 diffuseColor  = gDefaultMaterial.diffuse * lightResult.diffuse * albedo;
     vec3 ambientColor  = gDefaultMaterial.ambient * lightResult.ambient * albedo;
@@ -141,29 +166,86 @@ void main()
     oColor = vec4((ambientColor + diffuseColor + specularColor + emissiveColor), 1.0);
 })GLSL";
 
+// Light volume: proxy sphere around a local light, in view space
+static const char* gVolumeVertexShaderStr = R"GLSL(
+#version 330 core
+
+// Attributes
+layout(location = 0) in vec3 aPosition; // Unit sphere
+
+// Uniforms
+uniform mat4 uProjection;
+uniform vec4 uLightSphere; // View-space center (z = depth), radius
+
+void main()
+{
+    vec3 viewPos = vec3(uLightSphere.xy, -uLightSphere.z) + aPosition * uLightSphere.w;
+    gl_Position = uProjection * vec4(viewPos, 1.0);
+})GLSL";
+
+// Stencil marking only
+static const char* gVolumeStencilFragmentShaderStr = R"GLSL(
+#version 330 core
+
+void main()
+{
+})GLSL";
+
+static const char* gVolumeFragmentShaderStr = R"GLSL(
+// Uniforms
+uniform int uLightIndex; // In the light clusters texture buffer
+
+// Shader outputs (added to the global lights and emissive)
+out vec4 oColor;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float viewDepth;
+    vec3 fragPos = getFragPosition(texelFetch(uDepth, texel, 0).r, viewDepth);
+
+    vec3 normal = decodeNormal(texelFetch(uNormal, texel, 0).rg);
+    vec3 albedo = texelFetch(uAlbedo, texel, 0).rgb;
+
+    light_shade_result lightResult = light_shade(clustered_light(uLightIndex), gDefaultMaterial.shininess, uViewPosition, fragPos, normal);
+
+    vec3 diffuseColor  = gDefaultMaterial.diffuse * lightResult.diffuse * albedo;
+    vec3 ambientColor  = gDefaultMaterial.ambient * lightResult.ambient * albedo;
+    vec3 specularColor = gDefaultMaterial.specular * lightResult.specular;
+
+    oColor = vec4(ambientColor + diffuseColor + specularColor, 1.0);
+})GLSL";
+
 demo_deferred_shading::demo_deferred_shading(const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug)
-    : GLDebug(GLDebug), TavernScene(GLCache)
+    : GLDebug(GLDebug), FrameGraph(GLDebug.RenderTargets), TavernScene(GLCache)
 {
+    PROFILE_FUNCTION();
+
+    // Frame graph passes show up in the GPU profiler
+    FrameGraph.SetPassHooks(
+        [this](const char* PassName) { this->GLDebug.Profiler.Push(PassName); },
+        [this](const char*) { this->GLDebug.Profiler.Pop(); });
+
     // Create shader
     {
-        // Assemble fragment shader strings (defines + code)
-        char FragmentShaderConfig[] = "#define LIGHT_COUNT %d\n";
-        snprintf(FragmentShaderConfig, ARRAY_SIZE(FragmentShaderConfig), "#define LIGHT_COUNT %d\n", TavernScene.LightCount);
-        const char* GeoFragmentShaderStrs[2] = {
-            FragmentShaderConfig,
-            gGeoFragmentShaderStr,
-        };
-
-        // Assemble fragment shader strings (defines + code)
-        snprintf(FragmentShaderConfig, ARRAY_SIZE(FragmentShaderConfig), "#define LIGHT_COUNT %d\n", TavernScene.LightCount);
-        const char* LightFragmentShaderStrs[2] = {
-            FragmentShaderConfig,
+        // Assemble fragment shader strings (light clusters + G-buffer decoding + code)
+        const char* LightFragmentShaderStrs[3] = {
+            GL::light_clusters::GetShaderStr(),
+            gGBufferShaderStr,
             gLightFragmentShaderStr,
         };
+        const char* VolumeFragmentShaderStrs[3] = {
+            GL::light_clusters::GetShaderStr(),
+            gGBufferShaderStr,
+            gVolumeFragmentShaderStr,
+        };
+
+        geometryProgram = GL::CreateProgramEx(1, &gGeoVertexShaderStr, 1, &gGeoFragmentShaderStr, true);
 
-        geometryProgram = GL::CreateProgramEx(1, &gGeoVertexShaderStr, 2, GeoFragmentShaderStrs, true);
+        lightingProgram = GL::CreateProgramEx(1, &gLightVertexShaderStr, 3, LightFragmentShaderStrs, true);
 
-        lightingProgram = GL::CreateProgramEx(1, &gLightVertexShaderStr, 2, LightFragmentShaderStrs, true);
+        volumeStencilProgram = GL::CreateProgram(gVolumeVertexShaderStr, gVolumeStencilFragmentShaderStr);
+        volumeProgram = GL::CreateProgramEx(1, &gVolumeVertexShaderStr, 3, VolumeFragmentShaderStrs, true);
     }
     
     // Create a vertex array and bind attribs onto the vertex buffer
@@ -188,67 +270,51 @@ demo_deferred_shading::demo_deferred_shading(const platform_io& IO, GL::cache& G
         glUniform1i(glGetUniformLocation(geometryProgram, "uDiffuseTexture"), 0);
         glUniform1i(glGetUniformLocation(geometryProgram, "uEmissiveTexture"), 1);
 
-        glUseProgram(lightingProgram);
-        glUniformBlockBinding(lightingProgram, glGetUniformBlockIndex(lightingProgram, "uLightBlock"), LIGHT_BLOCK_BINDING_POINT);
-        glUniform1i(glGetUniformLocation(lightingProgram, "uPosition"), 0);
-        glUniform1i(glGetUniformLocation(lightingProgram, "uNormal"), 1);
-        glUniform1i(glGetUniformLocation(lightingProgram, "uAlbedo"), 2);
-        glUniform1i(glGetUniformLocation(lightingProgram, "uEmissive"), 3);
+        for (GLuint Program : { lightingProgram, volumeProgram })
+        {
+            glUseProgram(Program);
+            glUniform1i(glGetUniformLocation(Program, "uDepth"), 0);
+            glUniform1i(glGetUniformLocation(Program, "uNormal"), 1);
+            glUniform1i(glGetUniformLocation(Program, "uAlbedo"), 2);
+            glUniform1i(glGetUniformLocation(Program, "uEmissive"), 3);
+        }
+
+        // Set for every light
+        volumeStencilSphereLocation = glGetUniformLocation(volumeStencilProgram, "uLightSphere");
+        volumeSphereLocation = glGetUniformLocation(volumeProgram, "uLightSphere");
+        volumeLightIndexLocation = glGetUniformLocation(volumeProgram, "uLightIndex");
     }
 
-    // Generate FBO
+    // Light volume proxy: unit sphere (positions only) slightly enlarged so that its flat faces enclose the sphere
     {
-        glGenFramebuffers(1, &geometryBuffer);
-        glBindFramebuffer(GL_FRAMEBUFFER, geometryBuffer);
+        const int Lon = 12;
+        const int Lat = 8;
+        std::vector<v3> Vertices(Lon * Lat * 6);
 
-        // Generate textures
-        {
-            // - position color buffer
-            glGenTextures(1, &positionTexture);
-            glBindTexture(GL_TEXTURE_2D, positionTexture);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, IO.ScreenWidth, IO.ScreenHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, positionTexture, 0);
-
-            // - normal color buffer
-            glGenTextures(1, &normalTexture);
-            glBindTexture(GL_TEXTURE_2D, normalTexture);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, IO.ScreenWidth, IO.ScreenHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
-
-            // - color + specular color buffer
-            glGenTextures(1, &albedoTexture);
-            glBindTexture(GL_TEXTURE_2D, albedoTexture);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, IO.ScreenWidth, IO.ScreenHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, albedoTexture, 0);
-
-            // - color + specular color buffer
-            glGenTextures(1, &emissiveTexture);
-            glBindTexture(GL_TEXTURE_2D, emissiveTexture);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, IO.ScreenWidth, IO.ScreenHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, emissiveTexture, 0);
-        }
-
-        // - tell OpenGL which color attachments we'll use (of this framebuffer) for rendering 
-        GLuint attachments[4] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
-        glDrawBuffers(4, attachments);
+        vertex_descriptor Descriptor = {};
+        Descriptor.Stride = sizeof(v3);
+        Descriptor.PositionOffset = 0;
+        Mesh::BuildSphere(Vertices.data(), Vertices.data() + Vertices.size(), Descriptor, Lon, Lat);
+        float Scale = 2.f / (Math::Cos(Math::Pi() / Lon) * Math::Cos(Math::Pi() / (2.f * Lat)));
+        Mesh::Transform(Vertices.data(), Vertices.data() + Vertices.size(), Descriptor, Mat4::Scale({ Scale, Scale, Scale }));
+        sphere.VertexCount = (GLuint)Vertices.size();
+
+        glGenBuffers(1, &sphere.VertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, sphere.VertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, Vertices.size() * sizeof(v3), Vertices.data(), GL_STATIC_DRAW);
+
+        glGenVertexArrays(1, &sphere.VAO);
+        glBindVertexArray(sphere.VAO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(v3), (void*)0);
 
-        // Generate RBO
-        {
-            glGenRenderbuffers(1, &rboDepth);
-            glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, IO.ScreenWidth, IO.ScreenHeight);
-            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
     }
 
+    // Framebuffer reading the G-buffer depth and the lit image for blits
+    glGenFramebuffers(1, &blitFramebuffer);
+
     // Generate Quad VAO
     {
         // Create a descriptor based on the `struct vertex` format
@@ -286,71 +352,218 @@ demo_deferred_shading::~demo_deferred_shading()
     glDeleteVertexArrays(1, &VAO);
     glDeleteProgram(geometryProgram);
     glDeleteProgram(lightingProgram);
-
-    glDeleteFramebuffers(1, &geometryBuffer);
-    glDeleteRenderbuffers(1, &rboDepth);
-
-    glDeleteTextures(1, &positionTexture);
-    glDeleteTextures(1, &normalTexture);
-    glDeleteTextures(1, &albedoTexture);
-    glDeleteTextures(1, &emissiveTexture);
+    glDeleteProgram(volumeStencilProgram);
+    glDeleteProgram(volumeProgram);
+    glDeleteVertexArrays(1, &sphere.VAO);
+    glDeleteBuffers(1, &sphere.VertexBuffer);
+    glDeleteFramebuffers(1, &blitFramebuffer);
 }
 
 void demo_deferred_shading::Update(const platform_io& IO)
 {
     const float AspectRatio = (float)IO.WindowWidth / (float)IO.WindowHeight;
-    glViewport(0, 0, IO.WindowWidth, IO.WindowHeight);
 
     Camera = CameraUpdateFreefly(Camera, IO.CameraInputs);
 
-    glUseProgram(geometryProgram);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, geometryBuffer);
-
-    // Clear screen
-    glClearColor(0.f, 0.f, 0.f, 1.f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, positionTexture);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normalTexture);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, albedoTexture);
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, emissiveTexture);
-
     mat4 ProjectionMatrix = Mat4::Perspective(Math::ToRadians(60.f), AspectRatio, 0.1f, 100.f);
     mat4 ViewMatrix = CameraGetInverseMatrix(Camera);
     mat4 ModelMatrix = Mat4::Translate({ 0.f, 0.f, 0.f });
+    mat4 InverseProjectionMatrix = Mat4::Inverse(ProjectionMatrix);
+    mat4 InverseViewMatrix = CameraGetMatrix(Camera);
 
-    // Render tavern
-    this->RenderTavern(ProjectionMatrix, ViewMatrix, ModelMatrix);
-    
-    glUseProgram(lightingProgram);
+    TavernScene.UpdateLightClusters(IO, ViewMatrix, Math::ToRadians(60.f), AspectRatio, 0.1f, 100.f, LightVolumes);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    FrameGraph.Reset();
 
-    glUniform3fv(glGetUniformLocation(geometryProgram, "uViewPosition"), 1, Camera.Position.e);
+    // G-buffer follows the window size, 16 bytes per pixel: depth (position is rebuilt from it, stencil for the light volumes),
+    // octahedral normal, albedo (8 bit sRGB keeps the dark tones) and emissive (no alpha, LDR)
+    GL::frame_resource Depth = FrameGraph.CreateTexture("Depth", { GL_DEPTH24_STENCIL8, IO.WindowWidth, IO.WindowHeight });
+    GL::frame_resource Normal = FrameGraph.CreateTexture("Normal", { GL_RG16, IO.WindowWidth, IO.WindowHeight });
+    GL::frame_resource Albedo = FrameGraph.CreateTexture("Albedo", { GL_SRGB8_ALPHA8, IO.WindowWidth, IO.WindowHeight });
+    GL::frame_resource Emissive = FrameGraph.CreateTexture("Emissive", { GL_R11F_G11F_B10F, IO.WindowWidth, IO.WindowHeight });
+    GL::frame_resource Lights = FrameGraph.ImportBuffer("Lights", TavernScene.LightClusters.GetLightsBuffer());
+    GL::frame_resource Backbuffer = FrameGraph.ImportBackbuffer(IO.WindowWidth, IO.WindowHeight);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, positionTexture);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normalTexture);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, albedoTexture);
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, emissiveTexture);
-    glActiveTexture(GL_TEXTURE0);
+    FrameGraph.AddPass("Geometry",
+        [&](GL::frame_graph::pass_builder& Builder)
+        {
+            // The lighting pass skips background pixels: only depth needs a clear
+            Normal = Builder.WriteColor(Normal, GL::frame_load_op::DONT_CARE);
+            Albedo = Builder.WriteColor(Albedo, GL::frame_load_op::DONT_CARE);
+            Emissive = Builder.WriteColor(Emissive, GL::frame_load_op::DONT_CARE);
+            Depth = Builder.WriteDepth(Depth, GL::frame_load_op::CLEAR);
+        },
+        [=](const GL::frame_graph::pass_resources&)
+        {
+            glUseProgram(geometryProgram);
+
+            // Linear albedo encoded on write (sRGB attachments only)
+            glEnable(GL_FRAMEBUFFER_SRGB);
 
-    glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING_POINT, TavernScene.LightsUniformBuffer);
+            // Render tavern
+            this->RenderTavern(ProjectionMatrix, ViewMatrix, ModelMatrix);
 
-    glBindVertexArray(quad.VAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
+            glDisable(GL_FRAMEBUFFER_SRGB);
+        });
+
+    // G-buffer textures and per frame uniforms of the lighting programs
+    auto BindGBuffer = [=](GLuint Program, const GL::frame_graph::pass_resources& Resources)
+    {
+        glUseProgram(Program);
+
+        glUniform3fv(glGetUniformLocation(Program, "uViewPosition"), 1, Camera.Position.e);
+        glUniformMatrix4fv(glGetUniformLocation(Program, "uInverseProjection"), 1, GL_FALSE, InverseProjectionMatrix.e);
+        glUniformMatrix4fv(glGetUniformLocation(Program, "uInverseView"), 1, GL_FALSE, InverseViewMatrix.e);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, Resources.Get(Depth));
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, Resources.Get(Normal));
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, Resources.Get(Albedo));
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, Resources.Get(Emissive));
+        glActiveTexture(GL_TEXTURE0);
+
+        TavernScene.LightClusters.Bind(Program, LIGHT_CLUSTERS_TEXTURE_UNIT);
+    };
+
+    if (!LightVolumes)
+    {
+        FrameGraph.AddPass("Lighting",
+            [&](GL::frame_graph::pass_builder& Builder)
+            {
+                Builder.Read(Depth);
+                Builder.Read(Normal);
+                Builder.Read(Albedo);
+                Builder.Read(Emissive);
+                Builder.Read(Lights);
+                Builder.WriteBackbuffer(Backbuffer, GL::frame_load_op::CLEAR);
+            },
+            [=](const GL::frame_graph::pass_resources& Resources)
+            {
+                BindGBuffer(lightingProgram, Resources);
+
+                glBindVertexArray(quad.VAO);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                glBindVertexArray(0);
+
+                glUseProgram(0);
+            });
+    }
+    else
+    {
+        // The G-buffer depth cannot be sampled while attached: the volumes test against a copy (stencil for the volume marking)
+        GL::frame_resource LightDepth = FrameGraph.CreateRenderbuffer("Light depth", { GL_DEPTH24_STENCIL8, IO.WindowWidth, IO.WindowHeight });
+        GL::frame_resource Lit = FrameGraph.CreateTexture("Lit", { GL_RGBA16F, IO.WindowWidth, IO.WindowHeight });
+
+        FrameGraph.AddPass("Lighting",
+            [&](GL::frame_graph::pass_builder& Builder)
+            {
+                Builder.Read(Depth);
+                Builder.Read(Normal);
+                Builder.Read(Albedo);
+                Builder.Read(Emissive);
+                Builder.Read(Lights);
+                // Fullscreen pass writes every pixel, depth and stencil come from the G-buffer
+                Lit = Builder.WriteColor(Lit, GL::frame_load_op::DONT_CARE);
+                LightDepth = Builder.WriteDepth(LightDepth, GL::frame_load_op::DONT_CARE);
+            },
+            [=](const GL::frame_graph::pass_resources& Resources)
+            {
+                // Copy depth, stencil is 0 (cleared with the G-buffer depth)
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, blitFramebuffer);
+                glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, Resources.Get(Depth), 0);
+                glBlitFramebuffer(0, 0, IO.WindowWidth, IO.WindowHeight, 0, 0, IO.WindowWidth, IO.WindowHeight,
+                    GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+                glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+                // Global lights and emissive (the clusters are empty)
+                BindGBuffer(lightingProgram, Resources);
+                glDisable(GL_DEPTH_TEST);
+                glBindVertexArray(quad.VAO);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+
+                const std::vector<GL::light_clusters::local_light>& LocalLights = TavernScene.LightClusters.GetLocalLights();
+                if (!LocalLights.empty())
+                {
+                    BindGBuffer(volumeProgram, Resources);
+                    glUniformMatrix4fv(glGetUniformLocation(volumeProgram, "uProjection"), 1, GL_FALSE, ProjectionMatrix.e);
+                    glUseProgram(volumeStencilProgram);
+                    glUniformMatrix4fv(glGetUniformLocation(volumeStencilProgram, "uProjection"), 1, GL_FALSE, ProjectionMatrix.e);
+
+                    // Restored after the volumes: the geometry pass of the next frame draws with the caller's culling
+                    GLboolean CullFace = glIsEnabled(GL_CULL_FACE);
+
+                    glBindVertexArray(sphere.VAO);
+                    glEnable(GL_STENCIL_TEST);
+                    // Volumes crossing the far plane are still closed
+                    glEnable(GL_DEPTH_CLAMP);
+                    glDepthMask(GL_FALSE);
+                    glBlendFunc(GL_ONE, GL_ONE);
+
+                    for (const GL::light_clusters::local_light& Light : LocalLights)
+                    {
+                        v4 Sphere = { Light.Center.x, Light.Center.y, Light.Center.z, Light.Radius };
+
+                        // Stencil: pixels whose surface is inside the volume (z-fail, works with the camera inside the volume)
+                        glUseProgram(volumeStencilProgram);
+                        glUniform4fv(volumeStencilSphereLocation, 1, Sphere.e);
+                        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                        glEnable(GL_DEPTH_TEST);
+                        glDisable(GL_CULL_FACE);
+                        glStencilFunc(GL_ALWAYS, 0, 0xFF);
+                        glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+                        glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+                        glDrawArrays(GL_TRIANGLES, 0, sphere.VertexCount);
+
+                        // Shading: back faces once per marked pixel, the stencil is reset for the next light
+                        glUseProgram(volumeProgram);
+                        glUniform4fv(volumeSphereLocation, 1, Sphere.e);
+                        glUniform1i(volumeLightIndexLocation, Light.Index);
+                        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+                        glDisable(GL_DEPTH_TEST);
+                        glEnable(GL_CULL_FACE);
+                        glCullFace(GL_FRONT);
+                        glEnable(GL_BLEND);
+                        glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+                        glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
+                        glDrawArrays(GL_TRIANGLES, 0, sphere.VertexCount);
+                        glDisable(GL_BLEND);
+                    }
+
+                    glCullFace(GL_BACK);
+                    if (!CullFace)
+                        glDisable(GL_CULL_FACE);
+                    glDepthMask(GL_TRUE);
+                    glDisable(GL_DEPTH_CLAMP);
+                    glDisable(GL_STENCIL_TEST);
+                    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                }
+
+                glEnable(GL_DEPTH_TEST);
+                glBindVertexArray(0);
+                glUseProgram(0);
+            });
+
+        FrameGraph.AddPass("Resolve",
+            [&](GL::frame_graph::pass_builder& Builder)
+            {
+                Builder.Read(Lit);
+                Builder.WriteBackbuffer(Backbuffer, GL::frame_load_op::DONT_CARE);
+            },
+            [=](const GL::frame_graph::pass_resources& Resources)
+            {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, blitFramebuffer);
+                glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, Resources.Get(Lit), 0);
+                glBlitFramebuffer(0, 0, IO.WindowWidth, IO.WindowHeight, 0, 0, IO.WindowWidth, IO.WindowHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+                glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+            });
+    }
 
-    glUseProgram(0);
+    FrameGraph.Execute();
 
     // Display debug UI
     this->DisplayDebugUI();
@@ -369,6 +582,10 @@ void demo_deferred_shading::DisplayDebugUI()
             ImGui::TreePop();
         }
         TavernScene.InspectLights();
+        TavernScene.InspectLightClusters();
+        TavernScene.InspectOcclusionCulling();
+        ImGui::Checkbox("Light volumes (stencil)", &LightVolumes);
+        FrameGraph.InspectPasses();
 
         ImGui::TreePop();
     }
@@ -392,7 +609,7 @@ void demo_deferred_shading::RenderTavern(const mat4& ProjectionMatrix, const mat
     glBindTexture(GL_TEXTURE_2D, TavernScene.EmissiveTexture);
     glActiveTexture(GL_TEXTURE0); // Reset active texture just in case
     
-    // Draw mesh
+    // Draw the visible submeshes
     glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLES, 0, TavernScene.MeshVertexCount);
+    TavernScene.DrawSubmeshes(ProjectionMatrix * ViewMatrix * ModelMatrix);
 }
@@ -9,6 +9,7 @@
 #include "camera.h"
 
 #include "tavern_scene.h"
+#include "opengl_helpers_frame_graph.h"
 
 class demo_deferred_shading : public demo
 {
@@ -22,6 +23,16 @@ class demo_deferred_shading : public demo
 
     QuadMesh quad;
 
+    struct SphereMesh
+    {
+        GLuint VAO = 0;
+        GLuint VertexBuffer = 0;
+        GLuint VertexCount = 0;
+    };
+
+    // Light volume proxy
+    SphereMesh sphere;
+
 public:
     demo_deferred_shading(const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug);
     virtual ~demo_deferred_shading();
@@ -30,16 +41,12 @@ public:
     void RenderTavern(const mat4& ProjectionMatrix, const mat4& ViewMatrix, const mat4& ModelMatrix);
     void DisplayDebugUI();
 
+    // Initial value of LightVolumes (--light-volumes)
+    static bool DefaultLightVolumes;
+
 private:
     GL::debug& GLDebug;
-
-    GLuint geometryBuffer;
-    GLuint rboDepth;
-
-    GLuint positionTexture;
-    GLuint normalTexture;
-    GLuint albedoTexture;
-    GLuint emissiveTexture;
+    GL::frame_graph FrameGraph;
 
     // 3d camera
     camera Camera = {};
@@ -47,7 +54,17 @@ private:
     // GL objects needed by this demo
     GLuint geometryProgram = 0;
     GLuint lightingProgram = 0;
+    GLuint volumeStencilProgram = 0;
+    GLuint volumeProgram = 0;
+    GLuint blitFramebuffer = 0;
     GLuint VAO = 0;
 
+    GLint volumeStencilSphereLocation = -1;
+    GLint volumeSphereLocation = -1;
+    GLint volumeLightIndexLocation = -1;
+
+    // Local lights drawn one by one as stencil-tested spheres instead of the clustered fullscreen pass
+    bool LightVolumes = DefaultLightVolumes;
+
     tavern_scene TavernScene;
 };
@@ -4,6 +4,7 @@
 #include <imgui.h>
 
 #include "opengl_helpers.h"
+#include "cpu_profiler.h"
 #include "maths.h"
 #include "mesh.h"
 #include "color.h"
@@ -236,37 +237,7 @@ void main()
 demo_fbo::demo_fbo(const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug)
     : GLDebug(GLDebug), DemoBase(GLCache, GLDebug)
 {
-    // Geneate the framebuffer and bind it
-    glGenFramebuffers(1, &Framebuffer.FBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer.FBO);
-    
-    // Generate the color attachement texture
-    {
-        glGenTextures(1, &Framebuffer.ColorTexture);
-        glBindTexture(GL_TEXTURE_2D, Framebuffer.ColorTexture);
-
-        {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, IO.WindowWidth, IO.WindowHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, Framebuffer.ColorTexture, 0);
-        }
-    }
-
-    // Geneate the renderbuffer and bind it to the framebuffer
-    {
-        glGenRenderbuffers(1, &Framebuffer.DepthStencilRenderbuffer);
-        glBindRenderbuffer(GL_RENDERBUFFER, Framebuffer.DepthStencilRenderbuffer);
-
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, IO.WindowWidth, IO.WindowHeight);
-
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, Framebuffer.DepthStencilRenderbuffer);
-        glBindRenderbuffer(GL_RENDERBUFFER, 0);
-    }
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    PROFILE_FUNCTION();
 
     // Gen quad and its program
     {
@@ -305,13 +276,6 @@ demo_fbo::demo_fbo(const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug
 
 demo_fbo::~demo_fbo()
 {
-    // Delete First pass buffers
-    {
-        glDeleteFramebuffers(1, &Framebuffer.FBO);
-        glDeleteTextures(1, &Framebuffer.ColorTexture);
-        glDeleteRenderbuffers(1, &Framebuffer.DepthStencilRenderbuffer);
-    }
-
     // Delete second pass buffers
     {
         // Cleanup GL
@@ -354,28 +318,23 @@ void demo_fbo::DisplayDebugUI()
 
 void demo_fbo::Update(const platform_io& IO)
 {
-    if (IO.WindowSizeChanged)
-    {
-        glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer.FBO);
-
-        glBindRenderbuffer(GL_RENDERBUFFER, Framebuffer.DepthStencilRenderbuffer);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, IO.WindowWidth, IO.WindowHeight);
-        glBindRenderbuffer(GL_RENDERBUFFER, 0);
-
-        glBindTexture(GL_TEXTURE_2D, Framebuffer.ColorTexture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, IO.WindowWidth, IO.WindowHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-        glBindTexture(GL_TEXTURE_2D, 0);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    }
+    // Offscreen targets come from the pool (resized with the window)
+    GL::render_target_pool& RenderTargets = GLDebug.RenderTargets;
+    const GL::render_target* ColorTarget = RenderTargets.AcquireTexture(GL_RGB8, IO.WindowWidth, IO.WindowHeight);
+    const GL::render_target* DepthStencilTarget = RenderTargets.AcquireRenderbuffer(GL_DEPTH24_STENCIL8, IO.WindowWidth, IO.WindowHeight);
 
     // First rendering pass
-    glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer.FBO);
+    GLDebug.Profiler.Push("Scene");
+    glBindFramebuffer(GL_FRAMEBUFFER, RenderTargets.GetFramebuffer({ ColorTarget }, DepthStencilTarget));
     glEnable(GL_DEPTH_TEST);
 
     DemoBase.Update(IO);
+    GLDebug.Profiler.Pop();
+
+    RenderTargets.Release(DepthStencilTarget);
 
     // Second rendering pass
+    GLDebug.Profiler.Push("Postprocess");
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -383,7 +342,7 @@ void demo_fbo::Update(const platform_io& IO)
     glUseProgram(PostProcessPassData.Program);
     glBindVertexArray(PostProcessPassData.VAO);
     glDisable(GL_DEPTH_TEST);
-    glBindTexture(GL_TEXTURE_2D, Framebuffer.ColorTexture);
+    glBindTexture(GL_TEXTURE_2D, ColorTarget->Name);
 
     glUniform1i(glGetUniformLocation(PostProcessPassData.Program, "transformType"), (GLint)transformType);
     glUniform1f(glGetUniformLocation(PostProcessPassData.Program, "offset"), 1.f / 300.f);
@@ -392,6 +351,9 @@ void demo_fbo::Update(const platform_io& IO)
 
     glBindVertexArray(0);
     glUseProgram(0);
+    GLDebug.Profiler.Pop();
+
+    RenderTargets.Release(ColorTarget);
 
     DisplayDebugUI();
 }
\ No newline at end of file
@@ -10,14 +10,6 @@
 
 class demo_fbo : public demo
 {
-    // New framebuffer to render offscreen
-    struct framebuffer
-    {
-        GLuint FBO;
-        GLuint ColorTexture;
-        GLuint DepthStencilRenderbuffer;
-    };
-
     // First pass is the render inside demo_base::Update()
     // Second pass data (color transformation)
     struct postprocess_pass_data
@@ -56,7 +48,6 @@ private:
 
     color_transform transformType = color_transform::INVERSE;
     postprocess_pass_data PostProcessPassData;
-    framebuffer Framebuffer;
 
     demo_base DemoBase;
 };
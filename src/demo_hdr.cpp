@@ -2,9 +2,9 @@
 #include <vector>
 
 #include <imgui.h>
-#include <iostream>
 
 #include "opengl_helpers.h"
+#include "cpu_profiler.h"
 #include "opengl_helpers_wireframe.h"
 
 #include "color.h"
@@ -219,8 +219,15 @@ void main()
 )GLSL";
 
 demo_hdr::demo_hdr(const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug)
-    : GLDebug(GLDebug), TavernScene(GLCache)
+    : GLDebug(GLDebug), FrameGraph(GLDebug.RenderTargets), TavernScene(GLCache)
 {
+    PROFILE_FUNCTION();
+
+    // Frame graph passes show up in the GPU profiler
+    FrameGraph.SetPassHooks(
+        [this](const char* PassName) { this->GLDebug.Profiler.Push(PassName); },
+        [this](const char*) { this->GLDebug.Profiler.Pop(); });
+
     #pragma region LitShader
     // Create shader
     {
@@ -276,65 +283,8 @@ demo_hdr::demo_hdr(const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug
     {
         this->ProgramBloom = GL::CreateProgramEx(1, &gVertexShaderBloomStr, 1, &gFragmentShaderBloomStr, true);
     }
-    // set up floating point framebuffer to render scene to
+    // Floating point render targets are taken from the render target pool each frame
     {
-        glGenFramebuffers(1, &hdrFBO);
-
-        // create floating point color buffer
-        glGenTextures(2, colorBuffers);
-        for (unsigned int i = 0; i < 2; i++)
-        {
-            glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, IO.WindowWidth, IO.WindowHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        }
-
-        glBindTexture(GL_TEXTURE_2D, 0);
-
-
-        // create depth buffer (renderbuffer)
-        glGenRenderbuffers(1, &rboDepth);
-        glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, IO.WindowWidth, IO.WindowHeight);
-
-        // attach buffers
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorBuffers[0], 0);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, colorBuffers[1], 0);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-
-        unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-        glDrawBuffers(2, attachments);
-        
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "Framebuffer not complete!" << std::endl;
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-
-        glGenFramebuffers(2, pingpongFBO);
-        glGenTextures(2, pingpongColorbuffers);
-        for (unsigned int i = 0; i < 2; i++)
-        {
-            glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-            glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, IO.WindowWidth, IO.WindowHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // we clamp to the edge as the blur filter would otherwise sample repeated texture values!
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingpongColorbuffers[i], 0);
-            // also check if framebuffers are complete (no need for depth buffer)
-            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-                std::cout << "Framebuffer not complete!" << std::endl;
-        }
-
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glBindRenderbuffer(GL_RENDERBUFFER, 0);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
         glUseProgram(ProgramHDR);
         glUniform1i(glGetUniformLocation(ProgramHDR, "hdrBuffer"), 0);
         glUniform1i(glGetUniformLocation(ProgramHDR, "bloomBlur"), 1);
@@ -393,59 +343,89 @@ static void DrawQuad(GLuint Program, mat4 ModelViewProj)
 void demo_hdr::Update(const platform_io& IO)
 {
     const float AspectRatio = (float)IO.WindowWidth / (float)IO.WindowHeight;
-    glViewport(0, 0, IO.WindowWidth, IO.WindowHeight);
 
     Camera = CameraUpdateFreefly(Camera, IO.CameraInputs);
-    
-    glClearColor(0.f, 0.f, 0.f, 1.f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     mat4 ProjectionMatrix = Mat4::Perspective(Math::ToRadians(60.f), AspectRatio, 0.1f, 100.f);
     mat4 ViewMatrix = CameraGetInverseMatrix(Camera);
     mat4 ModelMatrix = Mat4::Translate({ 0.f, 0.f, 0.f });
+    mat4 ModelViewProj = ProjectionMatrix * ViewMatrix * ModelMatrix;
+
+    // Declare this frame passes, the graph orders them, drops the unused ones and allocates their targets
+    FrameGraph.Reset();
 
-    // Render tavern
-    this->RenderTavern(ProjectionMatrix, ViewMatrix, ModelMatrix);
+    GL::frame_target_desc HDRDesc = { GL_RGBA16F, IO.WindowWidth, IO.WindowHeight };
+    GL::frame_resource SceneColor = FrameGraph.CreateTexture("Scene color", HDRDesc);
+    GL::frame_resource BrightColor = FrameGraph.CreateTexture("Bright color", HDRDesc);
+    GL::frame_resource SceneDepth = FrameGraph.CreateRenderbuffer("Scene depth", { GL_DEPTH_COMPONENT24, IO.WindowWidth, IO.WindowHeight });
+    GL::frame_resource Backbuffer = FrameGraph.ImportBackbuffer(IO.WindowWidth, IO.WindowHeight);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // Render scene and its bright parts to floating point targets
+    FrameGraph.AddPass("Scene",
+        [&](GL::frame_graph::pass_builder& Builder)
+        {
+            SceneColor = Builder.WriteColor(SceneColor, GL::frame_load_op::CLEAR);
+            BrightColor = Builder.WriteColor(BrightColor, GL::frame_load_op::CLEAR);
+            Builder.WriteDepth(SceneDepth, GL::frame_load_op::CLEAR);
+        },
+        [=](const GL::frame_graph::pass_resources&)
+        {
+            this->RenderTavern(ProjectionMatrix, ViewMatrix, ModelMatrix);
+        });
 
     //Bloom
-    bool horizontal = true;
-    glUseProgram(ProgramBloom);
-    for (unsigned int i = 0; i < bloomIteration; i++)
+    // Each blur writes a new transient target, the pool makes them ping-pong between two textures
+    GL::frame_resource BloomBlur = BrightColor;
+    for (int i = 0; i < bloomIteration; i++)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
-        glUniform1i(glGetUniformLocation(ProgramBloom, "horizontal"), horizontal);
-        glBindTexture(GL_TEXTURE_2D, i == 0 ? colorBuffers[1] : pingpongColorbuffers[!horizontal]);
-        RenderHdrTavern(ProjectionMatrix * ViewMatrix * ModelMatrix);
-        horizontal = !horizontal;
+        GL::frame_resource Source = BloomBlur;
+        bool horizontal = i % 2 == 0;
+
+        FrameGraph.AddPass("Bloom blur",
+            [&](GL::frame_graph::pass_builder& Builder)
+            {
+                Builder.Read(Source);
+                BloomBlur = Builder.WriteColor(FrameGraph.CreateTexture("Bloom blur", HDRDesc), GL::frame_load_op::DONT_CARE);
+            },
+            [=](const GL::frame_graph::pass_resources& Resources)
+            {
+                glUseProgram(ProgramBloom);
+                glUniform1i(glGetUniformLocation(ProgramBloom, "horizontal"), horizontal);
+                glBindTexture(GL_TEXTURE_2D, Resources.Get(Source));
+                RenderHdrTavern(ModelViewProj);
+            });
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-   
-    
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Without bloom, nothing reads the blur passes and the bright target so they are culled
+    bool UseBloom = bloom && bloomIteration > 0;
 
-    glUseProgram(ProgramHDR);
+    //HDR
+    FrameGraph.AddPass("Tonemap",
+        [&](GL::frame_graph::pass_builder& Builder)
+        {
+            Builder.Read(SceneColor);
+            if (UseBloom)
+                Builder.Read(BloomBlur);
+            Builder.WriteBackbuffer(Backbuffer, GL::frame_load_op::CLEAR);
+        },
+        [=](const GL::frame_graph::pass_resources& Resources)
+        {
+            glUseProgram(ProgramHDR);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, Resources.Get(SceneColor));
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
-    glActiveTexture(GL_TEXTURE0);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, UseBloom ? Resources.Get(BloomBlur) : 0);
+            glActiveTexture(GL_TEXTURE0);
 
-    glUniform1i(glGetUniformLocation(ProgramHDR, "hdr"), hdr);
-    glUniform1i(glGetUniformLocation(ProgramHDR, "bloom"), bloomIteration > 0);
-    glUniform1f(glGetUniformLocation(ProgramHDR, "explosure"), explosure);
-   //HDR
-   this->RenderHdrTavern(ProjectionMatrix * ViewMatrix * ModelMatrix);
+            glUniform1i(glGetUniformLocation(ProgramHDR, "hdr"), hdr);
+            glUniform1i(glGetUniformLocation(ProgramHDR, "bloom"), UseBloom);
+            glUniform1f(glGetUniformLocation(ProgramHDR, "explosure"), explosure);
+            this->RenderHdrTavern(ModelViewProj);
+        });
 
-    // Render tavern wireframe
+    FrameGraph.Execute();
 
     // Display debug UI
     this->DisplayDebugUI();
@@ -465,9 +445,11 @@ void demo_hdr::DisplayDebugUI()
             ImGui::TreePop();
         }
         TavernScene.InspectLights();
+        FrameGraph.InspectPasses();
 
         if (ImGui::TreeNodeEx("Post Process"))
         {
+            ImGui::Checkbox("Bloom", &bloom);
             ImGui::DragInt("Bloom Iteration", &bloomIteration, 1.0f, 0, 50);
             ImGui::Checkbox("Hdr", &hdr);
             if (hdr)
@@ -9,6 +9,7 @@
 #include "camera.h"
 
 #include "tavern_scene.h"
+#include "opengl_helpers_frame_graph.h"
 
 class demo_hdr : public demo
 {
@@ -24,6 +25,7 @@ public:
 
 private:
     GL::debug& GLDebug;
+    GL::frame_graph FrameGraph;
 
     // 3d camera
     camera Camera = {};
@@ -39,17 +41,11 @@ private:
     GLuint vertexBuffer = 0;
     int vertexCount = 0;
 
-    unsigned int hdrFBO;
-    unsigned int rboDepth;
-    unsigned int colorBuffers[2];
-
-    unsigned int pingpongFBO[2];
-    unsigned int pingpongColorbuffers[2];
-
     float explosure = 0.5f;
-    bool hdr;
+    bool hdr = true;
 
-    int bloomIteration;
+    bool bloom = true;
+    int bloomIteration = 10;
 
     tavern_scene TavernScene;
 
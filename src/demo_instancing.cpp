@@ -1,13 +1,20 @@
 
+#include <cstdio>
 #include <vector>
+#include <cstring>
+#include <string>
+#include <random>
 
 #include <imgui.h>
 #include <iostream>
 
 #include "opengl_helpers.h"
+#include "opengl_helpers_memory.h"
+#include "cpu_profiler.h"
 #include "maths.h"
 #include "mesh.h"
 #include "color.h"
+#include "culling.h"
 
 #include "demo_instancing.h"
 
@@ -30,14 +37,25 @@ static const char* gVertexShaderStr = R"GLSL(
 layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec2 aUV;
 layout(location = 2) in mat4 aModel;
+layout(location = 6) in uint aFrame; // Culled instances only
 
 uniform mat4  uViewProj;
+uniform bool  uCulledInstances;
+uniform uint  uFrame;
 
 // Varyings (variables that are passed to fragment shader with perspective interpolation)
 out vec2 vUV;
 
 void main()
 {
+    // Slot not written by the culling pass of this frame: degenerate triangles
+    if (uCulledInstances && aFrame != uFrame)
+    {
+        vUV = vec2(0.0);
+        gl_Position = vec4(0.0);
+        return;
+    }
+
     vUV = aUV;
     gl_Position = uViewProj * aModel * vec4(aPosition, 1.0);
 })GLSL";
@@ -59,9 +77,201 @@ void main()
     oColor = texture(uColorTexture, vUV);
 })GLSL";
 
+// GPU culling pass (rasterizer discard), one point per instance
+static const char* gCullVertexShaderStr = R"GLSL(
+#version 330 core
+
+layout(location = 0) in mat4 aModel;
+
+out mat4 vModel;
+
+void main()
+{
+    vModel = aModel;
+})GLSL";
+
+static const char* gCullGeometryShaderStr = R"GLSL(
+#version 330 core
+
+layout(points) in;
+layout(points, max_vertices = 1) out;
+
+in mat4 vModel[];
+
+uniform vec4 uFrustumPlanes[6]; // Normalized, pointing inside
+uniform vec4 uBoundingSphere;   // Mesh space center and radius
+uniform uint uFrame;
+
+// Captured by transform feedback
+out vec4 gModel0;
+out vec4 gModel1;
+out vec4 gModel2;
+out vec4 gModel3;
+flat out uint gFrame;
+
+void main()
+{
+    mat4 model = vModel[0];
+    vec3 center = (model * vec4(uBoundingSphere.xyz, 1.0)).xyz;
+    float scale = sqrt(max(dot(model[0].xyz, model[0].xyz), max(dot(model[1].xyz, model[1].xyz), dot(model[2].xyz, model[2].xyz))));
+    float radius = uBoundingSphere.w * scale;
+
+    for (int i = 0; i < 6; ++i)
+    {
+        if (dot(uFrustumPlanes[i].xyz, center) + uFrustumPlanes[i].w < -radius)
+            return;
+    }
+
+    gModel0 = model[0];
+    gModel1 = model[1];
+    gModel2 = model[2];
+    gModel3 = model[3];
+    gFrame = uFrame;
+    EmitVertex();
+})GLSL";
+
+// CPU_SOA animation, the rows of the model matrices
+static const char* gSoAVertexShaderStr = R"GLSL(
+#version 330 core
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec2 aUV;
+layout(location = 2) in vec4 aModelRow0;
+layout(location = 3) in vec4 aModelRow1;
+layout(location = 4) in vec4 aModelRow2;
+
+uniform mat4 uViewProj;
+
+out vec2 vUV;
+
+void main()
+{
+    mat4 model = transpose(mat4(aModelRow0, aModelRow1, aModelRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+    vUV = aUV;
+    gl_Position = uViewProj * model * vec4(aPosition, 1.0);
+})GLSL";
+
+static const char* gSoACullVertexShaderStr = R"GLSL(
+#version 330 core
+
+layout(location = 0) in vec4 aModelRow0;
+layout(location = 1) in vec4 aModelRow1;
+layout(location = 2) in vec4 aModelRow2;
+
+out mat4 vModel;
+
+void main()
+{
+    vModel = transpose(mat4(aModelRow0, aModelRow1, aModelRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+})GLSL";
+
+// GPU_PROCEDURAL animation, strings after a #version line
+static const char* gVersionStr = "#version 330 core\n";
+
+static const char* gProceduralInstanceStr = R"GLSL(
+uniform float uTime;
+uniform bool  uSpin;
+uniform float uSpinSpeed;
+uniform bool  uOrbit;
+uniform float uOrbitSpeed;
+uniform bool  uBob;
+uniform float uBobAmplitude;
+uniform float uBobFrequency;
+
+// Rodrigues rotation, axis normalized
+mat3 axisAngle(vec3 axis, float angle)
+{
+    float c = cos(angle);
+    float s = sin(angle);
+    vec3 t = (1.0 - c) * axis;
+    return mat3(t.x * axis + vec3(c, s * axis.z, -s * axis.y),
+                t.y * axis + vec3(-s * axis.z, c, s * axis.x),
+                t.z * axis + vec3(s * axis.y, -s * axis.x, c));
+}
+
+mat4 proceduralModel(vec4 positionScale, vec4 axisPhase)
+{
+    vec3 position = positionScale.xyz;
+
+    float spin = axisPhase.w;
+    if (uSpin)
+        spin += uSpinSpeed * uTime;
+    mat3 rotation = axisAngle(axisPhase.xyz, spin) * positionScale.w;
+
+    if (uOrbit)
+    {
+        // Kepler-like: the angular speed decreases with the radius (1 at 150)
+        float orbit = uOrbitSpeed * uTime * sqrt(150.0 / max(length(position.xz), 1.0));
+        float c = cos(orbit);
+        float s = sin(orbit);
+        position.xz = mat2(c, s, -s, c) * position.xz;
+    }
+
+    if (uBob)
+        position.y += uBobAmplitude * sin(uBobFrequency * uTime + axisPhase.w);
+
+    return mat4(vec4(rotation[0], 0.0), vec4(rotation[1], 0.0), vec4(rotation[2], 0.0), vec4(position, 1.0));
+})GLSL";
+
+static const char* gProceduralVertexShaderStr = R"GLSL(
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec2 aUV;
+layout(location = 2) in vec4 aPositionScale;
+layout(location = 3) in vec4 aAxisPhase;
+
+uniform mat4 uViewProj;
+
+out vec2 vUV;
+
+void main()
+{
+    vUV = aUV;
+    gl_Position = uViewProj * proceduralModel(aPositionScale, aAxisPhase) * vec4(aPosition, 1.0);
+})GLSL";
+
+static const char* gProceduralCullVertexShaderStr = R"GLSL(
+layout(location = 0) in vec4 aPositionScale;
+layout(location = 1) in vec4 aAxisPhase;
+
+out mat4 vModel;
+
+void main()
+{
+    vModel = proceduralModel(aPositionScale, aAxisPhase);
+})GLSL";
+
+demo_instancing::animation demo_instancing::DefaultAnimation = demo_instancing::animation::CPU_MATRICES;
+
+bool demo_instancing::FindAnimation(const char* Name, animation* AnimationOut)
+{
+    if (strcmp(Name, "cpu") == 0)
+        *AnimationOut = animation::CPU_MATRICES;
+    else if (strcmp(Name, "gpu") == 0)
+        *AnimationOut = animation::GPU_PROCEDURAL;
+    else if (strcmp(Name, "soa") == 0)
+        *AnimationOut = animation::CPU_SOA;
+    else
+        return false;
+    return true;
+}
+
+// mat4 then the frame number, interleaved by transform feedback
+static const int CULLED_INSTANCE_STRIDE = 16 * sizeof(float) + sizeof(uint32_t);
+
+// glDrawArraysIndirect command, InstanceCount written by the GPU from the culling query
+struct draw_arrays_indirect_command
+{
+    GLuint VertexCount;
+    GLuint InstanceCount;
+    GLuint First;
+    GLuint BaseInstance; // Reserved before GL 4.2, must be 0
+};
+
 demo_instancing::demo_instancing(GL::cache& GLCache, GL::debug& GLDebug)
     : GLCache(GLCache), GLDebug(GLDebug)
 {
+    PROFILE_FUNCTION();
+
     // Create render pipeline
     this->Program = GL::CreateProgram(gVertexShaderStr, gFragmentShaderStr);
     
@@ -84,6 +294,7 @@ demo_instancing::demo_instancing(GL::cache& GLCache, GL::debug& GLDebug)
 
         offsets.push_back(Mat4::Translate(superVec) * Mat4::RotateX(xRot) * Mat4::RotateY(yRot) * Mat4::RotateZ(zRot));
     }
+    GL::TrackCPUMemory(&offsets, "demo_instancing::offsets", offsets.capacity() * sizeof(mat4));
 
     // Gen obj
     {
@@ -133,6 +344,163 @@ demo_instancing::demo_instancing(GL::cache& GLCache, GL::debug& GLDebug)
         }
         glBindVertexArray(0);
         //glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        RockBounds = GLCache.FindMeshInfo("media/rock.obj")->Bounds;
+    }
+
+    // GPU culling
+    {
+        const char* Varyings[] = { "gModel0", "gModel1", "gModel2", "gModel3", "gFrame" };
+        cullProgram = GL::CreateTransformFeedbackProgram(gCullVertexShaderStr, gCullGeometryShaderStr, ARRAY_SIZE(Varyings), Varyings);
+
+        // Source: every instance as a point
+        glGenVertexArrays(1, &cullVAO);
+        glBindVertexArray(cullVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (int Column = 0; Column < 4; ++Column)
+        {
+            glEnableVertexAttribArray(Column);
+            glVertexAttribPointer(Column, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (void*)(Column * sizeof(v4)));
+        }
+
+        // Destination, zeroed so no slot matches a frame number before being written
+        std::vector<uint8_t> Zeros(offsets.size() * CULLED_INSTANCE_STRIDE, 0);
+        glGenBuffers(1, &culledInstanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, culledInstanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, Zeros.size(), Zeros.data(), GL_DYNAMIC_COPY);
+
+        // Draw: same mesh attributes as VAO, instances from culledInstanceVBO
+        glGenVertexArrays(1, &culledVAO);
+        glBindVertexArray(culledVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_full), (void*)OFFSETOF(vertex_full, Position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_full), (void*)OFFSETOF(vertex_full, UV));
+
+        glBindBuffer(GL_ARRAY_BUFFER, culledInstanceVBO);
+        for (int Column = 0; Column < 4; ++Column)
+        {
+            glEnableVertexAttribArray(2 + Column);
+            glVertexAttribPointer(2 + Column, 4, GL_FLOAT, GL_FALSE, CULLED_INSTANCE_STRIDE, (void*)(Column * sizeof(v4)));
+            glVertexAttribDivisor(2 + Column, 1);
+        }
+        glEnableVertexAttribArray(6);
+        glVertexAttribIPointer(6, 1, GL_UNSIGNED_INT, CULLED_INSTANCE_STRIDE, (void*)(16 * sizeof(float)));
+        glVertexAttribDivisor(6, 1);
+        glBindVertexArray(0);
+
+        glGenQueries(CULL_QUERY_COUNT, cullQueries);
+        for (int& Count : culledInstanceCounts)
+            Count = -1;
+
+        if (GLAD_GL_ARB_query_buffer_object && GLAD_GL_ARB_draw_indirect)
+        {
+            draw_arrays_indirect_command Command = { (GLuint)VertexCount, 0, 0, 0 };
+            glGenBuffers(1, &cullIndirectBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cullIndirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(Command), &Command, GL_DYNAMIC_COPY);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+    }
+
+    // GPU procedural animation: same positions, random axis, phase and scale (own generator, rand() sequence unchanged)
+    {
+        Animation = DefaultAnimation;
+
+        std::mt19937 Generator(1234);
+        std::uniform_real_distribution<float> Unit(-1.f, 1.f);
+        std::vector<procedural_instance> Instances(offsets.size());
+        for (size_t i = 0; i < offsets.size(); ++i)
+        {
+            v3 Axis;
+            do
+                Axis = { Unit(Generator), Unit(Generator), Unit(Generator) };
+            while (Vec3::Length(Axis) < 0.01f);
+            Axis = Vec3::Normalize(Axis);
+
+            float Phase = (Unit(Generator) * 0.5f + 0.5f) * Math::TwoPi();
+            float Scale = 1.f + Unit(Generator) * 0.25f;
+            const v4& Translation = offsets[i].c[3];
+            Instances[i].PositionScale = { Translation.x, Translation.y, Translation.z, Scale };
+            Instances[i].AxisPhase = { Axis.x, Axis.y, Axis.z, Phase };
+        }
+
+        const char* DrawVS[] = { gVersionStr, gProceduralInstanceStr, gProceduralVertexShaderStr };
+        const char* DrawFS[] = { gFragmentShaderStr };
+        proceduralProgram = GL::CreateProgramEx(ARRAY_SIZE(DrawVS), DrawVS, ARRAY_SIZE(DrawFS), DrawFS);
+
+        std::string CullVS = std::string(gVersionStr) + gProceduralInstanceStr + gProceduralCullVertexShaderStr;
+        const char* Varyings[] = { "gModel0", "gModel1", "gModel2", "gModel3", "gFrame" };
+        proceduralCullProgram = GL::CreateTransformFeedbackProgram(CullVS.c_str(), gCullGeometryShaderStr, ARRAY_SIZE(Varyings), Varyings);
+
+        // Uploaded once
+        glGenBuffers(1, &proceduralInstanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, proceduralInstanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, Instances.size() * sizeof(procedural_instance), Instances.data(), GL_STATIC_DRAW);
+
+        glGenVertexArrays(1, &proceduralVAO);
+        glBindVertexArray(proceduralVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_full), (void*)OFFSETOF(vertex_full, Position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_full), (void*)OFFSETOF(vertex_full, UV));
+        glBindBuffer(GL_ARRAY_BUFFER, proceduralInstanceVBO);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(procedural_instance), (void*)OFFSETOF(procedural_instance, PositionScale));
+        glVertexAttribDivisor(2, 1);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(procedural_instance), (void*)OFFSETOF(procedural_instance, AxisPhase));
+        glVertexAttribDivisor(3, 1);
+
+        glGenVertexArrays(1, &proceduralCullVAO);
+        glBindVertexArray(proceduralCullVAO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(procedural_instance), (void*)OFFSETOF(procedural_instance, PositionScale));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(procedural_instance), (void*)OFFSETOF(procedural_instance, AxisPhase));
+        glBindVertexArray(0);
+    }
+
+    // CPU SoA animation: the instance matrices split into translation, rotation and scale
+    {
+        for (const mat4& Offset : offsets)
+            soaTransforms.Add(Offset.c[3].xyz, Quat::FromMatrix(Offset), { 1.f, 1.f, 1.f });
+        GL::TrackCPUMemory(&soaTransforms, "demo_instancing::soaTransforms", soaTransforms.GetMemorySize());
+
+        soaProgram = GL::CreateProgram(gSoAVertexShaderStr, gFragmentShaderStr);
+        const char* Varyings[] = { "gModel0", "gModel1", "gModel2", "gModel3", "gFrame" };
+        soaCullProgram = GL::CreateTransformFeedbackProgram(gSoACullVertexShaderStr, gCullGeometryShaderStr, ARRAY_SIZE(Varyings), Varyings);
+
+        // Streamed, rewritten every update
+        glGenBuffers(1, &soaInstanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, soaInstanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, soaTransforms.GetCount() * sizeof(Instances::matrix3x4), nullptr, GL_STREAM_DRAW);
+
+        glGenVertexArrays(1, &soaVAO);
+        glBindVertexArray(soaVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_full), (void*)OFFSETOF(vertex_full, Position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_full), (void*)OFFSETOF(vertex_full, UV));
+        glBindBuffer(GL_ARRAY_BUFFER, soaInstanceVBO);
+        for (int Row = 0; Row < 3; ++Row)
+        {
+            glEnableVertexAttribArray(2 + Row);
+            glVertexAttribPointer(2 + Row, 4, GL_FLOAT, GL_FALSE, sizeof(Instances::matrix3x4), (void*)(Row * sizeof(v4)));
+            glVertexAttribDivisor(2 + Row, 1);
+        }
+
+        glGenVertexArrays(1, &soaCullVAO);
+        glBindVertexArray(soaCullVAO);
+        for (int Row = 0; Row < 3; ++Row)
+        {
+            glEnableVertexAttribArray(Row);
+            glVertexAttribPointer(Row, 4, GL_FLOAT, GL_FALSE, sizeof(Instances::matrix3x4), (void*)(Row * sizeof(v4)));
+        }
+        glBindVertexArray(0);
     }
 
     // Gen texture
@@ -149,6 +517,25 @@ demo_instancing::~demo_instancing()
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &instanceVBO);
     glDeleteProgram(Program);
+    glDeleteQueries(CULL_QUERY_COUNT, cullQueries);
+    glDeleteBuffers(1, &cullIndirectBuffer);
+    glDeleteVertexArrays(1, &culledVAO);
+    glDeleteVertexArrays(1, &cullVAO);
+    glDeleteBuffers(1, &culledInstanceVBO);
+    glDeleteProgram(cullProgram);
+    glDeleteVertexArrays(1, &soaCullVAO);
+    glDeleteVertexArrays(1, &soaVAO);
+    glDeleteBuffers(1, &soaInstanceVBO);
+    glDeleteProgram(soaCullProgram);
+    glDeleteProgram(soaProgram);
+    GL::TrackCPUMemory(&soaTransforms, "demo_instancing::soaTransforms", 0);
+    glDeleteVertexArrays(1, &proceduralCullVAO);
+    glDeleteVertexArrays(1, &proceduralVAO);
+    glDeleteBuffers(1, &proceduralInstanceVBO);
+    glDeleteProgram(proceduralCullProgram);
+    glDeleteProgram(proceduralProgram);
+
+    GL::TrackCPUMemory(&offsets, "demo_instancing::offsets", 0);
 }
 
 void demo_instancing::DisplayDebugUI()
@@ -157,20 +544,61 @@ void demo_instancing::DisplayDebugUI()
     {
         static bool swag = false;
         ImGui::Checkbox("Are you swag ?", &swag);
+
+        int AnimationIndex = (int)Animation;
+        ImGui::Combo("Animation", &AnimationIndex, "CPU matrices\0GPU procedural\0CPU SoA (job pool)\0");
+        Animation = (animation)AnimationIndex;
+        if (Animation == animation::GPU_PROCEDURAL)
+        {
+            ImGui::Checkbox("Spin", &Spin);
+            ImGui::SameLine();
+            ImGui::Checkbox("Orbit", &Orbit);
+            ImGui::SameLine();
+            ImGui::Checkbox("Bob", &Bob);
+            ImGui::SliderFloat("Spin speed", &SpinSpeed, 0.f, 10.f);
+            ImGui::SliderFloat("Orbit speed", &OrbitSpeed, 0.f, 1.f);
+            ImGui::SliderFloat("Bob amplitude", &BobAmplitude, 0.f, 10.f);
+            ImGui::SliderFloat("Bob frequency", &BobFrequency, 0.f, 10.f);
+        }
+
+        ImGui::Checkbox("GPU frustum culling", &Culling::Enabled);
+        if (Culling::Enabled)
+        {
+            int LastCount = -1;
+            for (int i = 1; i <= CULL_QUERY_COUNT && LastCount < 0; ++i)
+                LastCount = culledInstanceCounts[(cullQueryIndex - i + CULL_QUERY_COUNT) % CULL_QUERY_COUNT];
+            ImGui::Text("Visible instances: %d / %d (last result)", LastCount, (int)offsets.size());
+            if (cullIndirectBuffer)
+                ImGui::Text("Drawn instances: visible ones (count written by the GPU, indirect draw)");
+            else
+                ImGui::Text("Drawn instances: %d (all slots until the count of the frame is available)", culledInstanceDrawCount);
+        }
         ImGui::TreePop();
     }
 }
 
 void demo_instancing::Update(const platform_io& IO)
 {
-    mat4 rotate = Mat4::RotateX(IO.DeltaTime);
+    if (Animation == animation::CPU_MATRICES)
+    {
+        mat4 rotate = Mat4::RotateX(IO.DeltaTime);
 
-    for (int i = 0; i < offsets.size(); i++)
-        offsets[i] *= rotate;
+        for (int i = 0; i < offsets.size(); i++)
+            offsets[i] *= rotate;
 
-    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, offsets.size() * sizeof(mat4), offsets.data());
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, offsets.size() * sizeof(mat4), offsets.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    else if (Animation == animation::CPU_SOA)
+    {
+        UpdateSoAInstances(IO.DeltaTime);
+    }
+    else
+    {
+        // Nothing uploaded
+        AnimationTime += IO.DeltaTime;
+    }
 
     Camera = CameraUpdateFreefly(Camera, IO.CameraInputs);
 
@@ -197,11 +625,167 @@ void demo_instancing::Update(const platform_io& IO)
 
     mat4 ViewProj = ProjectionMatrix * ViewMatrix;
 
-    glUniformMatrix4fv(glGetUniformLocation(Program, "uViewProj"), 1, GL_FALSE, ViewProj.e);
+    if (Culling::Enabled)
+    {
+        // Culled instances are matrices whatever the animation
+        CullInstances(ViewProj);
+        glUseProgram(Program);
+        glUniformMatrix4fv(glGetUniformLocation(Program, "uViewProj"), 1, GL_FALSE, ViewProj.e);
+        glUniform1i(glGetUniformLocation(Program, "uCulledInstances"), true);
+        glUniform1ui(glGetUniformLocation(Program, "uFrame"), cullFrame);
+
+        glBindVertexArray(culledVAO);
+        if (cullIndirectBuffer)
+        {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cullIndirectBuffer);
+            glDrawArraysIndirect(GL_TRIANGLES, (void*)0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        else
+        {
+            glDrawArraysInstanced(GL_TRIANGLES, 0, VertexCount, culledInstanceDrawCount);
+        }
+    }
+    else if (Animation == animation::CPU_SOA)
+    {
+        glUseProgram(soaProgram);
+        glUniformMatrix4fv(glGetUniformLocation(soaProgram, "uViewProj"), 1, GL_FALSE, ViewProj.e);
+
+        glBindVertexArray(soaVAO);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, VertexCount, offsets.size());
+    }
+    else if (Animation == animation::GPU_PROCEDURAL)
+    {
+        glUseProgram(proceduralProgram);
+        glUniformMatrix4fv(glGetUniformLocation(proceduralProgram, "uViewProj"), 1, GL_FALSE, ViewProj.e);
+        SetProceduralUniforms(proceduralProgram);
+
+        glBindVertexArray(proceduralVAO);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, VertexCount, offsets.size());
+    }
+    else
+    {
+        glUniformMatrix4fv(glGetUniformLocation(Program, "uViewProj"), 1, GL_FALSE, ViewProj.e);
+        glUniform1i(glGetUniformLocation(Program, "uCulledInstances"), false);
 
-    glBindVertexArray(VAO);
-    glDrawArraysInstanced(GL_TRIANGLES, 0, VertexCount, offsets.size());
+        glBindVertexArray(VAO);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, VertexCount, offsets.size());
+    }
     glBindVertexArray(0);
 
-    //DisplayDebugUI();
+    DisplayDebugUI();
+}
+
+void demo_instancing::UpdateSoAInstances(float DeltaTime)
+{
+    PROFILE_FUNCTION();
+
+    // Invalidated (orphaned): the driver hands out new storage instead of waiting for the draws still reading the previous one
+    GLsizeiptr Size = soaTransforms.GetCount() * sizeof(Instances::matrix3x4);
+    glBindBuffer(GL_ARRAY_BUFFER, soaInstanceVBO);
+    Instances::matrix3x4* Matrices = (Instances::matrix3x4*)glMapBufferRange(GL_ARRAY_BUFFER, 0, Size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (Matrices == nullptr)
+    {
+        fprintf(stderr, "Cannot map the instance buffer\n");
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return;
+    }
+
+    // Same rotation as the CPU_MATRICES update (offsets[i] *= Mat4::RotateX(DeltaTime))
+    Instances::ParallelRotateAndCompose(soaTransforms, Quat::AxisAngle({ 1.f, 0.f, 0.f }, DeltaTime), Matrices);
+
+    if (!glUnmapBuffer(GL_ARRAY_BUFFER))
+        fprintf(stderr, "Instance buffer lost while mapped\n");
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void demo_instancing::SetProceduralUniforms(GLuint ProgramToSet)
+{
+    glUniform1f(glGetUniformLocation(ProgramToSet, "uTime"), (float)AnimationTime);
+    glUniform1i(glGetUniformLocation(ProgramToSet, "uSpin"), Spin);
+    glUniform1f(glGetUniformLocation(ProgramToSet, "uSpinSpeed"), SpinSpeed);
+    glUniform1i(glGetUniformLocation(ProgramToSet, "uOrbit"), Orbit);
+    glUniform1f(glGetUniformLocation(ProgramToSet, "uOrbitSpeed"), OrbitSpeed);
+    glUniform1i(glGetUniformLocation(ProgramToSet, "uBob"), Bob);
+    glUniform1f(glGetUniformLocation(ProgramToSet, "uBobAmplitude"), BobAmplitude);
+    glUniform1f(glGetUniformLocation(ProgramToSet, "uBobFrequency"), BobFrequency);
+}
+
+void demo_instancing::CullInstances(const mat4& ViewProj)
+{
+    PROFILE_FUNCTION();
+
+    ++cullFrame;
+
+    // Counts of the previous frames, only the available ones
+    for (int i = 0; i < CULL_QUERY_COUNT; ++i)
+    {
+        if (!cullQueryPending[i])
+            continue;
+
+        GLint Available = 0;
+        glGetQueryObjectiv(cullQueries[i], GL_QUERY_RESULT_AVAILABLE, &Available);
+        if (!Available)
+            continue;
+
+        GLuint Count = 0;
+        glGetQueryObjectuiv(cullQueries[i], GL_QUERY_RESULT, &Count);
+        culledInstanceCounts[i] = (int)Count;
+        cullQueryPending[i] = false;
+    }
+
+    Culling::frustum Frustum = Culling::ExtractFrustum(ViewProj);
+    v4 Planes[6];
+    for (int i = 0; i < 6; ++i)
+        Planes[i] = { Frustum.X[i], Frustum.Y[i], Frustum.Z[i], Frustum.W[i] };
+
+    // Procedural instances are animated by the culling pass, the draw reads the resulting matrices
+    bool Procedural = Animation == animation::GPU_PROCEDURAL;
+    GLuint CullProgram = Procedural ? proceduralCullProgram : Animation == animation::CPU_SOA ? soaCullProgram : cullProgram;
+    glUseProgram(CullProgram);
+    glUniform4fv(glGetUniformLocation(CullProgram, "uFrustumPlanes"), 6, Planes[0].e);
+    glUniform4f(glGetUniformLocation(CullProgram, "uBoundingSphere"), RockBounds.Center.x, RockBounds.Center.y, RockBounds.Center.z, RockBounds.Radius);
+    glUniform1ui(glGetUniformLocation(CullProgram, "uFrame"), cullFrame);
+    if (Procedural)
+        SetProceduralUniforms(CullProgram);
+
+    GLuint Query = cullQueries[cullQueryIndex];
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(Procedural ? proceduralCullVAO : Animation == animation::CPU_SOA ? soaCullVAO : cullVAO);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, culledInstanceVBO);
+    glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, Query);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, (GLsizei)offsets.size());
+    glEndTransformFeedback();
+    glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    // The GPU copies the count into the indirect command once the culling pass is done, the CPU does not wait
+    if (cullIndirectBuffer)
+    {
+        glBindBuffer(GL_QUERY_BUFFER, cullIndirectBuffer);
+        glGetQueryObjectuiv(Query, GL_QUERY_RESULT, (GLuint*)OFFSETOF(draw_arrays_indirect_command, InstanceCount));
+        glBindBuffer(GL_QUERY_BUFFER, 0);
+    }
+
+    // Exact count only when the GPU is already done, otherwise every slot (stale ones are dropped by the vertex shader)
+    culledInstanceDrawCount = (int)offsets.size();
+    GLint Available = 0;
+    glGetQueryObjectiv(Query, GL_QUERY_RESULT_AVAILABLE, &Available);
+    if (Available)
+    {
+        GLuint Count = 0;
+        glGetQueryObjectuiv(Query, GL_QUERY_RESULT, &Count);
+        culledInstanceDrawCount = (int)Count;
+        culledInstanceCounts[cullQueryIndex] = (int)Count;
+        cullQueryPending[cullQueryIndex] = false;
+    }
+    else
+    {
+        cullQueryPending[cullQueryIndex] = true;
+        culledInstanceCounts[cullQueryIndex] = -1;
+    }
+    cullQueryIndex = (cullQueryIndex + 1) % CULL_QUERY_COUNT;
 }
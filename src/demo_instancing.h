@@ -3,8 +3,11 @@
 #include "demo.h"
 
 #include "opengl_headers.h"
+#include "opengl_helpers.h"
 
 #include "camera.h"
+#include "mesh.h"
+#include "instance_transforms.h"
 
 class demo_instancing : public demo
 {
@@ -15,7 +18,25 @@ public:
 
     void DisplayDebugUI();
 
+    // Per-frame animation of the instances
+    enum class animation
+    {
+        CPU_MATRICES,   // Instance matrices rotated on the CPU then uploaded every frame
+        GPU_PROCEDURAL, // Static instance data uploaded once, the vertex shader computes the transforms from the time
+        CPU_SOA,        // Positions, quaternions and scales in SoA updated on the job pool, written as 3x4 matrices in a mapped buffer
+    };
+    static animation DefaultAnimation; // --instance-animation
+    // "cpu", "gpu" or "soa", false when unknown
+    static bool FindAnimation(const char* Name, animation* AnimationOut);
+
 private:
+    // GPU_PROCEDURAL instance attributes
+    struct procedural_instance
+    {
+        v4 PositionScale;
+        v4 AxisPhase; // Spin axis (normalized), phase in radians (initial spin angle, bob offset)
+    };
+
     GL::cache& GLCache;
     GL::debug& GLDebug;
 
@@ -34,5 +55,57 @@ private:
     GLuint VertexBuffer = 0;
     int VertexCount = 0;
 
+    // GPU frustum culling (Culling::Enabled): a geometry shader under GL_RASTERIZER_DISCARD emits the instances whose bounding
+    // sphere touches the frustum, transform feedback compacts them into culledInstanceVBO with the frame number
+    // With GL_ARB_query_buffer_object and GL_ARB_draw_indirect, the GPU writes the GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN
+    // result into the instance count of cullIndirectBuffer and the draw covers exactly the visible instances, CPU never waiting
+    // (glDrawTransformFeedbackInstanced does not fit: the captured count is its vertex count, not its instance count)
+    // Plain GL 3.3 cannot source a draw count from the GPU: the draw covers every slot unless the query of this frame is
+    // already available, and the vertex shader drops the slots left over from older frames. Every instance is then vertex
+    // shaded on top of the culling pass, a net loss against no culling (see README). Counts of previous frames never bound
+    // the draw, more instances than them can survive when the camera moves
+    // Queries of the previous frames give the visible count of the debug UI
+    static const int CULL_QUERY_COUNT = 4;
+    GLuint cullProgram = 0;
+    GLuint cullVAO = 0;     // instanceVBO as points
+    GLuint culledVAO = 0;   // Mesh with culledInstanceVBO
+    GLuint culledInstanceVBO = 0;
+    GLuint cullQueries[CULL_QUERY_COUNT] = {};
+    bool cullQueryPending[CULL_QUERY_COUNT] = {};
+    int cullQueryIndex = 0;
+    int culledInstanceCounts[CULL_QUERY_COUNT]; // Latest results, -1 unknown
+    int culledInstanceDrawCount = 0;  // Without cullIndirectBuffer
+    GLuint cullIndirectBuffer = 0;    // Draw arrays indirect command, 0 without the extensions
+    uint32_t cullFrame = 0;
+    Mesh::bounds RockBounds = {};
+
+    // GPU_PROCEDURAL animation: spin around the instance axis, orbit around the world Y axis (inner instances faster), bob along Y
+    animation Animation = animation::CPU_MATRICES;
+    double AnimationTime = 0.0;
+    bool Spin = true;
+    bool Orbit = true;
+    bool Bob = true;
+    float SpinSpeed = 1.f;    // Radians per second
+    float OrbitSpeed = 0.05f; // Radians per second at the mean radius
+    float BobAmplitude = 2.f;
+    float BobFrequency = 1.f; // Radians per second
+    GLuint proceduralProgram = 0;
+    GLuint proceduralCullProgram = 0;
+    GLuint proceduralInstanceVBO = 0;
+    GLuint proceduralVAO = 0;     // Mesh with proceduralInstanceVBO
+    GLuint proceduralCullVAO = 0; // proceduralInstanceVBO as points
+
+    // CPU_SOA animation: same rotation as CPU_MATRICES, the buffer is orphaned and rewritten through glMapBufferRange every frame
+    Instances::transforms_soa soaTransforms;
+    GLuint soaProgram = 0;
+    GLuint soaCullProgram = 0;
+    GLuint soaInstanceVBO = 0;  // Instances::matrix3x4 per instance
+    GLuint soaVAO = 0;          // Mesh with soaInstanceVBO
+    GLuint soaCullVAO = 0;      // soaInstanceVBO as points
+
     bool Wireframe = false;
+
+    void SetProceduralUniforms(GLuint ProgramToSet);
+    void UpdateSoAInstances(float DeltaTime);
+    void CullInstances(const mat4& ViewProj);
 };
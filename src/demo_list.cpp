@@ -0,0 +1,72 @@
+#include <cstring>
+#include <cstdlib>
+#include <typeinfo>
+#include <utility>
+
+#include "opengl_helpers_memory.h"
+
+#include "demo_all.h"
+#include "demo_deferred_shading.h"
+#include "demo_picking.h"
+#include "demo_fbo.h"
+#include "demo_skybox.h"
+#include "demo_shadowMap.h"
+#include "demo_base.h"
+#include "demo_hdr.h"
+#include "demo_npr.h"
+#include "demo_normal_map.h"
+#include "demo_pbr.h"
+#include "demo_instancing.h"
+#include "demo_visibility_buffer.h"
+
+#include "demo_list.h"
+
+// TODO(demo): Add demos here
+
+// Demo constructors allocate their resources under the demo name
+template <typename T, typename... Args>
+static std::unique_ptr<demo> MakeDemo(Args&&... Arguments)
+{
+    GL::memory_owner_scope MemoryOwner(typeid(T).name());
+    return std::make_unique<T>(std::forward<Args>(Arguments)...);
+}
+
+static const demo_info DemoInfos[] =
+{
+    { "pbr",               [](const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug) { return MakeDemo<demo_pbr>(IO, GLCache, GLDebug); } },
+    { "fbo",               [](const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug) { return MakeDemo<demo_fbo>(IO, GLCache, GLDebug); } },
+    { "shadow_map",        [](const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug) { return MakeDemo<demo_shadowMap>(GLCache, GLDebug); } },
+    { "normal_map",        [](const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug) { return MakeDemo<demo_normal_map>(GLCache, GLDebug); } },
+    { "skybox",            [](const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug) { return MakeDemo<demo_skybox>(GLCache, GLDebug); } },
+    { "hdr",               [](const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug) { return MakeDemo<demo_hdr>(IO, GLCache, GLDebug); } },
+    { "npr",               [](const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug) { return MakeDemo<demo_npr>(IO, GLCache, GLDebug); } },
+    { "instancing",        [](const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug) { return MakeDemo<demo_instancing>(GLCache, GLDebug); } },
+    { "all",               [](const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug) { return MakeDemo<demo_all>(IO, GLCache, GLDebug); } },
+    { "picking",           [](const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug) { return MakeDemo<demo_picking>(IO, GLCache, GLDebug); } },
+    { "deferred_shading",  [](const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug) { return MakeDemo<demo_deferred_shading>(IO, GLCache, GLDebug); } },
+    { "base",              [](const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug) { return MakeDemo<demo_base>(GLCache, GLDebug); } },
+    { "visibility_buffer", [](const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug) { return MakeDemo<demo_visibility_buffer>(IO, GLCache, GLDebug); } },
+};
+
+const demo_info* GetDemoInfos(int* CountOut)
+{
+    if (CountOut)
+        *CountOut = (int)ARRAY_SIZE(DemoInfos);
+    return DemoInfos;
+}
+
+int FindDemo(const char* NameOrIndex)
+{
+    for (int i = 0; i < (int)ARRAY_SIZE(DemoInfos); ++i)
+    {
+        if (strcmp(DemoInfos[i].Name, NameOrIndex) == 0)
+            return i;
+    }
+
+    char* End = nullptr;
+    long Index = strtol(NameOrIndex, &End, 10);
+    if (End != NameOrIndex && *End == '\0' && Index >= 0 && Index < (long)ARRAY_SIZE(DemoInfos))
+        return (int)Index;
+
+    return -1;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <memory>
+
+#include "demo.h"
+#include "opengl_helpers.h"
+
+struct demo_info
+{
+    const char* Name; // Used on the command line
+    std::unique_ptr<demo> (*Create)(const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug);
+};
+
+// Demos in display order (CountOut may be null)
+const demo_info* GetDemoInfos(int* CountOut);
+
+// Index from a demo name or index, -1 if not found
+int FindDemo(const char* NameOrIndex);
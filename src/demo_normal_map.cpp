@@ -4,6 +4,7 @@
 #include <imgui.h>
 
 #include "opengl_helpers.h"
+#include "cpu_profiler.h"
 #include "maths.h"
 #include "mesh.h"
 #include "color.h"
@@ -120,6 +121,8 @@ void main()
 demo_normal_map::demo_normal_map(GL::cache& GLCache, GL::debug& GLDebug)
     : GLDebug(GLDebug)
 {
+    PROFILE_FUNCTION();
+
     // Create shader
     {
         // Assemble fragment shader strings (defines + code)
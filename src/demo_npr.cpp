@@ -4,6 +4,7 @@
 #include <imgui.h>
 
 #include "opengl_helpers.h"
+#include "cpu_profiler.h"
 #include "maths.h"
 #include "mesh.h"
 #include "color.h"
@@ -15,6 +16,8 @@
 demo_npr::demo_npr(const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug)
     : GLCache(GLCache), GLDebug(GLDebug)
 {
+    PROFILE_FUNCTION();
+
     // Create render pipeline
     Program = GL::CreateProgramFromFiles("src/shaders/toon_shader.vert", "src/shaders/toon_shader.frag");
 
@@ -70,42 +73,8 @@ demo_npr::demo_npr(const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug
         glUseProgram(0);
     }
 
-    // Generate FBO for outline
+    // Generate outline pass program and quad
     {
-        // Geneate the framebuffer and bind it
-        glGenFramebuffers(1, &OutlineFBO);
-        glBindFramebuffer(GL_FRAMEBUFFER, OutlineFBO);
-
-        // Generate the color attachement texture
-        {
-            glGenTextures(1, &OutlineTexture);
-            glBindTexture(GL_TEXTURE_2D, OutlineTexture);
-
-            {
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, IO.WindowWidth, IO.WindowHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, OutlineTexture, 0);
-
-                //glBindTexture(GL_TEXTURE_2D, 0);
-            }
-
-            // Geneate the renderbuffer and bind it to the framebuffer
-            {
-                glGenRenderbuffers(1, &RenderBuffer);
-                glBindRenderbuffer(GL_RENDERBUFFER, RenderBuffer);
-
-                glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, IO.WindowWidth, IO.WindowHeight);
-
-                glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, RenderBuffer);
-                glBindRenderbuffer(GL_RENDERBUFFER, 0);
-            }
-        }
-
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
         OutlineProgram = GL::CreateProgramFromFiles("src/shaders/outline_shader.vert", "src/shaders/outline_shader.frag");
 
         // Create a descriptor based on the `struct vertex` format
@@ -142,12 +111,10 @@ demo_npr::demo_npr(const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug
 demo_npr::~demo_npr()
 {
     // Cleanup GL
-    glDeleteFramebuffers(1, &OutlineFBO);
     glDeleteBuffers(1, &QuadVBO);
     glDeleteBuffers(1, &VertexBuffer);
     glDeleteVertexArrays(1, &QuadVAO);
     glDeleteVertexArrays(1, &VAO);
-    glDeleteTextures(1, &OutlineTexture);
     glDeleteProgram(OutlineProgram);
     glDeleteProgram(Program);
 }
@@ -175,7 +142,7 @@ void demo_npr::DisplayDebugUI()
     }
 }
 
-void demo_npr::RenderOutline(const mat4& ModelViewProj)
+void demo_npr::RenderOutline(const mat4& ModelViewProj, GLuint OutlineTexture)
 {
     // Change color for depth test for render quad
     glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
@@ -197,21 +164,6 @@ void demo_npr::RenderOutline(const mat4& ModelViewProj)
 
 void demo_npr::Update(const platform_io& IO)
 {
-    if (IO.WindowSizeChanged)
-    {
-        glBindFramebuffer(GL_FRAMEBUFFER, OutlineFBO);
-
-        glBindRenderbuffer(GL_RENDERBUFFER, RenderBuffer);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, IO.WindowWidth, IO.WindowHeight);
-        glBindRenderbuffer(GL_RENDERBUFFER, 0);
-
-        glBindTexture(GL_TEXTURE_2D, OutlineTexture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, IO.WindowWidth, IO.WindowHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-        glBindTexture(GL_TEXTURE_2D, 0);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    }
-
     glViewport(0, 0, IO.WindowWidth, IO.WindowHeight);
 
     Camera = CameraUpdateFreefly(Camera, IO.CameraInputs);
@@ -222,7 +174,13 @@ void demo_npr::Update(const platform_io& IO)
     mat4 ModelMatrix = Mat4::Translate({ 0.f, 0.f, 0.f });
     mat4 NormalMatrix = Mat4::Transpose(Mat4::Inverse(ModelMatrix));
 
-    glBindFramebuffer(GL_FRAMEBUFFER, OutlineFBO);
+    // Scene is rendered offscreen then used by the outline pass
+    GL::render_target_pool& RenderTargets = GLDebug.RenderTargets;
+    const GL::render_target* ColorTarget = RenderTargets.AcquireTexture(GL_RGB8, IO.WindowWidth, IO.WindowHeight);
+    const GL::render_target* DepthStencilTarget = RenderTargets.AcquireRenderbuffer(GL_DEPTH24_STENCIL8, IO.WindowWidth, IO.WindowHeight);
+
+    GLDebug.Profiler.Push("Scene");
+    glBindFramebuffer(GL_FRAMEBUFFER, RenderTargets.GetFramebuffer({ ColorTarget }, DepthStencilTarget));
 
     // Setup GL state
     glEnable(GL_DEPTH_TEST);
@@ -252,10 +210,15 @@ void demo_npr::Update(const platform_io& IO)
     glBindVertexArray(0);
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    RenderTargets.Release(DepthStencilTarget);
 
     glUseProgram(0);
+    GLDebug.Profiler.Pop();
 
-    RenderOutline(Mat4::Identity());
+    GLDebug.Profiler.Push("Outline");
+    RenderOutline(Mat4::Identity(), ColorTarget->Name);
+    GLDebug.Profiler.Pop();
+    RenderTargets.Release(ColorTarget);
 
     DisplayDebugUI();
 }
@@ -13,7 +13,7 @@ public:
     virtual ~demo_npr();
     virtual void Update(const platform_io& IO);
 
-    void RenderOutline(const mat4& ModelViewProj);
+    void RenderOutline(const mat4& ModelViewProj, GLuint OutlineTexture);
 
     void DisplayDebugUI();
 
@@ -22,9 +22,6 @@ private:
     GL::debug& GLDebug;
 
     GLuint OutlineProgram;
-    GLuint OutlineFBO;
-    GLuint OutlineTexture;
-    GLuint RenderBuffer;
 
     GLuint QuadVAO;
     GLuint QuadVBO;
@@ -1,9 +1,13 @@
 #include "demo_pbr.h"
 #include "color.h"
+#include "cpu_profiler.h"
+#include "startup_trace.h"
+#include "opengl_helpers_stats.h"
 #include <imgui.h>
 
 #include "stb_image.h"
 #include <iostream>
+#include <algorithm>
 #include "maths.h"
 
 const int LIGHT_BLOCK_BINDING_POINT = 0;
@@ -11,7 +15,43 @@ const int LIGHT_BLOCK_BINDING_POINT = 0;
 demo_pbr::demo_pbr(const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug)
     : GLDebug(GLDebug)
 {
+    PROFILE_FUNCTION();
+
     SetupScene(GLCache);
+
+    // Build the variants reachable from the debug UI for the current lights
+    {
+        std::vector<GL::shader_variants::variant_key> Keys;
+        for (int i = 0; i < 8; ++i)
+            Keys.push_back(GetVariantKey(i & 1, i & 2, i & 4));
+        ProgramVariants->Precompile(Keys);
+    }
+
+    // Hot-reload (reloading any IBL shader redoes the precompute, PBR variants are watched by ProgramVariants)
+    GLDebug.Shaders.Watch(&sphereMap.Program, "src/shaders/SphereMapShader.vert", "src/shaders/SphereMapShader.frag", false,
+        [this](GLuint NewProgram)
+        {
+            glUseProgram(NewProgram);
+            glUniform1i(glGetUniformLocation(NewProgram, "equirectangularMap"), 0);
+            PBRLoaded = false;
+        });
+    GLDebug.Shaders.Watch(&skybox.Program, "src/shaders/SkyboxShader.vert", "src/shaders/SkyboxShader.frag", false,
+        [](GLuint NewProgram)
+        {
+            glUseProgram(NewProgram);
+            glUniform1i(glGetUniformLocation(NewProgram, "environmentMap"), 0);
+        });
+    GLDebug.Shaders.Watch(&irradiance.Program, "src/shaders/SkyboxShader.vert", "src/shaders/ShaderIrradianceMap.frag", false,
+        [this](GLuint) { PBRLoaded = false; });
+    GLDebug.Shaders.Watch(&prefilterMap.Program, "src/shaders/SkyboxShader.vert", "src/shaders/ShaderPrefilterMap.frag", false,
+        [this](GLuint NewProgram)
+        {
+            glUseProgram(NewProgram);
+            glUniform1i(glGetUniformLocation(NewProgram, "environmentMap"), 0);
+            PBRLoaded = false;
+        });
+    GLDebug.Shaders.Watch(&brdf.Program, "src/shaders/ShaderBRDF.vert", "src/shaders/ShaderBRDF.frag", false,
+        [this](GLuint) { PBRLoaded = false; });
 }
 
 
@@ -42,12 +82,6 @@ void demo_pbr::SetupScene(GL::cache& GLCache)
 
 void demo_pbr::SetupLight()
 {
-    // Set uniforms that won't change
-    {
-        glUseProgram(Program);
-        glUniformBlockBinding(Program, glGetUniformBlockIndex(Program, "uLightBlock"), LIGHT_BLOCK_BINDING_POINT);
-    }
-
     Lights.resize(1);
 
     lightPBR light = {};
@@ -65,24 +99,59 @@ void demo_pbr::SetupLight()
     //this->Lights[3].position = { 10, -10 , 5, 0.f };
 
     // Gen light uniform buffer
-    {
-        glGenBuffers(1, &LightsUniformBuffer);
-        glBindBuffer(GL_UNIFORM_BUFFER, LightsUniformBuffer);
-        glBufferData(GL_UNIFORM_BUFFER, Lights.size() * sizeof(lightPBR), Lights.data(), GL_DYNAMIC_DRAW);
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glGenBuffers(1, &LightsUniformBuffer);
+    UploadLights();
+}
 
+void demo_pbr::UploadLights()
+{
+    // Sort lights by type (directional, point, spot) to match the light loops of the shader, disabled lights are skipped
+    std::vector<lightPBR> SortedLights;
+    for (int LightType = 1; LightType <= 3; ++LightType)
+    {
+        int Count = 0;
+        for (const lightPBR& Light : Lights)
+        {
+            if (Light.lightType == LightType && Count < MAX_LIGHTS_PER_TYPE)
+            {
+                SortedLights.push_back(Light);
+                Count++;
+            }
+        }
+        LightCounts[LightType - 1] = Count;
     }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, LightsUniformBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, std::max((size_t)1, SortedLights.size()) * sizeof(lightPBR), SortedLights.empty() ? nullptr : SortedLights.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+GL::shader_variants::variant_key demo_pbr::GetVariantKey(bool HasNormalMap, bool HasIBL, bool HasClearCoat) const
+{
+    return ProgramVariants->GetKey({ LightCounts[0], LightCounts[1], LightCounts[2], HasNormalMap, HasIBL, HasClearCoat });
 }
 
 
 void demo_pbr::SetupSphere(GL::cache& GLCache)
 {
     {
-        Program = GL::CreateProgramFromFiles("src/shaders/ShaderPBR.vert", "src/shaders/ShaderPBR.frag");
+        // Light counts per type and material features are compile-time keywords
+        std::vector<GL::shader_keyword> Keywords =
+        {
+            { "DIRECTIONAL_LIGHT_COUNT", MAX_LIGHTS_PER_TYPE },
+            { "POINT_LIGHT_COUNT",       MAX_LIGHTS_PER_TYPE },
+            { "SPOT_LIGHT_COUNT",        MAX_LIGHTS_PER_TYPE },
+            { "HAS_NORMAL_MAP",          1 },
+            { "HAS_IBL",                 1 },
+            { "HAS_CLEAR_COAT",          1 },
+        };
+        ProgramVariants = std::make_unique<GL::shader_variants>("src/shaders/ShaderPBR.vert", "src/shaders/ShaderPBR.frag", Keywords,
+            [](GLuint NewProgram) { SetupProgramUniforms(NewProgram); }, &GLDebug.Shaders);
 
         {
             // Use vbo from GLCache
             sphere.MeshBuffer = GLCache.LoadObj("media/Gun/Gun.obj", 1.f, &sphere.MeshVertexCount);
+            sphere.Bounds = GLCache.FindMeshInfo("media/Gun/Gun.obj")->Bounds;
 
             sphere.MeshDesc.Stride = sizeof(vertex_full);
             sphere.MeshDesc.HasNormal = true;
@@ -120,6 +189,8 @@ void demo_pbr::SetupSphere(GL::cache& GLCache)
         materialPBR.metallic = 1.f;
         materialPBR.roughness = 1.f;
         materialPBR.ao = 1.f; //Ambient occlusion
+        materialPBR.clearCoat = 0.f;
+        materialPBR.clearCoatRoughness = 0.f;
         materialPBR.hasNormal = true;
         irradiance.hasIrradianceMap = true;
 
@@ -227,20 +298,22 @@ void demo_pbr::SetupSphere(GL::cache& GLCache)
     //
     //}
 
-    // Set uniforms that won't change
-    {
-        glUseProgram(Program);
-        glUniform1i(glGetUniformLocation(Program, "uMaterial.albedoMap"), 0);
-        glUniform1i(glGetUniformLocation(Program, "uMaterial.normalMap"), 1);
-        glUniform1i(glGetUniformLocation(Program, "uMaterial.specularMap"), 2);
-        glUniform1i(glGetUniformLocation(Program, "uMaterial.metallicMap"), 3);
-        glUniform1i(glGetUniformLocation(Program, "uMaterial.roughnessMap"), 4);
-        glUniform1i(glGetUniformLocation(Program, "uMaterial.aoMap"), 5);
-        glUniform1i(glGetUniformLocation(Program, "irradianceMap"), 6);
-        glUniform1i(glGetUniformLocation(Program, "prefilterMap"), 7);
-        glUniform1i(glGetUniformLocation(Program, "brdfLUT"), 8);
-    }
+}
 
+void demo_pbr::SetupProgramUniforms(GLuint Program)
+{
+    // Set uniforms that won't change
+    glUseProgram(Program);
+    glUniformBlockBinding(Program, glGetUniformBlockIndex(Program, "uLightBlock"), LIGHT_BLOCK_BINDING_POINT);
+    glUniform1i(glGetUniformLocation(Program, "uMaterial.albedoMap"), 0);
+    glUniform1i(glGetUniformLocation(Program, "uMaterial.normalMap"), 1);
+    glUniform1i(glGetUniformLocation(Program, "uMaterial.specularMap"), 2);
+    glUniform1i(glGetUniformLocation(Program, "uMaterial.metallicMap"), 3);
+    glUniform1i(glGetUniformLocation(Program, "uMaterial.roughnessMap"), 4);
+    glUniform1i(glGetUniformLocation(Program, "uMaterial.aoMap"), 5);
+    glUniform1i(glGetUniformLocation(Program, "irradianceMap"), 6);
+    glUniform1i(glGetUniformLocation(Program, "prefilterMap"), 7);
+    glUniform1i(glGetUniformLocation(Program, "brdfLUT"), 8);
 }
 
 void demo_pbr::SetupCube(GL::cache& GLCache)
@@ -312,25 +385,28 @@ void demo_pbr::SetupSphereMap(GL::cache& GLCache)
     sphereMap.Program = GL::CreateProgramFromFiles("src/shaders/SphereMapShader.vert", "src/shaders/SphereMapShader.frag");
     //Load HDR spheremap
 
-    stbi_set_flip_vertically_on_load(true);
-    int width, height, nrComponents;
-    float* data = stbi_loadf("media/14-Hamarikyu_Bridge_B_3k.hdr", &width, &height, &nrComponents, 0);
-    if (data)
     {
-        glGenTextures(1, &sphereMap.hdrTexture);
-        glBindTexture(GL_TEXTURE_2D, sphereMap.hdrTexture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
+        STARTUP_ASSET(TEXTURE, "media/14-Hamarikyu_Bridge_B_3k.hdr");
+        stbi_set_flip_vertically_on_load(true);
+        int width, height, nrComponents;
+        float* data = stbi_loadf("media/14-Hamarikyu_Bridge_B_3k.hdr", &width, &height, &nrComponents, 0);
+        if (data)
+        {
+            glGenTextures(1, &sphereMap.hdrTexture);
+            glBindTexture(GL_TEXTURE_2D, sphereMap.hdrTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Failed to load HDR image." << std::endl;
+            stbi_image_free(data);
+        }
+        else
+        {
+            std::cout << "Failed to load HDR image." << std::endl;
+        }
     }
 
     //Capture 6 face of a sphereMap to convert in cubemap
@@ -429,6 +505,12 @@ void demo_pbr::SetupBDRF()
 
 demo_pbr::~demo_pbr()
 {
+    GLDebug.Shaders.Unwatch(&sphereMap.Program);
+    GLDebug.Shaders.Unwatch(&skybox.Program);
+    GLDebug.Shaders.Unwatch(&irradiance.Program);
+    GLDebug.Shaders.Unwatch(&prefilterMap.Program);
+    GLDebug.Shaders.Unwatch(&brdf.Program);
+
     glDeleteTextures(1, &materialPBR.normalMap);
     glDeleteTextures(1, &materialPBR.albedoMap);
     glDeleteTextures(1, &materialPBR.specularMap);
@@ -441,7 +523,6 @@ demo_pbr::~demo_pbr()
     glDeleteBuffers(1, &LightsUniformBuffer);
 
     glDeleteVertexArrays(1, &VAO);
-    glDeleteProgram(Program);
 }
 
 void demo_pbr::SetupPBR()
@@ -461,6 +542,7 @@ void demo_pbr::SetupPBR()
 
     //Setup spheremap
     {
+        GL::gpu_scope Scope(GLDebug.Profiler, "Equirect to cubemap");
         // convert HDR equirectangular environment map to cubemap equivalent
         glUseProgram(sphereMap.Program);
         glUniformMatrix4fv(glGetUniformLocation(sphereMap.Program, "uProjection"), 1, GL_FALSE, captureProjectionMatrix.e);
@@ -490,6 +572,7 @@ void demo_pbr::SetupPBR()
 
     //Setup Irradiancemap
     {
+        GL::gpu_scope Scope(GLDebug.Profiler, "Irradiance map");
         glUseProgram(irradiance.Program);
 
         //irradianceShader.setInt("environmentMap", 0);
@@ -517,6 +600,7 @@ void demo_pbr::SetupPBR()
 
     //Setup prefilterMap
     {
+        GL::gpu_scope Scope(GLDebug.Profiler, "Prefilter map");
         glUseProgram(prefilterMap.Program);
         //prefilterShader.setInt("environmentMap", 0);
         glUniformMatrix4fv(glGetUniformLocation(prefilterMap.Program, "uProjection"), 1, GL_FALSE, captureProjectionMatrix.e);
@@ -557,6 +641,7 @@ void demo_pbr::SetupPBR()
 
     //Setup BRDF
     {
+        GL::gpu_scope Scope(GLDebug.Profiler, "BRDF LUT");
         glBindFramebuffer(GL_FRAMEBUFFER, sphereMap.captureFBO);
         glBindRenderbuffer(GL_RENDERBUFFER, sphereMap.captureRBO);
         glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, brdf.resolution, brdf.resolution);
@@ -580,7 +665,11 @@ void demo_pbr::SetupPBR()
 void demo_pbr::Update(const platform_io& IO)
 {
     if (!PBRLoaded)
+    {
+        GL::gpu_scope Scope(GLDebug.Profiler, "IBL precompute");
+        STARTUP_PHASE("IBL precompute");
         SetupPBR();
+    }
 
     //Render Scene
     const float AspectRatio = (float)IO.WindowWidth / (float)IO.WindowHeight;
@@ -595,32 +684,54 @@ void demo_pbr::Update(const platform_io& IO)
     mat4 ProjectionMatrix = Mat4::Perspective(Math::ToRadians(60.f), AspectRatio, 0.1f, 100.f);
     mat4 ViewMatrix = CameraGetInverseMatrix(Camera);
 
-    if (enableSceneMultiSphere)
+    //Render Spheres
     {
-        for (int i = 0; i < sphereCount; i++)
+        GL::gpu_scope Scope(GLDebug.Profiler, "Spheres");
+        if (enableSceneMultiSphere)
         {
-            for (int j = 0; j < sphereCount; j++)
+            // Skip the spheres outside the view frustum
+            sphereBounds.Clear();
+            for (int i = 0; i < sphereCount; i++)
+            {
+                for (int j = 0; j < sphereCount; j++)
+                    sphereBounds.Add(Culling::TransformBounds(sphere.Bounds, Mat4::Translate({ origin + marging * i, origin + marging * j, offsetZ })));
+            }
+            sphereVisible.assign(sphereBounds.GetCount(), 1);
+            if (Culling::Enabled)
+            {
+                int VisibleCount = Culling::CullBoxes(Culling::ExtractFrustum(ProjectionMatrix * ViewMatrix), sphereBounds, sphereVisible.data());
+                GL::CountCulling(VisibleCount, sphereBounds.GetCount() - VisibleCount);
+            }
+
+            for (int i = 0; i < sphereCount; i++)
             {
-                mat4 ModelMatrix = Mat4::Translate({ origin + marging * i, origin + marging * j, offsetZ });
+                for (int j = 0; j < sphereCount; j++)
+                {
+                    if (!sphereVisible[i * sphereCount + j])
+                        continue;
+
+                    mat4 ModelMatrix = Mat4::Translate({ origin + marging * i, origin + marging * j, offsetZ });
 
-                materialPBR.roughness = ((1 / (float)sphereCount) * i);
-                materialPBR.metallic = ((1 / (float)sphereCount) * j);
+                    materialPBR.roughness = ((1 / (float)sphereCount) * i);
+                    materialPBR.metallic = ((1 / (float)sphereCount) * j);
 
-                // Render tavern
-                RenderSphere(ProjectionMatrix, ViewMatrix, ModelMatrix);
+                    // Render tavern
+                    RenderSphere(ProjectionMatrix, ViewMatrix, ModelMatrix);
+                }
             }
         }
-    }
-    else
-    {
-        mat4 ModelMatrix = Mat4::Translate({ 0,0,-5 });
+        else
+        {
+            mat4 ModelMatrix = Mat4::Translate({ 0,0,-5 });
 
-        // Render tavern
-        RenderSphere(ProjectionMatrix, ViewMatrix, ModelMatrix);
+            // Render tavern
+            RenderSphere(ProjectionMatrix, ViewMatrix, ModelMatrix);
+        }
     }
 
     //Render Skybox
     {
+        GL::gpu_scope Scope(GLDebug.Profiler, "Skybox");
         glDepthFunc(GL_LEQUAL);
         glCullFace(GL_FRONT);
         // convert HDR equirectangular environment map to cubemap equivalent
@@ -646,7 +757,8 @@ void demo_pbr::RenderSphere(const mat4& ProjectionMatrix, const mat4& ViewMatrix
 {
     glEnable(GL_DEPTH_TEST);
 
-    // Use shader and configure its uniforms
+    // Use the variant matching the lights and material features
+    GLuint Program = ProgramVariants->GetProgram(GetVariantKey(materialPBR.hasNormal, irradiance.hasIrradianceMap, materialPBR.clearCoat != 0.f));
     glUseProgram(Program);
 
     // Set uniforms
@@ -658,8 +770,6 @@ void demo_pbr::RenderSphere(const mat4& ProjectionMatrix, const mat4& ViewMatrix
     glUniformMatrix4fv(glGetUniformLocation(Program, "uModelNormalMatrix"), 1, GL_FALSE, NormalMatrix.e);
     glUniform3fv(glGetUniformLocation(Program, "uViewPosition"), 1, Camera.Position.e);
 
-    glUniform1i(glGetUniformLocation(Program, "uMaterial.hasNormalMap"), materialPBR.hasNormal);
-    glUniform1i(glGetUniformLocation(Program, "hasIrradianceMap"), irradiance.hasIrradianceMap);
     glUniform3fv(glGetUniformLocation(Program, "uMaterial.albedo"), 1, materialPBR.albedo.e);
     glUniform1f(glGetUniformLocation(Program, "uMaterial.specular"), materialPBR.specular);
     glUniform1f(glGetUniformLocation(Program, "uMaterial.metallic"), materialPBR.metallic);
@@ -715,7 +825,7 @@ static bool EditLight(lightPBR* Light)
     float outerCutOff = Math::ToDegrees(acosf(Light->params.e[1]));
 
     bool Result =
-        ImGui::SliderInt("Light Type", &Light->lightType, 0, 4)
+        ImGui::SliderInt("Light Type", &Light->lightType, 0, 3)
         + ImGui::SliderFloat4("Position", Light->position.e, -4.f, 4.f)
         + ImGui::SliderFloat3("Rotation", Light->direction.e, -4.f, 4.f)
         + ImGui::ColorEdit3("Diffuse", Light->diffuse.e)
@@ -752,14 +862,25 @@ void demo_pbr::DisplayDebugUI()
                 {
                     lightPBR& Light = Lights[i];
                     if (EditLight(&Light))
-                    {
-                        glBindBuffer(GL_UNIFORM_BUFFER, LightsUniformBuffer);
-                        glBufferSubData(GL_UNIFORM_BUFFER, i * sizeof(lightPBR), sizeof(lightPBR), &Light);
-                        glBindBuffer(GL_UNIFORM_BUFFER, 0);
-                    }
+                        UploadLights();
                     ImGui::TreePop();
                 }
             }
+
+            if (ImGui::Button("Add light"))
+            {
+                Lights.push_back(Lights.empty() ? lightPBR{} : Lights.back());
+                UploadLights();
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Remove light") && !Lights.empty())
+            {
+                Lights.pop_back();
+                UploadLights();
+            }
+
+            ImGui::Text("Lights (dir/point/spot): %d/%d/%d", LightCounts[0], LightCounts[1], LightCounts[2]);
+            ImGui::Text("Compiled variants: %d", ProgramVariants->GetVariantCount());
             ImGui::TreePop();
         }
 
@@ -1,5 +1,6 @@
 #pragma once
 #include <array>
+#include <memory>
 
 #include "demo.h"
 
@@ -8,6 +9,8 @@
 #include "camera.h"
 
 #include "opengl_helpers.h"
+#include "opengl_helpers_shader_variants.h"
+#include "culling.h"
 
 struct vertex
 {
@@ -59,6 +62,7 @@ class demo_pbr : public demo
         GLuint MeshBuffer = 0;
         int MeshVertexCount = 0;
         vertex_descriptor MeshDesc;
+        Mesh::bounds Bounds; // Model space
     };
 
     struct SphereMap
@@ -114,11 +118,13 @@ public:
 
     void SetupScene(GL::cache& GLCache);
     void SetupSphere(GL::cache& GLCache);
+    static void SetupProgramUniforms(GLuint Program);
     void SetupCube(GL::cache& GLCache);
     void SetupQuad(GL::cache& GLCache);
     void SetupSphereMap(GL::cache& GLCache);
     void SetupSkybox();
     void SetupLight();
+    void UploadLights();
     void SetupIrradianceMap();
     void SetupPrefilterMap();
     void SetupBDRF();
@@ -128,6 +134,7 @@ public:
     virtual ~demo_pbr();
     virtual void Update(const platform_io& IO);
 
+    GL::shader_variants::variant_key GetVariantKey(bool HasNormalMap, bool HasIBL, bool HasClearCoat) const;
     void RenderSphere(const mat4& ProjectionMatrix, const mat4& ViewMatrix, const mat4& ModelMatrix);
     void DisplayDebugUI();
 
@@ -137,8 +144,10 @@ private:
     // 3d camera
     camera Camera = {};
 
+    static const int MAX_LIGHTS_PER_TYPE = 8;
+
     // GL objects needed by this demos
-    GLuint Program = 0;
+    std::unique_ptr<GL::shader_variants> ProgramVariants;
     GLuint VAO = 0;
     MaterialPBR materialPBR;
 
@@ -157,8 +166,13 @@ private:
     int sphereCount;
     float origin;
 
+    // World-space bounds of the grid spheres and their visibility, rebuilt every frame
+    Culling::bounds_soa sphereBounds;
+    std::vector<uint8_t> sphereVisible;
+
     std::vector<lightPBR> Lights;
     GLuint LightsUniformBuffer = 0;
+    int LightCounts[3] = {}; // Directional/point/spot lights in the uniform buffer
 
     bool PBRLoaded = false;
 };
@@ -1,11 +1,14 @@
 
 #include <vector>
+#include <algorithm>
 
 #include <imgui.h>
 
 #include "opengl_helpers.h"
+#include "cpu_profiler.h"
 #include "maths.h"
 #include "mesh.h"
+#include "opengl_helpers_stats.h"
 #include "color.h"
 
 #include "demo_picking.h"
@@ -102,6 +105,8 @@ void main()
 demo_picking::demo_picking(const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug)
     : GLCache(GLCache), GLDebug(GLDebug), TavernScene(GLCache)
 {
+    PROFILE_FUNCTION();
+
     // Create shader
     {
         // Assemble fragment shader strings (defines + code)
@@ -162,31 +167,6 @@ demo_picking::demo_picking(const platform_io& IO, GL::cache& GLCache, GL::debug&
         glBindVertexArray(0);
         //glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-        // Generate FBO for outline
-        {
-            // Geneate the framebuffer and bind it
-            glGenFramebuffers(1, &Picking.FBO);
-            glBindFramebuffer(GL_FRAMEBUFFER, Picking.FBO);
-
-            // Generate the color attachement texture
-            {
-                glGenTextures(1, &Picking.Texture);
-                glBindTexture(GL_TEXTURE_2D, Picking.Texture);
-
-                {
-                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, IO.WindowWidth, IO.WindowHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-
-                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-                    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, Picking.Texture, 0);
-
-                    //glBindTexture(GL_TEXTURE_2D, 0);
-                }
-            }
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        }
-
         float offset = 4.f;
         int id = 1;
         for (int x = 0; x < 10; x++)
@@ -199,10 +179,12 @@ demo_picking::demo_picking(const platform_io& IO, GL::cache& GLCache, GL::debug&
                 modelBasic.ID.b = (id & 0x00FF0000) >> 16;
 
                 models.push_back(modelBasic);
+                modelBounds.Add(Culling::TransformBounds(GLCache.FindMeshInfo("media/backpack.obj")->Bounds, Mat4::Translate(modelBasic.position)));
 
                 id++;
             }
         }
+        modelVisible.resize(models.size(), 1);
     }
 }
 
@@ -215,11 +197,7 @@ demo_picking::~demo_picking()
         glDeleteVertexArrays(1, &model.VAO);
     }
 
-    {
-        glDeleteFramebuffers(1, &Picking.FBO);
-        glDeleteTextures(1, &Picking.Texture);
-        glDeleteProgram(Picking.Program);
-    }
+    glDeleteProgram(Picking.Program);
     
     glDeleteProgram(Program);
 
@@ -267,18 +245,22 @@ void demo_picking::RenderOutline(const mat4& ModelViewProj)
     glDrawArrays(GL_TRIANGLES, 0, 6);
 }
 
-void demo_picking::RenderPickingTexture(const mat4 ViewProj)
+void demo_picking::RenderPickingTexture(const mat4 ViewProj, GLuint FBO)
 {
     glUseProgram(Picking.Program);
 
     glUniformMatrix4fv(glGetUniformLocation(Picking.Program, "uViewProjection"), 1, GL_FALSE, ViewProj.e);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, Picking.FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
     
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    for (auto& model : models)
+    for (size_t i = 0; i < models.size(); ++i)
     {
+        const Model& model = models[i];
+        if (!modelVisible[i])
+            continue;
+
         mat4 ModelMatrix = Mat4::Translate(model.position);
 
         // Bind uniform buffer and textures
@@ -301,6 +283,8 @@ void demo_picking::Update(const platform_io& IO)
 
     Camera = CameraUpdateFreefly(Camera, IO.CameraInputs);
 
+    GLDebug.Profiler.Push("Scene");
+
     // Clear screen
     glClearColor(0.f, 0.f, 0.f, 1.f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -318,9 +302,22 @@ void demo_picking::Update(const platform_io& IO)
     glUniform3fv(glGetUniformLocation(Program, "uViewPosition"), 1, Camera.Position.e);
     glUniformMatrix4fv(glGetUniformLocation(Program, "uView"), 1, GL_FALSE, ViewMatrix.e);
 
+    // Models outside the view frustum are skipped (picking pass included)
+    if (Culling::Enabled)
+    {
+        int VisibleCount = Culling::CullBoxes(Culling::ExtractFrustum(ProjectionMatrix * ViewMatrix), modelBounds, modelVisible.data());
+        GL::CountCulling(VisibleCount, (int)models.size() - VisibleCount);
+    }
+    else
+    {
+        std::fill(modelVisible.begin(), modelVisible.end(), 1);
+    }
+
     v3 color = { 1.f, 1.f, 1.f };
     for (int i = 0; i < models.size(); i++)
     {
+        if (!modelVisible[i])
+            continue;
 
         if (Picking.PickedID != -1 && i == Picking.PickedID)
             color = { 1.0, 0.0, 0.0 };
@@ -345,11 +342,21 @@ void demo_picking::Update(const platform_io& IO)
         color = { 1.f, 1.f, 1.f };
     }
 
+    GLDebug.Profiler.Pop();
+
     //RenderPickingTexture(ProjectionMatrix * ViewMatrix);
 
+    // Acquired every frame to display it in the debug UI (the pool gives back the same texture while the size does not change)
+    GL::render_target_pool& RenderTargets = GLDebug.RenderTargets;
+    const GL::render_target* PickingTarget = RenderTargets.AcquireTexture(GL_RGB8, IO.WindowWidth, IO.WindowHeight);
+    Picking.Texture = PickingTarget->Name;
+
     if (ImGui::IsMouseClicked(ImGuiMouseButton_Left))
     {
-        RenderPickingTexture(ProjectionMatrix * ViewMatrix);
+        const GL::render_target* DepthTarget = RenderTargets.AcquireRenderbuffer(GL_DEPTH_COMPONENT24, IO.WindowWidth, IO.WindowHeight);
+        GLDebug.Profiler.Push("Picking");
+        RenderPickingTexture(ProjectionMatrix * ViewMatrix, RenderTargets.GetFramebuffer({ PickingTarget }, DepthTarget));
+        GLDebug.Profiler.Pop();
 
         ImVec2 mousePos = ImGui::GetMousePos();
 
@@ -368,6 +375,7 @@ void demo_picking::Update(const platform_io& IO)
         Picking.PickedID = pickedID - 1;
 
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        RenderTargets.Release(DepthTarget);
     }
     
     glDisable(GL_DEPTH_TEST);
@@ -8,6 +8,7 @@
 
 #include "camera.h"
 #include "tavern_scene.h"
+#include "culling.h"
 
 struct Model
 {
@@ -24,8 +25,7 @@ class demo_picking : public demo
 {
     struct picking
     {
-        GLuint FBO;
-        GLuint Texture;
+        GLuint Texture = 0; // Pooled target, only valid during the current frame
         GLuint Program;
         int PickedID = -1;
     };
@@ -36,7 +36,7 @@ public:
     virtual void Update(const platform_io& IO);
 
     void RenderOutline(const mat4& ModelViewProj);
-    void RenderPickingTexture(const mat4 ViewProj);
+    void RenderPickingTexture(const mat4 ViewProj, GLuint FBO);
 
     void DisplayDebugUI(const platform_io& IO);
 
@@ -49,6 +49,10 @@ private:
 
     std::vector<Model> models;
 
+    // World-space bounds of the models, visibility of the current frame
+    Culling::bounds_soa modelBounds;
+    std::vector<uint8_t> modelVisible;
+
     // 3d camera
     camera Camera = {};
 
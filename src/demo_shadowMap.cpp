@@ -4,6 +4,7 @@
 #include <imgui.h>
 
 #include "opengl_helpers.h"
+#include "cpu_profiler.h"
 #include "maths.h"
 #include "mesh.h"
 #include "color.h"
@@ -166,6 +167,8 @@ void main()
 demo_shadowMap::demo_shadowMap(GL::cache& GLCache, GL::debug& GLDebug)
     : GLDebug(GLDebug), TavernScene(GLCache)//DemoBase(GLCache, GLDebug)
 {
+    PROFILE_FUNCTION();
+
     // Create shader
     {
         // Assemble fragment shader strings (defines + code)
@@ -215,29 +218,13 @@ demo_shadowMap::demo_shadowMap(GL::cache& GLCache, GL::debug& GLDebug)
 
     Shadow.Program = GL::CreateProgramFromFiles("src/shaders/shadow_shader.vert", "src/shaders/shadow_shader.frag");
 
-    // Generate shadow map
-    glGenFramebuffers(1, &Shadow.FBO);
-
-    // Generate shadow texture
-    glGenTextures(1, &Shadow.ID);
-    glBindTexture(GL_TEXTURE_2D, Shadow.ID);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, Shadow.width, Shadow.height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    // Clamp to border for deactivate frustum shadows
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    float borderColor[] = { 1.f, 1.f, 1.f, 1.f };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-    // Attach texture to framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, Shadow.FBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, Shadow.ID, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    float BorderColor[] = { 1.f, 1.f, 1.f, 1.f };
+    glGenSamplers(1, &Shadow.Sampler);
+    glSamplerParameteri(Shadow.Sampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glSamplerParameteri(Shadow.Sampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glSamplerParameteri(Shadow.Sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glSamplerParameteri(Shadow.Sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glSamplerParameterfv(Shadow.Sampler, GL_TEXTURE_BORDER_COLOR, BorderColor);
 
     /* //Generate VAO
     glGenVertexArrays(1, &Shadow.VAO);
@@ -255,10 +242,10 @@ demo_shadowMap::demo_shadowMap(GL::cache& GLCache, GL::debug& GLDebug)
 demo_shadowMap::~demo_shadowMap()
 {
     // Cleanup GL
-    if (Shadow.ID)
-        glDeleteTextures(1, &Shadow.ID);
-    if (Shadow.FBO)
-
+    if (Shadow.Program)
+        glDeleteProgram(Shadow.Program);
+    if (Shadow.Sampler)
+        glDeleteSamplers(1, &Shadow.Sampler);
     if (VertexBuffer)
         glDeleteBuffers(1, &VertexBuffer);
     if (VAO)
@@ -293,9 +280,14 @@ void demo_shadowMap::CreateShadowTexture(const platform_io& IO)
     glUniformMatrix4fv(glGetUniformLocation(Shadow.Program, "uModel"), 1, GL_FALSE, ModelMatrix.e);
     glUniformMatrix4fv(glGetUniformLocation(Shadow.Program, "uLightSpaceMatrix"), 1, GL_FALSE, lightSpaceMatrix.e);
 
+    // Depth only target from the pool, sampled through Shadow.Sampler (the pool owns its texture parameters)
+    GL::render_target_pool& RenderTargets = GLDebug.RenderTargets;
+    const GL::render_target* ShadowTarget = RenderTargets.AcquireTexture(GL_DEPTH_COMPONENT24, Shadow.width, Shadow.height);
+    Shadow.ID = ShadowTarget->Name;
+
     // Set shadow texture viewport
     glViewport(0, 0, Shadow.width, Shadow.height);
-    glBindFramebuffer(GL_FRAMEBUFFER, Shadow.FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, RenderTargets.GetFramebuffer({}, ShadowTarget));
 
     glClear(GL_DEPTH_BUFFER_BIT);
 
@@ -344,11 +336,14 @@ void demo_shadowMap::RenderTavern(const platform_io& IO)
     glBindTexture(GL_TEXTURE_2D, TavernScene.EmissiveTexture);
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, Shadow.ID);
+    glBindSampler(2, Shadow.Sampler);
     glActiveTexture(GL_TEXTURE0); // Reset active texture just in case
 
     // Draw mesh
     glBindVertexArray(VAO);
     glDrawArrays(GL_TRIANGLES, 0, TavernScene.MeshVertexCount);
+
+    glBindSampler(2, 0);
 }
 
 void demo_shadowMap::Update(const platform_io& IO)
@@ -359,8 +354,14 @@ void demo_shadowMap::Update(const platform_io& IO)
 
     glEnable(GL_DEPTH_TEST);
 
-    CreateShadowTexture(IO);
-    RenderTavern(IO);
+    {
+        GL::gpu_scope Scope(GLDebug.Profiler, "Shadow map");
+        CreateShadowTexture(IO);
+    }
+    {
+        GL::gpu_scope Scope(GLDebug.Profiler, "Scene");
+        RenderTavern(IO);
+    }
 
     glDisable(GL_DEPTH_TEST);
 
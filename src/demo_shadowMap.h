@@ -20,9 +20,9 @@ class demo_shadowMap : public demo
         float superSample = 3.f;
         float aspect = 0.f;
 
-        GLuint FBO;
         GLuint VAO;
-        GLuint ID;
+        GLuint ID = 0; // Pooled target, only valid during the current frame
+        GLuint Sampler = 0; // Clamp to a far border: no shadow outside of the light frustum, the pooled texture is left untouched
         GLuint Program;
     };
 
@@ -5,6 +5,8 @@
 #include <stb_image.h>
 
 #include "opengl_helpers.h"
+#include "cpu_profiler.h"
+#include "startup_trace.h"
 #include "maths.h"
 #include "mesh.h"
 #include "color.h"
@@ -35,6 +37,8 @@ static const std::string skyboxFaces[6] = {
 demo_skybox::demo_skybox(GL::cache& GLCache, GL::debug& GLDebug)
     : GLDebug(GLDebug), DemoBase(GLCache, GLDebug)
 {
+    PROFILE_FUNCTION();
+
     // Generate ID texture
     glGenTextures(1, &Skybox.ID);
     glBindTexture(GL_TEXTURE_CUBE_MAP, Skybox.ID);
@@ -46,6 +50,7 @@ demo_skybox::demo_skybox(GL::cache& GLCache, GL::debug& GLDebug)
     // Load and generate skybox faces
     for (unsigned int i = 0; i < 6; i++)
     {
+        STARTUP_ASSET(TEXTURE, skyboxFaces[i].c_str());
         int dimX, dimY;
         unsigned char* data = stbi_load(skyboxFaces[i].c_str(), &dimX, &dimY, &channel, 4);
 
@@ -0,0 +1,423 @@
+#include <cstdio>
+#include <vector>
+
+#include <imgui.h>
+
+#include "opengl_helpers.h"
+#include "cpu_profiler.h"
+
+#include "maths.h"
+#include "mesh.h"
+
+#include "demo_visibility_buffer.h"
+
+const int LIGHT_CLUSTERS_TEXTURE_UNIT = 5;
+
+// Visibility encoding: (draw ID + 1) in the top 8 bits (0 is the background), triangle ID in the 24 low bits
+const int MAX_DRAW_COUNT = 255;
+const int MAX_TRIANGLE_COUNT = 1 << 24;
+
+// vertex_full in RG32F texels (Position.xy | Position.z, Normal.x | Normal.yz | UV | Tangent, Bitangent...)
+const int VERTEX_TEXEL_COUNT = sizeof(vertex_full) / (2 * sizeof(float));
+static_assert(sizeof(vertex_full) == VERTEX_TEXEL_COUNT * 2 * sizeof(float), "vertex_full must be made of RG32F texels");
+
+static const char* gVisibilityVertexShaderStr = R"GLSL(
+#version 330 core
+
+// Attributes
+layout(location = 0) in vec3 aPosition;
+
+// Uniforms
+uniform mat4 uProjection;
+uniform mat4 uModel;
+uniform mat4 uView;
+
+void main()
+{
+    gl_Position = uProjection * uView * uModel * vec4(aPosition, 1.0);
+})GLSL";
+
+static const char* gVisibilityFragmentShaderStr = R"GLSL(
+#version 330 core
+
+// Uniforms
+uniform uint uDrawID;
+
+// Shader outputs
+layout (location = 0) out uint oVisibility; // R32UI
+
+void main()
+{
+    // gl_PrimitiveID counts the triangles of the draw call
+    oVisibility = ((uDrawID + 1u) << 24) | uint(gl_PrimitiveID);
+})GLSL";
+
+static const char* gResolveVertexShaderStr = R"GLSL(
+#version 330 core
+
+void main()
+{
+    // Fullscreen triangle
+    vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+})GLSL";
+
+static const char* gResolveFragmentShaderStr = R"GLSL(
+// MAX_DRAW_COUNT and VERTEX_TEXEL_COUNT are defined from the C++ constants
+
+// Uniforms
+uniform usampler2D uVisibility;
+uniform usamplerBuffer uIndices;  // R32UI
+uniform samplerBuffer uVertices;  // RG32F, VERTEX_TEXEL_COUNT per vertex
+uniform int uDrawFirstIndex[MAX_DRAW_COUNT];
+
+uniform mat4 uProjection;
+uniform mat4 uModel;
+uniform mat4 uView;
+uniform mat4 uModelNormalMatrix;
+uniform vec3 uViewPosition;
+uniform bool uShowTriangleIDs;
+
+uniform sampler2D uDiffuseTexture;
+uniform sampler2D uEmissiveTexture;
+
+// Shader outputs
+out vec4 oColor;
+
+struct vertex
+{
+    vec3 position;
+    vec3 normal;
+    vec2 uv;
+};
+
+vertex fetchVertex(int index)
+{
+    int texel = index * VERTEX_TEXEL_COUNT;
+    vec2 t0 = texelFetch(uVertices, texel + 0).rg;
+    vec2 t1 = texelFetch(uVertices, texel + 1).rg;
+    vec2 t2 = texelFetch(uVertices, texel + 2).rg;
+    vec2 t3 = texelFetch(uVertices, texel + 3).rg;
+
+    vertex v;
+    v.position = vec3(t0, t1.x);
+    v.normal = vec3(t1.y, t2);
+    v.uv = t3;
+    return v;
+}
+
+// Perspective-correct barycentrics of the pixel and their change for a one pixel step in x and y
+struct barycentrics
+{
+    vec3 lambda;
+    vec3 ddx;
+    vec3 ddy;
+    float w; // Interpolated clip w (view depth)
+};
+
+barycentrics computeBarycentrics(vec4 p0, vec4 p1, vec4 p2, vec2 ndc, vec2 viewportSize)
+{
+    vec3 invW = 1.0 / vec3(p0.w, p1.w, p2.w);
+    vec2 ndc0 = p0.xy * invW.x;
+    vec2 ndc1 = p1.xy * invW.y;
+    vec2 ndc2 = p2.xy * invW.z;
+
+    // Screen-space gradients of lambda / w (linear in screen space)
+    float invDet = 1.0 / determinant(mat2(ndc2 - ndc1, ndc0 - ndc1));
+    vec3 ddx = vec3(ndc1.y - ndc2.y, ndc2.y - ndc0.y, ndc0.y - ndc1.y) * invDet * invW;
+    vec3 ddy = vec3(ndc2.x - ndc1.x, ndc0.x - ndc2.x, ndc1.x - ndc0.x) * invDet * invW;
+    float ddxSum = dot(ddx, vec3(1.0));
+    float ddySum = dot(ddy, vec3(1.0));
+
+    vec2 delta = ndc - ndc0;
+    float interpInvW = invW.x + delta.x * ddxSum + delta.y * ddySum;
+
+    barycentrics result;
+    result.w = 1.0 / interpInvW;
+    result.lambda = result.w * (vec3(invW.x, 0.0, 0.0) + delta.x * ddx + delta.y * ddy);
+
+    // One pixel is 2 / viewportSize in NDC
+    vec2 pixel = 2.0 / viewportSize;
+    ddx *= pixel.x;
+    ddy *= pixel.y;
+    result.ddx = (result.lambda * interpInvW + ddx) / (interpInvW + ddxSum * pixel.x) - result.lambda;
+    result.ddy = (result.lambda * interpInvW + ddy) / (interpInvW + ddySum * pixel.y) - result.lambda;
+    return result;
+}
+
+vec3 hashColor(uint id)
+{
+    id = (id ^ 61u) ^ (id >> 16);
+    id *= 9u;
+    id = id ^ (id >> 4);
+    id *= 0x27d4eb2du;
+    id = id ^ (id >> 15);
+    return vec3(uvec3(id, id >> 8, id >> 16) & 0xFFu) / 255.0;
+}
+
+void main()
+{
+    uint visibility = texelFetch(uVisibility, ivec2(gl_FragCoord.xy), 0).r;
+
+    // Background
+    if (visibility == 0u)
+    {
+        oColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    int drawID = int(visibility >> 24) - 1;
+    int triangleID = int(visibility & 0xFFFFFFu);
+    if (uShowTriangleIDs)
+    {
+        oColor = vec4(hashColor(visibility), 1.0);
+        return;
+    }
+
+    // Triangle vertices
+    int firstIndex = uDrawFirstIndex[drawID] + triangleID * 3;
+    vertex v0 = fetchVertex(int(texelFetch(uIndices, firstIndex + 0).r));
+    vertex v1 = fetchVertex(int(texelFetch(uIndices, firstIndex + 1).r));
+    vertex v2 = fetchVertex(int(texelFetch(uIndices, firstIndex + 2).r));
+
+    vec4 world0 = uModel * vec4(v0.position, 1.0);
+    vec4 world1 = uModel * vec4(v1.position, 1.0);
+    vec4 world2 = uModel * vec4(v2.position, 1.0);
+
+    mat4 viewProjection = uProjection * uView;
+    vec2 viewportSize = vec2(textureSize(uVisibility, 0));
+    vec2 ndc = gl_FragCoord.xy / viewportSize * 2.0 - 1.0;
+    barycentrics b = computeBarycentrics(viewProjection * world0, viewProjection * world1, viewProjection * world2, ndc, viewportSize);
+
+    // Interpolate attributes
+    vec3 position = mat3(world0.xyz, world1.xyz, world2.xyz) * b.lambda;
+    vec3 normal = normalize((uModelNormalMatrix * vec4(mat3(v0.normal, v1.normal, v2.normal) * b.lambda, 0.0)).xyz);
+    mat3x2 uvs = mat3x2(v0.uv, v1.uv, v2.uv);
+    vec2 uv = uvs * b.lambda;
+    vec2 uvDdx = uvs * b.ddx;
+    vec2 uvDdy = uvs * b.ddy;
+
+    // Compute phong shading (lights of the pixel cluster, view depth is the clip w)
+    light_shade_result lightResult = clustered_lights_shade(gDefaultMaterial.shininess, uViewPosition, position, normal, gl_FragCoord.xy, b.w);
+
+    vec3 diffuseColor  = gDefaultMaterial.diffuse * lightResult.diffuse * textureGrad(uDiffuseTexture, uv, uvDdx, uvDdy).rgb;
+    vec3 ambientColor  = gDefaultMaterial.ambient * lightResult.ambient;
+    vec3 specularColor = gDefaultMaterial.specular * lightResult.specular;
+    vec3 emissiveColor = gDefaultMaterial.emission + textureGrad(uEmissiveTexture, uv, uvDdx, uvDdy).rgb;
+
+    // Apply light color
+    oColor = vec4((ambientColor + diffuseColor + specularColor + emissiveColor), 1.0);
+})GLSL";
+
+demo_visibility_buffer::demo_visibility_buffer(const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug)
+    : GLDebug(GLDebug), FrameGraph(GLDebug.RenderTargets), TavernScene(GLCache)
+{
+    PROFILE_FUNCTION();
+
+    // Frame graph passes show up in the GPU profiler
+    FrameGraph.SetPassHooks(
+        [this](const char* PassName) { this->GLDebug.Profiler.Push(PassName); },
+        [this](const char*) { this->GLDebug.Profiler.Pop(); });
+
+    // Create shader
+    {
+        // Assemble fragment shader strings (defines + light clusters + code)
+        char ResolveFragmentShaderConfig[128];
+        snprintf(ResolveFragmentShaderConfig, ARRAY_SIZE(ResolveFragmentShaderConfig), "#define MAX_DRAW_COUNT %d\n#define VERTEX_TEXEL_COUNT %d\n",
+            MAX_DRAW_COUNT, VERTEX_TEXEL_COUNT);
+        const char* ResolveFragmentShaderStrs[3] = {
+            ResolveFragmentShaderConfig,
+            GL::light_clusters::GetShaderStr(),
+            gResolveFragmentShaderStr,
+        };
+
+        visibilityProgram = GL::CreateProgram(gVisibilityVertexShaderStr, gVisibilityFragmentShaderStr);
+        resolveProgram = GL::CreateProgramEx(1, &gResolveVertexShaderStr, 3, ResolveFragmentShaderStrs, true);
+    }
+
+    // Indexed tavern, drawn in one draw call
+    {
+        TavernMesh = GLCache.LoadIndexedObj("media/fantasy_game_inn.obj", 1.f);
+        Draws.push_back({ 0, TavernMesh.IndexCount });
+
+        for (const draw& Draw : Draws)
+        {
+            if (Draw.IndexCount / 3 > MAX_TRIANGLE_COUNT)
+                fprintf(stderr, "Visibility buffer: draw of %d triangles over the %d triangle IDs\n", Draw.IndexCount / 3, MAX_TRIANGLE_COUNT);
+        }
+
+        GLint MaxTexels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &MaxTexels);
+        if (TavernMesh.VertexCount * VERTEX_TEXEL_COUNT > MaxTexels || TavernMesh.IndexCount > MaxTexels)
+            fprintf(stderr, "Visibility buffer: mesh over the texture buffer size limit (%d texels)\n", MaxTexels);
+    }
+
+    // Create a vertex array and bind attribs onto the vertex buffer (positions only)
+    {
+        glGenVertexArrays(1, &VAO);
+        glBindVertexArray(VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, TavernMesh.VertexBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_full), (void*)OFFSETOF(vertex_full, Position));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, TavernMesh.IndexBuffer);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glGenVertexArrays(1, &EmptyVAO);
+    }
+
+    // Same buffers read by the resolve pass
+    {
+        glGenTextures(1, &VerticesTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, VerticesTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, TavernMesh.VertexBuffer);
+
+        glGenTextures(1, &IndicesTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, IndicesTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, TavernMesh.IndexBuffer);
+
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // Set uniforms that won't change
+    {
+        visibilityDrawIDLocation = glGetUniformLocation(visibilityProgram, "uDrawID");
+
+        glUseProgram(resolveProgram);
+        glUniform1i(glGetUniformLocation(resolveProgram, "uVisibility"), 0);
+        glUniform1i(glGetUniformLocation(resolveProgram, "uIndices"), 1);
+        glUniform1i(glGetUniformLocation(resolveProgram, "uVertices"), 2);
+        glUniform1i(glGetUniformLocation(resolveProgram, "uDiffuseTexture"), 3);
+        glUniform1i(glGetUniformLocation(resolveProgram, "uEmissiveTexture"), 4);
+
+        std::vector<GLint> DrawFirstIndices;
+        for (const draw& Draw : Draws)
+            DrawFirstIndices.push_back(Draw.FirstIndex);
+        glUniform1iv(glGetUniformLocation(resolveProgram, "uDrawFirstIndex"), (GLsizei)DrawFirstIndices.size(), DrawFirstIndices.data());
+    }
+}
+
+demo_visibility_buffer::~demo_visibility_buffer()
+{
+    // Cleanup GL (mesh buffers from GLCache)
+    glDeleteTextures(1, &VerticesTexture);
+    glDeleteTextures(1, &IndicesTexture);
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteVertexArrays(1, &EmptyVAO);
+    glDeleteProgram(visibilityProgram);
+    glDeleteProgram(resolveProgram);
+}
+
+void demo_visibility_buffer::Update(const platform_io& IO)
+{
+    const float AspectRatio = (float)IO.WindowWidth / (float)IO.WindowHeight;
+
+    Camera = CameraUpdateFreefly(Camera, IO.CameraInputs);
+
+    mat4 ProjectionMatrix = Mat4::Perspective(Math::ToRadians(60.f), AspectRatio, 0.1f, 100.f);
+    mat4 ViewMatrix = CameraGetInverseMatrix(Camera);
+    mat4 ModelMatrix = Mat4::Translate({ 0.f, 0.f, 0.f });
+    mat4 NormalMatrix = Mat4::Transpose(Mat4::Inverse(ModelMatrix));
+
+    TavernScene.UpdateLightClusters(IO, ViewMatrix, Math::ToRadians(60.f), AspectRatio, 0.1f, 100.f);
+
+    FrameGraph.Reset();
+
+    // 4 bytes per pixel, background stays 0
+    GL::frame_resource Visibility = FrameGraph.CreateTexture("Visibility", { GL_R32UI, IO.WindowWidth, IO.WindowHeight });
+    GL::frame_resource Depth = FrameGraph.CreateRenderbuffer("Depth", { GL_DEPTH_COMPONENT24, IO.WindowWidth, IO.WindowHeight });
+    GL::frame_resource Lights = FrameGraph.ImportBuffer("Lights", TavernScene.LightClusters.GetLightsBuffer());
+    GL::frame_resource Backbuffer = FrameGraph.ImportBackbuffer(IO.WindowWidth, IO.WindowHeight);
+
+    FrameGraph.AddPass("Visibility",
+        [&](GL::frame_graph::pass_builder& Builder)
+        {
+            Visibility = Builder.WriteColor(Visibility, GL::frame_load_op::CLEAR, { 0.f, 0.f, 0.f, 0.f });
+            Depth = Builder.WriteDepth(Depth, GL::frame_load_op::CLEAR);
+        },
+        [=](const GL::frame_graph::pass_resources&)
+        {
+            glEnable(GL_DEPTH_TEST);
+            glUseProgram(visibilityProgram);
+            glUniformMatrix4fv(glGetUniformLocation(visibilityProgram, "uProjection"), 1, GL_FALSE, ProjectionMatrix.e);
+            glUniformMatrix4fv(glGetUniformLocation(visibilityProgram, "uModel"), 1, GL_FALSE, ModelMatrix.e);
+            glUniformMatrix4fv(glGetUniformLocation(visibilityProgram, "uView"), 1, GL_FALSE, ViewMatrix.e);
+
+            glBindVertexArray(VAO);
+            for (int i = 0; i < (int)Draws.size() && i < MAX_DRAW_COUNT; ++i)
+            {
+                glUniform1ui(visibilityDrawIDLocation, (GLuint)i);
+                glDrawElements(GL_TRIANGLES, Draws[i].IndexCount, GL_UNSIGNED_INT, (void*)(Draws[i].FirstIndex * sizeof(uint32_t)));
+            }
+            glBindVertexArray(0);
+        });
+
+    FrameGraph.AddPass("Resolve",
+        [&](GL::frame_graph::pass_builder& Builder)
+        {
+            Builder.Read(Visibility);
+            Builder.Read(Lights);
+            Builder.WriteBackbuffer(Backbuffer, GL::frame_load_op::CLEAR);
+        },
+        [=](const GL::frame_graph::pass_resources& Resources)
+        {
+            glUseProgram(resolveProgram);
+            glUniformMatrix4fv(glGetUniformLocation(resolveProgram, "uProjection"), 1, GL_FALSE, ProjectionMatrix.e);
+            glUniformMatrix4fv(glGetUniformLocation(resolveProgram, "uModel"), 1, GL_FALSE, ModelMatrix.e);
+            glUniformMatrix4fv(glGetUniformLocation(resolveProgram, "uView"), 1, GL_FALSE, ViewMatrix.e);
+            glUniformMatrix4fv(glGetUniformLocation(resolveProgram, "uModelNormalMatrix"), 1, GL_FALSE, NormalMatrix.e);
+            glUniform3fv(glGetUniformLocation(resolveProgram, "uViewPosition"), 1, Camera.Position.e);
+            glUniform1i(glGetUniformLocation(resolveProgram, "uShowTriangleIDs"), ShowTriangleIDs);
+
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, Resources.Get(Visibility));
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_BUFFER, IndicesTexture);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_BUFFER, VerticesTexture);
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_2D, TavernScene.DiffuseTexture);
+            glActiveTexture(GL_TEXTURE4);
+            glBindTexture(GL_TEXTURE_2D, TavernScene.EmissiveTexture);
+            glActiveTexture(GL_TEXTURE0);
+
+            TavernScene.LightClusters.Bind(resolveProgram, LIGHT_CLUSTERS_TEXTURE_UNIT);
+
+            glDisable(GL_DEPTH_TEST);
+            glBindVertexArray(EmptyVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+            glEnable(GL_DEPTH_TEST);
+
+            glUseProgram(0);
+        });
+
+    FrameGraph.Execute();
+
+    // Display debug UI
+    this->DisplayDebugUI();
+}
+
+void demo_visibility_buffer::DisplayDebugUI()
+{
+    if (ImGui::TreeNodeEx("demo_visibility_buffer", ImGuiTreeNodeFlags_Framed))
+    {
+        // Debug display
+        ImGui::Checkbox("Show triangle IDs", &ShowTriangleIDs);
+        ImGui::Text("Triangles: %d (%d unique vertices)", TavernMesh.IndexCount / 3, TavernMesh.VertexCount);
+        if (ImGui::TreeNodeEx("Camera"))
+        {
+            ImGui::Text("Position: (%.2f, %.2f, %.2f)", Camera.Position.x, Camera.Position.y, Camera.Position.z);
+            ImGui::Text("Pitch: %.2f", Math::ToDegrees(Camera.Pitch));
+            ImGui::Text("Yaw: %.2f", Math::ToDegrees(Camera.Yaw));
+            ImGui::TreePop();
+        }
+        TavernScene.InspectLights();
+        TavernScene.InspectLightClusters();
+        FrameGraph.InspectPasses();
+
+        ImGui::TreePop();
+    }
+}
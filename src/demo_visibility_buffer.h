@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+#include "demo.h"
+
+#include "opengl_headers.h"
+
+#include "camera.h"
+
+#include "tavern_scene.h"
+#include "opengl_helpers_frame_graph.h"
+#include "opengl_helpers_cache.h"
+
+// Visibility buffer: the geometry pass only writes a draw ID and a triangle ID per pixel (32 bits),
+// the resolve pass fetches the triangle vertices from buffer textures, rebuilds the perspective-correct
+// barycentrics and their screen derivatives analytically and shades each pixel once
+class demo_visibility_buffer : public demo
+{
+public:
+    demo_visibility_buffer(const platform_io& IO, GL::cache& GLCache, GL::debug& GLDebug);
+    virtual ~demo_visibility_buffer();
+    virtual void Update(const platform_io& IO);
+
+    void DisplayDebugUI();
+
+private:
+    // Draws of the visibility pass, the draw ID selects the first index of the triangle ID
+    struct draw
+    {
+        int FirstIndex;
+        int IndexCount;
+    };
+
+    GL::debug& GLDebug;
+    GL::frame_graph FrameGraph;
+
+    // 3d camera
+    camera Camera = {};
+
+    // GL objects needed by this demo
+    GLuint visibilityProgram = 0;
+    GLuint resolveProgram = 0;
+    GLuint VAO = 0;
+    GLuint EmptyVAO = 0; // Fullscreen triangle from gl_VertexID
+    GLuint VerticesTexture = 0;
+    GLuint IndicesTexture = 0;
+
+    GLint visibilityDrawIDLocation = -1;
+
+    tavern_scene TavernScene;
+    // Same .obj as TavernScene.MeshBuffer, indexed (from GLCache)
+    GL::indexed_mesh TavernMesh;
+    std::vector<draw> Draws;
+
+    bool ShowTriangleIDs = false;
+};
@@ -0,0 +1,181 @@
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+
+#include <stb_image.h>
+
+#include "opengl_helpers_readback.h"
+#include "cpu_profiler.h"
+#include "image_write.h"
+#include "image_diff.h"
+#include "demo_list.h"
+#include "headless.h"
+
+#include "golden.h"
+
+namespace
+{
+    // Viewing condition of the perceptual diff (0.7 m from a 24" 4K monitor)
+    const float PIXELS_PER_DEGREE = 67.f;
+
+    struct golden_capture
+    {
+        int DemoId;
+        GL::async_readback Readback;
+        std::vector<uint8_t> Pixels;
+    };
+
+    bool CompareWithGolden(const app_options& Options, const char* Demo, const std::vector<uint8_t>& Pixels)
+    {
+        std::string GoldenFilename = (std::filesystem::path(Options.GoldenDir) / (std::string(Demo) + ".png")).string();
+        int Width, Height;
+        uint8_t* Golden = stbi_load(GoldenFilename.c_str(), &Width, &Height, nullptr, 4);
+        if (Golden == nullptr)
+        {
+            fprintf(stderr, "%s: cannot load golden '%s' (run with --update-golden)\n", Demo, GoldenFilename.c_str());
+            return false;
+        }
+
+        bool Passed = false;
+        if (Width != Options.Width || Height != Options.Height)
+        {
+            fprintf(stderr, "%s: golden is %dx%d, capture is %dx%d\n", Demo, Width, Height, Options.Width, Options.Height);
+        }
+        else
+        {
+            image_diff_result Diff;
+            ComputeImageDiff(Golden, Pixels.data(), Width, Height, PIXELS_PER_DEGREE, &Diff);
+
+            golden_tolerance Tolerance = LoadGoldenTolerance(Options.GoldenDir, Demo);
+            Passed = Diff.MeanError <= Tolerance.MaxMeanError && Diff.P99Error <= Tolerance.MaxP99Error && Diff.MaxError <= Tolerance.MaxMaxError;
+            printf("%-16s mean %.5f (<= %.5f) p99 %.5f (<= %.5f) max %.5f (<= %.5f) %s\n", Demo,
+                Diff.MeanError, Tolerance.MaxMeanError, Diff.P99Error, Tolerance.MaxP99Error, Diff.MaxError, Tolerance.MaxMaxError, Passed ? "PASS" : "FAIL");
+
+            if (!Passed)
+            {
+                std::string DiffFilename = GetOutputPath(Options, std::string(Demo) + "_diff.png");
+                std::vector<uint8_t> HeatMap = ImageDiffHeatMap(Diff);
+                if (WritePNG(DiffFilename.c_str(), Width, Height, 3, HeatMap.data()))
+                    printf("%-16s error map written to '%s'\n", Demo, DiffFilename.c_str());
+            }
+        }
+
+        stbi_image_free(Golden);
+        return Passed;
+    }
+}
+
+golden_tolerance LoadGoldenTolerance(const std::string& GoldenDir, const char* Demo)
+{
+    golden_tolerance Default;
+    std::string Filename = (std::filesystem::path(GoldenDir) / "tolerances.txt").string();
+    FILE* File = fopen(Filename.c_str(), "r");
+    if (File == nullptr)
+        return Default;
+
+    golden_tolerance Result;
+    bool Found = false;
+    char Line[256];
+    while (fgets(Line, sizeof(Line), File))
+    {
+        char Name[64];
+        golden_tolerance Tolerance;
+        // The max error is optional, older files only have the mean and p99
+        if (Line[0] == '#' || sscanf(Line, "%63s %lf %lf %lf", Name, &Tolerance.MaxMeanError, &Tolerance.MaxP99Error, &Tolerance.MaxMaxError) < 3)
+            continue;
+
+        if (strcmp(Name, Demo) == 0)
+        {
+            Result = Tolerance;
+            Found = true;
+        }
+        else if (strcmp(Name, "default") == 0)
+        {
+            Default = Tolerance;
+        }
+    }
+    fclose(File);
+
+    return Found ? Result : Default;
+}
+
+int RunGolden(const app_options& Options)
+{
+    app_options GoldenOptions = Options;
+    GoldenOptions.VSync = false;
+
+    headless_app App(GoldenOptions);
+    if (!App.Init())
+        return 1;
+
+    int CaptureFrame = Options.FrameCount;
+    if (CaptureFrame < 0)
+        CaptureFrame = App.GetCameraPath().GetFrameCount() > 0 ? App.GetCameraPath().GetFrameCount() : 60;
+    CaptureFrame = std::max(CaptureFrame, 1);
+
+    int DemoCount;
+    const demo_info* Demos = GetDemoInfos(&DemoCount);
+
+    std::vector<std::unique_ptr<golden_capture>> Captures;
+    for (int DemoId = 0; DemoId < DemoCount; ++DemoId)
+    {
+        if (!Options.Demo.empty() && DemoId != FindDemo(Options.Demo.c_str()))
+            continue;
+        std::unique_ptr<golden_capture> Capture = std::make_unique<golden_capture>();
+        Capture->DemoId = DemoId;
+        Captures.push_back(std::move(Capture));
+    }
+
+    // The copy of a demo's frame runs on the GPU while the next demo loads and renders
+    for (std::unique_ptr<golden_capture>& Capture : Captures)
+    {
+        PROFILE_SCOPE_DETAIL("Golden capture", Demos[Capture->DemoId].Name);
+        App.LoadDemo(Capture->DemoId);
+        for (int i = 0; i < CaptureFrame; ++i)
+            App.RunFrame();
+
+        GL::offscreen_backbuffer& Backbuffer = App.GetBackbuffer();
+        Capture->Readback.Request(Backbuffer.GetFramebuffer(), Backbuffer.GetWidth(), Backbuffer.GetHeight());
+    }
+    App.UnloadDemo();
+
+    for (std::unique_ptr<golden_capture>& Capture : Captures)
+        Capture->Readback.Resolve(&Capture->Pixels);
+
+    int FailedCount = 0;
+    for (std::unique_ptr<golden_capture>& Capture : Captures)
+    {
+        const char* Demo = Demos[Capture->DemoId].Name;
+        std::string Filename = GetOutputPath(Options, std::string(Demo) + ".png");
+        WritePNG(Filename.c_str(), Options.Width, Options.Height, 4, Capture->Pixels.data());
+
+        if (Options.UpdateGolden)
+        {
+            std::error_code Error;
+            std::filesystem::create_directories(Options.GoldenDir, Error);
+            std::string GoldenFilename = (std::filesystem::path(Options.GoldenDir) / (std::string(Demo) + ".png")).string();
+            if (WritePNG(GoldenFilename.c_str(), Options.Width, Options.Height, 4, Capture->Pixels.data()))
+                printf("%-16s golden written to '%s'\n", Demo, GoldenFilename.c_str());
+            else
+                FailedCount++;
+        }
+        else if (!CompareWithGolden(Options, Demo, Capture->Pixels))
+        {
+            FailedCount++;
+        }
+    }
+
+    if (!Options.UpdateGolden)
+        printf("%d/%d demos within tolerance (frame %d)\n", (int)Captures.size() - FailedCount, (int)Captures.size(), CaptureFrame);
+
+    if (CPUProfiler::IsRecording())
+    {
+        CPUProfiler::StopRecording();
+        CPUProfiler::WriteTrace(GetOutputPath(Options, Options.TraceFilename).c_str());
+    }
+
+    return FailedCount == 0 ? 0 : 1;
+}
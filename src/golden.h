@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+#include "command_line.h"
+
+struct golden_tolerance
+{
+    double MaxMeanError = 0.01; // Mean perceptual error of the frame
+    double MaxP99Error = 0.1;   // Error of the 1% worst pixels
+    double MaxMaxError = 0.15;  // Error of the worst pixel: catches the regressions too small to move the mean and p99
+};
+
+// Per demo tolerances of <dir>/tolerances.txt: one "<demo|default> <max mean> <max p99> [<max error>]" per line, '#' comments
+// Missing file or demo: default tolerance
+golden_tolerance LoadGoldenTolerance(const std::string& GoldenDir, const char* Demo);
+
+// --golden entry point: render every selected demo headless, read the captured frames back asynchronously,
+// write them to the output directory and compare them with the goldens (or replace the goldens with --update-golden)
+// Returns 0 when every demo is within tolerance, 1 otherwise
+int RunGolden(const app_options& Options);
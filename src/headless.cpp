@@ -0,0 +1,277 @@
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <typeinfo>
+#include <vector>
+
+#include <imgui.h>
+#include <imgui_impl_opengl3.h>
+
+#include "opengl_headers.h"
+
+#include "opengl_helpers_stats.h"
+#include "opengl_helpers_memory.h"
+#include "cpu_profiler.h"
+#include "startup_trace.h"
+#include "platform_headless.h"
+#include "image_write.h"
+#include "demo_list.h"
+
+#include "pg.h"
+
+#include "headless.h"
+
+static void HeadlessOpenGLErrorCallback(GLenum Source, GLenum Type, GLuint Id, GLenum Severity, GLsizei Length, const GLchar* Message, const void* UserParam)
+{
+    if (Id == 1234) // Wireframe::flush
+        return;
+    fprintf(stderr, "OpenGL log (0x%x): %s\n", Id, Message);
+}
+
+headless_app::headless_app(const app_options& Options)
+    : Options(Options)
+{
+}
+
+headless_app::~headless_app()
+{
+    Shutdown();
+}
+
+bool headless_app::Init()
+{
+    PROFILE_FUNCTION();
+
+    if (!Options.ReplayCameraPath.empty() && !CameraPath.Load(Options.ReplayCameraPath.c_str()))
+        return false;
+
+    {
+        STARTUP_PHASE("OpenGL init");
+        if (!HeadlessCreateContext())
+            return false;
+        ContextCreated = true;
+
+        GL::InstallStatsHooks();
+        GL::InstallMemoryHooks();
+
+        if (GLAD_GL_KHR_debug)
+        {
+            glDebugMessageCallback(HeadlessOpenGLErrorCallback, nullptr);
+            glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+            glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+            glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_PERFORMANCE, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+            glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_OTHER, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+            glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_PUSH_GROUP, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+            glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_POP_GROUP, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+        }
+
+        // Stands for the window framebuffer from now on
+        Backbuffer = std::make_unique<GL::offscreen_backbuffer>(Options.Width, Options.Height);
+    }
+
+    {
+        STARTUP_PHASE("ImGui init");
+        // Demos build their UI every frame: the ImGui context exists even when the overlay is not rendered
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGuiIO& io = ImGui::GetIO();
+        io.IniFilename = nullptr;
+        io.DisplaySize = ImVec2((float)Options.Width, (float)Options.Height);
+        ImGui::StyleColorsDark();
+        if (Options.ImGui)
+        {
+            ImGui_ImplOpenGL3_Init("#version 330");
+            ImGuiRendererInitialized = true;
+        }
+        else
+        {
+            // Normally built by the renderer
+            unsigned char* Pixels;
+            int Width, Height;
+            io.Fonts->GetTexDataAsRGBA32(&Pixels, &Width, &Height);
+        }
+    }
+
+    IO.WindowWidth = Options.Width;
+    IO.WindowHeight = Options.Height;
+    CameraPathSetFixedTime(&IO, 0);
+
+    {
+        STARTUP_PHASE("PG::Init");
+        PG::Init();
+    }
+    GLCache = std::make_unique<GL::cache>();
+    GLDebug = std::make_unique<GL::debug>();
+
+    return true;
+}
+
+void headless_app::LoadDemo(int NewDemoId)
+{
+    const demo_info* Demos = GetDemoInfos(nullptr);
+    PROFILE_SCOPE_DETAIL("LoadDemo", Demos[NewDemoId].Name);
+
+    UnloadDemo();
+    CameraPathSetFixedTime(&IO, 0);
+    STARTUP_PHASE_DETAIL("Demo constructor", Demos[NewDemoId].Name);
+    Demo = Demos[NewDemoId].Create(IO, *GLCache, *GLDebug);
+    DemoId = NewDemoId;
+    FrameIndex = 0;
+}
+
+void headless_app::UnloadDemo()
+{
+    Demo.reset();
+    DemoId = -1;
+}
+
+void headless_app::RunFrame()
+{
+    PROFILE_SCOPE("Frame");
+    std::chrono::steady_clock::time_point FrameStart = std::chrono::steady_clock::now();
+
+    // Fixed time step, recorded camera inputs only
+    CameraPathSetFixedTime(&IO, FrameIndex);
+    IO.CameraInputs = CameraPath.GetInputs(FrameIndex);
+    IO.WindowSizeChanged = false;
+
+    ImGuiIO& io = ImGui::GetIO();
+    io.DeltaTime = (float)IO.DeltaTime;
+    if (ImGuiRendererInitialized)
+        ImGui_ImplOpenGL3_NewFrame();
+    ImGui::NewFrame();
+
+    {
+        PROFILE_SCOPE("Shader reload");
+        GLDebug->Shaders.Update();
+    }
+
+    GLDebug->RenderTargets.BeginFrame();
+
+    GL::ResetFrameStats();
+    GLDebug->Profiler.BeginFrame();
+
+    // Window viewport (set by the windowing system on window framebuffers)
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, Options.Width, Options.Height);
+
+    {
+        PROFILE_SCOPE("Demo update");
+        GL::gpu_scope Scope(GLDebug->Profiler, "Demo");
+        GL::memory_owner_scope MemoryOwner(typeid(*Demo).name());
+        Demo->Update(IO);
+    }
+
+    {
+        PROFILE_SCOPE("Wireframe flush");
+        GL::gpu_scope Scope(GLDebug->Profiler, "Wireframe");
+        GLDebug->Wireframe.Flush();
+    }
+
+    LastFrameStats = GL::GetFrameStats();
+
+    {
+        PROFILE_SCOPE("ImGui render");
+        ImGui::Render();
+        if (ImGuiRendererInitialized)
+        {
+            GL::gpu_scope Scope(GLDebug->Profiler, "ImGui");
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+    }
+
+    GLDebug->Profiler.EndFrame();
+
+    // No swap: flush so that CPU frame times include the submission
+    glFlush();
+
+    FrameIndex++;
+
+    std::chrono::duration<double, std::milli> FrameDuration = std::chrono::steady_clock::now() - FrameStart;
+    LastFrameMs = FrameDuration.count();
+    StartupTrace::EndFrame(LastFrameMs);
+
+    // Swap interval 1 equivalent
+    if (Options.VSync)
+    {
+        PROFILE_SCOPE("VSync");
+        std::this_thread::sleep_until(FrameStart + std::chrono::microseconds(16667));
+    }
+}
+
+bool headless_app::SaveFrame(const std::string& Filename)
+{
+    std::vector<uint8_t> Pixels;
+    Backbuffer->ReadPixels(&Pixels);
+    return WritePNG(Filename.c_str(), Backbuffer->GetWidth(), Backbuffer->GetHeight(), 4, Pixels.data());
+}
+
+void headless_app::Shutdown()
+{
+    if (!ContextCreated)
+        return;
+
+    Demo.reset();
+    if (GLDebug)
+        GLDebug->Shaders.CancelAll();
+    GLDebug.reset();
+    GLCache.reset();
+    PG::Destroy();
+
+    if (ImGuiRendererInitialized)
+        ImGui_ImplOpenGL3_Shutdown();
+    ImGui::DestroyContext();
+
+    Backbuffer.reset();
+    HeadlessDestroyContext();
+    ContextCreated = false;
+}
+
+int RunHeadless(const app_options& Options)
+{
+    headless_app App(Options);
+    if (!App.Init())
+        return 1;
+
+    // Demo of the camera path by default
+    const std::string& DemoName = Options.Demo.empty() ? App.GetCameraPath().Demo : Options.Demo;
+    int DemoId = DemoName.empty() ? 0 : FindDemo(DemoName.c_str());
+    if (DemoId < 0)
+    {
+        fprintf(stderr, "Unknown demo '%s'\n", DemoName.c_str());
+        return 1;
+    }
+    const demo_info& Info = GetDemoInfos(nullptr)[DemoId];
+    App.LoadDemo(DemoId);
+
+    int FrameCount = Options.FrameCount;
+    if (FrameCount < 0)
+        FrameCount = App.GetCameraPath().GetFrameCount() > 0 ? App.GetCameraPath().GetFrameCount() : 100;
+
+    double TotalMs = 0.0;
+    for (int i = 0; i < FrameCount; ++i)
+    {
+        App.RunFrame();
+        TotalMs += App.GetLastFrameMs();
+    }
+
+    if (FrameCount > 0)
+    {
+        printf("%s: %d frames, %.3f ms/frame (CPU)\n", Info.Name, FrameCount, TotalMs / FrameCount);
+
+        std::string Filename = GetOutputPath(Options, std::string(Info.Name) + ".png");
+        if (App.SaveFrame(Filename))
+            printf("Last frame written to '%s'\n", Filename.c_str());
+    }
+
+    if (Options.StartupTrace)
+        StartupTrace::Finish(Info.Name, GetOutputPath(Options, "startup.json").c_str(), GetOutputPath(Options, "startup_history.csv").c_str());
+
+    if (CPUProfiler::IsRecording())
+    {
+        CPUProfiler::StopRecording();
+        CPUProfiler::WriteTrace(GetOutputPath(Options, Options.TraceFilename).c_str());
+    }
+
+    return 0;
+}
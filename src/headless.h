@@ -0,0 +1,69 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "platform.h"
+#include "opengl_helpers.h"
+#include "opengl_helpers_backbuffer.h"
+#include "opengl_helpers_stats.h"
+
+#include "command_line.h"
+#include "camera_path.h"
+
+class demo;
+
+// Offscreen app driving the demos without window nor input (captures, benchmarks)
+// Frames use a fixed time step and replay Options.ReplayCameraPath (if any) from the demo load, so two runs render the same images
+class headless_app
+{
+public:
+    headless_app(const app_options& Options);
+    ~headless_app();
+    headless_app(const headless_app&) = delete;
+    headless_app& operator=(const headless_app&) = delete;
+
+    // Context, hooks, ImGui, camera path and the shared GL cache/debug objects, false on failure
+    bool Init();
+    // Restarts the camera path
+    void LoadDemo(int DemoId);
+    void UnloadDemo();
+    void RunFrame();
+    bool SaveFrame(const std::string& Filename);
+
+    const app_options& GetOptions() const { return Options; }
+    platform_io& GetIO() { return IO; }
+    GL::debug& GetGLDebug() { return *GLDebug; }
+    demo* GetDemo() { return Demo.get(); }
+    GL::offscreen_backbuffer& GetBackbuffer() { return *Backbuffer; }
+    const camera_path& GetCameraPath() const { return CameraPath; }
+    // Frames rendered since the demo load
+    int GetFrameIndex() const { return FrameIndex; }
+    // CPU time of the last RunFrame(), throttling excluded
+    double GetLastFrameMs() const { return LastFrameMs; }
+    // Demo and wireframe GL calls of the last frame (ImGui excluded)
+    const GL::frame_stats& GetLastFrameStats() const { return LastFrameStats; }
+
+private:
+    void Shutdown();
+
+    app_options Options;
+    platform_io IO = {};
+
+    bool ContextCreated = false;
+    bool ImGuiRendererInitialized = false;
+    std::unique_ptr<GL::offscreen_backbuffer> Backbuffer;
+    std::unique_ptr<GL::cache> GLCache;
+    std::unique_ptr<GL::debug> GLDebug;
+    std::unique_ptr<demo> Demo;
+    int DemoId = -1;
+
+    camera_path CameraPath;
+    int FrameIndex = 0;
+
+    double LastFrameMs = 0.0;
+    GL::frame_stats LastFrameStats = {};
+};
+
+// --headless entry point: render Options.FrameCount frames of the selected demo and write the last one as PNG
+int RunHeadless(const app_options& Options);
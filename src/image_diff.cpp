@@ -0,0 +1,304 @@
+#include <cmath>
+#include <algorithm>
+
+#include "image_diff.h"
+
+namespace
+{
+    struct color { float x, y, z; };
+
+    const float PI = 3.14159265f;
+
+    // D65 reference white
+    const color WHITE_XYZ = { 0.950428545f, 1.f, 1.088900371f };
+
+    float SRGBToLinear(float C)
+    {
+        return C <= 0.04045f ? C / 12.92f : std::pow((C + 0.055f) / 1.055f, 2.4f);
+    }
+
+    color LinearRGBToXYZ(color C)
+    {
+        return {
+            0.4124564f * C.x + 0.3575761f * C.y + 0.1804375f * C.z,
+            0.2126729f * C.x + 0.7151522f * C.y + 0.0721750f * C.z,
+            0.0193339f * C.x + 0.1191920f * C.y + 0.9503041f * C.z,
+        };
+    }
+
+    color XYZToLinearRGB(color C)
+    {
+        return {
+             3.2404542f * C.x - 1.5371385f * C.y - 0.4985314f * C.z,
+            -0.9692660f * C.x + 1.8760108f * C.y + 0.0415560f * C.z,
+             0.0556434f * C.x - 0.2040259f * C.y + 1.0572252f * C.z,
+        };
+    }
+
+    // Linear opponent space where the contrast sensitivity filters are applied
+    color XYZToYCxCz(color C)
+    {
+        float Y = C.y / WHITE_XYZ.y;
+        return { 116.f * Y - 16.f, 500.f * (C.x / WHITE_XYZ.x - Y), 200.f * (Y - C.z / WHITE_XYZ.z) };
+    }
+
+    color YCxCzToXYZ(color C)
+    {
+        float Y = (C.x + 16.f) / 116.f;
+        return { (C.y / 500.f + Y) * WHITE_XYZ.x, Y * WHITE_XYZ.y, (Y - C.z / 200.f) * WHITE_XYZ.z };
+    }
+
+    color XYZToLab(color C)
+    {
+        auto F = [](float T) { return T > 0.008856f ? std::cbrt(T) : 7.787f * T + 16.f / 116.f; };
+        float FX = F(C.x / WHITE_XYZ.x);
+        float FY = F(C.y / WHITE_XYZ.y);
+        float FZ = F(C.z / WHITE_XYZ.z);
+        return { 116.f * FY - 16.f, 500.f * (FX - FY), 200.f * (FY - FZ) };
+    }
+
+    // Hunt effect: chroma appears lower at low luminance
+    color Hunt(color Lab)
+    {
+        float Scale = 0.01f * Lab.x;
+        return { Lab.x, Scale * Lab.y, Scale * Lab.z };
+    }
+
+    float HyAB(color A, color B)
+    {
+        return std::fabs(A.x - B.x) + std::sqrt((A.y - B.y) * (A.y - B.y) + (A.z - B.z) * (A.z - B.z));
+    }
+
+    // Separable convolution with clamped borders
+    void Convolve(std::vector<float>& Channel, const std::vector<float>& Kernel, int Width, int Height)
+    {
+        int Radius = (int)Kernel.size() / 2;
+        std::vector<float> Tmp(Channel.size());
+        for (int y = 0; y < Height; ++y)
+        {
+            for (int x = 0; x < Width; ++x)
+            {
+                float Sum = 0.f;
+                for (int k = -Radius; k <= Radius; ++k)
+                    Sum += Kernel[k + Radius] * Channel[y * Width + std::clamp(x + k, 0, Width - 1)];
+                Tmp[y * Width + x] = Sum;
+            }
+        }
+        for (int y = 0; y < Height; ++y)
+        {
+            for (int x = 0; x < Width; ++x)
+            {
+                float Sum = 0.f;
+                for (int k = -Radius; k <= Radius; ++k)
+                    Sum += Kernel[k + Radius] * Tmp[std::clamp(y + k, 0, Height - 1) * Width + x];
+                Channel[y * Width + x] = Sum;
+            }
+        }
+    }
+
+    // Contrast sensitivity as a sum of two Gaussians (A1, B1, A2, B2 in degrees), normalized 1D kernel
+    std::vector<float> CSFKernel(float A1, float B1, float A2, float B2, float PixelsPerDegree)
+    {
+        float MaxSigma = std::sqrt(std::max(B1, B2) / (2.f * PI * PI)) * PixelsPerDegree;
+        int Radius = std::max((int)std::ceil(3.f * MaxSigma), 1);
+
+        // Applied separably: exact for a single Gaussian, close enough for the blue-yellow sum of two
+        std::vector<float> Kernel(2 * Radius + 1);
+        float Sum = 0.f;
+        for (int i = -Radius; i <= Radius; ++i)
+        {
+            float X = (float)i / PixelsPerDegree;
+            float Weight = A1 * std::sqrt(PI / B1) * std::exp(-PI * PI * X * X / B1)
+                         + A2 * std::sqrt(PI / B2) * std::exp(-PI * PI * X * X / B2);
+            Kernel[i + Radius] = Weight;
+            Sum += Weight;
+        }
+        for (float& Weight : Kernel)
+            Weight /= Sum;
+        return Kernel;
+    }
+
+    // Gaussian derivatives used by the feature detection
+    void FeatureKernels(float PixelsPerDegree, std::vector<float>* Gauss, std::vector<float>* Edge, std::vector<float>* Point)
+    {
+        float Sigma = 0.5f * 0.082f * PixelsPerDegree;
+        int Radius = std::max((int)std::ceil(3.f * Sigma), 1);
+        Gauss->resize(2 * Radius + 1);
+        Edge->resize(2 * Radius + 1);
+        Point->resize(2 * Radius + 1);
+
+        float GaussSum = 0.f;
+        for (int i = -Radius; i <= Radius; ++i)
+        {
+            float G = std::exp(-(float)(i * i) / (2.f * Sigma * Sigma));
+            (*Gauss)[i + Radius] = G;
+            (*Edge)[i + Radius] = -(float)i * G;
+            (*Point)[i + Radius] = ((float)(i * i) / (Sigma * Sigma) - 1.f) * G;
+            GaussSum += G;
+        }
+
+        // Normalize: Gaussian sums to 1, derivatives have unit positive/negative lobes
+        float EdgePositive = 0.f, PointPositive = 0.f, PointNegative = 0.f;
+        for (int i = 0; i < 2 * Radius + 1; ++i)
+        {
+            (*Gauss)[i] /= GaussSum;
+            EdgePositive += std::max((*Edge)[i], 0.f);
+            PointPositive += std::max((*Point)[i], 0.f);
+            PointNegative += std::max(-(*Point)[i], 0.f);
+        }
+        for (int i = 0; i < 2 * Radius + 1; ++i)
+        {
+            (*Edge)[i] /= EdgePositive;
+            (*Point)[i] /= (*Point)[i] > 0.f ? PointPositive : PointNegative;
+        }
+    }
+
+    // Separable filter with different kernels along x and y
+    std::vector<float> Filter2D(const std::vector<float>& Channel, const std::vector<float>& KernelX, const std::vector<float>& KernelY, int Width, int Height)
+    {
+        int Radius = (int)KernelX.size() / 2;
+        std::vector<float> Tmp(Channel.size());
+        std::vector<float> Out(Channel.size());
+        for (int y = 0; y < Height; ++y)
+        {
+            for (int x = 0; x < Width; ++x)
+            {
+                float Sum = 0.f;
+                for (int k = -Radius; k <= Radius; ++k)
+                    Sum += KernelX[k + Radius] * Channel[y * Width + std::clamp(x + k, 0, Width - 1)];
+                Tmp[y * Width + x] = Sum;
+            }
+        }
+        for (int y = 0; y < Height; ++y)
+        {
+            for (int x = 0; x < Width; ++x)
+            {
+                float Sum = 0.f;
+                for (int k = -Radius; k <= Radius; ++k)
+                    Sum += KernelY[k + Radius] * Tmp[std::clamp(y + k, 0, Height - 1) * Width + x];
+                Out[y * Width + x] = Sum;
+            }
+        }
+        return Out;
+    }
+
+    struct prepared_image
+    {
+        std::vector<color> FilteredLab; // Hunt adjusted Lab of the CSF filtered image
+        std::vector<float> EdgeMagnitude;
+        std::vector<float> PointMagnitude;
+    };
+
+    prepared_image Prepare(const uint8_t* Pixels, int Width, int Height, float PixelsPerDegree)
+    {
+        int PixelCount = Width * Height;
+        std::vector<float> Channels[3];
+        std::vector<float> Achromatic(PixelCount);
+        for (std::vector<float>& Channel : Channels)
+            Channel.resize(PixelCount);
+
+        for (int i = 0; i < PixelCount; ++i)
+        {
+            color Linear = { SRGBToLinear(Pixels[i * 4 + 0] / 255.f), SRGBToLinear(Pixels[i * 4 + 1] / 255.f), SRGBToLinear(Pixels[i * 4 + 2] / 255.f) };
+            color Opponent = XYZToYCxCz(LinearRGBToXYZ(Linear));
+            Channels[0][i] = Opponent.x;
+            Channels[1][i] = Opponent.y;
+            Channels[2][i] = Opponent.z;
+            Achromatic[i] = (Opponent.x + 16.f) / 116.f; // [0, 1]
+        }
+
+        // Achromatic, red-green and blue-yellow contrast sensitivities
+        Convolve(Channels[0], CSFKernel(1.f, 0.0047f, 0.f, 1e-5f, PixelsPerDegree), Width, Height);
+        Convolve(Channels[1], CSFKernel(1.f, 0.0053f, 0.f, 1e-5f, PixelsPerDegree), Width, Height);
+        Convolve(Channels[2], CSFKernel(34.1f, 0.04f, 13.5f, 0.025f, PixelsPerDegree), Width, Height);
+
+        prepared_image Image;
+        Image.FilteredLab.resize(PixelCount);
+        for (int i = 0; i < PixelCount; ++i)
+        {
+            color Linear = XYZToLinearRGB(YCxCzToXYZ({ Channels[0][i], Channels[1][i], Channels[2][i] }));
+            Linear = { std::clamp(Linear.x, 0.f, 1.f), std::clamp(Linear.y, 0.f, 1.f), std::clamp(Linear.z, 0.f, 1.f) };
+            Image.FilteredLab[i] = Hunt(XYZToLab(LinearRGBToXYZ(Linear)));
+        }
+
+        std::vector<float> Gauss, Edge, Point;
+        FeatureKernels(PixelsPerDegree, &Gauss, &Edge, &Point);
+        std::vector<float> EdgeX = Filter2D(Achromatic, Edge, Gauss, Width, Height);
+        std::vector<float> EdgeY = Filter2D(Achromatic, Gauss, Edge, Width, Height);
+        std::vector<float> PointX = Filter2D(Achromatic, Point, Gauss, Width, Height);
+        std::vector<float> PointY = Filter2D(Achromatic, Gauss, Point, Width, Height);
+
+        Image.EdgeMagnitude.resize(PixelCount);
+        Image.PointMagnitude.resize(PixelCount);
+        for (int i = 0; i < PixelCount; ++i)
+        {
+            Image.EdgeMagnitude[i] = std::sqrt(EdgeX[i] * EdgeX[i] + EdgeY[i] * EdgeY[i]);
+            Image.PointMagnitude[i] = std::sqrt(PointX[i] * PointX[i] + PointY[i] * PointY[i]);
+        }
+        return Image;
+    }
+}
+
+void ComputeImageDiff(const uint8_t* Reference, const uint8_t* Test, int Width, int Height, float PixelsPerDegree, image_diff_result* Result)
+{
+    prepared_image A = Prepare(Reference, Width, Height, PixelsPerDegree);
+    prepared_image B = Prepare(Test, Width, Height, PixelsPerDegree);
+
+    // Largest color difference: between pure green and pure blue
+    const float QC = 0.7f;
+    const float PC = 0.4f;
+    const float PT = 0.95f;
+    const float QF = 0.5f;
+    float MaxColorDiff = std::pow(HyAB(Hunt(XYZToLab(LinearRGBToXYZ({ 0.f, 1.f, 0.f }))), Hunt(XYZToLab(LinearRGBToXYZ({ 0.f, 0.f, 1.f })))), QC);
+
+    int PixelCount = Width * Height;
+    Result->ErrorMap.resize(PixelCount);
+    double Sum = 0.0;
+    Result->MaxError = 0.0;
+    for (int i = 0; i < PixelCount; ++i)
+    {
+        // Color error compressed to [0, 1]: most of the range goes to small differences
+        float ColorDiff = std::pow(HyAB(A.FilteredLab[i], B.FilteredLab[i]), QC);
+        if (ColorDiff < PC * MaxColorDiff)
+            ColorDiff = PT / (PC * MaxColorDiff) * ColorDiff;
+        else
+            ColorDiff = PT + (ColorDiff - PC * MaxColorDiff) / (MaxColorDiff - PC * MaxColorDiff) * (1.f - PT);
+        ColorDiff = std::min(ColorDiff, 1.f);
+
+        float EdgeDiff = std::fabs(A.EdgeMagnitude[i] - B.EdgeMagnitude[i]);
+        float PointDiff = std::fabs(A.PointMagnitude[i] - B.PointMagnitude[i]);
+        float FeatureDiff = std::pow(std::min(std::max(EdgeDiff, PointDiff) / std::sqrt(2.f), 1.f), QF);
+
+        float Error = std::pow(ColorDiff, 1.f - FeatureDiff);
+        Result->ErrorMap[i] = Error;
+        Sum += Error;
+        Result->MaxError = std::max(Result->MaxError, (double)Error);
+    }
+    Result->MeanError = PixelCount > 0 ? Sum / PixelCount : 0.0;
+
+    std::vector<float> Sorted = Result->ErrorMap;
+    size_t P99Index = Sorted.empty() ? 0 : (size_t)(0.99 * (Sorted.size() - 1));
+    if (!Sorted.empty())
+    {
+        std::nth_element(Sorted.begin(), Sorted.begin() + P99Index, Sorted.end());
+        Result->P99Error = Sorted[P99Index];
+    }
+    else
+    {
+        Result->P99Error = 0.0;
+    }
+}
+
+std::vector<uint8_t> ImageDiffHeatMap(const image_diff_result& Result)
+{
+    std::vector<uint8_t> Pixels(Result.ErrorMap.size() * 3);
+    for (size_t i = 0; i < Result.ErrorMap.size(); ++i)
+    {
+        // Black -> red -> yellow
+        float Error = std::clamp(Result.ErrorMap[i], 0.f, 1.f);
+        Pixels[i * 3 + 0] = (uint8_t)(255.f * std::min(Error * 2.f, 1.f));
+        Pixels[i * 3 + 1] = (uint8_t)(255.f * std::max(Error * 2.f - 1.f, 0.f));
+        Pixels[i * 3 + 2] = 0;
+    }
+    return Pixels;
+}
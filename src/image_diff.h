@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct image_diff_result
+{
+    double MeanError;
+    double MaxError;
+    double P99Error;
+    std::vector<float> ErrorMap; // Per pixel error in [0, 1], same layout as the images
+};
+
+// FLIP-style perceptual difference of two RGBA8 sRGB images (alpha ignored)
+// Color term: images filtered by the contrast sensitivity of the eye (opponent space) then compared with HyAB in Lab
+// Feature term: edges and points of the achromatic channel, raising the color error where structures differ
+// PixelsPerDegree is the viewing condition (67: 0.7 m from a 24" 4K monitor)
+void ComputeImageDiff(const uint8_t* Reference, const uint8_t* Test, int Width, int Height, float PixelsPerDegree, image_diff_result* Result);
+
+// Error map as RGB8 heat map (black to yellow)
+std::vector<uint8_t> ImageDiffHeatMap(const image_diff_result& Result);
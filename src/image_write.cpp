@@ -0,0 +1,111 @@
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+#include "image_write.h"
+
+static uint32_t CRC32(uint32_t CRC, const uint8_t* Data, size_t Size)
+{
+    static uint32_t Table[256];
+    if (Table[1] == 0)
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t Value = i;
+            for (int k = 0; k < 8; ++k)
+                Value = (Value & 1) ? 0xEDB88320u ^ (Value >> 1) : Value >> 1;
+            Table[i] = Value;
+        }
+    }
+
+    CRC = ~CRC;
+    for (size_t i = 0; i < Size; ++i)
+        CRC = Table[(CRC ^ Data[i]) & 0xFF] ^ (CRC >> 8);
+    return ~CRC;
+}
+
+static void PushU32(std::vector<uint8_t>& Out, uint32_t Value)
+{
+    Out.push_back((uint8_t)(Value >> 24));
+    Out.push_back((uint8_t)(Value >> 16));
+    Out.push_back((uint8_t)(Value >> 8));
+    Out.push_back((uint8_t)Value);
+}
+
+static void WriteChunk(FILE* File, const char* Type, const std::vector<uint8_t>& Data)
+{
+    std::vector<uint8_t> Chunk;
+    PushU32(Chunk, (uint32_t)Data.size());
+    Chunk.insert(Chunk.end(), Type, Type + 4);
+    Chunk.insert(Chunk.end(), Data.begin(), Data.end());
+    PushU32(Chunk, CRC32(0, Chunk.data() + 4, Chunk.size() - 4)); // Type and data
+    fwrite(Chunk.data(), 1, Chunk.size(), File);
+}
+
+bool WritePNG(const char* Filename, int Width, int Height, int Channels, const uint8_t* Pixels)
+{
+    static const uint8_t ColorTypes[] = { 0, 0, 4, 2, 6 }; // Grey, grey alpha, RGB, RGBA
+    if (Channels < 1 || Channels > 4)
+        return false;
+
+    FILE* File = fopen(Filename, "wb");
+    if (File == nullptr)
+    {
+        fprintf(stderr, "Cannot write image '%s'\n", Filename);
+        return false;
+    }
+
+    static const uint8_t Signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    fwrite(Signature, 1, sizeof(Signature), File);
+
+    std::vector<uint8_t> Header;
+    PushU32(Header, (uint32_t)Width);
+    PushU32(Header, (uint32_t)Height);
+    Header.push_back(8); // Bit depth
+    Header.push_back(ColorTypes[Channels]);
+    Header.push_back(0); // Compression
+    Header.push_back(0); // Filter
+    Header.push_back(0); // Interlace
+    WriteChunk(File, "IHDR", Header);
+
+    // Scanlines with filter type 0
+    size_t RowSize = (size_t)Width * Channels;
+    std::vector<uint8_t> Raw;
+    Raw.reserve((RowSize + 1) * Height);
+    for (int y = 0; y < Height; ++y)
+    {
+        Raw.push_back(0);
+        Raw.insert(Raw.end(), Pixels + y * RowSize, Pixels + (y + 1) * RowSize);
+    }
+
+    // zlib stream made of stored deflate blocks
+    std::vector<uint8_t> ZLib = { 0x78, 0x01 };
+    uint32_t A = 1, B = 0; // Adler-32
+    for (size_t Offset = 0; Offset < Raw.size() || Offset == 0; )
+    {
+        size_t BlockSize = std::min<size_t>(Raw.size() - Offset, 65535);
+        bool Last = Offset + BlockSize == Raw.size();
+        ZLib.push_back(Last ? 1 : 0);
+        ZLib.push_back((uint8_t)BlockSize);
+        ZLib.push_back((uint8_t)(BlockSize >> 8));
+        ZLib.push_back((uint8_t)~BlockSize);
+        ZLib.push_back((uint8_t)(~BlockSize >> 8));
+        ZLib.insert(ZLib.end(), Raw.begin() + Offset, Raw.begin() + Offset + BlockSize);
+
+        for (size_t i = Offset; i < Offset + BlockSize; ++i)
+        {
+            A = (A + Raw[i]) % 65521;
+            B = (B + A) % 65521;
+        }
+
+        Offset += BlockSize;
+        if (Last)
+            break;
+    }
+    PushU32(ZLib, (B << 16) | A);
+    WriteChunk(File, "IDAT", ZLib);
+    WriteChunk(File, "IEND", {});
+
+    fclose(File);
+    return true;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// Uncompressed PNG (stored deflate blocks), enough for captures read back by stb_image
+// Pixels are 8 bit per channel (1 to 4 channels), top row first
+bool WritePNG(const char* Filename, int Width, int Height, int Channels, const uint8_t* Pixels);
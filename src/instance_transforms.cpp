@@ -0,0 +1,198 @@
+#include <cstdint>
+#include <algorithm>
+
+#include <xmmintrin.h>
+
+#include "maths.h"
+#include "jobs.h"
+#include "cpu_profiler.h"
+
+#include "instance_transforms.h"
+
+// Instances per job, enough to hide the scheduling cost
+static const int MIN_BATCH_SIZE = 16384;
+
+void Instances::transforms_soa::Clear()
+{
+    PositionX.clear(); PositionY.clear(); PositionZ.clear();
+    RotationX.clear(); RotationY.clear(); RotationZ.clear(); RotationW.clear();
+    ScaleX.clear(); ScaleY.clear(); ScaleZ.clear();
+}
+
+void Instances::transforms_soa::Add(v3 Position, v4 Rotation, v3 Scale)
+{
+    PositionX.push_back(Position.x);
+    PositionY.push_back(Position.y);
+    PositionZ.push_back(Position.z);
+    RotationX.push_back(Rotation.x);
+    RotationY.push_back(Rotation.y);
+    RotationZ.push_back(Rotation.z);
+    RotationW.push_back(Rotation.w);
+    ScaleX.push_back(Scale.x);
+    ScaleY.push_back(Scale.y);
+    ScaleZ.push_back(Scale.z);
+}
+
+// Matrices of 4 instances from their SoA components, stored in address order
+static inline void ComposeStore4(__m128 QX, __m128 QY, __m128 QZ, __m128 QW, int i, const Instances::transforms_soa& Transforms,
+                                 Instances::matrix3x4* Matrices, bool Stream)
+{
+    const __m128 One = _mm_set1_ps(1.f);
+    const __m128 Two = _mm_set1_ps(2.f);
+
+    __m128 X2 = _mm_mul_ps(QX, Two), Y2 = _mm_mul_ps(QY, Two), Z2 = _mm_mul_ps(QZ, Two);
+    __m128 XX = _mm_mul_ps(QX, X2), YY = _mm_mul_ps(QY, Y2), ZZ = _mm_mul_ps(QZ, Z2);
+    __m128 XY = _mm_mul_ps(QX, Y2), XZ = _mm_mul_ps(QX, Z2), YZ = _mm_mul_ps(QY, Z2);
+    __m128 WX = _mm_mul_ps(QW, X2), WY = _mm_mul_ps(QW, Y2), WZ = _mm_mul_ps(QW, Z2);
+
+    __m128 SX = _mm_loadu_ps(&Transforms.ScaleX[i]);
+    __m128 SY = _mm_loadu_ps(&Transforms.ScaleY[i]);
+    __m128 SZ = _mm_loadu_ps(&Transforms.ScaleZ[i]);
+
+    // Element (row, column) of the 4 matrices, columns scaled
+    __m128 R0[4] =
+    {
+        _mm_mul_ps(_mm_sub_ps(One, _mm_add_ps(YY, ZZ)), SX),
+        _mm_mul_ps(_mm_sub_ps(XY, WZ), SY),
+        _mm_mul_ps(_mm_add_ps(XZ, WY), SZ),
+        _mm_loadu_ps(&Transforms.PositionX[i]),
+    };
+    __m128 R1[4] =
+    {
+        _mm_mul_ps(_mm_add_ps(XY, WZ), SX),
+        _mm_mul_ps(_mm_sub_ps(One, _mm_add_ps(XX, ZZ)), SY),
+        _mm_mul_ps(_mm_sub_ps(YZ, WX), SZ),
+        _mm_loadu_ps(&Transforms.PositionY[i]),
+    };
+    __m128 R2[4] =
+    {
+        _mm_mul_ps(_mm_sub_ps(XZ, WY), SX),
+        _mm_mul_ps(_mm_add_ps(YZ, WX), SY),
+        _mm_mul_ps(_mm_sub_ps(One, _mm_add_ps(XX, YY)), SZ),
+        _mm_loadu_ps(&Transforms.PositionZ[i]),
+    };
+
+    // SoA to one row per register
+    _MM_TRANSPOSE4_PS(R0[0], R0[1], R0[2], R0[3]);
+    _MM_TRANSPOSE4_PS(R1[0], R1[1], R1[2], R1[3]);
+    _MM_TRANSPOSE4_PS(R2[0], R2[1], R2[2], R2[3]);
+
+    float* Out = Matrices[i].Rows[0].e;
+    for (int j = 0; j < 4; ++j, Out += 12)
+    {
+        if (Stream)
+        {
+            _mm_stream_ps(Out + 0, R0[j]);
+            _mm_stream_ps(Out + 4, R1[j]);
+            _mm_stream_ps(Out + 8, R2[j]);
+        }
+        else
+        {
+            _mm_storeu_ps(Out + 0, R0[j]);
+            _mm_storeu_ps(Out + 4, R1[j]);
+            _mm_storeu_ps(Out + 8, R2[j]);
+        }
+    }
+}
+
+static inline void ComposeScalar(v4 Q, int i, const Instances::transforms_soa& Transforms, Instances::matrix3x4* Matrices)
+{
+    float XX = 2.f * Q.x * Q.x, YY = 2.f * Q.y * Q.y, ZZ = 2.f * Q.z * Q.z;
+    float XY = 2.f * Q.x * Q.y, XZ = 2.f * Q.x * Q.z, YZ = 2.f * Q.y * Q.z;
+    float WX = 2.f * Q.w * Q.x, WY = 2.f * Q.w * Q.y, WZ = 2.f * Q.w * Q.z;
+    float SX = Transforms.ScaleX[i], SY = Transforms.ScaleY[i], SZ = Transforms.ScaleZ[i];
+
+    Matrices[i].Rows[0] = { (1.f - YY - ZZ) * SX, (XY - WZ) * SY, (XZ + WY) * SZ, Transforms.PositionX[i] };
+    Matrices[i].Rows[1] = { (XY + WZ) * SX, (1.f - XX - ZZ) * SY, (YZ - WX) * SZ, Transforms.PositionY[i] };
+    Matrices[i].Rows[2] = { (XZ - WY) * SX, (YZ + WX) * SY, (1.f - XX - YY) * SZ, Transforms.PositionZ[i] };
+}
+
+void Instances::ComposeMatrices(const transforms_soa& Transforms, int Begin, int End, matrix3x4* Matrices)
+{
+    bool Stream = ((uintptr_t)Matrices & 15) == 0;
+
+    int i = Begin;
+    for (; i + 4 <= End; i += 4)
+    {
+        ComposeStore4(_mm_loadu_ps(&Transforms.RotationX[i]), _mm_loadu_ps(&Transforms.RotationY[i]),
+                      _mm_loadu_ps(&Transforms.RotationZ[i]), _mm_loadu_ps(&Transforms.RotationW[i]), i, Transforms, Matrices, Stream);
+    }
+
+    // Remainder
+    for (; i < End; ++i)
+        ComposeScalar({ Transforms.RotationX[i], Transforms.RotationY[i], Transforms.RotationZ[i], Transforms.RotationW[i] }, i, Transforms, Matrices);
+
+    // Non-temporal stores visible before the buffer is unmapped
+    if (Stream)
+        _mm_sfence();
+}
+
+void Instances::RotateAndCompose(transforms_soa& Transforms, v4 Rotation, int Begin, int End, matrix3x4* Matrices)
+{
+    bool Stream = ((uintptr_t)Matrices & 15) == 0;
+
+    const __m128 RX = _mm_set1_ps(Rotation.x);
+    const __m128 RY = _mm_set1_ps(Rotation.y);
+    const __m128 RZ = _mm_set1_ps(Rotation.z);
+    const __m128 RW = _mm_set1_ps(Rotation.w);
+    const __m128 Half = _mm_set1_ps(0.5f);
+    const __m128 ThreeHalves = _mm_set1_ps(1.5f);
+
+    int i = Begin;
+    for (; i + 4 <= End; i += 4)
+    {
+        __m128 X = _mm_loadu_ps(&Transforms.RotationX[i]);
+        __m128 Y = _mm_loadu_ps(&Transforms.RotationY[i]);
+        __m128 Z = _mm_loadu_ps(&Transforms.RotationZ[i]);
+        __m128 W = _mm_loadu_ps(&Transforms.RotationW[i]);
+
+        // Quat::Multiply(Q, Rotation)
+        __m128 NX = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(W, RX), _mm_mul_ps(X, RW)), _mm_mul_ps(Y, RZ)), _mm_mul_ps(Z, RY));
+        __m128 NY = _mm_add_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(W, RY), _mm_mul_ps(X, RZ)), _mm_mul_ps(Y, RW)), _mm_mul_ps(Z, RX));
+        __m128 NZ = _mm_add_ps(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(W, RZ), _mm_mul_ps(X, RY)), _mm_mul_ps(Y, RX)), _mm_mul_ps(Z, RW));
+        __m128 NW = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_mul_ps(W, RW), _mm_mul_ps(X, RX)), _mm_mul_ps(Y, RY)), _mm_mul_ps(Z, RZ));
+
+        // Renormalized so the errors do not accumulate over the frames: rsqrt and a Newton-Raphson step
+        __m128 LengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(NX, NX), _mm_mul_ps(NY, NY)), _mm_add_ps(_mm_mul_ps(NZ, NZ), _mm_mul_ps(NW, NW)));
+        __m128 InvLength = _mm_rsqrt_ps(LengthSq);
+        InvLength = _mm_mul_ps(InvLength, _mm_sub_ps(ThreeHalves, _mm_mul_ps(_mm_mul_ps(Half, LengthSq), _mm_mul_ps(InvLength, InvLength))));
+        NX = _mm_mul_ps(NX, InvLength);
+        NY = _mm_mul_ps(NY, InvLength);
+        NZ = _mm_mul_ps(NZ, InvLength);
+        NW = _mm_mul_ps(NW, InvLength);
+
+        _mm_storeu_ps(&Transforms.RotationX[i], NX);
+        _mm_storeu_ps(&Transforms.RotationY[i], NY);
+        _mm_storeu_ps(&Transforms.RotationZ[i], NZ);
+        _mm_storeu_ps(&Transforms.RotationW[i], NW);
+
+        ComposeStore4(NX, NY, NZ, NW, i, Transforms, Matrices, Stream);
+    }
+
+    // Remainder
+    for (; i < End; ++i)
+    {
+        v4 Q = Quat::Multiply({ Transforms.RotationX[i], Transforms.RotationY[i], Transforms.RotationZ[i], Transforms.RotationW[i] }, Rotation);
+        Q = Q / Math::Sqrt(Q.x * Q.x + Q.y * Q.y + Q.z * Q.z + Q.w * Q.w);
+        Transforms.RotationX[i] = Q.x;
+        Transforms.RotationY[i] = Q.y;
+        Transforms.RotationZ[i] = Q.z;
+        Transforms.RotationW[i] = Q.w;
+        ComposeScalar(Q, i, Transforms, Matrices);
+    }
+
+    if (Stream)
+        _mm_sfence();
+}
+
+void Instances::ParallelRotateAndCompose(transforms_soa& Transforms, v4 Rotation, matrix3x4* Matrices)
+{
+    PROFILE_FUNCTION();
+
+    // Batches of groups of 4 instances: only the last instances take the scalar path, whatever the split
+    int Count = Transforms.GetCount();
+    Jobs::ParallelFor((Count + 3) / 4, MIN_BATCH_SIZE / 4, [&](int Begin, int End)
+    {
+        RotateAndCompose(Transforms, Rotation, Begin * 4, std::min(End * 4, Count), Matrices);
+    });
+}
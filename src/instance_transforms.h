@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+
+#include "types.h"
+
+// CPU driven instance transforms: translation, rotation and scale stored in SoA, composed into 3x4 matrices
+// 4 instances per SSE instruction, ranges split on the job pool (Jobs::ParallelFor)
+namespace Instances
+{
+    struct transforms_soa
+    {
+        std::vector<float> PositionX, PositionY, PositionZ;
+        std::vector<float> RotationX, RotationY, RotationZ, RotationW; // Unit quaternions
+        std::vector<float> ScaleX, ScaleY, ScaleZ;
+
+        void Clear();
+        void Add(v3 Position, v4 Rotation, v3 Scale);
+        int GetCount() const { return (int)PositionX.size(); }
+        size_t GetMemorySize() const { return PositionX.capacity() * 10 * sizeof(float); }
+    };
+
+    // First three rows of the model matrix (translation in w): 48 bytes per instance instead of 64
+    struct matrix3x4
+    {
+        v4 Rows[3];
+    };
+
+    // Matrices[i] = T * R * S of the instances [Begin, End)
+    // Matrices can be a mapped buffer: it is only written, with non-temporal stores when 16 bytes aligned
+    void ComposeMatrices(const transforms_soa& Transforms, int Begin, int End, matrix3x4* Matrices);
+
+    // Rotations of [Begin, End) post-multiplied by Rotation (in the local space of the instances) and renormalized,
+    // then composed as ComposeMatrices() does in the same pass
+    void RotateAndCompose(transforms_soa& Transforms, v4 Rotation, int Begin, int End, matrix3x4* Matrices);
+
+    // RotateAndCompose() of every instance on the job pool, the result does not depend on the thread count
+    void ParallelRotateAndCompose(transforms_soa& Transforms, v4 Rotation, matrix3x4* Matrices);
+}
@@ -0,0 +1,167 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "cpu_profiler.h"
+
+#include "jobs.h"
+
+namespace
+{
+    struct job_pool
+    {
+        std::vector<std::thread> Workers;
+
+        std::mutex Mutex;
+        std::condition_variable WorkAvailable;
+        std::condition_variable WorkDone;
+
+        // Current ParallelFor(), published under Mutex
+        const std::function<void(int, int)>* Body = nullptr;
+        int Count = 0;
+        int BatchSize = 1;
+        uint64_t Generation = 0;
+        int ActiveWorkers = 0;
+        bool Quit = false;
+
+        std::atomic<int> NextBatch{ 0 };
+
+        job_pool()
+        {
+            Start(std::max((int)std::thread::hardware_concurrency() - 1, 0));
+        }
+
+        ~job_pool()
+        {
+            Stop();
+        }
+
+        void Start(int WorkerCount)
+        {
+            for (int i = 0; i < WorkerCount; ++i)
+                Workers.emplace_back([this, i]() { WorkerMain(i); });
+        }
+
+        void Stop()
+        {
+            {
+                std::lock_guard<std::mutex> Lock(Mutex);
+                Quit = true;
+            }
+            WorkAvailable.notify_all();
+            for (std::thread& Worker : Workers)
+                Worker.join();
+            Workers.clear();
+            Quit = false;
+        }
+
+        // Batches are taken in order until none is left
+        void RunBatches(const std::function<void(int, int)>& Body, int Count, int BatchSize)
+        {
+            int BatchCount = (Count + BatchSize - 1) / BatchSize;
+            for (int Batch = NextBatch.fetch_add(1); Batch < BatchCount; Batch = NextBatch.fetch_add(1))
+                Body(Batch * BatchSize, std::min((Batch + 1) * BatchSize, Count));
+        }
+
+        void WorkerMain(int WorkerIndex)
+        {
+            std::string Name = "Worker " + std::to_string(WorkerIndex);
+            CPUProfiler::SetThreadName(Name.c_str());
+
+            uint64_t SeenGeneration = 0;
+            while (true)
+            {
+                const std::function<void(int, int)>* CurrentBody;
+                int CurrentCount, CurrentBatchSize;
+                {
+                    std::unique_lock<std::mutex> Lock(Mutex);
+                    WorkAvailable.wait(Lock, [&]() { return Quit || Generation != SeenGeneration; });
+                    if (Quit)
+                        return;
+                    SeenGeneration = Generation;
+                    // Woke up after the ParallelFor() returned
+                    if (Body == nullptr)
+                        continue;
+                    CurrentBody = Body;
+                    CurrentCount = Count;
+                    CurrentBatchSize = BatchSize;
+                    ActiveWorkers++;
+                }
+
+                {
+                    PROFILE_SCOPE("Jobs::ParallelFor");
+                    RunBatches(*CurrentBody, CurrentCount, CurrentBatchSize);
+                }
+
+                {
+                    std::lock_guard<std::mutex> Lock(Mutex);
+                    ActiveWorkers--;
+                }
+                WorkDone.notify_all();
+            }
+        }
+    };
+
+    job_pool& GetPool()
+    {
+        static job_pool Pool;
+        return Pool;
+    }
+}
+
+void Jobs::ParallelFor(int Count, int MinBatchSize, const std::function<void(int Begin, int End)>& Body)
+{
+    if (Count <= 0)
+        return;
+
+    job_pool& Pool = GetPool();
+
+    // About 4 batches per thread for balancing
+    int ThreadCount = (int)Pool.Workers.size() + 1;
+    int BatchSize = std::max(MinBatchSize, (Count + ThreadCount * 4 - 1) / (ThreadCount * 4));
+    if (Pool.Workers.empty() || BatchSize >= Count)
+    {
+        Body(0, Count);
+        return;
+    }
+
+    {
+        // Workers still leaving the previous call must not take batches of this one
+        std::unique_lock<std::mutex> Lock(Pool.Mutex);
+        Pool.WorkDone.wait(Lock, [&]() { return Pool.ActiveWorkers == 0; });
+        Pool.Body = &Body;
+        Pool.Count = Count;
+        Pool.BatchSize = BatchSize;
+        Pool.NextBatch.store(0);
+        Pool.Generation++;
+    }
+    Pool.WorkAvailable.notify_all();
+
+    Pool.RunBatches(Body, Count, BatchSize);
+
+    // Workers that wake up later see no body and go back to sleep
+    std::unique_lock<std::mutex> Lock(Pool.Mutex);
+    Pool.WorkDone.wait(Lock, [&]() { return Pool.ActiveWorkers == 0; });
+    Pool.Body = nullptr;
+}
+
+void Jobs::SetThreadCount(int ThreadCount)
+{
+    if (ThreadCount <= 0)
+        ThreadCount = std::max((int)std::thread::hardware_concurrency(), 1);
+
+    job_pool& Pool = GetPool();
+    if ((int)Pool.Workers.size() + 1 == ThreadCount)
+        return;
+    Pool.Stop();
+    Pool.Start(ThreadCount - 1);
+}
+
+int Jobs::GetThreadCount()
+{
+    return (int)GetPool().Workers.size() + 1;
+}
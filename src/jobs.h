@@ -0,0 +1,18 @@
+#pragma once
+
+#include <functional>
+
+// Persistent worker threads (hardware threads - 1) started on first use, the calling thread works too
+// Bodies must not call ParallelFor() themselves
+namespace Jobs
+{
+    // Split [0, Count) in batches of at least MinBatchSize items and run Body(Begin, End) on every batch, returns when all are done
+    void ParallelFor(int Count, int MinBatchSize, const std::function<void(int Begin, int End)>& Body);
+
+    // Calling thread included
+    int GetThreadCount();
+
+    // Restart the pool with ThreadCount threads (calling thread included, hardware threads if <= 0)
+    // Not while a ParallelFor() is running. Checks and benchmarks use it to compare thread counts
+    void SetThreadCount(int ThreadCount);
+}
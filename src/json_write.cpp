@@ -0,0 +1,16 @@
+#include "json_write.h"
+
+void WriteJSONString(FILE* File, const char* Str)
+{
+    fputc('"', File);
+    for (; *Str; ++Str)
+    {
+        if (*Str == '"' || *Str == '\\')
+            fputc('\\', File);
+        if ((unsigned char)*Str < 0x20)
+            fputc(' ', File);
+        else
+            fputc(*Str, File);
+    }
+    fputc('"', File);
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdio>
+
+// Str as a quoted JSON string: quotes and backslashes escaped, control characters replaced by spaces
+void WriteJSONString(FILE* File, const char* Str);
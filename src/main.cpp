@@ -1,7 +1,11 @@
 
 #include <memory>
 #include <cstdio>
+#include <string>
+#include <vector>
 #include <typeinfo>
+#include <algorithm>
+#include <chrono>
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
@@ -14,31 +18,27 @@
 
 #include "opengl_helpers.h"
 #include "opengl_helpers_wireframe.h"
+#include "opengl_helpers_stats.h"
+#include "opengl_helpers_memory.h"
 #include "maths.h"
 #include "camera.h"
 #include "platform.h"
+#include "cpu_profiler.h"
+#include "startup_trace.h"
+#include "mesh.h"
+#include "opengl_helpers_program_cache.h"
 
 #include "pg.h"
 
-#include "demo_minimal.h"
-#include "demo_all.h"
+#include "demo_list.h"
+#include "command_line.h"
+#include "headless.h"
+#include "golden.h"
+#include "camera_path.h"
+#include "tavern_scene.h"
 #include "demo_deferred_shading.h"
-#include "demo_picking.h"
-#include "demo_fbo.h"
-#include "demo_skybox.h"
-#include "demo_shadowMap.h"
-#include "demo_base.h"
-#include "demo_hdr.h"
-#include "demo_npr.h"
-#include "demo_normal_map.h"
-#include "demo_pbr.h"
-#include "demo_pg_skybox.h"
-#include "demo_pg_billboard.h"
-#include "demo_pg_billboard2.h"
-#include "demo_pg_postprocess.h"
 #include "demo_instancing.h"
-
-// TODO(demo): Add headers here
+#include "culling.h"
 
 #if 0
 // Run on laptop high perf GPU
@@ -180,64 +180,111 @@ bool KeyPressed(int Key, const keyboard& PrevKeyboard, const keyboard& Keyboard)
 
 int main(int argc, char* argv[])
 {
-    const int WIDTH = 1440;
-    const int HEIGHT = 900;
-    
     app App = {};
 
-    // Init GLFW
-    glfwSetErrorCallback(GLFWErrorCallback);
-    if (glfwInit() != GLFW_TRUE)
+    app_options Options;
+    if (!ParseCommandLine(argc, argv, &Options))
         return 1;
 
-    // Create window
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    { // Restricted scope to force access to Window with App.Window
-        GLFWwindow* Window = glfwCreateWindow(WIDTH, HEIGHT, "Image Based rendering", nullptr, nullptr);
-        glfwSetWindowUserPointer(Window, &App);
-        App.Window = Window;
-        // Store initial window size in IO
-        glfwGetWindowSize(App.Window, &App.IO.WindowWidth, &App.IO.WindowHeight);
+    // F12 and --trace write there
+    std::string TraceFilename = GetOutputPath(Options, Options.TraceFilename);
+
+    CPUProfiler::SetThreadName("Main");
+    if (Options.Trace)
+        CPUProfiler::StartRecording();
+
+    // Before anything loads from the caches
+    if (Options.ColdStart)
+    {
+        Mesh::ClearObjCache("media");
+        GL::ClearProgramBinaryCache();
     }
+    if (Options.StartupTrace)
+        StartupTrace::Start();
+
+    tavern_scene::DefaultExtraLightCount = Options.TavernLights;
+    tavern_scene::DefaultClusteredLights = Options.LightClusters;
+    demo_deferred_shading::DefaultLightVolumes = Options.LightVolumes;
+    Culling::Enabled = Options.FrustumCulling;
+    tavern_scene::DefaultOcclusionCulling = Options.OcclusionCulling;
+    tavern_scene::DefaultSoftwareOcclusion = Options.SoftwareOcclusion;
+    demo_instancing::FindAnimation(Options.InstanceAnimation.c_str(), &demo_instancing::DefaultAnimation); // Validated
+
+    if (!Options.GoldenDir.empty())
+        return RunGolden(Options);
+    if (Options.Headless)
+        return RunHeadless(Options);
 
-    // Register GLFW callbacks
-    glfwSetKeyCallback(App.Window, GLFWKeyCallback);
-    glfwSetMouseButtonCallback(App.Window, GLFWMouseButtonCallback);
-    glfwSetWindowSizeCallback(App.Window, GLFWWindowSizeCallback);
+    // Init GLFW
+    {
+        STARTUP_PHASE("GLFW init");
+        glfwSetErrorCallback(GLFWErrorCallback);
+        if (glfwInit() != GLFW_TRUE)
+            return 1;
+
+        // Create window
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        { // Restricted scope to force access to Window with App.Window
+            GLFWwindow* Window = glfwCreateWindow(Options.Width, Options.Height, "Image Based rendering", nullptr, nullptr);
+            glfwSetWindowUserPointer(Window, &App);
+            App.Window = Window;
+            // Store initial window size in IO
+            glfwGetWindowSize(App.Window, &App.IO.WindowWidth, &App.IO.WindowHeight);
+        }
+
+        // Register GLFW callbacks
+        glfwSetKeyCallback(App.Window, GLFWKeyCallback);
+        glfwSetMouseButtonCallback(App.Window, GLFWMouseButtonCallback);
+        glfwSetWindowSizeCallback(App.Window, GLFWWindowSizeCallback);
+    }
 
     // Init OpenGL
-    glfwMakeContextCurrent(App.Window);
-    glfwSwapInterval(1);
-    if (!gladLoadGL())
     {
-        fprintf(stderr, "gladLoadGL failed.\n");
-        glfwTerminate();
-        return 1;
+        STARTUP_PHASE("OpenGL init");
+        glfwMakeContextCurrent(App.Window);
+        glfwSwapInterval(Options.VSync ? 1 : 0);
+        if (!gladLoadGL())
+        {
+            fprintf(stderr, "gladLoadGL failed.\n");
+            glfwTerminate();
+            return 1;
+        }
+
+        // Count draws, binds and uploads
+        GL::InstallStatsHooks();
+        // Track texture, renderbuffer and buffer sizes
+        GL::InstallMemoryHooks();
+
+        // Setup KHR debug
+        glDebugMessageCallback(OpenGLErrorCallback, nullptr);
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+        glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_PERFORMANCE, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+        glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_OTHER, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+        glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_PUSH_GROUP, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+        glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_POP_GROUP, GL_DONT_CARE, 0, nullptr, GL_FALSE);
     }
 
-    // Setup KHR debug
-    glDebugMessageCallback(OpenGLErrorCallback, nullptr);
-    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
-	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
-	glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_PERFORMANCE, GL_DONT_CARE, 0, nullptr, GL_FALSE);
-	glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_OTHER, GL_DONT_CARE, 0, nullptr, GL_FALSE);
-    
     // Setup Dear ImGui context
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO& io = ImGui::GetIO();
-    io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;       // Enable Keyboard Controls
-    io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;           // Enable Docking
-
-    // Setup Dear ImGui style
-    ImGui::StyleColorsDark();
-    
-    // Setup Platform/Renderer bindings
-    ImGui_ImplGlfw_InitForOpenGL(App.Window, true);
-    ImGui_ImplOpenGL3_Init("#version 330");
+    {
+        STARTUP_PHASE("ImGui init");
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGuiIO& io = ImGui::GetIO();
+        io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;       // Enable Keyboard Controls
+        io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;           // Enable Docking
+
+        // Setup Dear ImGui style
+        ImGui::StyleColorsDark();
+
+        // Setup Platform/Renderer bindings
+        ImGui_ImplGlfw_InitForOpenGL(App.Window, true);
+        ImGui_ImplOpenGL3_Init("#version 330");
+    }
+
     bool ShowDemoWindow = false;
     bool HideImGui = false;
 
@@ -245,43 +292,77 @@ int main(int argc, char* argv[])
 
     // Demo scope
     {
-        PG::Init();
+        {
+            STARTUP_PHASE("PG::Init");
+            PG::Init();
+        }
         GL::cache GLCache;
         GL::debug GLDebug;
 
         // First update to pass to demo constructors
         GLFWPlatformIOUpdate(App.Window, &App.IO);
         
-        int DemoId = 0; // Change this to start with another demo
-        std::unique_ptr<demo> Demos[] =
+        // Camera path recorded or replayed from the first frame of the starting demo
+        camera_path CameraPath;
+        bool RecordingCamera = !Options.RecordCameraPath.empty();
+        bool ReplayingCamera = !Options.ReplayCameraPath.empty() && CameraPath.Load(Options.ReplayCameraPath.c_str());
+        int CameraPathFrame = 0;
+        if (RecordingCamera || ReplayingCamera)
+            CameraPathSetFixedTime(&App.IO, 0);
+
+        const std::string& DemoName = Options.Demo.empty() && ReplayingCamera ? CameraPath.Demo : Options.Demo;
+        int DemoId = DemoName.empty() ? 0 : std::max(FindDemo(DemoName.c_str()), 0);
+        int DemoCount;
+        const demo_info* DemoInfos = GetDemoInfos(&DemoCount);
+        std::vector<std::unique_ptr<demo>> Demos;
         {
-            std::make_unique<demo_pbr>(App.IO, GLCache, GLDebug),
-            std::make_unique<demo_fbo>(App.IO, GLCache, GLDebug),
-            std::make_unique<demo_shadowMap>(GLCache, GLDebug),
-            std::make_unique<demo_normal_map>(GLCache, GLDebug),
-            std::make_unique<demo_skybox>(GLCache, GLDebug),
-            std::make_unique<demo_hdr>(App.IO, GLCache, GLDebug),
-            std::make_unique<demo_npr>(App.IO, GLCache, GLDebug),
-            std::make_unique<demo_instancing>(GLCache, GLDebug),
-            std::make_unique<demo_all>(App.IO, GLCache, GLDebug),
-            std::make_unique<demo_picking>(App.IO, GLCache, GLDebug),
-            std::make_unique<demo_deferred_shading>(App.IO, GLCache, GLDebug),
-            std::make_unique<demo_base>(GLCache, GLDebug),
-        };
+            STARTUP_PHASE("Demo constructors");
+            for (int i = 0; i < DemoCount; ++i)
+            {
+                STARTUP_PHASE_DETAIL("Demo constructor", DemoInfos[i].Name);
+                Demos.push_back(DemoInfos[i].Create(App.IO, GLCache, GLDebug));
+            }
+        }
+
+        // Demo and wireframe GL calls of the last frame (ImGui excluded)
+        GL::frame_stats LastFrameStats = {};
 
         // Main loop
         while (!glfwWindowShouldClose(App.Window))
         {
+            PROFILE_SCOPE("Frame");
+            std::chrono::steady_clock::time_point FrameStart = std::chrono::steady_clock::now();
+
             // HANDLE INPUTS ------------------------------
             // --------------------------------------------
             // Store keyboard state before glfwPollEvents because input callbacks are triggered inside it
             keyboard PrevKeyboard = App.Keyboard;
             App.IO.WindowSizeChanged = false;
-            glfwPollEvents();
+            {
+                PROFILE_SCOPE("glfwPollEvents");
+                glfwPollEvents();
+            }
 
             GLFWPlatformIOUpdate(App.Window, &App.IO);
             
-            App.IO.CameraInputs = GLFWGetCameraInputs(App.IO, App.Keyboard);
+            // Fixed time step, replaces GLFWPlatformIOUpdate() timings
+            if (ReplayingCamera && CameraPathFrame == CameraPath.GetFrameCount())
+            {
+                printf("Camera replay finished (%d frames)\n", CameraPathFrame);
+                ReplayingCamera = false;
+            }
+            if (RecordingCamera || ReplayingCamera)
+                CameraPathSetFixedTime(&App.IO, CameraPathFrame);
+
+            if (ReplayingCamera)
+                App.IO.CameraInputs = CameraPath.GetInputs(CameraPathFrame);
+            else
+                App.IO.CameraInputs = GLFWGetCameraInputs(App.IO, App.Keyboard);
+
+            if (RecordingCamera)
+                CameraPath.Record(App.IO.CameraInputs);
+            if (RecordingCamera || ReplayingCamera)
+                CameraPathFrame++;
 
             // Escape key (capture mouse to move camera)
             if (KeyPressed(GLFW_KEY_ESCAPE, PrevKeyboard, App.Keyboard))
@@ -308,6 +389,20 @@ int main(int argc, char* argv[])
                 App.IO.DebugKeysDown[i]    = App.Keyboard.Keys[Key];
                 App.IO.DebugKeysPressed[i] = KeyPressed(Key, PrevKeyboard, App.Keyboard);
             }
+
+            // F12 key (start/stop CPU trace recording)
+            if (KeyPressed(GLFW_KEY_F12, PrevKeyboard, App.Keyboard))
+            {
+                if (CPUProfiler::IsRecording())
+                {
+                    CPUProfiler::StopRecording();
+                    CPUProfiler::WriteTrace(TraceFilename.c_str());
+                }
+                else
+                {
+                    CPUProfiler::StartRecording();
+                }
+            }
             
             // Start the Dear ImGui frame
             ImGui_ImplOpenGL3_NewFrame();
@@ -317,23 +412,43 @@ int main(int argc, char* argv[])
                 ImGui::GetIO().MousePos = ImVec2(-FLT_MAX,-FLT_MAX);
             ImGui::NewFrame();
             
-            // Demo id selector
+            // Demo id selector (the camera path only applies to its demo)
+            if (RecordingCamera || ReplayingCamera)
+            {
+                ImGui::Text("[%s] %s camera path: frame %d", DemoInfos[DemoId].Name, RecordingCamera ? "Recording" : "Replaying", CameraPathFrame);
+            }
+            else
             {
                 if (ImGui::Button("Previous"))
-                    DemoId = Math::TrueMod(DemoId - 1, (int)ARRAY_SIZE(Demos));
+                    DemoId = Math::TrueMod(DemoId - 1, DemoCount);
                 ImGui::SameLine();
-                ImGui::Text("%d/%d", DemoId+1, (int)ARRAY_SIZE(Demos));
+                ImGui::Text("%d/%d", DemoId+1, DemoCount);
                 ImGui::SameLine();
                 if (ImGui::Button("Next"))
-                    DemoId = Math::TrueMod(DemoId + 1, (int)ARRAY_SIZE(Demos));
+                    DemoId = Math::TrueMod(DemoId + 1, DemoCount);
                 ImGui::SameLine();
-                ImGui::Text("[%s]", typeid(*Demos[DemoId]).name());
+                ImGui::Text("[%s]", DemoInfos[DemoId].Name);
             }
 
             // Display GPU infos
             ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
             ImGui::Checkbox("Demo window", &ShowDemoWindow);
 
+            if (ImGui::CollapsingHeader("GPU profiler"))
+                GLDebug.Profiler.DisplayDebugUI();
+
+            if (ImGui::CollapsingHeader("Render stats"))
+            {
+                GL::DisplayFrameStats(LastFrameStats);
+                ImGui::Checkbox("Frustum culling", &Culling::Enabled);
+            }
+
+            if (ImGui::CollapsingHeader("Memory"))
+                GL::DisplayMemoryUI();
+
+            if (CPUProfiler::IsRecording())
+                ImGui::TextColored(ImVec4(1.f, 0.3f, 0.3f, 1.f), "Recording CPU trace (F12 to stop and write '%s')", TraceFilename.c_str());
+
             if (ImGui::CollapsingHeader("System info"))
             {
                 ImGui::Text("GL_VERSION: %s", glGetString(GL_VERSION));
@@ -344,25 +459,81 @@ int main(int argc, char* argv[])
             if (ShowDemoWindow)
                 ImGui::ShowDemoWindow(&ShowDemoWindow);
 
+            // Reload modified shaders
+            {
+                PROFILE_SCOPE("Shader reload");
+                GLDebug.Shaders.Update();
+            }
+
+            // Give back last frame transient render targets
+            GLDebug.RenderTargets.BeginFrame();
+
+            GL::ResetFrameStats();
+
+            // GPU timings are read back a few frames later
+            GLDebug.Profiler.BeginFrame();
+
             // Display demo
-            Demos[DemoId]->Update(App.IO);
+            {
+                PROFILE_SCOPE("Demo update");
+                GL::gpu_scope Scope(GLDebug.Profiler, "Demo");
+                GL::memory_owner_scope MemoryOwner(typeid(*Demos[DemoId]).name());
+                Demos[DemoId]->Update(App.IO);
+            }
+
+            {
+                PROFILE_SCOPE("Wireframe flush");
+                GL::gpu_scope Scope(GLDebug.Profiler, "Wireframe");
+                GLDebug.Wireframe.Flush();
+            }
+
+            LastFrameStats = GL::GetFrameStats();
 
-            GLDebug.Wireframe.Flush();
+            {
+                PROFILE_SCOPE("ImGui render");
+                ImGui::Render();
+                if (HideImGui == false)
+                {
+                    GL::gpu_scope Scope(GLDebug.Profiler, "ImGui");
+                    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+                }
+            }
 
-            ImGui::Render();
-            if (HideImGui == false)
-                ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            GLDebug.Profiler.EndFrame();
 
             // Present framebuffer
-            glfwSwapBuffers(App.Window);
+            {
+                PROFILE_SCOPE("glfwSwapBuffers");
+                glfwSwapBuffers(App.Window);
+            }
+
+            std::chrono::duration<double, std::milli> FrameDuration = std::chrono::steady_clock::now() - FrameStart;
+            StartupTrace::EndFrame(FrameDuration.count());
         }
 
+        if (Options.StartupTrace)
+            StartupTrace::Finish(DemoInfos[DemoId].Name, GetOutputPath(Options, "startup.json").c_str(), GetOutputPath(Options, "startup_history.csv").c_str());
+
+        if (!Options.RecordCameraPath.empty())
+        {
+            CameraPath.Demo = DemoInfos[DemoId].Name;
+            CameraPath.Save(GetOutputPath(Options, Options.RecordCameraPath).c_str());
+        }
+
+        // Shader rebuilds in flight, while the context still exists
+        GLDebug.Shaders.CancelAll();
         PG::Destroy();
     }
 
     double Duration = glfwGetTime() - StartTime;
     printf("Duration %.2fs\n", Duration);
 
+    if (CPUProfiler::IsRecording())
+    {
+        CPUProfiler::StopRecording();
+        CPUProfiler::WriteTrace(TraceFilename.c_str());
+    }
+
     // Cleanup
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
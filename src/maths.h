@@ -388,4 +388,57 @@ namespace Mat4
     }
 };
 
+// ========================================================================
+// QUATERNION FUNCTIONS (v4: x, y, z vector part, w scalar part)
+// ========================================================================
+namespace Quat
+{
+    inline v4 AxisAngle(v3 Axis, float AngleRadians)
+    {
+        float S = Math::Sin(AngleRadians * 0.5f);
+        return { Axis.x * S, Axis.y * S, Axis.z * S, Math::Cos(AngleRadians * 0.5f) };
+    }
+
+    // Rotation by B then by A, as the matrix product A * B
+    inline v4 Multiply(v4 A, v4 B)
+    {
+        return
+        {
+            A.w * B.x + A.x * B.w + A.y * B.z - A.z * B.y,
+            A.w * B.y - A.x * B.z + A.y * B.w + A.z * B.x,
+            A.w * B.z + A.x * B.y - A.y * B.x + A.z * B.w,
+            A.w * B.w - A.x * B.x - A.y * B.y - A.z * B.z,
+        };
+    }
+
+    // Rotation part of a matrix without scale (Shepperd)
+    inline v4 FromMatrix(const mat4& M)
+    {
+        float M00 = M.c[0].e[0], M11 = M.c[1].e[1], M22 = M.c[2].e[2];
+        float Trace = M00 + M11 + M22;
+        v4 Q;
+        if (Trace > 0.f)
+        {
+            float S = Math::Sqrt(Trace + 1.f) * 2.f;
+            Q = { (M.c[1].e[2] - M.c[2].e[1]) / S, (M.c[2].e[0] - M.c[0].e[2]) / S, (M.c[0].e[1] - M.c[1].e[0]) / S, 0.25f * S };
+        }
+        else if (M00 > M11 && M00 > M22)
+        {
+            float S = Math::Sqrt(1.f + M00 - M11 - M22) * 2.f;
+            Q = { 0.25f * S, (M.c[1].e[0] + M.c[0].e[1]) / S, (M.c[2].e[0] + M.c[0].e[2]) / S, (M.c[1].e[2] - M.c[2].e[1]) / S };
+        }
+        else if (M11 > M22)
+        {
+            float S = Math::Sqrt(1.f + M11 - M00 - M22) * 2.f;
+            Q = { (M.c[1].e[0] + M.c[0].e[1]) / S, 0.25f * S, (M.c[2].e[1] + M.c[1].e[2]) / S, (M.c[2].e[0] - M.c[0].e[2]) / S };
+        }
+        else
+        {
+            float S = Math::Sqrt(1.f + M22 - M00 - M11) * 2.f;
+            Q = { (M.c[2].e[0] + M.c[0].e[2]) / S, (M.c[2].e[1] + M.c[1].e[2]) / S, 0.25f * S, (M.c[0].e[1] - M.c[1].e[0]) / S };
+        }
+        return Q;
+    }
+}
+
 #include "maths_extension.h"
\ No newline at end of file
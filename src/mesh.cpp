@@ -5,11 +5,16 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include <filesystem>
 
 #include <tiny_obj_loader.h>
 
 #include "maths.h"
 #include "mesh.h"
+#include "startup_trace.h"
 
 using namespace Mesh;
 
@@ -269,6 +274,151 @@ void Mesh::AddNormalMapParameters(std::vector<vertex_full>& Mesh)
     AddNormalMapParameters(Mesh.data(), Mesh.size());
 }
 
+Mesh::bounds Mesh::ComputeBounds(const vertex_full* Vertices, int VertexCount)
+{
+    bounds Bounds = {};
+    if (VertexCount == 0)
+        return Bounds;
+
+    Bounds.Min = Bounds.Max = Vertices[0].Position;
+    for (int i = 1; i < VertexCount; ++i)
+    {
+        const v3& P = Vertices[i].Position;
+        Bounds.Min = { Math::Min(Bounds.Min.x, P.x), Math::Min(Bounds.Min.y, P.y), Math::Min(Bounds.Min.z, P.z) };
+        Bounds.Max = { Math::Max(Bounds.Max.x, P.x), Math::Max(Bounds.Max.y, P.y), Math::Max(Bounds.Max.z, P.z) };
+    }
+
+    Bounds.Center = (Bounds.Min + Bounds.Max) * 0.5f;
+    Bounds.Radius = Vec3::Length(Bounds.Max - Bounds.Center);
+    return Bounds;
+}
+
+void Mesh::BuildSubmeshes(std::vector<vertex_full>& Vertices, int CellCount, std::vector<submesh>& Submeshes)
+{
+    Submeshes.clear();
+    int TriangleCount = (int)Vertices.size() / 3;
+    bounds Bounds = ComputeBounds(Vertices.data(), (int)Vertices.size());
+    v3 Size = Bounds.Max - Bounds.Min;
+
+    // Cell of each triangle centroid
+    std::vector<int> Cells(TriangleCount);
+    for (int i = 0; i < TriangleCount; ++i)
+    {
+        v3 Centroid = (Vertices[i * 3 + 0].Position + Vertices[i * 3 + 1].Position + Vertices[i * 3 + 2].Position) / 3.f;
+        int Cell[3];
+        for (int Axis = 0; Axis < 3; ++Axis)
+        {
+            float T = Size.e[Axis] > 0.f ? (Centroid.e[Axis] - Bounds.Min.e[Axis]) / Size.e[Axis] : 0.f;
+            Cell[Axis] = Math::Clamp((int)(T * CellCount), 0, CellCount - 1);
+        }
+        Cells[i] = (Cell[2] * CellCount + Cell[1]) * CellCount + Cell[0];
+    }
+
+    // Stable counting sort of the triangles by cell
+    std::vector<int> CellStarts(CellCount * CellCount * CellCount + 1, 0);
+    for (int Cell : Cells)
+        CellStarts[Cell + 1]++;
+    for (size_t i = 1; i < CellStarts.size(); ++i)
+        CellStarts[i] += CellStarts[i - 1];
+
+    std::vector<vertex_full> Sorted(TriangleCount * 3);
+    std::vector<int> Cursors(CellStarts.begin(), CellStarts.end() - 1);
+    for (int i = 0; i < TriangleCount; ++i)
+    {
+        int Dst = Cursors[Cells[i]]++;
+        Sorted[Dst * 3 + 0] = Vertices[i * 3 + 0];
+        Sorted[Dst * 3 + 1] = Vertices[i * 3 + 1];
+        Sorted[Dst * 3 + 2] = Vertices[i * 3 + 2];
+    }
+    // Trailing vertices of an incomplete triangle are dropped like the draw calls do
+    Vertices.swap(Sorted);
+
+    for (size_t Cell = 0; Cell + 1 < CellStarts.size(); ++Cell)
+    {
+        int First = CellStarts[Cell] * 3;
+        int Count = (CellStarts[Cell + 1] - CellStarts[Cell]) * 3;
+        if (Count > 0)
+            Submeshes.push_back({ First, Count, ComputeBounds(&Vertices[First], Count) });
+    }
+}
+
+struct vertex_key
+{
+    const vertex_full* Vertex;
+
+    bool operator==(const vertex_key& Other) const { return memcmp(Vertex, Other.Vertex, sizeof(vertex_full)) == 0; }
+};
+
+struct vertex_key_hash
+{
+    size_t operator()(const vertex_key& Key) const
+    {
+        // FNV-1a over the vertex bytes
+        const uint8_t* Bytes = (const uint8_t*)Key.Vertex;
+        uint64_t Hash = 14695981039346656037ull;
+        for (size_t i = 0; i < sizeof(vertex_full); ++i)
+            Hash = (Hash ^ Bytes[i]) * 1099511628211ull;
+        return (size_t)Hash;
+    }
+};
+
+void Mesh::BuildIndexed(const vertex_full* Vertices, int VertexCount, std::vector<vertex_full>& UniqueVertices, std::vector<uint32_t>& Indices)
+{
+    UniqueVertices.clear();
+    Indices.resize(VertexCount);
+
+    // Keys point into the source vertices, which outlive the map
+    std::unordered_map<vertex_key, uint32_t, vertex_key_hash> Known;
+    Known.reserve(VertexCount);
+    for (int i = 0; i < VertexCount; ++i)
+    {
+        auto Inserted = Known.emplace(vertex_key{ &Vertices[i] }, (uint32_t)UniqueVertices.size());
+        if (Inserted.second)
+            UniqueVertices.push_back(Vertices[i]);
+        Indices[i] = Inserted.first->second;
+    }
+}
+
+void Mesh::SelectOccluders(const vertex_full* Vertices, int VertexCount, int MaxTriangleCount, float MinArea, std::vector<v3>& Triangles)
+{
+    Triangles.clear();
+
+    struct candidate
+    {
+        float Area;
+        int Triangle;
+    };
+    std::vector<candidate> Candidates;
+    for (int i = 0; i < VertexCount / 3; ++i)
+    {
+        const v3& A = Vertices[i * 3 + 0].Position;
+        const v3& B = Vertices[i * 3 + 1].Position;
+        const v3& C = Vertices[i * 3 + 2].Position;
+        float Area = 0.5f * Vec3::Length(Vec3::Cross(B - A, C - A));
+        if (Area > MinArea)
+            Candidates.push_back({ Area, i });
+    }
+
+    // Largest first (ties by index so the selection does not depend on the sort), then back to mesh order
+    if ((int)Candidates.size() > MaxTriangleCount)
+    {
+        std::sort(Candidates.begin(), Candidates.end(), [](const candidate& A, const candidate& B)
+        {
+            return A.Area != B.Area ? A.Area > B.Area : A.Triangle < B.Triangle;
+        });
+        Candidates.resize(MaxTriangleCount);
+        std::sort(Candidates.begin(), Candidates.end(), [](const candidate& A, const candidate& B) { return A.Triangle < B.Triangle; });
+    }
+
+    Triangles.reserve(Candidates.size() * 3);
+    for (const candidate& Candidate : Candidates)
+    {
+        Triangles.push_back(Vertices[Candidate.Triangle * 3 + 0].Position);
+        Triangles.push_back(Vertices[Candidate.Triangle * 3 + 1].Position);
+        Triangles.push_back(Vertices[Candidate.Triangle * 3 + 2].Position);
+    }
+}
+
 int AddToKnowVertices(std::vector<v3>& vertices, const v3& v)
 {
     int i = 0;
@@ -442,7 +592,9 @@ void SaveObjToCache(const std::vector<vertex_full>& Mesh, const char* Filename)
 
 bool Mesh::LoadObjNoConvertion(std::vector<vertex_full>& Mesh, const char* Filename, float Scale)
 {
-    if (!LoadObjFromCache(Mesh, Filename))
+    bool CacheHit = LoadObjFromCache(Mesh, Filename);
+    StartupTrace::ReportCacheHit(CacheHit);
+    if (!CacheHit)
     {
         std::string Warn;
         std::string Err;
@@ -574,3 +726,14 @@ void* Mesh::LoadObj(void* Vertices, void* End, const vertex_descriptor& Descript
     // Convert to output vertex format
     return ConvertVertices(Vertices, Descriptor, &Mesh[0], MeshSize);
 }
+
+void Mesh::ClearObjCache(const char* Directory)
+{
+    std::error_code Error;
+    for (std::filesystem::recursive_directory_iterator It(Directory, Error), End; !Error && It != End; It.increment(Error))
+    {
+        const std::string Path = It->path().string();
+        if (Path.size() > 10 && Path.compare(Path.size() - 10, 10, ".obj.cache") == 0)
+            std::filesystem::remove(It->path(), Error);
+    }
+}
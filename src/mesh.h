@@ -30,6 +30,23 @@ struct vertex_full
 
 namespace Mesh
 {
+// Axis-aligned box and the sphere around it (same center)
+struct bounds
+{
+	v3 Min;
+	v3 Max;
+	v3 Center;
+	float Radius;
+};
+
+// Range of vertices (whole triangles) of a mesh
+struct submesh
+{
+	int FirstVertex;
+	int VertexCount;
+	bounds Bounds;
+};
+
 void  AddNormalMapParameters(std::vector<vertex_full>& Mesh);
 void  AddNormalMapParameters(vertex_full* Mesh, int VertexCount);
 void* Transform(void* Vertices, void* End, const vertex_descriptor& Descriptor, const mat4& Transform);
@@ -40,4 +57,13 @@ void* BuildInvertedCube(void* Vertices, void* End, const vertex_descriptor& Desc
 void* BuildSphere(void* Vertices, void* End, const vertex_descriptor& Descriptor, int Lon, int Lat);
 void* LoadObj(void* Vertices, void* End, const vertex_descriptor& Descriptor, const char* Filename, float Scale);
 bool LoadObjNoConvertion(std::vector<vertex_full>& Mesh, const char* Filename, float Scale);
+bounds ComputeBounds(const vertex_full* Vertices, int VertexCount);
+// Sort the triangles by the cell of their centroid in a CellCount^3 grid over the mesh bounds, one submesh per non empty cell
+void  BuildSubmeshes(std::vector<vertex_full>& Vertices, int CellCount, std::vector<submesh>& Submeshes);
+// Merge the bitwise identical vertices of a triangle list, triangle order is kept
+void  BuildIndexed(const vertex_full* Vertices, int VertexCount, std::vector<vertex_full>& UniqueVertices, std::vector<uint32_t>& Indices);
+// Positions (3 per triangle) of the MaxTriangleCount largest triangles with an area over MinArea, in mesh order
+void  SelectOccluders(const vertex_full* Vertices, int VertexCount, int MaxTriangleCount, float MinArea, std::vector<v3>& Triangles);
+// Delete the parsed .obj caches (.obj.cache files) found under Directory
+void  ClearObjCache(const char* Directory);
 }
\ No newline at end of file
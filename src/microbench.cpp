@@ -0,0 +1,123 @@
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+#include "microbench.h"
+
+static const void* volatile EscapedPointer = nullptr;
+
+void MicrobenchEscape(const void* Pointer)
+{
+    EscapedPointer = Pointer;
+}
+
+void microbench_state::PauseTiming()
+{
+    if (Running)
+    {
+        Elapsed += clock::now() - Start;
+        Running = false;
+    }
+}
+
+void microbench_state::ResumeTiming()
+{
+    if (!Running)
+    {
+        Start = clock::now();
+        Running = true;
+    }
+}
+
+double microbench_runner::RunSample(const std::function<void(microbench_state&)>& Body, int Iterations, int64_t* ItemsPerOperation)
+{
+    microbench_state State;
+    State.Iterations = Iterations;
+    State.ResumeTiming();
+    Body(State);
+    State.PauseTiming();
+
+    *ItemsPerOperation = State.ItemsPerOperation;
+    return std::chrono::duration<double, std::nano>(State.Elapsed).count();
+}
+
+void microbench_runner::Run(const std::string& Name, const std::function<void(microbench_state&)>& Body)
+{
+    if (!Filter.empty() && Name.find(Filter) == std::string::npos)
+        return;
+
+    int64_t ItemsPerOperation = 0;
+
+    // Calibration (also warms caches up): grow the iteration count until a sample lasts MinSampleMs
+    int Iterations = 1;
+    double MinSampleNs = MinSampleMs * 1000000.0;
+    for (;;)
+    {
+        double SampleNs = RunSample(Body, Iterations, &ItemsPerOperation);
+        if (SampleNs >= MinSampleNs || Iterations >= (1 << 30))
+            break;
+
+        // Aim 20% above the target, at most x10 per step
+        double Scale = SampleNs > 0.0 ? std::min(MinSampleNs * 1.2 / SampleNs, 10.0) : 10.0;
+        Iterations = std::max(Iterations + 1, (int)std::min((double)Iterations * Scale, (double)(1 << 30)));
+    }
+
+    std::vector<double> Samples;
+    for (int i = 0; i < Repetitions; ++i)
+        Samples.push_back(RunSample(Body, Iterations, &ItemsPerOperation) / Iterations);
+    std::sort(Samples.begin(), Samples.end());
+
+    microbench_result Result = {};
+    Result.Name = Name;
+    Result.Iterations = Iterations;
+    Result.Repetitions = Repetitions;
+    Result.ItemsPerOperation = ItemsPerOperation;
+
+    double Sum = 0.0;
+    for (double Sample : Samples)
+        Sum += Sample;
+    Result.MeanNs = Sum / Samples.size();
+
+    double SquaredSum = 0.0;
+    for (double Sample : Samples)
+        SquaredSum += (Sample - Result.MeanNs) * (Sample - Result.MeanNs);
+    Result.StdDevNs = Samples.size() > 1 ? std::sqrt(SquaredSum / (Samples.size() - 1)) : 0.0;
+
+    Result.MinNs = Samples.front();
+    Result.MaxNs = Samples.back();
+    size_t Middle = Samples.size() / 2;
+    Result.MedianNs = Samples.size() % 2 ? Samples[Middle] : (Samples[Middle - 1] + Samples[Middle]) * 0.5;
+
+    printf("%-44s %14.1f ns/op (median %.1f, +/- %4.1f%%, %d x %d)", Name.c_str(), Result.MeanNs, Result.MedianNs,
+        Result.MeanNs > 0.0 ? 100.0 * Result.StdDevNs / Result.MeanNs : 0.0, Repetitions, Iterations);
+    if (ItemsPerOperation > 0)
+        printf(" %.3g items/s", ItemsPerOperation * 1e9 / Result.MedianNs);
+    printf("\n");
+
+    Results.push_back(Result);
+}
+
+bool microbench_runner::WriteJSON(const char* Filename) const
+{
+    FILE* File = fopen(Filename, "w");
+    if (File == nullptr)
+    {
+        fprintf(stderr, "Cannot write microbenchmark results '%s'\n", Filename);
+        return false;
+    }
+
+    fprintf(File, "{\n  \"build\": \"%s %s\",\n  \"repetitions\": %d,\n  \"min_sample_ms\": %g,\n  \"benchmarks\": [\n", __DATE__, __TIME__, Repetitions, MinSampleMs);
+    for (size_t i = 0; i < Results.size(); ++i)
+    {
+        const microbench_result& Result = Results[i];
+        fprintf(File, "    { \"name\": \"%s\", \"iterations\": %d, \"repetitions\": %d, \"items_per_op\": %lld, "
+            "\"mean_ns\": %.6g, \"stddev_ns\": %.6g, \"min_ns\": %.6g, \"median_ns\": %.6g, \"max_ns\": %.6g }%s\n",
+            Result.Name.c_str(), Result.Iterations, Result.Repetitions, (long long)Result.ItemsPerOperation,
+            Result.MeanNs, Result.StdDevNs, Result.MinNs, Result.MedianNs, Result.MaxNs, i + 1 < Results.size() ? "," : "");
+    }
+    fprintf(File, "  ]\n}\n");
+    fclose(File);
+
+    printf("Microbenchmark results written to '%s'\n", Filename);
+    return true;
+}
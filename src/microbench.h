@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Minimal microbenchmark runner
+// A benchmark body runs State.Iterations operations, the runner calibrates the iteration count
+// so that a sample lasts MinSampleMs then takes Repetitions samples and reports their ns/op statistics
+class microbench_state
+{
+public:
+    int Iterations = 1;
+
+    // Exclude setup work done inside the body (file deletion, GL flush...)
+    void PauseTiming();
+    void ResumeTiming();
+    // Items (vertices, bytes...) processed by one operation, reported as items/s
+    void SetItemsPerOperation(int64_t Items) { ItemsPerOperation = Items; }
+
+private:
+    friend class microbench_runner;
+    using clock = std::chrono::steady_clock;
+
+    clock::time_point Start;
+    clock::duration Elapsed = {};
+    bool Running = false;
+    int64_t ItemsPerOperation = 0;
+};
+
+struct microbench_result
+{
+    std::string Name;
+    int Iterations;  // Per sample
+    int Repetitions; // Samples
+    int64_t ItemsPerOperation;
+
+    // Nanoseconds per operation over the samples
+    double MeanNs;
+    double StdDevNs;
+    double MinNs;
+    double MedianNs;
+    double MaxNs;
+};
+
+class microbench_runner
+{
+public:
+    int Repetitions = 10;
+    double MinSampleMs = 20.0;
+    std::string Filter; // Substring of the benchmark names to run, all when empty
+
+    void Run(const std::string& Name, const std::function<void(microbench_state&)>& Body);
+
+    const std::vector<microbench_result>& GetResults() const { return Results; }
+    bool WriteJSON(const char* Filename) const;
+
+private:
+    // Body duration in ns
+    static double RunSample(const std::function<void(microbench_state&)>& Body, int Iterations, int64_t* ItemsPerOperation);
+
+    std::vector<microbench_result> Results;
+};
+
+// Keep a computed value (and the work producing it) from being optimized away
+void MicrobenchEscape(const void* Pointer);
+
+template <typename T>
+inline void DoNotOptimize(const T& Value)
+{
+    MicrobenchEscape(&Value);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+}
@@ -0,0 +1,525 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "stb_image.h"
+
+#include "opengl_headers.h"
+
+#include "maths.h"
+#include "mesh.h"
+#include "culling.h"
+#include "occlusion_rasterizer.h"
+#include "instance_transforms.h"
+#include "jobs.h"
+#include "platform.h"
+#include "opengl_helpers_wireframe.h"
+#include "platform_headless.h"
+#include "command_line.h"
+#include "microbench.h"
+
+// ibr_microbench: CPU primitives used by the demos, run from the repository root (media/ paths)
+
+static std::vector<mat4> RandomMatrices(int Count)
+{
+    std::vector<mat4> Matrices(Count);
+    srand(1234);
+    for (mat4& Matrix : Matrices)
+    {
+        for (float& Element : Matrix.e)
+            Element = (float)rand() / RAND_MAX * 2.f - 1.f;
+        // Keep them invertible
+        Matrix.c[0].x += 4.f;
+        Matrix.c[1].y += 4.f;
+        Matrix.c[2].z += 4.f;
+        Matrix.c[3].w += 4.f;
+    }
+    return Matrices;
+}
+
+static vertex_descriptor FullVertexDescriptor()
+{
+    vertex_descriptor Descriptor = {};
+    Descriptor.Stride = sizeof(vertex_full);
+    Descriptor.PositionOffset = OFFSETOF(vertex_full, Position);
+    Descriptor.HasNormal = true;
+    Descriptor.NormalOffset = OFFSETOF(vertex_full, Normal);
+    Descriptor.HasUV = true;
+    Descriptor.UVOffset = OFFSETOF(vertex_full, UV);
+    return Descriptor;
+}
+
+static std::vector<vertex_full> BuildSphereVertices(int Lon, int Lat)
+{
+    std::vector<vertex_full> Vertices(Lon * Lat * 6);
+    Mesh::BuildSphere(Vertices.data(), Vertices.data() + Vertices.size(), FullVertexDescriptor(), Lon, Lat);
+    return Vertices;
+}
+
+static void RunMathsBenchmarks(microbench_runner& Runner)
+{
+    const int COUNT = 1024; // Power of two, fits in L1/L2
+    std::vector<mat4> A = RandomMatrices(COUNT);
+    std::vector<mat4> B = RandomMatrices(COUNT);
+    std::vector<mat4> Result(COUNT);
+
+    Runner.Run("maths/mat4_multiply", [&](microbench_state& State)
+    {
+        for (int i = 0; i < State.Iterations; ++i)
+            Result[i & (COUNT - 1)] = A[i & (COUNT - 1)] * B[(i + 1) & (COUNT - 1)];
+        DoNotOptimize(Result);
+    });
+
+    Runner.Run("maths/mat4_inverse", [&](microbench_state& State)
+    {
+        for (int i = 0; i < State.Iterations; ++i)
+            Result[i & (COUNT - 1)] = Mat4::Inverse(A[i & (COUNT - 1)]);
+        DoNotOptimize(Result);
+    });
+
+    Runner.Run("maths/mat4_transpose", [&](microbench_state& State)
+    {
+        for (int i = 0; i < State.Iterations; ++i)
+            Result[i & (COUNT - 1)] = Mat4::Transpose(A[i & (COUNT - 1)]);
+        DoNotOptimize(Result);
+    });
+}
+
+static void RunMeshBenchmarks(microbench_runner& Runner)
+{
+    const vertex_descriptor Descriptor = FullVertexDescriptor();
+
+    const int SphereSizes[][2] = { { 8, 8 }, { 32, 32 }, { 128, 128 } };
+    for (const int* Size : SphereSizes)
+    {
+        int Lon = Size[0];
+        int Lat = Size[1];
+        std::vector<vertex_full> Vertices(Lon * Lat * 6);
+        Runner.Run("mesh/build_sphere_" + std::to_string(Lon) + "x" + std::to_string(Lat), [&](microbench_state& State)
+        {
+            State.SetItemsPerOperation((int64_t)Vertices.size());
+            for (int i = 0; i < State.Iterations; ++i)
+            {
+                Mesh::BuildSphere(Vertices.data(), Vertices.data() + Vertices.size(), Descriptor, Lon, Lat);
+                DoNotOptimize(Vertices[0]);
+            }
+        });
+    }
+
+    // 6144, 98304 and 393216 vertices
+    const int TransformSizes[] = { 32, 128, 256 };
+    // Rigid transform: vertices stay finite however many times it is applied
+    mat4 Transform = Mat4::Translate({ 0.001f, 0.002f, 0.003f }) * Mat4::RotateX(0.5f);
+    for (int Size : TransformSizes)
+    {
+        std::vector<vertex_full> Vertices = BuildSphereVertices(Size, Size);
+        Runner.Run("mesh/transform_" + std::to_string(Vertices.size()), [&](microbench_state& State)
+        {
+            State.SetItemsPerOperation((int64_t)Vertices.size());
+            for (int i = 0; i < State.Iterations; ++i)
+            {
+                Mesh::Transform(Vertices.data(), Vertices.data() + Vertices.size(), Descriptor, Transform);
+                DoNotOptimize(Vertices[0]);
+            }
+        });
+    }
+
+    const int NormalMapSizes[] = { 1024 * 3, 16384 * 3, 262144 * 3 };
+    for (int VertexCount : NormalMapSizes)
+    {
+        std::vector<vertex_full> Sphere = BuildSphereVertices(256, 256);
+        std::vector<vertex_full> Vertices(VertexCount);
+        for (int i = 0; i < VertexCount; ++i)
+            Vertices[i] = Sphere[i % Sphere.size()];
+
+        Runner.Run("mesh/add_normal_map_parameters_" + std::to_string(VertexCount), [&](microbench_state& State)
+        {
+            State.SetItemsPerOperation(VertexCount);
+            for (int i = 0; i < State.Iterations; ++i)
+            {
+                Mesh::AddNormalMapParameters(Vertices.data(), VertexCount);
+                DoNotOptimize(Vertices[0]);
+            }
+        });
+    }
+}
+
+// Correctness of the CPU occlusion rasterizer (no GL), returns the failure count
+static int CheckOcclusionRasterizer()
+{
+    int FailureCount = 0;
+    auto Check = [&FailureCount](bool Condition, const char* Description)
+    {
+        printf("check %-58s %s\n", Description, Condition ? "PASS" : "FAIL");
+        FailureCount += Condition ? 0 : 1;
+    };
+
+    // Camera at the origin looking down -Z, a 4x4 quad facing it at 10 units
+    mat4 ViewProjection = Mat4::Perspective(Math::ToRadians(60.f), 16.f / 9.f, 0.1f, 100.f);
+    const v3 Quad[6] =
+    {
+        { -2.f, -2.f, -10.f }, {  2.f, -2.f, -10.f }, {  2.f,  2.f, -10.f },
+        { -2.f, -2.f, -10.f }, {  2.f,  2.f, -10.f }, { -2.f,  2.f, -10.f },
+    };
+
+    struct box_case
+    {
+        const char* Description;
+        v3 Center;
+        bool Visible;
+    };
+    const box_case Cases[] =
+    {
+        { "occlusion: box behind the quad is hidden",            {  0.f, 0.f, -20.f }, false },
+        { "occlusion: box beside the quad is visible",           {  8.f, 0.f, -20.f }, true },
+        { "occlusion: box across the quad silhouette is visible", { 3.9f, 0.f, -20.f }, true },
+        { "occlusion: box in front of the quad is visible",      {  0.f, 0.f,  -5.f }, true },
+        { "occlusion: box straddling the near plane is visible", {  0.f, 0.f,   0.f }, true },
+    };
+
+    Culling::bounds_soa Bounds;
+    for (const box_case& Case : Cases)
+    {
+        Mesh::bounds Box;
+        Box.Center = Case.Center;
+        Box.Min = Case.Center - v3{ 0.5f, 0.5f, 0.5f };
+        Box.Max = Case.Center + v3{ 0.5f, 0.5f, 0.5f };
+        Box.Radius = Vec3::Length(Box.Max - Box.Center);
+        Bounds.Add(Box);
+    }
+
+    Culling::occlusion_rasterizer Rasterizer;
+    Rasterizer.Rasterize(ViewProjection, Quad, 2);
+    std::vector<uint8_t> Visible(Bounds.GetCount(), 1);
+    Rasterizer.TestBoxes(ViewProjection, Bounds, Visible.data());
+    for (int i = 0; i < Bounds.GetCount(); ++i)
+    {
+        Check(Visible[i] == (Cases[i].Visible ? 1 : 0), Cases[i].Description);
+        v3 Extent = { 0.5f, 0.5f, 0.5f };
+        if (Rasterizer.IsBoxVisible(ViewProjection, Cases[i].Center, Extent) != Cases[i].Visible)
+            Check(false, "occlusion: IsBoxVisible() agrees with TestBoxes()");
+    }
+
+    // Overlapping triangles over every tile: the depth must not depend on which thread rasterizes a tile
+    std::vector<v3> Triangles;
+    srand(1234);
+    for (int i = 0; i < 2048; ++i)
+    {
+        float X = (float)rand() / RAND_MAX * 40.f - 20.f;
+        float Y = (float)rand() / RAND_MAX * 24.f - 12.f;
+        float Z = -5.f - (float)rand() / RAND_MAX * 30.f;
+        float Size = 1.f + (float)rand() / RAND_MAX * 4.f;
+        Triangles.push_back({ X, Y, Z });
+        Triangles.push_back({ X + Size, Y, Z - (float)rand() / RAND_MAX });
+        Triangles.push_back({ X, Y + Size, Z + (float)rand() / RAND_MAX });
+    }
+
+    int ThreadCount = Jobs::GetThreadCount();
+    Jobs::SetThreadCount(1);
+    Rasterizer.Rasterize(ViewProjection, Triangles.data(), (int)Triangles.size() / 3);
+    std::vector<float> SerialDepth(Rasterizer.GetDepth(), Rasterizer.GetDepth() + Rasterizer.GetPitch() * Rasterizer.GetHeight());
+
+    // Forced above the hardware thread count so that tiles really go to several threads
+    Jobs::SetThreadCount(std::max(ThreadCount, 4));
+    Rasterizer.Rasterize(ViewProjection, Triangles.data(), (int)Triangles.size() / 3);
+    bool SameDepth = memcmp(SerialDepth.data(), Rasterizer.GetDepth(), SerialDepth.size() * sizeof(float)) == 0;
+    bool Covered = std::count(SerialDepth.begin(), SerialDepth.end(), 1.f) < (int)SerialDepth.size();
+    Check(SameDepth && Covered, "occlusion: same depth with 1 and 4+ threads");
+    Jobs::SetThreadCount(ThreadCount);
+
+    return FailureCount;
+}
+
+static void RunCullingBenchmarks(microbench_runner& Runner)
+{
+    // Tavern split and its occluders as GL::cache::LoadObj() does, seen from inside
+    std::vector<vertex_full> Vertices;
+    Mesh::LoadObjNoConvertion(Vertices, "media/fantasy_game_inn.obj", 1.f);
+    Mesh::bounds MeshBounds = Mesh::ComputeBounds(Vertices.data(), (int)Vertices.size());
+    std::vector<Mesh::submesh> Submeshes;
+    Mesh::BuildSubmeshes(Vertices, 4, Submeshes);
+    std::vector<v3> Occluders;
+    float Diagonal = 2.f * MeshBounds.Radius;
+    Mesh::SelectOccluders(Vertices.data(), (int)Vertices.size(), 2048, 1e-4f * Diagonal * Diagonal, Occluders);
+
+    Culling::bounds_soa Bounds;
+    for (const Mesh::submesh& Submesh : Submeshes)
+        Bounds.Add(Submesh.Bounds);
+    std::vector<uint8_t> Visible(Submeshes.size());
+
+    mat4 ViewProjection = Mat4::Perspective(Math::ToRadians(60.f), 16.f / 9.f, 0.1f, 100.f)
+        * Mat4::Translate({ 0.f, -1.f, 0.f });
+    Culling::frustum Frustum = Culling::ExtractFrustum(ViewProjection);
+
+    Runner.Run("culling/frustum_boxes_" + std::to_string(Submeshes.size()), [&](microbench_state& State)
+    {
+        State.SetItemsPerOperation((int64_t)Submeshes.size());
+        for (int i = 0; i < State.Iterations; ++i)
+            DoNotOptimize(Culling::CullBoxes(Frustum, Bounds, Visible.data()));
+    });
+
+    Culling::occlusion_rasterizer Rasterizer;
+    Runner.Run("culling/occlusion_rasterize_" + std::to_string(Occluders.size() / 3), [&](microbench_state& State)
+    {
+        State.SetItemsPerOperation((int64_t)Occluders.size() / 3);
+        for (int i = 0; i < State.Iterations; ++i)
+        {
+            Rasterizer.Rasterize(ViewProjection, Occluders.data(), (int)Occluders.size() / 3);
+            DoNotOptimize(Rasterizer.GetDepth()[0]);
+        }
+    });
+
+    Runner.Run("culling/occlusion_test_" + std::to_string(Submeshes.size()), [&](microbench_state& State)
+    {
+        State.SetItemsPerOperation((int64_t)Submeshes.size());
+        for (int i = 0; i < State.Iterations; ++i)
+        {
+            std::fill(Visible.begin(), Visible.end(), 1);
+            DoNotOptimize(Rasterizer.TestBoxes(ViewProjection, Bounds, Visible.data()));
+        }
+    });
+}
+
+static void RunInstanceBenchmarks(microbench_runner& Runner)
+{
+    // Per-frame rotation of CPU driven instances as demo_instancing does it: AoS mat4 loop against SoA + SSE composition
+    const int InstanceCounts[] = { 100000, 1000000, 5000000 };
+    const float DeltaTime = 1.f / 60.f;
+    mat4 Rotation = Mat4::RotateX(DeltaTime);
+    v4 RotationQuat = Quat::AxisAngle({ 1.f, 0.f, 0.f }, DeltaTime);
+    bool HasContext = HeadlessCreateContext();
+
+    for (int Count : InstanceCounts)
+    {
+        std::string Suffix = "_" + std::to_string(Count);
+        Instances::transforms_soa Transforms;
+        {
+            std::vector<mat4> Offsets(Count);
+            srand(1234);
+            for (mat4& Offset : Offsets)
+            {
+                float Angle = (float)rand() / RAND_MAX * Math::TwoPi();
+                Offset = Mat4::Translate({ (float)rand() / RAND_MAX, (float)rand() / RAND_MAX, (float)rand() / RAND_MAX }) * Mat4::RotateY(Angle);
+                Transforms.Add(Offset.c[3].xyz, Quat::FromMatrix(Offset), { 1.f, 1.f, 1.f });
+            }
+
+            Runner.Run("instances/aos_mat4" + Suffix, [&](microbench_state& State)
+            {
+                State.SetItemsPerOperation(Count);
+                for (int i = 0; i < State.Iterations; ++i)
+                {
+                    for (mat4& Offset : Offsets)
+                        Offset *= Rotation;
+                    DoNotOptimize(Offsets[0]);
+                }
+            });
+        }
+
+        std::vector<Instances::matrix3x4> Matrices(Count);
+        Runner.Run("instances/soa_1_thread" + Suffix, [&](microbench_state& State)
+        {
+            State.SetItemsPerOperation(Count);
+            for (int i = 0; i < State.Iterations; ++i)
+            {
+                Instances::RotateAndCompose(Transforms, RotationQuat, 0, Count, Matrices.data());
+                DoNotOptimize(Matrices[0]);
+            }
+        });
+
+        Runner.Run("instances/soa_job_pool" + Suffix, [&](microbench_state& State)
+        {
+            State.SetItemsPerOperation(Count);
+            for (int i = 0; i < State.Iterations; ++i)
+            {
+                Instances::ParallelRotateAndCompose(Transforms, RotationQuat, Matrices.data());
+                DoNotOptimize(Matrices[0]);
+            }
+        });
+        Matrices = {};
+
+        if (!HasContext)
+            continue;
+
+        // Map, write and unmap: what UpdateSoAInstances() costs the frame (the upload itself is the driver's)
+        GLsizeiptr Size = Count * sizeof(Instances::matrix3x4);
+        GLuint Buffer;
+        glGenBuffers(1, &Buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, Buffer);
+        glBufferData(GL_ARRAY_BUFFER, Size, nullptr, GL_STREAM_DRAW);
+        Runner.Run("instances/soa_mapped" + Suffix, [&](microbench_state& State)
+        {
+            State.SetItemsPerOperation(Count);
+            for (int i = 0; i < State.Iterations; ++i)
+            {
+                void* Mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, Size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+                Instances::ParallelRotateAndCompose(Transforms, RotationQuat, (Instances::matrix3x4*)Mapped);
+                glUnmapBuffer(GL_ARRAY_BUFFER);
+            }
+        });
+        glDeleteBuffers(1, &Buffer);
+    }
+
+    if (HasContext)
+        HeadlessDestroyContext();
+    else
+        fprintf(stderr, "No GL context, mapped instance benchmarks skipped\n");
+}
+
+static void RunAssetBenchmarks(microbench_runner& Runner)
+{
+    // Cold: .obj parsing and .cache file writing, cached: .cache file reading
+    const char* ObjFiles[] = { "media/rock.obj", "media/fantasy_game_inn.obj" };
+    for (const char* Filename : ObjFiles)
+    {
+        std::string CacheFilename = std::string(Filename) + ".cache";
+        std::string Name = Filename + strlen("media/");
+        std::vector<vertex_full> Mesh;
+
+        Runner.Run("asset/load_obj_cold/" + Name, [&](microbench_state& State)
+        {
+            for (int i = 0; i < State.Iterations; ++i)
+            {
+                State.PauseTiming();
+                remove(CacheFilename.c_str());
+                Mesh.clear();
+                State.ResumeTiming();
+
+                Mesh::LoadObjNoConvertion(Mesh, Filename, 1.f);
+                DoNotOptimize(Mesh);
+            }
+            State.SetItemsPerOperation((int64_t)Mesh.size());
+        });
+
+        Runner.Run("asset/load_obj_cached/" + Name, [&](microbench_state& State)
+        {
+            for (int i = 0; i < State.Iterations; ++i)
+            {
+                Mesh.clear();
+                Mesh::LoadObjNoConvertion(Mesh, Filename, 1.f);
+                DoNotOptimize(Mesh);
+            }
+            State.SetItemsPerOperation((int64_t)Mesh.size());
+        });
+    }
+
+    // Decoding only, the files are read beforehand
+    const char* ImageFiles[] = { "media/brickwall.jpg", "media/brickwall_normal.jpg", "media/fantasy_game_inn_diffuse.png", "media/Sky_NightTime01FT.png" };
+    for (const char* Filename : ImageFiles)
+    {
+        std::ifstream File(Filename, std::ios::binary);
+        if (!File.is_open())
+        {
+            fprintf(stderr, "Cannot read '%s', skipped\n", Filename);
+            continue;
+        }
+        std::vector<unsigned char> Data((std::istreambuf_iterator<char>(File)), std::istreambuf_iterator<char>());
+
+        Runner.Run(std::string("asset/stbi_decode/") + (Filename + strlen("media/")), [&](microbench_state& State)
+        {
+            int Width = 0, Height = 0, Channels = 0;
+            for (int i = 0; i < State.Iterations; ++i)
+            {
+                stbi_uc* Pixels = stbi_load_from_memory(Data.data(), (int)Data.size(), &Width, &Height, &Channels, STBI_rgb_alpha);
+                DoNotOptimize(Pixels);
+                stbi_image_free(Pixels);
+            }
+            State.SetItemsPerOperation((int64_t)Width * Height);
+        });
+    }
+}
+
+static void RunWireframeBenchmarks(microbench_runner& Runner)
+{
+    // wireframe_renderer owns GL objects: recording is measured, flushes are excluded
+    if (!HeadlessCreateContext())
+    {
+        fprintf(stderr, "No GL context, wireframe benchmarks skipped\n");
+        return;
+    }
+
+    {
+        const int DrawCounts[] = { 16, 256, 4096 };
+        const int MAX_DRAW_COUNT = 4096;
+
+        GL::wireframe_renderer Wireframe;
+        std::vector<mat4> MVPs = RandomMatrices(1024);
+
+        GLuint VertexBuffer;
+        std::vector<v3> Positions(3 * MAX_DRAW_COUNT);
+        glGenBuffers(1, &VertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, Positions.size() * sizeof(v3), Positions.data(), GL_STATIC_DRAW);
+
+        for (int DrawCount : DrawCounts)
+        {
+            Runner.Run("wireframe/record_" + std::to_string(DrawCount) + "_draws", [&](microbench_state& State)
+            {
+                State.SetItemsPerOperation(DrawCount);
+                for (int i = 0; i < State.Iterations; ++i)
+                {
+                    Wireframe.BindBuffer(VertexBuffer, sizeof(v3), 0, 3 * DrawCount);
+                    for (int j = 0; j < DrawCount; ++j)
+                        Wireframe.DrawArray(j * 3, 3, MVPs[j & 1023]);
+
+                    State.PauseTiming();
+                    Wireframe.Flush();
+                    State.ResumeTiming();
+                }
+            });
+        }
+
+        glDeleteBuffers(1, &VertexBuffer);
+    }
+
+    HeadlessDestroyContext();
+}
+
+int main(int argc, char* argv[])
+{
+    microbench_runner Runner;
+    app_options Options;
+    std::string Name = "microbench";
+    bool CheckOnly = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* Arg = argv[i];
+        bool HasValue = i + 1 < argc;
+
+        if (HasValue && strcmp(Arg, "--filter") == 0)            Runner.Filter = argv[++i];
+        else if (HasValue && strcmp(Arg, "--repetitions") == 0)  Runner.Repetitions = std::max(atoi(argv[++i]), 1);
+        else if (HasValue && strcmp(Arg, "--min-time-ms") == 0)  Runner.MinSampleMs = atof(argv[++i]);
+        else if (HasValue && strcmp(Arg, "--output") == 0)       Options.OutputDir = argv[++i];
+        else if (HasValue && strcmp(Arg, "--name") == 0)         Name = argv[++i];
+        else if (strcmp(Arg, "--check") == 0)                    CheckOnly = true;
+        else
+        {
+            printf("Usage: %s [--filter <substring>] [--repetitions <count>] [--min-time-ms <ms>] [--output <dir>] [--name <name>] [--check]\n", argv[0]);
+            printf("Results written to <output>/<name>.json\n");
+            printf("Correctness checks run first (exit code 1 on failure), --check runs only them\n");
+            return strcmp(Arg, "--help") == 0 || strcmp(Arg, "-h") == 0 ? 0 : 1;
+        }
+    }
+
+    // Nothing is timed when a primitive is wrong
+    if (CheckOcclusionRasterizer() > 0)
+        return 1;
+    if (CheckOnly)
+        return 0;
+
+    RunMathsBenchmarks(Runner);
+    RunMeshBenchmarks(Runner);
+    RunCullingBenchmarks(Runner);
+    RunInstanceBenchmarks(Runner);
+    RunAssetBenchmarks(Runner);
+    RunWireframeBenchmarks(Runner);
+
+    Runner.WriteJSON(GetOutputPath(Options, Name + ".json").c_str());
+    return 0;
+}
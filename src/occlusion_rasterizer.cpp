@@ -0,0 +1,275 @@
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+#include <xmmintrin.h>
+
+#include <imgui.h>
+
+#include "maths.h"
+#include "jobs.h"
+#include "cpu_profiler.h"
+
+#include "occlusion_rasterizer.h"
+
+using namespace Culling;
+
+// Vertices closer than this (clip w) are treated as crossing the near plane
+static const float NEAR_W = 1e-5f;
+
+occlusion_rasterizer::occlusion_rasterizer(int Width, int Height)
+{
+    Resize(Width, Height);
+}
+
+void occlusion_rasterizer::Resize(int Width, int Height)
+{
+    this->Width = Math::Max(Width, 1);
+    this->Height = Math::Max(Height, 1);
+    TileCountX = (this->Width + TILE_WIDTH - 1) / TILE_WIDTH;
+    TileCountY = (this->Height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    Pitch = TileCountX * TILE_WIDTH;
+
+    Depth.assign(Pitch * TileCountY * TILE_HEIGHT, 1.f);
+    BlockMaxDepth.assign((Pitch / BLOCK_WIDTH) * (TileCountY * TILE_HEIGHT / BLOCK_HEIGHT), 1.f);
+    TileTriangles.resize(TileCountX * TileCountY);
+}
+
+void occlusion_rasterizer::Rasterize(const mat4& ViewProjection, const v3* Triangles, int TriangleCount)
+{
+    PROFILE_FUNCTION();
+    std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+    // Transform, set up and bin the triangles (cheap for a few thousand occluders)
+    ScreenTriangles.clear();
+    for (std::vector<int>& Bin : TileTriangles)
+        Bin.clear();
+
+    for (int i = 0; i < TriangleCount; ++i)
+    {
+        float X[3], Y[3], Z[3];
+        bool Clipped = false;
+        for (int j = 0; j < 3 && !Clipped; ++j)
+        {
+            const v3& P = Triangles[i * 3 + j];
+            v4 Clip = ViewProjection * v4{ P.x, P.y, P.z, 1.f };
+            Clipped = Clip.w < NEAR_W || Clip.z < -Clip.w;
+            float InvW = 1.f / Clip.w;
+            X[j] = (Clip.x * InvW * 0.5f + 0.5f) * Width;
+            Y[j] = (Clip.y * InvW * 0.5f + 0.5f) * Height;
+            Z[j] = Clip.z * InvW * 0.5f + 0.5f;
+        }
+        if (Clipped)
+            continue;
+
+        // Counter-clockwise triangles have a positive area, back faces and degenerate ones do not occlude
+        float Area = (X[1] - X[0]) * (Y[2] - Y[0]) - (X[2] - X[0]) * (Y[1] - Y[0]);
+        if (Area <= 1e-6f)
+            continue;
+
+        // Pixels whose center can be covered
+        screen_triangle Triangle;
+        Triangle.MinX = Math::Max((int)std::ceil(Math::Min(X[0], Math::Min(X[1], X[2])) - 0.5f), 0);
+        Triangle.MinY = Math::Max((int)std::ceil(Math::Min(Y[0], Math::Min(Y[1], Y[2])) - 0.5f), 0);
+        Triangle.MaxX = Math::Min((int)std::floor(Math::Max(X[0], Math::Max(X[1], X[2])) - 0.5f), Width - 1);
+        Triangle.MaxY = Math::Min((int)std::floor(Math::Max(Y[0], Math::Max(Y[1], Y[2])) - 0.5f), Height - 1);
+        if (Triangle.MinX > Triangle.MaxX || Triangle.MinY > Triangle.MaxY)
+            continue;
+
+        // Edge j goes from vertex j to vertex j + 1, positive inside
+        for (int j = 0; j < 3; ++j)
+        {
+            int k = (j + 1) % 3;
+            Triangle.EdgeA[j] = Y[j] - Y[k];
+            Triangle.EdgeB[j] = X[k] - X[j];
+            Triangle.EdgeC[j] = X[j] * Y[k] - X[k] * Y[j];
+        }
+
+        Triangle.ZX = ((Z[1] - Z[0]) * (Y[2] - Y[0]) - (Z[2] - Z[0]) * (Y[1] - Y[0])) / Area;
+        Triangle.ZY = ((Z[2] - Z[0]) * (X[1] - X[0]) - (Z[1] - Z[0]) * (X[2] - X[0])) / Area;
+        Triangle.Z0 = Z[0] - Triangle.ZX * X[0] - Triangle.ZY * Y[0];
+
+        int Index = (int)ScreenTriangles.size();
+        ScreenTriangles.push_back(Triangle);
+        for (int TileY = Triangle.MinY / TILE_HEIGHT; TileY <= Triangle.MaxY / TILE_HEIGHT; ++TileY)
+            for (int TileX = Triangle.MinX / TILE_WIDTH; TileX <= Triangle.MaxX / TILE_WIDTH; ++TileX)
+                TileTriangles[TileY * TileCountX + TileX].push_back(Index);
+    }
+
+    Jobs::ParallelFor(TileCountX * TileCountY, 1, [this](int Begin, int End)
+    {
+        for (int Tile = Begin; Tile < End; ++Tile)
+            RasterizeTile(Tile);
+    });
+
+    Stats.OccluderCount = TriangleCount;
+    Stats.RasterizedCount = (int)ScreenTriangles.size();
+    Stats.RasterizeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count();
+}
+
+void occlusion_rasterizer::RasterizeTile(int Tile)
+{
+    int TileX0 = (Tile % TileCountX) * TILE_WIDTH;
+    int TileY0 = (Tile / TileCountX) * TILE_HEIGHT;
+
+    for (int y = TileY0; y < TileY0 + TILE_HEIGHT; ++y)
+        std::fill_n(&Depth[y * Pitch + TileX0], TILE_WIDTH, 1.f);
+
+    const __m128 LaneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 Zero = _mm_setzero_ps();
+    for (int Index : TileTriangles[Tile])
+    {
+        const screen_triangle& Triangle = ScreenTriangles[Index];
+        int MinX = Math::Max(Triangle.MinX, TileX0) & ~3; // 4 pixels aligned, still inside the tile
+        int MaxX = Math::Min(Triangle.MaxX, TileX0 + TILE_WIDTH - 1);
+        int MinY = Math::Max(Triangle.MinY, TileY0);
+        int MaxY = Math::Min(Triangle.MaxY, TileY0 + TILE_HEIGHT - 1);
+
+        __m128 A0 = _mm_set1_ps(Triangle.EdgeA[0]), A1 = _mm_set1_ps(Triangle.EdgeA[1]), A2 = _mm_set1_ps(Triangle.EdgeA[2]);
+        __m128 ZX = _mm_set1_ps(Triangle.ZX);
+
+        for (int y = MinY; y <= MaxY; ++y)
+        {
+            float PY = (float)y + 0.5f;
+            __m128 Row0 = _mm_set1_ps(Triangle.EdgeB[0] * PY + Triangle.EdgeC[0]);
+            __m128 Row1 = _mm_set1_ps(Triangle.EdgeB[1] * PY + Triangle.EdgeC[1]);
+            __m128 Row2 = _mm_set1_ps(Triangle.EdgeB[2] * PY + Triangle.EdgeC[2]);
+            __m128 RowZ = _mm_set1_ps(Triangle.ZY * PY + Triangle.Z0);
+
+            float* DepthRow = &Depth[y * Pitch];
+            for (int x = MinX; x <= MaxX; x += 4)
+            {
+                __m128 PX = _mm_add_ps(_mm_set1_ps((float)x), LaneOffsets);
+                __m128 E0 = _mm_add_ps(_mm_mul_ps(A0, PX), Row0);
+                __m128 E1 = _mm_add_ps(_mm_mul_ps(A1, PX), Row1);
+                __m128 E2 = _mm_add_ps(_mm_mul_ps(A2, PX), Row2);
+                __m128 Inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(E0, Zero), _mm_cmpge_ps(E1, Zero)), _mm_cmpge_ps(E2, Zero));
+                if (_mm_movemask_ps(Inside) == 0)
+                    continue;
+
+                __m128 Z = _mm_add_ps(_mm_mul_ps(ZX, PX), RowZ);
+                __m128 Old = _mm_loadu_ps(DepthRow + x);
+                __m128 New = _mm_min_ps(Old, Z);
+                _mm_storeu_ps(DepthRow + x, _mm_or_ps(_mm_and_ps(Inside, New), _mm_andnot_ps(Inside, Old)));
+            }
+        }
+    }
+
+    // Farthest depth of each block
+    int BlockPitch = Pitch / BLOCK_WIDTH;
+    for (int BlockY = TileY0 / BLOCK_HEIGHT; BlockY < (TileY0 + TILE_HEIGHT) / BLOCK_HEIGHT; ++BlockY)
+    {
+        for (int BlockX = TileX0 / BLOCK_WIDTH; BlockX < (TileX0 + TILE_WIDTH) / BLOCK_WIDTH; ++BlockX)
+        {
+            __m128 Max = _mm_setzero_ps();
+            for (int y = BlockY * BLOCK_HEIGHT; y < (BlockY + 1) * BLOCK_HEIGHT; ++y)
+            {
+                const float* DepthRow = &Depth[y * Pitch + BlockX * BLOCK_WIDTH];
+                Max = _mm_max_ps(Max, _mm_max_ps(_mm_loadu_ps(DepthRow), _mm_loadu_ps(DepthRow + 4)));
+            }
+            alignas(16) float Lanes[4];
+            _mm_store_ps(Lanes, Max);
+            BlockMaxDepth[BlockY * BlockPitch + BlockX] = Math::Max(Math::Max(Lanes[0], Lanes[1]), Math::Max(Lanes[2], Lanes[3]));
+        }
+    }
+}
+
+bool occlusion_rasterizer::IsBoxVisible(const mat4& ViewProjection, const v3& Center, const v3& Extent) const
+{
+    // Screen rectangle and nearest depth of the corners
+    float MinX = INFINITY, MinY = INFINITY, MaxX = -INFINITY, MaxY = -INFINITY, MinZ = INFINITY;
+    for (int i = 0; i < 8; ++i)
+    {
+        v3 P = { Center.x + ((i & 1) ? Extent.x : -Extent.x), Center.y + ((i & 2) ? Extent.y : -Extent.y), Center.z + ((i & 4) ? Extent.z : -Extent.z) };
+        v4 Clip = ViewProjection * v4{ P.x, P.y, P.z, 1.f };
+        if (Clip.w < NEAR_W || Clip.z < -Clip.w)
+            return true;
+
+        float InvW = 1.f / Clip.w;
+        float X = (Clip.x * InvW * 0.5f + 0.5f) * Width;
+        float Y = (Clip.y * InvW * 0.5f + 0.5f) * Height;
+        MinX = Math::Min(MinX, X); MaxX = Math::Max(MaxX, X);
+        MinY = Math::Min(MinY, Y); MaxY = Math::Max(MaxY, Y);
+        MinZ = Math::Min(MinZ, Clip.z * InvW * 0.5f + 0.5f);
+    }
+
+    // Pixels touched by the rectangle and their neighbours
+    int X0 = Math::Max((int)std::floor(MinX) - 1, 0);
+    int Y0 = Math::Max((int)std::floor(MinY) - 1, 0);
+    int X1 = Math::Min((int)std::ceil(MaxX), Width - 1);
+    int Y1 = Math::Min((int)std::ceil(MaxY), Height - 1);
+    if (X0 > X1 || Y0 > Y1)
+        return true; // Off screen, left to the frustum culling
+
+    int BlockPitch = Pitch / BLOCK_WIDTH;
+    __m128 BoxZ = _mm_set1_ps(MinZ);
+    const __m128 LaneOffsets = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+    for (int BlockY = Y0 / BLOCK_HEIGHT; BlockY <= Y1 / BLOCK_HEIGHT; ++BlockY)
+    {
+        for (int BlockX = X0 / BLOCK_WIDTH; BlockX <= X1 / BLOCK_WIDTH; ++BlockX)
+        {
+            // Every occluder of the block is in front of the box
+            if (BlockMaxDepth[BlockY * BlockPitch + BlockX] < MinZ)
+                continue;
+
+            int BX0 = Math::Max(BlockX * BLOCK_WIDTH, X0), BX1 = Math::Min((BlockX + 1) * BLOCK_WIDTH - 1, X1);
+            int BY0 = Math::Max(BlockY * BLOCK_HEIGHT, Y0), BY1 = Math::Min((BlockY + 1) * BLOCK_HEIGHT - 1, Y1);
+            __m128 First = _mm_set1_ps((float)BX0 - 0.5f), Last = _mm_set1_ps((float)BX1 + 0.5f);
+            for (int y = BY0; y <= BY1; ++y)
+            {
+                const float* DepthRow = &Depth[y * Pitch];
+                for (int x = BX0 & ~3; x <= BX1; x += 4)
+                {
+                    __m128 PX = _mm_add_ps(_mm_set1_ps((float)x), LaneOffsets);
+                    __m128 InRect = _mm_and_ps(_mm_cmpgt_ps(PX, First), _mm_cmplt_ps(PX, Last));
+                    __m128 Behind = _mm_cmpge_ps(_mm_loadu_ps(DepthRow + x), BoxZ);
+                    if (_mm_movemask_ps(_mm_and_ps(InRect, Behind)))
+                        return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+int occlusion_rasterizer::TestBoxes(const mat4& ViewProjection, const bounds_soa& Bounds, uint8_t* Visible)
+{
+    PROFILE_FUNCTION();
+    std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+    int Count = Bounds.GetCount();
+    int TestedCount = 0;
+    for (int i = 0; i < Count; ++i)
+        TestedCount += Visible[i];
+
+    // Read only depth, each box writes its own flag
+    Jobs::ParallelFor(Count, 8, [&](int Begin, int End)
+    {
+        for (int i = Begin; i < End; ++i)
+        {
+            if (!Visible[i])
+                continue;
+
+            v3 Center = { Bounds.CenterX[i], Bounds.CenterY[i], Bounds.CenterZ[i] };
+            v3 Extent = { Bounds.ExtentX[i], Bounds.ExtentY[i], Bounds.ExtentZ[i] };
+            Visible[i] = IsBoxVisible(ViewProjection, Center, Extent) ? 1 : 0;
+        }
+    });
+
+    int VisibleCount = 0;
+    for (int i = 0; i < Count; ++i)
+        VisibleCount += Visible[i];
+
+    Stats.TestedCount = TestedCount;
+    Stats.OccludedCount = TestedCount - VisibleCount;
+    Stats.TestMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count();
+    return VisibleCount;
+}
+
+void occlusion_rasterizer::DisplayStats() const
+{
+    ImGui::Text("Depth buffer: %dx%d, %dx%d tiles (%d threads)", Width, Height, TileCountX, TileCountY, Jobs::GetThreadCount());
+    ImGui::Text("Occluders: %d triangles, %d rasterized", Stats.OccluderCount, Stats.RasterizedCount);
+    ImGui::Text("Boxes: %d tested, %d occluded", Stats.TestedCount, Stats.OccludedCount);
+    ImGui::Text("Rasterize: %.3f ms, test: %.3f ms", Stats.RasterizeMs, Stats.TestMs);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "types.h"
+#include "culling.h"
+
+namespace Culling
+{
+    // CPU occlusion culling: a few large occluder triangles are rasterized (depth only, 4 pixels per SSE instruction)
+    // into a low resolution depth buffer, then the boxes of the objects are tested against it before any GL submission
+    // Tiles are rasterized in parallel (Jobs::ParallelFor), each one by a single thread in triangle order, so the depth
+    // and the results do not depend on the thread count. There is no GL call: it runs headless
+    // A second level keeps the farthest depth of each block to reject most of the pixels of a box at once
+    class occlusion_rasterizer
+    {
+    public:
+        static const int TILE_WIDTH = 64;
+        static const int TILE_HEIGHT = 32;
+        static const int BLOCK_WIDTH = 8;
+        static const int BLOCK_HEIGHT = 4;
+
+        struct stats
+        {
+            int OccluderCount;   // Given to Rasterize()
+            int RasterizedCount; // Front facing, in front of the near plane and on screen
+            int TestedCount;
+            int OccludedCount;
+            double RasterizeMs;
+            double TestMs;
+        };
+
+        occlusion_rasterizer(int Width = 320, int Height = 180);
+        void Resize(int Width, int Height);
+
+        // Clear the depth and rasterize TriangleCount occluders (3 positions each, in the space of ViewProjection)
+        // Only front facing (counter-clockwise) triangles fully in front of the near plane occlude
+        void Rasterize(const mat4& ViewProjection, const v3* Triangles, int TriangleCount);
+
+        // False when the box is entirely behind the rasterized occluders (conservative by one pixel around the box)
+        bool IsBoxVisible(const mat4& ViewProjection, const v3& Center, const v3& Extent) const;
+        // Visible[i] = 0 for the boxes hidden by the occluders, boxes already at 0 are skipped, returns the visible count
+        int TestBoxes(const mat4& ViewProjection, const bounds_soa& Bounds, uint8_t* Visible);
+
+        int GetWidth() const { return Width; }
+        int GetHeight() const { return Height; }
+        // Rows of GetPitch() floats from the bottom of the screen, 0 near to 1 far (cleared)
+        const float* GetDepth() const { return Depth.data(); }
+        int GetPitch() const { return Pitch; }
+        const stats& GetStats() const { return Stats; }
+        void DisplayStats() const;
+
+    private:
+        // Screen space triangle, edge functions A * x + B * y + C and depth plane at pixel centers
+        struct screen_triangle
+        {
+            float EdgeA[3];
+            float EdgeB[3];
+            float EdgeC[3];
+            float Z0, ZX, ZY;
+            int MinX, MinY, MaxX, MaxY; // Pixels
+        };
+
+        void RasterizeTile(int Tile);
+
+        int Width = 0;
+        int Height = 0;
+        int Pitch = 0; // Width rounded up to the tiles
+        int TileCountX = 0;
+        int TileCountY = 0;
+        std::vector<float> Depth;
+        std::vector<float> BlockMaxDepth; // Pitch / BLOCK_WIDTH per row
+
+        std::vector<screen_triangle> ScreenTriangles;
+        std::vector<std::vector<int>> TileTriangles; // Bins in triangle order
+        stats Stats = {};
+    };
+}
@@ -12,6 +12,9 @@
 
 #include "opengl_helpers.h"
 #include "opengl_helpers_wireframe.h"
+#include "opengl_helpers_program_cache.h"
+#include "cpu_profiler.h"
+#include "startup_trace.h"
 
 using namespace GL;
 
@@ -155,10 +158,8 @@ void GL::UniformMaterial(GLuint Program, const char* MaterialUniformName, const
 	glUniform1f(glGetUniformLocation(Program, UniformMemberName), Material.Shininess);
 }
 
-GLuint GL::CompileShaderEx(GLenum ShaderType, int ShaderStrsCount, const char** ShaderStrs, bool InjectLightShading)
+std::vector<const char*> GL::GetShaderSources(int ShaderStrsCount, const char** ShaderStrs, bool InjectLightShading)
 {
-	GLuint Shader = glCreateShader(ShaderType);
-
 	std::vector<const char*> Sources;
 	Sources.reserve(4);
 	//Sources.push_back("#version 330 core\n");
@@ -171,6 +172,16 @@ GLuint GL::CompileShaderEx(GLenum ShaderType, int ShaderStrsCount, const char**
 	for (int i = 0; i < ShaderStrsCount; ++i)
 		Sources.push_back(ShaderStrs[i]);
 
+	return Sources;
+}
+
+GLuint GL::CompileShaderEx(GLenum ShaderType, int ShaderStrsCount, const char** ShaderStrs, bool InjectLightShading)
+{
+	PROFILE_FUNCTION();
+	GLuint Shader = glCreateShader(ShaderType);
+
+	std::vector<const char*> Sources = GetShaderSources(ShaderStrsCount, ShaderStrs, InjectLightShading);
+
 	glShaderSource(Shader, (GLsizei)Sources.size(), &Sources[0], nullptr);
 	glCompileShader(Shader);
 
@@ -205,7 +216,24 @@ std::string GL::LoadShaderFromFile(const std::string& path)
 
 GLuint GL::CreateProgramEx(int VSStringsCount, const char** VSStrings, int FSStringsCount, const char** FSStrings, bool InjectLightShading)
 {
-	GLuint Program = glCreateProgram();
+	PROFILE_FUNCTION();
+
+	// Try the program binary cache first
+	uint64_t BinaryKey = GL::ProgramBinaryKey(
+		GetShaderSources(VSStringsCount, VSStrings, false),
+		GetShaderSources(FSStringsCount, FSStrings, InjectLightShading));
+
+	char AssetName[32];
+	snprintf(AssetName, sizeof(AssetName), "program %016llx", (unsigned long long)BinaryKey);
+	STARTUP_ASSET(PROGRAM, AssetName);
+
+	GLuint Program = GL::LoadProgramBinary(BinaryKey);
+	if (GL::ProgramBinaryCacheSupported())
+		StartupTrace::ReportCacheHit(Program != 0);
+	if (Program)
+		return Program;
+
+	Program = glCreateProgram();
 
 	GLuint VertexShader = GL::CompileShaderEx(GL_VERTEX_SHADER, VSStringsCount, VSStrings);
 	GLuint FragmentShader = GL::CompileShaderEx(GL_FRAGMENT_SHADER, FSStringsCount, FSStrings, InjectLightShading);
@@ -213,6 +241,9 @@ GLuint GL::CreateProgramEx(int VSStringsCount, const char** VSStrings, int FSStr
 	glAttachShader(Program, VertexShader);
 	glAttachShader(Program, FragmentShader);
 
+	if (GL::ProgramBinaryCacheSupported())
+		glProgramParameteri(Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
 	glLinkProgram(Program);
 
 	GLint LinkStatus;
@@ -223,6 +254,10 @@ GLuint GL::CreateProgramEx(int VSStringsCount, const char** VSStrings, int FSStr
 		glGetProgramInfoLog(Program, ARRAY_SIZE(Infolog), nullptr, Infolog);
 		fprintf(stderr, "Program link error: %s\n", Infolog);
 	}
+	else
+	{
+		GL::SaveProgramBinary(BinaryKey, Program);
+	}
 
 	glDeleteShader(VertexShader);
 	glDeleteShader(FragmentShader);
@@ -245,6 +280,41 @@ GLuint GL::CreateProgram(const char* VSString, const char* FSString, bool Inject
 	return GL::CreateProgramEx(1, &VSString, 1, &FSString, InjectLightShading);
 }
 
+GLuint GL::CreateTransformFeedbackProgram(const char* VSString, const char* GSString, int VaryingCount, const char** Varyings, GLenum BufferMode)
+{
+	PROFILE_FUNCTION();
+
+	GLuint Program = glCreateProgram();
+
+	GLuint VertexShader = GL::CompileShader(GL_VERTEX_SHADER, VSString);
+	glAttachShader(Program, VertexShader);
+	GLuint GeometryShader = 0;
+	if (GSString)
+	{
+		GeometryShader = GL::CompileShader(GL_GEOMETRY_SHADER, GSString);
+		glAttachShader(Program, GeometryShader);
+	}
+
+	// Before linking
+	glTransformFeedbackVaryings(Program, VaryingCount, Varyings, BufferMode);
+	glLinkProgram(Program);
+
+	GLint LinkStatus;
+	glGetProgramiv(Program, GL_LINK_STATUS, &LinkStatus);
+	if (LinkStatus == GL_FALSE)
+	{
+		char Infolog[1024];
+		glGetProgramInfoLog(Program, ARRAY_SIZE(Infolog), nullptr, Infolog);
+		fprintf(stderr, "Program link error: %s\n", Infolog);
+	}
+
+	glDeleteShader(VertexShader);
+	if (GeometryShader)
+		glDeleteShader(GeometryShader);
+
+	return Program;
+}
+
 const char* GL::GetShaderStructsDefinitions()
 {
 	return ShaderStructsDefinitionsStr;
@@ -252,6 +322,9 @@ const char* GL::GetShaderStructsDefinitions()
 
 void GL::UploadTexture(const char* Filename, int ImageFlags, int* WidthOut, int* HeightOut)
 {
+    PROFILE_SCOPE_DETAIL("GL::UploadTexture", Filename);
+    STARTUP_ASSET(TEXTURE, Filename);
+
     // Flip
     stbi_set_flip_vertically_on_load((ImageFlags & IMG_FLIP) ? 1 : 0);
 
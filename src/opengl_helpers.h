@@ -4,6 +4,9 @@
 #include "types.h"
 #include "opengl_helpers_cache.h"
 #include "opengl_helpers_wireframe.h"
+#include "opengl_helpers_shader_registry.h"
+#include "opengl_helpers_render_targets.h"
+#include "opengl_helpers_gpu_profiler.h"
 
 enum image_flags
 {
@@ -52,6 +55,9 @@ namespace GL
         }
         
         GL::wireframe_renderer Wireframe;
+        GL::shader_registry Shaders;
+        GL::render_target_pool RenderTargets;
+        GL::gpu_profiler Profiler;
     };
 
     void UniformLight(GLuint Program, const char* LightUniformName, const light& Light);
@@ -62,6 +68,11 @@ namespace GL
     GLuint CreateProgramFromFiles(const std::string& VSPath, const std::string& FSPath, bool InjectLightShading = false);
     std::string LoadShaderFromFile(const std::string& path);
     GLuint CreateProgramEx(int VSStringsCount, const char** VSStrings, int FSStringCount, const char** FSString, bool InjectLightShading = false);
+    // Vertex and geometry (optional) shaders without fragment shader, Varyings captured by transform feedback (GL_RASTERIZER_DISCARD passes)
+    // Not stored in the program binary cache
+    GLuint CreateTransformFeedbackProgram(const char* VSString, const char* GSString, int VaryingCount, const char** Varyings, GLenum BufferMode = GL_INTERLEAVED_ATTRIBS);
+    // Exact list of strings sent to the compiler (with injected light shading code)
+    std::vector<const char*> GetShaderSources(int ShaderStrsCount, const char** ShaderStrs, bool InjectLightShading = false);
     const char* GetShaderStructsDefinitions();
     void UploadTexture(const char* Filename, int ImageFlags = 0, int* WidthOut = nullptr, int* HeightOut = nullptr);
     void UploadCheckerboardTexture(int Width, int Height, int SquareSize);
@@ -0,0 +1,120 @@
+
+#include <cstdio>
+#include <algorithm>
+
+#include "opengl_helpers_backbuffer.h"
+
+using namespace GL;
+
+namespace
+{
+	// Backbuffer replacing framebuffer 0, nullptr when the hooks forward the calls unchanged
+	offscreen_backbuffer* ActiveBackbuffer = nullptr;
+
+	decltype(glad_glBindFramebuffer) Original_glBindFramebuffer = nullptr;
+	decltype(glad_glDrawBuffer) Original_glDrawBuffer = nullptr;
+	decltype(glad_glReadBuffer) Original_glReadBuffer = nullptr;
+
+	GLenum RemapBuffer(GLenum Buffer)
+	{
+		switch (Buffer)
+		{
+		case GL_BACK:
+		case GL_FRONT:
+		case GL_BACK_LEFT:
+		case GL_FRONT_LEFT:
+			return GL_COLOR_ATTACHMENT0;
+		default:
+			return Buffer;
+		}
+	}
+
+	void APIENTRY Hook_glBindFramebuffer(GLenum target, GLuint framebuffer)
+	{
+		if (framebuffer == 0 && ActiveBackbuffer)
+			framebuffer = ActiveBackbuffer->GetFramebuffer();
+		Original_glBindFramebuffer(target, framebuffer);
+	}
+
+	void APIENTRY Hook_glDrawBuffer(GLenum buf)
+	{
+		Original_glDrawBuffer(ActiveBackbuffer ? RemapBuffer(buf) : buf);
+	}
+
+	void APIENTRY Hook_glReadBuffer(GLenum src)
+	{
+		Original_glReadBuffer(ActiveBackbuffer ? RemapBuffer(src) : src);
+	}
+
+	void InstallBackbufferHooks()
+	{
+		if (Original_glBindFramebuffer)
+			return;
+
+		Original_glBindFramebuffer = glad_glBindFramebuffer;
+		glad_glBindFramebuffer = Hook_glBindFramebuffer;
+		Original_glDrawBuffer = glad_glDrawBuffer;
+		glad_glDrawBuffer = Hook_glDrawBuffer;
+		Original_glReadBuffer = glad_glReadBuffer;
+		glad_glReadBuffer = Hook_glReadBuffer;
+	}
+}
+
+offscreen_backbuffer::offscreen_backbuffer(int Width, int Height)
+	: Width(Width), Height(Height)
+{
+	glGenRenderbuffers(1, &ColorRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, ColorRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, Width, Height);
+
+	glGenRenderbuffers(1, &DepthStencilRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, DepthStencilRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, Width, Height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, ColorRenderbuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, DepthStencilRenderbuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		fprintf(stderr, "Offscreen backbuffer incomplete\n");
+
+	InstallBackbufferHooks();
+	ActiveBackbuffer = this;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+offscreen_backbuffer::~offscreen_backbuffer()
+{
+	if (ActiveBackbuffer == this)
+		ActiveBackbuffer = nullptr;
+
+	glDeleteFramebuffers(1, &FBO);
+	glDeleteRenderbuffers(1, &ColorRenderbuffer);
+	glDeleteRenderbuffers(1, &DepthStencilRenderbuffer);
+}
+
+void offscreen_backbuffer::ReadPixels(std::vector<uint8_t>* Pixels)
+{
+	GLint PreviousReadFramebuffer;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &PreviousReadFramebuffer);
+
+	Pixels->resize((size_t)Width * Height * 4);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, Pixels->data());
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, PreviousReadFramebuffer);
+
+	// GL rows are bottom to top
+	size_t RowSize = (size_t)Width * 4;
+	std::vector<uint8_t> Row(RowSize);
+	for (int y = 0; y < Height / 2; ++y)
+	{
+		uint8_t* Top = Pixels->data() + y * RowSize;
+		uint8_t* Bottom = Pixels->data() + (Height - 1 - y) * RowSize;
+		std::copy(Top, Top + RowSize, Row.data());
+		std::copy(Bottom, Bottom + RowSize, Top);
+		std::copy(Row.data(), Row.data() + RowSize, Bottom);
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "opengl_headers.h"
+
+namespace GL
+{
+	// Framebuffer object standing in for the default framebuffer when there is none (headless contexts)
+	// While it is active, binding framebuffer 0 binds it instead and GL_BACK/GL_FRONT draw/read buffers select its color attachment,
+	// so the demos render into it unchanged
+	class offscreen_backbuffer
+	{
+	public:
+		offscreen_backbuffer(int Width, int Height);
+		~offscreen_backbuffer();
+		offscreen_backbuffer(const offscreen_backbuffer&) = delete;
+		offscreen_backbuffer& operator=(const offscreen_backbuffer&) = delete;
+
+		GLuint GetFramebuffer() const { return FBO; }
+		int GetWidth() const { return Width; }
+		int GetHeight() const { return Height; }
+
+		// RGBA8 pixels, top row first
+		void ReadPixels(std::vector<uint8_t>* Pixels);
+
+	private:
+		GLuint FBO = 0;
+		GLuint ColorRenderbuffer = 0;
+		GLuint DepthStencilRenderbuffer = 0;
+		int Width;
+		int Height;
+	};
+}
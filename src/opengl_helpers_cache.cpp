@@ -2,6 +2,16 @@
 #include "opengl_helpers.h"
 
 #include "opengl_helpers_cache.h"
+#include "opengl_helpers_memory.h"
+#include "cpu_profiler.h"
+#include "startup_trace.h"
+
+// Meshes over this size are split in SUBMESH_GRID_SIZE^3 cells for culling
+static const int SUBMESH_MIN_TRIANGLE_COUNT = 4096;
+static const int SUBMESH_GRID_SIZE = 4;
+// Occluders of the split meshes
+static const int OCCLUDER_MAX_TRIANGLE_COUNT = 2048;
+static const float OCCLUDER_MIN_AREA_RATIO = 1e-4f; // Of the squared bounds diagonal
 
 GL::cache::cache()
 {
@@ -14,6 +24,14 @@ GL::cache::~cache()
 
 	for (const auto& KeyValue : this->VertexBufferMap)
 		glDeleteBuffers(1, &KeyValue.second.VertexBuffer);
+
+	for (const auto& KeyValue : this->IndexedMeshMap)
+	{
+		glDeleteBuffers(1, &KeyValue.second.VertexBuffer);
+		glDeleteBuffers(1, &KeyValue.second.IndexBuffer);
+	}
+
+	GL::TrackCPUMemory(&this->TmpBuffer, "GL::cache::TmpBuffer", 0);
 }
 
 GLuint GL::cache::LoadObj(const char* Filename, float Scale, int* VertexCountOut)
@@ -26,8 +44,24 @@ GLuint GL::cache::LoadObj(const char* Filename, float Scale, int* VertexCountOut
 		return Found->second.VertexBuffer;
 	}
 
+	PROFILE_SCOPE_DETAIL("GL::cache::LoadObj", Filename);
+	STARTUP_ASSET(MESH, Filename);
+	GL::memory_owner_scope MemoryOwner("GL::cache");
 	this->TmpBuffer.clear();
 	Mesh::LoadObjNoConvertion(this->TmpBuffer, Filename, Scale);
+	GL::TrackCPUMemory(&this->TmpBuffer, "GL::cache::TmpBuffer", this->TmpBuffer.capacity() * sizeof(vertex_full));
+
+	mesh_info Info = {};
+	Info.Bounds = Mesh::ComputeBounds(this->TmpBuffer.data(), (int)this->TmpBuffer.size());
+	if ((int)this->TmpBuffer.size() / 3 >= SUBMESH_MIN_TRIANGLE_COUNT)
+	{
+		Mesh::BuildSubmeshes(this->TmpBuffer, SUBMESH_GRID_SIZE, Info.Submeshes);
+		float Diagonal = 2.f * Info.Bounds.Radius;
+		Mesh::SelectOccluders(this->TmpBuffer.data(), (int)this->TmpBuffer.size(), OCCLUDER_MAX_TRIANGLE_COUNT,
+			OCCLUDER_MIN_AREA_RATIO * Diagonal * Diagonal, Info.Occluders);
+	}
+	else
+		Info.Submeshes.push_back({ 0, (int)this->TmpBuffer.size(), Info.Bounds });
 
 	// Upload mesh to gpu
 	GLuint MeshBuffer = 0;
@@ -38,11 +72,54 @@ GLuint GL::cache::LoadObj(const char* Filename, float Scale, int* VertexCountOut
 	if (VertexCountOut)
 		*VertexCountOut = (int)this->TmpBuffer.size();
 	
-	this->VertexBufferMap[Filename] = { MeshBuffer, (int)this->TmpBuffer.size() };
+	Info.VertexBuffer = MeshBuffer;
+	Info.Size = (int)this->TmpBuffer.size();
+	this->VertexBufferMap[Filename] = Info;
 
 	return MeshBuffer;
 }
 
+const GL::mesh_info* GL::cache::FindMeshInfo(const char* Filename) const
+{
+	auto Found = this->VertexBufferMap.find(Filename);
+	return Found != this->VertexBufferMap.end() ? &Found->second : nullptr;
+}
+
+const GL::indexed_mesh& GL::cache::LoadIndexedObj(const char* Filename, float Scale)
+{
+	auto Found = this->IndexedMeshMap.find(Filename);
+	if (Found != this->IndexedMeshMap.end())
+		return Found->second;
+
+	PROFILE_SCOPE_DETAIL("GL::cache::LoadIndexedObj", Filename);
+	STARTUP_ASSET(MESH, Filename);
+	GL::memory_owner_scope MemoryOwner("GL::cache");
+	this->TmpBuffer.clear();
+	Mesh::LoadObjNoConvertion(this->TmpBuffer, Filename, Scale);
+	GL::TrackCPUMemory(&this->TmpBuffer, "GL::cache::TmpBuffer", this->TmpBuffer.capacity() * sizeof(vertex_full));
+
+	std::vector<vertex_full> Vertices;
+	std::vector<uint32_t> Indices;
+	Mesh::BuildIndexed(this->TmpBuffer.data(), (int)this->TmpBuffer.size(), Vertices, Indices);
+
+	// Upload mesh to gpu
+	indexed_mesh Mesh;
+	Mesh.VertexCount = (int)Vertices.size();
+	Mesh.IndexCount = (int)Indices.size();
+
+	glGenBuffers(1, &Mesh.VertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, Mesh.VertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, Vertices.size() * sizeof(vertex_full), Vertices.data(), GL_STATIC_DRAW);
+
+	// Bound as array buffer: binding an element array buffer needs a vertex array
+	glGenBuffers(1, &Mesh.IndexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, Mesh.IndexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, Indices.size() * sizeof(uint32_t), Indices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	return this->IndexedMeshMap[Filename] = Mesh;
+}
+
 GLuint GL::cache::LoadTexture(const char* Filename, int ImageFlags, int* WidthOut, int* HeightOut)
 {
 	texture_identifier TextureIdentifier = { Filename, ImageFlags };
@@ -55,6 +132,8 @@ GLuint GL::cache::LoadTexture(const char* Filename, int ImageFlags, int* WidthOu
 		return Found->second.TextureID;
 	}
 
+	PROFILE_SCOPE_DETAIL("GL::cache::LoadTexture", Filename);
+	GL::memory_owner_scope MemoryOwner("GL::cache");
 	GLuint Texture;
 	glGenTextures(1, &Texture);
 	glBindTexture(GL_TEXTURE_2D, Texture);
@@ -9,21 +9,42 @@
 
 namespace GL
 {
+	// Vertices (vertex_full) and 32-bit indices of a triangle list
+	struct indexed_mesh
+	{
+		GLuint VertexBuffer = 0;
+		GLuint IndexBuffer = 0;
+		int VertexCount = 0;
+		int IndexCount = 0;
+	};
+
+	// Mesh loaded by cache::LoadObj, bounds in model space
+	struct mesh_info
+	{
+		GLuint VertexBuffer;
+		int Size;
+		Mesh::bounds Bounds;
+		// Meshes of 4096 triangles or more are split in spatial cells, their triangles sorted by cell in VertexBuffer
+		// (the .obj order is lost), smaller ones have a single submesh
+		std::vector<Mesh::submesh> Submeshes;
+		// Largest triangles of the split meshes, for the CPU occlusion culling (Culling::occlusion_rasterizer)
+		std::vector<v3> Occluders;
+	};
+
 	class cache
 	{
 	public:
         cache();
         ~cache();
+        // Every mesh of 4096 triangles or more (not only the tavern) gets its triangles reordered by cell in its vertex buffer
         GLuint LoadObj(const char* Filename, float Scale, int* VertexCountOut);
+        // Bounds and submeshes of a mesh loaded with LoadObj (nullptr if not loaded)
+        const mesh_info* FindMeshInfo(const char* Filename) const;
+        // Same .obj with its duplicated vertices merged (separate buffers from LoadObj)
+        const indexed_mesh& LoadIndexedObj(const char* Filename, float Scale);
         GLuint LoadTexture(const char* Filename, int ImageFlags = 0, int* WidthOut = nullptr, int* HeightOut = nullptr);
 
 	private:
-		struct mesh
-		{
-			GLuint VertexBuffer;
-			int Size;
-		};
-
 		struct texture_identifier
 		{
 			std::string Filename;
@@ -43,7 +64,8 @@ namespace GL
 		};
 
 		std::vector<vertex_full> TmpBuffer;
-		std::map<std::string, mesh> VertexBufferMap;
+		std::map<std::string, mesh_info> VertexBufferMap;
+		std::map<std::string, indexed_mesh> IndexedMeshMap;
 		std::map<texture_identifier, texture> TextureMap;
 	};
 }
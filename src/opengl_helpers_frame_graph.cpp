@@ -0,0 +1,458 @@
+
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+
+#include <imgui.h>
+
+#include "opengl_helpers_frame_graph.h"
+#include "cpu_profiler.h"
+
+using namespace GL;
+
+frame_graph::frame_graph(render_target_pool& RenderTargets)
+	: RenderTargets(RenderTargets)
+{
+}
+
+void frame_graph::Reset()
+{
+	Resources.clear();
+	Versions.clear();
+	Passes.clear();
+	SkippedClearCount = 0;
+}
+
+frame_resource frame_graph::AddResource(const char* Name, resource_type Type, const frame_target_desc& Desc, GLuint ImportedName)
+{
+	resource Resource = {};
+	Resource.Name = Name;
+	Resource.Type = Type;
+	Resource.Desc = Desc;
+	Resource.ImportedName = ImportedName;
+	Resource.LatestVersion = (frame_resource)Versions.size();
+	Resources.push_back(Resource);
+
+	version Version = {};
+	Version.Resource = (int)Resources.size() - 1;
+	Versions.push_back(Version);
+	return Resource.LatestVersion;
+}
+
+frame_resource frame_graph::CreateTexture(const char* Name, const frame_target_desc& Desc)
+{
+	return AddResource(Name, resource_type::TEXTURE, Desc, 0);
+}
+
+frame_resource frame_graph::CreateRenderbuffer(const char* Name, const frame_target_desc& Desc)
+{
+	return AddResource(Name, resource_type::RENDERBUFFER, Desc, 0);
+}
+
+frame_resource frame_graph::ImportTexture(const char* Name, GLuint Texture, int Width, int Height)
+{
+	return AddResource(Name, resource_type::IMPORTED_TEXTURE, { GL_NONE, Width, Height }, Texture);
+}
+
+frame_resource frame_graph::ImportBuffer(const char* Name, GLuint Buffer)
+{
+	return AddResource(Name, resource_type::IMPORTED_BUFFER, { GL_NONE, 0, 0 }, Buffer);
+}
+
+frame_resource frame_graph::ImportBackbuffer(int Width, int Height)
+{
+	return AddResource("Backbuffer", resource_type::BACKBUFFER, { GL_NONE, Width, Height }, 0);
+}
+
+bool frame_graph::IsTransient(int Resource) const
+{
+	return Resources[Resource].Type == resource_type::TEXTURE || Resources[Resource].Type == resource_type::RENDERBUFFER;
+}
+
+frame_resource frame_graph::AddVersion(frame_resource Previous, int PassIndex, frame_load_op LoadOp)
+{
+	resource& Resource = Resources[Versions[Previous].Resource];
+	if (Resource.LatestVersion != Previous)
+		fprintf(stderr, "Frame graph pass '%s' writes an old version of '%s'\n", Passes[PassIndex].Name.c_str(), Resource.Name.c_str());
+
+	// Loading the previous content makes the pass depend on its writer
+	// (nothing to load from a transient resource that was never written)
+	bool HasContent = Versions[Previous].Producer >= 0 || !IsTransient(Versions[Previous].Resource);
+	if (LoadOp == frame_load_op::LOAD && HasContent)
+	{
+		Passes[PassIndex].Reads.push_back(Previous);
+		Versions[Previous].ReaderCount++;
+	}
+
+	version Version = {};
+	Version.Resource = Versions[Previous].Resource;
+	Version.Previous = Previous;
+	Version.Producer = PassIndex;
+	Versions.push_back(Version);
+
+	frame_resource NewVersion = (frame_resource)Versions.size() - 1;
+	Resource.LatestVersion = NewVersion;
+	Passes[PassIndex].Writes.push_back(NewVersion);
+
+	// Writes to resources owned outside of the graph are always kept
+	if (!IsTransient(Version.Resource))
+		Passes[PassIndex].SideEffect = true;
+
+	return NewVersion;
+}
+
+void frame_graph::pass_builder::Read(frame_resource Resource)
+{
+	if (Graph.Versions[Resource].Producer < 0 && Graph.IsTransient(Graph.Versions[Resource].Resource))
+		fprintf(stderr, "Frame graph pass '%s' reads '%s' before it is written\n", Graph.Passes[PassIndex].Name.c_str(), Graph.Resources[Graph.Versions[Resource].Resource].Name.c_str());
+
+	Graph.Passes[PassIndex].Reads.push_back(Resource);
+	Graph.Versions[Resource].ReaderCount++;
+}
+
+frame_resource frame_graph::pass_builder::WriteColor(frame_resource Resource, frame_load_op LoadOp, v4 ClearColor)
+{
+	if (!Graph.IsTransient(Graph.Versions[Resource].Resource))
+		fprintf(stderr, "Frame graph pass '%s' can only attach transient targets\n", Graph.Passes[PassIndex].Name.c_str());
+
+	attachment Attachment = {};
+	Attachment.Version = Graph.AddVersion(Resource, PassIndex, LoadOp);
+	Attachment.LoadOp = LoadOp;
+	Attachment.ClearColor = ClearColor;
+	Graph.Passes[PassIndex].ColorAttachments.push_back(Attachment);
+	return Attachment.Version;
+}
+
+frame_resource frame_graph::pass_builder::WriteDepth(frame_resource Resource, frame_load_op LoadOp, float ClearDepth)
+{
+	if (!Graph.IsTransient(Graph.Versions[Resource].Resource))
+		fprintf(stderr, "Frame graph pass '%s' can only attach transient targets\n", Graph.Passes[PassIndex].Name.c_str());
+
+	attachment Attachment = {};
+	Attachment.Version = Graph.AddVersion(Resource, PassIndex, LoadOp);
+	Attachment.LoadOp = LoadOp;
+	Attachment.ClearDepth = ClearDepth;
+	Graph.Passes[PassIndex].DepthAttachment = Attachment;
+	return Attachment.Version;
+}
+
+frame_resource frame_graph::pass_builder::WriteBackbuffer(frame_resource Backbuffer, frame_load_op LoadOp, v4 ClearColor)
+{
+	attachment Attachment = {};
+	Attachment.Version = Graph.AddVersion(Backbuffer, PassIndex, LoadOp);
+	Attachment.LoadOp = LoadOp;
+	Attachment.ClearColor = ClearColor;
+	Attachment.ClearDepth = 1.f;
+	Graph.Passes[PassIndex].WritesBackbuffer = true;
+	Graph.Passes[PassIndex].BackbufferAttachment = Attachment;
+	return Attachment.Version;
+}
+
+frame_resource frame_graph::pass_builder::Write(frame_resource Resource)
+{
+	return Graph.AddVersion(Resource, PassIndex, frame_load_op::LOAD);
+}
+
+void frame_graph::pass_builder::SetSideEffect()
+{
+	Graph.Passes[PassIndex].SideEffect = true;
+}
+
+GLuint frame_graph::pass_resources::Get(frame_resource Resource) const
+{
+	const resource& PhysicalResource = Graph.Resources[Graph.Versions[Resource].Resource];
+	if (PhysicalResource.Target)
+		return PhysicalResource.Target->Name;
+	return PhysicalResource.ImportedName;
+}
+
+void frame_graph::AddPass(const char* Name, pass_setup Setup, pass_execute Execute)
+{
+	pass Pass = {};
+	Pass.Name = Name;
+	Pass.Execute = Execute;
+	Passes.push_back(Pass);
+
+	pass_builder Builder(*this, (int)Passes.size() - 1);
+	Setup(Builder);
+}
+
+void frame_graph::SetPassHooks(pass_hook OnPassBegin, pass_hook OnPassEnd)
+{
+	this->OnPassBegin = OnPassBegin;
+	this->OnPassEnd = OnPassEnd;
+}
+
+// Color outputs nobody reads are not allocated (draw buffer set to GL_NONE)
+bool frame_graph::IsDiscarded(const attachment& Attachment) const
+{
+	return Versions[Attachment.Version].ReaderCount == 0 && IsTransient(Versions[Attachment.Version].Resource);
+}
+
+void frame_graph::CullPasses()
+{
+	// Reference count of a pass is the number of reads of its outputs
+	std::vector<int> UnreferencedPasses;
+	for (int i = 0; i < (int)Passes.size(); ++i)
+	{
+		pass& Pass = Passes[i];
+		Pass.RefCount = Pass.SideEffect ? 1 : 0;
+		for (frame_resource Write : Pass.Writes)
+			Pass.RefCount += Versions[Write].ReaderCount;
+
+		if (Pass.RefCount == 0)
+			UnreferencedPasses.push_back(i);
+	}
+
+	// Culling a pass releases its reads, which can make their producers unreferenced as well
+	while (!UnreferencedPasses.empty())
+	{
+		pass& Pass = Passes[UnreferencedPasses.back()];
+		UnreferencedPasses.pop_back();
+		Pass.Culled = true;
+
+		for (frame_resource Read : Pass.Reads)
+		{
+			version& Version = Versions[Read];
+			Version.ReaderCount--;
+			if (Version.Producer >= 0 && --Passes[Version.Producer].RefCount == 0)
+				UnreferencedPasses.push_back(Version.Producer);
+		}
+	}
+}
+
+std::vector<int> frame_graph::SortPasses() const
+{
+	// Edges: producer -> reader, previous writer -> writer and previous readers -> writer
+	std::vector<std::vector<int>> Successors(Passes.size());
+	std::vector<int> PredecessorCount(Passes.size(), 0);
+	auto AddEdge = [&](int From, int To)
+	{
+		if (From < 0 || From == To || Passes[From].Culled)
+			return;
+		Successors[From].push_back(To);
+		PredecessorCount[To]++;
+	};
+
+	for (int i = 0; i < (int)Passes.size(); ++i)
+	{
+		if (Passes[i].Culled)
+			continue;
+
+		for (frame_resource Read : Passes[i].Reads)
+			AddEdge(Versions[Read].Producer, i);
+
+		for (frame_resource Write : Passes[i].Writes)
+		{
+			frame_resource Previous = Versions[Write].Previous;
+			AddEdge(Versions[Previous].Producer, i);
+			for (int j = 0; j < (int)Passes.size(); ++j)
+			{
+				if (std::find(Passes[j].Reads.begin(), Passes[j].Reads.end(), Previous) != Passes[j].Reads.end())
+					AddEdge(j, i);
+			}
+		}
+	}
+
+	// Topological sort, declaration order breaks ties
+	std::vector<int> Order;
+	std::vector<bool> Scheduled(Passes.size(), false);
+	for (;;)
+	{
+		int Next = -1;
+		for (int i = 0; i < (int)Passes.size() && Next < 0; ++i)
+		{
+			if (!Passes[i].Culled && !Scheduled[i] && PredecessorCount[i] == 0)
+				Next = i;
+		}
+
+		if (Next < 0)
+			break;
+
+		Scheduled[Next] = true;
+		Order.push_back(Next);
+		for (int Successor : Successors[Next])
+			PredecessorCount[Successor]--;
+	}
+
+	for (int i = 0; i < (int)Passes.size(); ++i)
+	{
+		if (!Passes[i].Culled && !Scheduled[i])
+		{
+			fprintf(stderr, "Frame graph has a dependency cycle on pass '%s'\n", Passes[i].Name.c_str());
+			Order.push_back(i);
+		}
+	}
+
+	return Order;
+}
+
+void frame_graph::Execute()
+{
+	PROFILE_FUNCTION();
+
+	CullPasses();
+	std::vector<int> Order = SortPasses();
+
+	// Transient resources live from their first to their last user
+	for (int i = 0; i < (int)Order.size(); ++i)
+	{
+		pass& Pass = Passes[Order[i]];
+		auto Use = [&](frame_resource Version)
+		{
+			resource& Resource = Resources[Versions[Version].Resource];
+			if (Resource.FirstUse < 0)
+				Resource.FirstUse = i;
+			Resource.LastUse = i;
+		};
+
+		for (frame_resource Read : Pass.Reads)
+			Use(Read);
+		for (frame_resource Write : Pass.Writes)
+		{
+			bool IsDiscardedAttachment = false;
+			for (const attachment& Attachment : Pass.ColorAttachments)
+				IsDiscardedAttachment |= Attachment.Version == Write && IsDiscarded(Attachment);
+			if (!IsDiscardedAttachment)
+				Use(Write);
+		}
+	}
+
+	std::vector<pass_stats> FrameStats;
+	for (const pass& Pass : Passes)
+		FrameStats.push_back({ Pass.Name, Pass.Culled, 0.0 });
+
+	for (int i = 0; i < (int)Order.size(); ++i)
+	{
+		for (resource& Resource : Resources)
+		{
+			if (Resource.FirstUse == i && Resource.Type == resource_type::TEXTURE)
+				Resource.Target = RenderTargets.AcquireTexture(Resource.Desc.InternalFormat, Resource.Desc.Width, Resource.Desc.Height, Resource.Desc.Samples);
+			else if (Resource.FirstUse == i && Resource.Type == resource_type::RENDERBUFFER)
+				Resource.Target = RenderTargets.AcquireRenderbuffer(Resource.Desc.InternalFormat, Resource.Desc.Width, Resource.Desc.Height, Resource.Desc.Samples);
+		}
+
+		FrameStats[Order[i]].CPUTimeMs = ExecutePass(Passes[Order[i]]);
+
+		// Give memory back for the next passes
+		for (resource& Resource : Resources)
+		{
+			if (Resource.LastUse == i && Resource.Target)
+				RenderTargets.Release(Resource.Target);
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// Smooth timings of passes that kept their place since last frame
+	for (size_t i = 0; i < FrameStats.size(); ++i)
+	{
+		if (i < LastFrameStats.size() && LastFrameStats[i].Name == FrameStats[i].Name)
+			FrameStats[i].CPUTimeMs = LastFrameStats[i].CPUTimeMs * 0.9 + FrameStats[i].CPUTimeMs * 0.1;
+	}
+	LastFrameStats = FrameStats;
+}
+
+double frame_graph::ExecutePass(pass& Pass)
+{
+	PROFILE_SCOPE_DETAIL("frame_graph::ExecutePass", Pass.Name.c_str());
+
+	if (OnPassBegin)
+		OnPassBegin(Pass.Name.c_str());
+
+	std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+	pass_resources PassResources(*this);
+
+	if (Pass.WritesBackbuffer)
+	{
+		const frame_target_desc& Desc = Resources[Versions[Pass.BackbufferAttachment.Version].Resource].Desc;
+		PassResources.Width = Desc.Width;
+		PassResources.Height = Desc.Height;
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(0, 0, Desc.Width, Desc.Height);
+
+		if (Pass.BackbufferAttachment.LoadOp == frame_load_op::CLEAR)
+		{
+			const v4& Color = Pass.BackbufferAttachment.ClearColor;
+			glClearColor(Color.r, Color.g, Color.b, Color.a);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		}
+	}
+	else if (!Pass.ColorAttachments.empty() || Pass.DepthAttachment.Version >= 0)
+	{
+		std::vector<const render_target*> ColorTargets;
+		for (const attachment& Attachment : Pass.ColorAttachments)
+			ColorTargets.push_back(IsDiscarded(Attachment) ? nullptr : Resources[Versions[Attachment.Version].Resource].Target);
+
+		const render_target* DepthTarget = nullptr;
+		if (Pass.DepthAttachment.Version >= 0)
+			DepthTarget = Resources[Versions[Pass.DepthAttachment.Version].Resource].Target;
+
+		const render_target* SizeTarget = DepthTarget;
+		for (const render_target* ColorTarget : ColorTargets)
+			SizeTarget = SizeTarget ? SizeTarget : ColorTarget;
+
+		if (SizeTarget)
+		{
+			PassResources.Width = SizeTarget->Width;
+			PassResources.Height = SizeTarget->Height;
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, RenderTargets.GetFramebuffer(ColorTargets, DepthTarget));
+		glViewport(0, 0, PassResources.Width, PassResources.Height);
+
+		// Clears of discarded outputs are skipped
+		for (int i = 0; i < (int)Pass.ColorAttachments.size(); ++i)
+		{
+			if (Pass.ColorAttachments[i].LoadOp != frame_load_op::CLEAR)
+				continue;
+
+			const v4& Color = Pass.ColorAttachments[i].ClearColor;
+			if (ColorTargets[i] && IsIntegerFormat(ColorTargets[i]->InternalFormat))
+			{
+				GLuint IntegerColor[4] = { (GLuint)Color.r, (GLuint)Color.g, (GLuint)Color.b, (GLuint)Color.a };
+				glClearBufferuiv(GL_COLOR, i, IntegerColor);
+			}
+			else if (ColorTargets[i])
+				glClearBufferfv(GL_COLOR, i, Color.e);
+			else
+				SkippedClearCount++;
+		}
+
+		if (DepthTarget && Pass.DepthAttachment.LoadOp == frame_load_op::CLEAR)
+		{
+			if (DepthTarget->InternalFormat == GL_DEPTH24_STENCIL8 || DepthTarget->InternalFormat == GL_DEPTH32F_STENCIL8)
+				glClearBufferfi(GL_DEPTH_STENCIL, 0, Pass.DepthAttachment.ClearDepth, 0);
+			else
+				glClearBufferfv(GL_DEPTH, 0, &Pass.DepthAttachment.ClearDepth);
+		}
+	}
+
+	Pass.Execute(PassResources);
+	std::chrono::steady_clock::time_point End = std::chrono::steady_clock::now();
+
+	if (OnPassEnd)
+		OnPassEnd(Pass.Name.c_str());
+
+	return std::chrono::duration<double, std::milli>(End - Start).count();
+}
+
+void frame_graph::InspectPasses()
+{
+	if (ImGui::TreeNodeEx("Frame graph"))
+	{
+		for (const pass_stats& Stats : LastFrameStats)
+		{
+			if (Stats.Culled)
+				ImGui::TextDisabled("%s (culled)", Stats.Name.c_str());
+			else
+				ImGui::Text("%s: %.3f ms (cpu)", Stats.Name.c_str(), Stats.CPUTimeMs);
+		}
+
+		ImGui::Text("Skipped clears: %d", SkippedClearCount);
+		ImGui::Text("Pooled targets: %d (%.1f MB)", RenderTargets.GetTargetCount(), RenderTargets.GetAllocatedBytes() / (1024.0 * 1024.0));
+		ImGui::TreePop();
+	}
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "opengl_headers.h"
+#include "types.h"
+#include "opengl_helpers_render_targets.h"
+
+namespace GL
+{
+	// Handle to a version of a frame graph resource (each write creates a new version), -1 when invalid
+	using frame_resource = int;
+
+	enum class frame_load_op
+	{
+		LOAD,      // Keep previous content (depends on the previous writer)
+		CLEAR,     // Clear before the pass (no dependency on the previous writer)
+		DONT_CARE, // The pass overwrites every pixel (fullscreen quad)
+	};
+
+	struct frame_target_desc
+	{
+		GLenum InternalFormat;
+		int Width;
+		int Height;
+		int Samples = 0;
+	};
+
+	// Passes declare the resources they read and write, the graph derives the execution order,
+	// culls passes whose outputs are never read, clears attachments only when their content is used
+	// and takes transient targets from the render target pool for the lifetime of their users
+	// The graph is rebuilt every frame: Reset(), declare resources and passes, Execute()
+	class frame_graph
+	{
+	public:
+		class pass_builder
+		{
+		public:
+			void Read(frame_resource Resource);
+			// Color attachments are bound in declaration order, integer formats are cleared to the truncated ClearColor
+			frame_resource WriteColor(frame_resource Resource, frame_load_op LoadOp = frame_load_op::LOAD, v4 ClearColor = { 0.f, 0.f, 0.f, 1.f });
+			frame_resource WriteDepth(frame_resource Resource, frame_load_op LoadOp = frame_load_op::LOAD, float ClearDepth = 1.f);
+			// Color and depth of the default framebuffer, the pass is never culled
+			frame_resource WriteBackbuffer(frame_resource Backbuffer, frame_load_op LoadOp = frame_load_op::LOAD, v4 ClearColor = { 0.f, 0.f, 0.f, 1.f });
+			// Buffers or textures written without framebuffer (transform feedback, uploads...)
+			frame_resource Write(frame_resource Resource);
+			// Keep the pass even if nothing reads its outputs
+			void SetSideEffect();
+
+		private:
+			friend class frame_graph;
+			pass_builder(frame_graph& Graph, int PassIndex) : Graph(Graph), PassIndex(PassIndex) {}
+
+			frame_graph& Graph;
+			int PassIndex;
+		};
+
+		class pass_resources
+		{
+		public:
+			// Texture, renderbuffer or buffer name of a resource read or written by the pass
+			GLuint Get(frame_resource Resource) const;
+			int GetWidth() const { return Width; }
+			int GetHeight() const { return Height; }
+
+		private:
+			friend class frame_graph;
+			pass_resources(const frame_graph& Graph) : Graph(Graph) {}
+
+			const frame_graph& Graph;
+			int Width = 0;
+			int Height = 0;
+		};
+
+		using pass_setup = std::function<void(pass_builder& Builder)>;
+		using pass_execute = std::function<void(const pass_resources& Resources)>;
+		using pass_hook = std::function<void(const char* PassName)>;
+
+		frame_graph(render_target_pool& RenderTargets);
+		frame_graph(const frame_graph&) = delete;
+		frame_graph& operator=(const frame_graph&) = delete;
+
+		void Reset();
+
+		frame_resource CreateTexture(const char* Name, const frame_target_desc& Desc);
+		frame_resource CreateRenderbuffer(const char* Name, const frame_target_desc& Desc);
+		frame_resource ImportTexture(const char* Name, GLuint Texture, int Width, int Height);
+		frame_resource ImportBuffer(const char* Name, GLuint Buffer);
+		frame_resource ImportBackbuffer(int Width, int Height);
+
+		// Setup is called immediately, Execute during Execute() if the pass is not culled
+		void AddPass(const char* Name, pass_setup Setup, pass_execute Execute);
+
+		void Execute();
+
+		// Called around each executed pass (GPU profilers, debug groups...)
+		void SetPassHooks(pass_hook OnPassBegin, pass_hook OnPassEnd);
+
+		// Passes of the last executed frame with their CPU time
+		void InspectPasses();
+
+	private:
+		enum class resource_type
+		{
+			TEXTURE,
+			RENDERBUFFER,
+			IMPORTED_TEXTURE,
+			IMPORTED_BUFFER,
+			BACKBUFFER,
+		};
+
+		struct resource
+		{
+			std::string Name;
+			resource_type Type;
+			frame_target_desc Desc;
+			GLuint ImportedName = 0;
+
+			frame_resource LatestVersion = -1;
+
+			// Set during Execute() for transient resources
+			const render_target* Target = nullptr;
+			int FirstUse = -1; // Position in the execution order
+			int LastUse = -1;
+		};
+
+		struct version
+		{
+			int Resource;
+			frame_resource Previous = -1;
+			int Producer = -1; // Pass index
+			int ReaderCount = 0;
+		};
+
+		struct attachment
+		{
+			frame_resource Version = -1;
+			frame_load_op LoadOp;
+			v4 ClearColor;
+			float ClearDepth;
+		};
+
+		struct pass
+		{
+			std::string Name;
+			pass_execute Execute;
+
+			std::vector<frame_resource> Reads;
+			std::vector<frame_resource> Writes; // Every version produced by the pass
+			std::vector<attachment> ColorAttachments;
+			attachment DepthAttachment;
+			bool WritesBackbuffer = false;
+			attachment BackbufferAttachment;
+
+			bool SideEffect = false;
+			int RefCount = 0;
+			bool Culled = false;
+		};
+
+		struct pass_stats
+		{
+			std::string Name;
+			bool Culled;
+			double CPUTimeMs; // Smoothed over frames
+		};
+
+		frame_resource AddResource(const char* Name, resource_type Type, const frame_target_desc& Desc, GLuint ImportedName);
+		frame_resource AddVersion(frame_resource Resource, int PassIndex, frame_load_op LoadOp);
+		bool IsTransient(int Resource) const;
+		bool IsDiscarded(const attachment& Attachment) const;
+		void CullPasses();
+		std::vector<int> SortPasses() const;
+		double ExecutePass(pass& Pass);
+
+		render_target_pool& RenderTargets;
+
+		std::vector<resource> Resources;
+		std::vector<version> Versions;
+		std::vector<pass> Passes;
+
+		pass_hook OnPassBegin;
+		pass_hook OnPassEnd;
+
+		// Debug
+		std::vector<pass_stats> LastFrameStats;
+		int SkippedClearCount = 0;
+	};
+}
@@ -0,0 +1,314 @@
+
+#include <cstdio>
+#include <algorithm>
+#include <functional>
+
+#include <imgui.h>
+
+#include "opengl_helpers_gpu_profiler.h"
+#include "cpu_profiler.h"
+
+using namespace GL;
+
+gpu_profiler::~gpu_profiler()
+{
+	for (frame& Frame : Frames)
+	{
+		if (!Frame.Queries.empty())
+			glDeleteQueries((GLsizei)Frame.Queries.size(), Frame.Queries.data());
+	}
+}
+
+GLuint gpu_profiler::NewQuery(frame& Frame)
+{
+	if (Frame.UsedQueries == (int)Frame.Queries.size())
+	{
+		GLuint Query;
+		glGenQueries(1, &Query);
+		Frame.Queries.push_back(Query);
+	}
+
+	return Frame.Queries[Frame.UsedQueries++];
+}
+
+int gpu_profiler::GetPathId(const std::string& Path, const std::string& Name, int Depth)
+{
+	auto Found = PathIds.find(Path);
+	if (Found != PathIds.end())
+		return Found->second;
+
+	path_stats NewStats = {};
+	NewStats.Path = Path;
+	NewStats.Name = Name;
+	NewStats.Depth = Depth;
+	Stats.push_back(NewStats);
+
+	int PathId = (int)Stats.size() - 1;
+	PathIds[Path] = PathId;
+	return PathId;
+}
+
+void gpu_profiler::BeginFrame()
+{
+	// EndFrame() was missed
+	if (Recording)
+		EndFrame();
+
+	FrameIndex = (FrameIndex + 1) % FRAME_LATENCY;
+
+	// Read back the frame issued FRAME_LATENCY frames ago before reusing its queries
+	frame& Frame = Frames[FrameIndex];
+	if (Frame.Pending)
+		Resolve(Frame);
+
+	Frame.Scopes.clear();
+	Frame.UsedQueries = 0;
+	Frame.Pending = false;
+
+	Recording = Enabled;
+	if (Recording)
+		Push("Frame");
+}
+
+void gpu_profiler::EndFrame()
+{
+	if (!Recording)
+		return;
+
+	// Close scopes left open (the "Frame" scope included)
+	while (!ScopeStack.empty())
+		Pop();
+
+	Frames[FrameIndex].Pending = true;
+	Recording = false;
+}
+
+void gpu_profiler::Push(const char* Name)
+{
+	if (GLAD_GL_KHR_debug)
+		glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, Name);
+
+	if (!Recording)
+	{
+		ScopeStack.push_back(-1);
+		return;
+	}
+
+	frame& Frame = Frames[FrameIndex];
+
+	scope Scope = {};
+	Scope.Name = Name;
+	Scope.Depth = (int)PathStack.size();
+	PathStack.push_back(PathStack.empty() ? Scope.Name : PathStack.back() + "/" + Scope.Name);
+	Scope.PathId = GetPathId(PathStack.back(), Scope.Name, Scope.Depth);
+	Scope.BeginQuery = NewQuery(Frame);
+	glQueryCounter(Scope.BeginQuery, GL_TIMESTAMP);
+
+	Frame.Scopes.push_back(Scope);
+	ScopeStack.push_back((int)Frame.Scopes.size() - 1);
+}
+
+void gpu_profiler::Pop()
+{
+	if (ScopeStack.empty())
+	{
+		fprintf(stderr, "gpu_profiler: Pop() without Push()\n");
+		return;
+	}
+
+	int ScopeIndex = ScopeStack.back();
+	ScopeStack.pop_back();
+
+	if (ScopeIndex >= 0)
+	{
+		scope& Scope = Frames[FrameIndex].Scopes[ScopeIndex];
+		Scope.EndQuery = NewQuery(Frames[FrameIndex]);
+		glQueryCounter(Scope.EndQuery, GL_TIMESTAMP);
+		PathStack.pop_back();
+	}
+
+	if (GLAD_GL_KHR_debug)
+		glPopDebugGroup();
+}
+
+void gpu_profiler::Resolve(frame& Frame)
+{
+	PROFILE_FUNCTION();
+
+	if (Frame.Scopes.empty())
+		return;
+
+	// Timestamps complete in order: the "Frame" end query is the last one issued
+	GLint Available = 0;
+	glGetQueryObjectiv(Frame.Scopes[0].EndQuery, GL_QUERY_RESULT_AVAILABLE, &Available);
+	if (!Available)
+	{
+		// GPU is more than FRAME_LATENCY frames behind, drop the frame instead of waiting
+		DroppedFrameCount++;
+		return;
+	}
+
+	GLuint64 FrameBegin = 0;
+	glGetQueryObjectui64v(Frame.Scopes[0].BeginQuery, GL_QUERY_RESULT, &FrameBegin);
+
+	Timeline.clear();
+	LastFramePaths.clear();
+	for (path_stats& PathStats : Stats)
+	{
+		PathStats.CallCount = 0;
+		PathStats.LastMs = 0.0;
+	}
+
+	for (const scope& Scope : Frame.Scopes)
+	{
+		GLuint64 Begin = 0;
+		GLuint64 End = 0;
+		glGetQueryObjectui64v(Scope.BeginQuery, GL_QUERY_RESULT, &Begin);
+		glGetQueryObjectui64v(Scope.EndQuery, GL_QUERY_RESULT, &End);
+
+		timeline_scope TimelineScope = {};
+		TimelineScope.Name = Scope.Name;
+		TimelineScope.Depth = Scope.Depth;
+		TimelineScope.StartMs = (double)(Begin - FrameBegin) / 1000000.0;
+		TimelineScope.DurationMs = (double)(End - Begin) / 1000000.0;
+		Timeline.push_back(TimelineScope);
+
+		// Scopes with the same path in a frame are summed
+		path_stats& PathStats = Stats[Scope.PathId];
+		if (PathStats.CallCount == 0)
+			LastFramePaths.push_back(Scope.PathId);
+		PathStats.CallCount++;
+		PathStats.LastMs += TimelineScope.DurationMs;
+	}
+
+	for (int PathId : LastFramePaths)
+	{
+		path_stats& PathStats = Stats[PathId];
+		if ((int)PathStats.History.size() < HISTORY_SIZE)
+			PathStats.History.push_back((float)PathStats.LastMs);
+		else
+			PathStats.History[PathStats.HistoryIndex] = (float)PathStats.LastMs;
+		PathStats.HistoryIndex = (PathStats.HistoryIndex + 1) % HISTORY_SIZE;
+	}
+
+	LastFrameMs = Timeline[0].DurationMs;
+	ResolvedFrameCount++;
+}
+
+void gpu_profiler::GetLastFrameTimings(std::vector<scope_timing>* Timings) const
+{
+	Timings->clear();
+	for (int PathId : LastFramePaths)
+		Timings->push_back({ Stats[PathId].Path, Stats[PathId].LastMs });
+}
+
+void gpu_profiler::DisplayTable()
+{
+	ImGui::Columns(5, "gpu_profiler_table");
+	ImGui::Text("Scope");   ImGui::NextColumn();
+	ImGui::Text("Last ms"); ImGui::NextColumn();
+	ImGui::Text("Min");     ImGui::NextColumn();
+	ImGui::Text("Avg");     ImGui::NextColumn();
+	ImGui::Text("Max");     ImGui::NextColumn();
+	ImGui::Separator();
+
+	auto DisplayRow = [&](const path_stats& PathStats, bool InLastFrame)
+	{
+		float Min = PathStats.History[0];
+		float Max = PathStats.History[0];
+		float Sum = 0.f;
+		for (float Sample : PathStats.History)
+		{
+			Min = std::min(Min, Sample);
+			Max = std::max(Max, Sample);
+			Sum += Sample;
+		}
+		float Avg = Sum / (float)PathStats.History.size();
+
+		if (!InLastFrame)
+			ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyle().Colors[ImGuiCol_TextDisabled]);
+
+		if (PathStats.CallCount > 1)
+			ImGui::Text("%*s%s (x%d)", PathStats.Depth * 2, "", PathStats.Name.c_str(), PathStats.CallCount);
+		else
+			ImGui::Text("%*s%s", PathStats.Depth * 2, "", PathStats.Name.c_str());
+		ImGui::NextColumn();
+		if (InLastFrame)
+			ImGui::Text("%.3f", PathStats.LastMs);
+		else
+			ImGui::Text("-");
+		ImGui::NextColumn();
+		ImGui::Text("%.3f", Min); ImGui::NextColumn();
+		ImGui::Text("%.3f", Avg); ImGui::NextColumn();
+		ImGui::Text("%.3f", Max); ImGui::NextColumn();
+
+		if (!InLastFrame)
+			ImGui::PopStyleColor();
+	};
+
+	for (int PathId : LastFramePaths)
+		DisplayRow(Stats[PathId], true);
+
+	// Scopes that did not run last frame (one shot precomputations, other demos...)
+	for (int PathId = 0; PathId < (int)Stats.size(); ++PathId)
+	{
+		if (Stats[PathId].History.empty() || std::find(LastFramePaths.begin(), LastFramePaths.end(), PathId) != LastFramePaths.end())
+			continue;
+		DisplayRow(Stats[PathId], false);
+	}
+
+	ImGui::Columns(1);
+}
+
+void gpu_profiler::DisplayTimeline()
+{
+	if (Timeline.empty() || LastFrameMs <= 0.0)
+		return;
+
+	int MaxDepth = 0;
+	for (const timeline_scope& Scope : Timeline)
+		MaxDepth = std::max(MaxDepth, Scope.Depth);
+
+	ImDrawList* DrawList = ImGui::GetWindowDrawList();
+	ImVec2 Origin = ImGui::GetCursorScreenPos();
+	float Width = std::max(ImGui::GetContentRegionAvail().x, 100.f);
+	float RowHeight = ImGui::GetTextLineHeightWithSpacing();
+	ImGui::InvisibleButton("gpu_profiler_timeline", ImVec2(Width, RowHeight * (MaxDepth + 1)));
+
+	for (const timeline_scope& Scope : Timeline)
+	{
+		ImVec2 Min = { Origin.x + (float)(Scope.StartMs / LastFrameMs) * Width, Origin.y + Scope.Depth * RowHeight };
+		ImVec2 Max = { Min.x + std::max((float)(Scope.DurationMs / LastFrameMs) * Width, 1.f), Min.y + RowHeight - 1.f };
+
+		// Stable color per scope name
+		float Hue = (float)(std::hash<std::string>()(Scope.Name) % 360) / 360.f;
+		DrawList->AddRectFilled(Min, Max, ImColor::HSV(Hue, 0.5f, 0.6f));
+
+		DrawList->PushClipRect(Min, Max, true);
+		DrawList->AddText({ Min.x + 2.f, Min.y }, IM_COL32_WHITE, Scope.Name.c_str());
+		DrawList->PopClipRect();
+
+		if (ImGui::IsMouseHoveringRect(Min, Max))
+			ImGui::SetTooltip("%s: %.3f ms (at %.3f ms)", Scope.Name.c_str(), Scope.DurationMs, Scope.StartMs);
+	}
+}
+
+void gpu_profiler::DisplayDebugUI()
+{
+	ImGui::Checkbox("Enabled", &Enabled);
+	ImGui::SameLine();
+	ImGui::Text("GPU frame: %.3f ms (%d frames latency, %d dropped)", LastFrameMs, FRAME_LATENCY, DroppedFrameCount);
+
+	if (ImGui::TreeNodeEx("Timeline", ImGuiTreeNodeFlags_DefaultOpen))
+	{
+		DisplayTimeline();
+		ImGui::TreePop();
+	}
+
+	if (ImGui::TreeNodeEx("Scopes", ImGuiTreeNodeFlags_DefaultOpen))
+	{
+		ImGui::Text("min/avg/max over the last %d frames", HISTORY_SIZE);
+		DisplayTable();
+		ImGui::TreePop();
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "opengl_headers.h"
+
+namespace GL
+{
+	// GPU timings of nested scopes measured with timestamp queries
+	// Queries of a frame are read back FRAME_LATENCY frames later, only if they are available, so the CPU never waits for the GPU
+	// Each scope is also pushed as a KHR_debug group so captures (RenderDoc, Nsight...) show the same hierarchy
+	class gpu_profiler
+	{
+	public:
+		static const int FRAME_LATENCY = 3;
+		static const int HISTORY_SIZE = 120; // Frames used for min/avg/max
+
+		gpu_profiler() = default;
+		~gpu_profiler();
+		gpu_profiler(const gpu_profiler&) = delete;
+		gpu_profiler& operator=(const gpu_profiler&) = delete;
+
+		// Frame scope, call once per frame around all the GL work
+		void BeginFrame();
+		void EndFrame();
+
+		// Scopes outside BeginFrame()/EndFrame() only push debug groups
+		void Push(const char* Name);
+		void Pop();
+
+		// Hierarchical table (last/min/avg/max) and timeline of the last resolved frame
+		void DisplayDebugUI();
+
+		struct scope_timing
+		{
+			std::string Path; // "Frame/Demo/Bloom blur"
+			double Ms;        // Scopes with the same path are summed
+		};
+
+		// Timings of the last resolved frame, in execution order
+		void GetLastFrameTimings(std::vector<scope_timing>* Timings) const;
+		// Incremented by each resolved frame (a frame is resolved FRAME_LATENCY frames after its EndFrame())
+		int GetResolvedFrameCount() const { return ResolvedFrameCount; }
+
+		// Applied on the next BeginFrame()
+		bool Enabled = true;
+
+	private:
+		struct scope
+		{
+			std::string Name;
+			int Depth;
+			int PathId;
+			GLuint BeginQuery;
+			GLuint EndQuery = 0;
+		};
+
+		struct frame
+		{
+			std::vector<scope> Scopes;
+			std::vector<GLuint> Queries; // Pool, grows with the scope count
+			int UsedQueries = 0;
+			bool Pending = false; // Queries issued and not read back yet
+		};
+
+		struct timeline_scope
+		{
+			std::string Name;
+			int Depth;
+			double StartMs;
+			double DurationMs;
+		};
+
+		struct path_stats
+		{
+			std::string Path;
+			std::string Name;
+			int Depth;
+			int CallCount; // Last frame (bloom blur passes are summed)
+			double LastMs;
+			std::vector<float> History;
+			int HistoryIndex = 0;
+		};
+
+		GLuint NewQuery(frame& Frame);
+		int GetPathId(const std::string& Path, const std::string& Name, int Depth);
+		void Resolve(frame& Frame);
+		void DisplayTable();
+		void DisplayTimeline();
+
+		frame Frames[FRAME_LATENCY];
+		int FrameIndex = 0;
+		bool Recording = false;
+		std::vector<int> ScopeStack; // Open scopes (index in the recorded frame, -1 when not recorded)
+
+		// Stats indexed by path id, paths are "Frame/Demo/Bloom blur"...
+		std::unordered_map<std::string, int> PathIds;
+		std::vector<std::string> PathStack; // Paths of the open recorded scopes
+		std::vector<path_stats> Stats;
+		std::vector<int> LastFramePaths; // Display order (execution order of the last resolved frame)
+
+		std::vector<timeline_scope> Timeline;
+		double LastFrameMs = 0.0;
+		int DroppedFrameCount = 0;
+		int ResolvedFrameCount = 0;
+	};
+
+	// RAII helper for gpu_profiler::Push()/Pop()
+	class gpu_scope
+	{
+	public:
+		gpu_scope(gpu_profiler& Profiler, const char* Name) : Profiler(Profiler) { Profiler.Push(Name); }
+		~gpu_scope() { Profiler.Pop(); }
+		gpu_scope(const gpu_scope&) = delete;
+		gpu_scope& operator=(const gpu_scope&) = delete;
+
+	private:
+		gpu_profiler& Profiler;
+	};
+}
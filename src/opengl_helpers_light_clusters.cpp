@@ -0,0 +1,421 @@
+
+#include <cmath>
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+
+#include <imgui.h>
+
+#include "maths.h"
+#include "cpu_profiler.h"
+#include "jobs.h"
+
+#include "opengl_helpers_memory.h"
+#include "opengl_helpers_light_clusters.h"
+
+using namespace GL;
+
+static const char* gClusteredLightsStr = R"GLSL(
+// =================================
+// CLUSTERED LIGHTS START ===========
+
+uniform samplerBuffer uClusterLights;    // 4 texels per light: position, ambient + constant, diffuse + linear, specular + quadratic
+uniform usamplerBuffer uClusterRanges;   // Per cluster: first index, light count
+uniform usamplerBuffer uClusterIndices;  // Light indices of every cluster
+uniform int uClusterGlobalLightCount;    // First lights, shaded on every pixel
+uniform ivec3 uClusterGrid;              // Tiles x, tiles y, depth slices
+uniform vec2 uClusterTileSize;           // Pixels
+uniform vec2 uClusterDepthScaleBias;     // slice = log(viewDepth) * scale + bias
+
+light clustered_light(int index)
+{
+    vec4 position = texelFetch(uClusterLights, index * 4);
+    vec4 ambient  = texelFetch(uClusterLights, index * 4 + 1);
+    vec4 diffuse  = texelFetch(uClusterLights, index * 4 + 2);
+    vec4 specular = texelFetch(uClusterLights, index * 4 + 3);
+    return light(true, position, ambient.rgb, diffuse.rgb, specular.rgb, vec3(ambient.a, diffuse.a, specular.a));
+}
+
+void clustered_light_add(inout light_shade_result result, int index, float shininess, vec3 eyePosition, vec3 position, vec3 normal)
+{
+    light_shade_result r = light_shade(clustered_light(index), shininess, eyePosition, position, normal);
+    result.ambient  += r.ambient;
+    result.diffuse  += r.diffuse;
+    result.specular += r.specular;
+}
+
+light_shade_result clustered_lights_shade(float shininess, vec3 eyePosition, vec3 position, vec3 normal, vec2 fragCoord, float viewDepth)
+{
+    light_shade_result result = light_shade_result(vec3(0.0), vec3(0.0), vec3(0.0));
+    for (int i = 0; i < uClusterGlobalLightCount; ++i)
+        clustered_light_add(result, i, shininess, eyePosition, position, normal);
+
+    ivec2 tile = min(ivec2(fragCoord / uClusterTileSize), uClusterGrid.xy - 1);
+    int slice = clamp(int(log(viewDepth) * uClusterDepthScaleBias.x + uClusterDepthScaleBias.y), 0, uClusterGrid.z - 1);
+    uvec2 range = texelFetch(uClusterRanges, (slice * uClusterGrid.y + tile.y) * uClusterGrid.x + tile.x).xy;
+    for (uint i = 0u; i < range.y; ++i)
+        clustered_light_add(result, int(texelFetch(uClusterIndices, int(range.x + i)).r), shininess, eyePosition, position, normal);
+
+    return result;
+}
+// CLUSTERED LIGHTS STOP ============
+// =================================
+)GLSL";
+
+light_clusters::light_clusters()
+{
+	glGenBuffers(1, &LightsBuffer);
+	glGenBuffers(1, &RangesBuffer);
+	glGenBuffers(1, &IndicesBuffer);
+
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &MaxIndexCount);
+
+	ClusterLights.resize(CLUSTER_COUNT);
+	ClusterRanges.resize(CLUSTER_COUNT * 2);
+
+	// Buffer objects exist once bound: valid (empty) buffers before the textures and the first build
+	Upload();
+
+	glGenTextures(1, &LightsTexture);
+	glBindTexture(GL_TEXTURE_BUFFER, LightsTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, LightsBuffer);
+	glGenTextures(1, &RangesTexture);
+	glBindTexture(GL_TEXTURE_BUFFER, RangesTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, RangesBuffer);
+	glGenTextures(1, &IndicesTexture);
+	glBindTexture(GL_TEXTURE_BUFFER, IndicesTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R16UI, IndicesBuffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+light_clusters::~light_clusters()
+{
+	GLuint Textures[] = { LightsTexture, RangesTexture, IndicesTexture };
+	glDeleteTextures(3, Textures);
+	GLuint Buffers[] = { LightsBuffer, RangesBuffer, IndicesBuffer };
+	glDeleteBuffers(3, Buffers);
+	GL::TrackCPUMemory(this, "GL::light_clusters", 0);
+}
+
+const char* light_clusters::GetShaderStr()
+{
+	return gClusteredLightsStr;
+}
+
+// Attenuation of light_shade(): 1 / (c + l * d + q * q * d), cut under 0.001
+float GL::GetLightRadius(const light& Light)
+{
+	if (Light.Position.w <= 0.f)
+		return INFINITY;
+
+	float Slope = Light.Attenuation.e[1] + Light.Attenuation.e[2] * Light.Attenuation.e[2];
+	if (Slope <= 0.f)
+		return Light.Attenuation.e[0] < 1000.f ? INFINITY : 0.f;
+	return std::max((1000.f - Light.Attenuation.e[0]) / Slope, 0.f);
+}
+
+void light_clusters::UpdateClusterBounds(float FovY, float AspectRatio, float Near, float Far, int ViewportWidth, int ViewportHeight)
+{
+	float Params[6] = { FovY, AspectRatio, Near, Far, (float)ViewportWidth, (float)ViewportHeight };
+	if (!ClusterBounds.empty() && std::equal(Params, Params + 6, BoundsParams))
+		return;
+	std::copy(Params, Params + 6, BoundsParams);
+
+	TileSize[0] = (float)((ViewportWidth + TILE_COUNT_X - 1) / TILE_COUNT_X);
+	TileSize[1] = (float)((ViewportHeight + TILE_COUNT_Y - 1) / TILE_COUNT_Y);
+
+	// slice = SLICE_COUNT * log(depth / Near) / log(Far / Near)
+	DepthScale = (float)SLICE_COUNT / logf(Far / Near);
+	DepthBias = -logf(Near) * DepthScale;
+
+	float TanY = tanf(FovY / 2.f);
+	float TanX = TanY * AspectRatio;
+
+	ClusterBounds.resize(CLUSTER_COUNT);
+	for (int Slice = 0; Slice < SLICE_COUNT; ++Slice)
+	{
+		float Depth0 = Near * powf(Far / Near, (float)Slice / SLICE_COUNT);
+		float Depth1 = Near * powf(Far / Near, (float)(Slice + 1) / SLICE_COUNT);
+		for (int TileY = 0; TileY < TILE_COUNT_Y; ++TileY)
+		{
+			float NdcY0 = std::min(TileY * TileSize[1] / ViewportHeight, 1.f) * 2.f - 1.f;
+			float NdcY1 = std::min((TileY + 1) * TileSize[1] / ViewportHeight, 1.f) * 2.f - 1.f;
+			for (int TileX = 0; TileX < TILE_COUNT_X; ++TileX)
+			{
+				float NdcX0 = std::min(TileX * TileSize[0] / ViewportWidth, 1.f) * 2.f - 1.f;
+				float NdcX1 = std::min((TileX + 1) * TileSize[0] / ViewportWidth, 1.f) * 2.f - 1.f;
+
+				// Tile sides are planes through the eye: extremes are at the slice near or far depth
+				aabb& Bounds = ClusterBounds[(Slice * TILE_COUNT_Y + TileY) * TILE_COUNT_X + TileX];
+				Bounds.Min.x = std::min(NdcX0 * Depth0, NdcX0 * Depth1) * TanX;
+				Bounds.Max.x = std::max(NdcX1 * Depth0, NdcX1 * Depth1) * TanX;
+				Bounds.Min.y = std::min(NdcY0 * Depth0, NdcY0 * Depth1) * TanY;
+				Bounds.Max.y = std::max(NdcY1 * Depth0, NdcY1 * Depth1) * TanY;
+				Bounds.Min.z = Depth0;
+				Bounds.Max.z = Depth1;
+			}
+		}
+	}
+}
+
+void light_clusters::Build(const light* Lights, int LightCount, const mat4& ViewMatrix, float FovY, float AspectRatio, float Near, float Far,
+	int ViewportWidth, int ViewportHeight, light_culling Culling)
+{
+	PROFILE_FUNCTION();
+
+	std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+	UpdateClusterBounds(FovY, AspectRatio, Near, Far, ViewportWidth, ViewportHeight);
+
+	float TanY = tanf(FovY / 2.f);
+	float TanX = TanY * AspectRatio;
+
+	this->Culling = Culling;
+	Stats = {};
+	LightTexels.clear();
+	LocalLights.clear();
+
+	auto AddTexels = [this](const light& Light)
+	{
+		LightTexels.push_back(Light.Position);
+		LightTexels.push_back({ Light.Ambient.x, Light.Ambient.y, Light.Ambient.z, Light.Attenuation.e[0] });
+		LightTexels.push_back({ Light.Diffuse.x, Light.Diffuse.y, Light.Diffuse.z, Light.Attenuation.e[1] });
+		LightTexels.push_back({ Light.Specular.x, Light.Specular.y, Light.Specular.z, Light.Attenuation.e[2] });
+	};
+
+	// Split global and local lights, global ones are stored first
+	{
+		PROFILE_SCOPE("Classify lights");
+
+		v3 FarCorner = { Far * TanX, Far * TanY, Far };
+		for (int i = 0; i < LightCount; ++i)
+		{
+			const light& Light = Lights[i];
+			if (!Light.Enabled)
+				continue;
+			Stats.LightCount++;
+
+			float Radius = GetLightRadius(Light);
+			if (Radius <= 0.f)
+				continue;
+
+			if (Culling == light_culling::NONE || Radius == INFINITY)
+			{
+				Stats.GlobalLightCount++;
+				AddTexels(Light);
+				continue;
+			}
+
+			v4 ViewPosition = ViewMatrix * v4{ Light.Position.x / Light.Position.w, Light.Position.y / Light.Position.w, Light.Position.z / Light.Position.w, 1.f };
+			v3 Center = { ViewPosition.x, ViewPosition.y, -ViewPosition.z };
+
+			// Outside the depth range
+			if (Center.z + Radius < Near || Center.z - Radius > Far)
+				continue;
+
+			// Contains the 4 far corners, hence the whole frustum
+			float FarDistance = 0.f;
+			for (float SignX : { -1.f, 1.f })
+				for (float SignY : { -1.f, 1.f })
+					FarDistance = std::max(FarDistance, Vec3::Length(v3{ FarCorner.x * SignX, FarCorner.y * SignY, FarCorner.z } - Center));
+			if (FarDistance <= Radius && Vec3::Length(Center) <= Radius)
+			{
+				Stats.GlobalLightCount++;
+				AddTexels(Light);
+				continue;
+			}
+
+			// Tiles covered by the bounding box of the sphere: x / depth extremes are at the box corners
+			local_light Local = {};
+			Local.Index = i; // Light index until the global lights are counted
+			Local.Center = Center;
+			Local.Radius = Radius;
+			float MinDepth = std::max(Center.z - Radius, Near);
+			float MaxDepth = std::min(Center.z + Radius, Far);
+			float MinNdc[2] = { INFINITY, INFINITY };
+			float MaxNdc[2] = { -INFINITY, -INFINITY };
+			for (float Depth : { MinDepth, MaxDepth })
+			{
+				for (float Sign : { -1.f, 1.f })
+				{
+					float NdcX = (Center.x + Sign * Radius) / (Depth * TanX);
+					float NdcY = (Center.y + Sign * Radius) / (Depth * TanY);
+					MinNdc[0] = std::min(MinNdc[0], NdcX); MaxNdc[0] = std::max(MaxNdc[0], NdcX);
+					MinNdc[1] = std::min(MinNdc[1], NdcY); MaxNdc[1] = std::max(MaxNdc[1], NdcY);
+				}
+			}
+
+			const int TileCount[2] = { TILE_COUNT_X, TILE_COUNT_Y };
+			const int ViewportSize[2] = { ViewportWidth, ViewportHeight };
+			bool Outside = false;
+			for (int Axis = 0; Axis < 2; ++Axis)
+			{
+				float MinTile = floorf((MinNdc[Axis] * 0.5f + 0.5f) * ViewportSize[Axis] / TileSize[Axis]);
+				float MaxTile = floorf((MaxNdc[Axis] * 0.5f + 0.5f) * ViewportSize[Axis] / TileSize[Axis]);
+				Outside |= MaxTile < 0.f || MinTile >= (float)TileCount[Axis];
+				Local.MinTile[Axis] = (int)std::max(MinTile, 0.f);
+				Local.MaxTile[Axis] = (int)std::min(MaxTile, (float)TileCount[Axis] - 1.f);
+			}
+			if (Outside)
+				continue;
+
+			Local.MinSlice = std::min(std::max((int)(logf(MinDepth) * DepthScale + DepthBias), 0), SLICE_COUNT - 1);
+			Local.MaxSlice = std::min(std::max((int)(logf(MaxDepth) * DepthScale + DepthBias), 0), SLICE_COUNT - 1);
+			LocalLights.push_back(Local);
+		}
+
+		if (Stats.GlobalLightCount + (int)LocalLights.size() > MAX_LIGHT_COUNT)
+		{
+			fprintf(stderr, "light_clusters: more than %d lights, %d dropped\n", MAX_LIGHT_COUNT, Stats.GlobalLightCount + (int)LocalLights.size() - MAX_LIGHT_COUNT);
+			LocalLights.resize(std::max(MAX_LIGHT_COUNT - Stats.GlobalLightCount, 0));
+		}
+
+		for (int i = 0; i < (int)LocalLights.size(); ++i)
+		{
+			AddTexels(Lights[LocalLights[i].Index]);
+			LocalLights[i].Index = Stats.GlobalLightCount + i;
+		}
+		Stats.VisibleLightCount = (int)LocalLights.size();
+	}
+
+	// Each depth slice lists its clusters lights independently
+	if (Culling != light_culling::CLUSTERS)
+	{
+		for (std::vector<uint16_t>& List : ClusterLights)
+			List.clear();
+	}
+	else
+	{
+		PROFILE_SCOPE("Assign lights");
+
+		Jobs::ParallelFor(SLICE_COUNT, 1, [this](int Begin, int End)
+		{
+			for (int Slice = Begin; Slice < End; ++Slice)
+			{
+				int FirstCluster = Slice * TILE_COUNT_X * TILE_COUNT_Y;
+				for (int Cluster = FirstCluster; Cluster < FirstCluster + TILE_COUNT_X * TILE_COUNT_Y; ++Cluster)
+					ClusterLights[Cluster].clear();
+
+				for (const local_light& Light : LocalLights)
+				{
+					if (Slice < Light.MinSlice || Slice > Light.MaxSlice)
+						continue;
+
+					float RadiusSquared = Light.Radius * Light.Radius;
+					for (int TileY = Light.MinTile[1]; TileY <= Light.MaxTile[1]; ++TileY)
+					{
+						for (int TileX = Light.MinTile[0]; TileX <= Light.MaxTile[0]; ++TileX)
+						{
+							int Cluster = FirstCluster + TileY * TILE_COUNT_X + TileX;
+							const aabb& Bounds = ClusterBounds[Cluster];
+
+							// Sphere vs box: distance to the closest point of the box
+							float DX = Light.Center.x - std::min(std::max(Light.Center.x, Bounds.Min.x), Bounds.Max.x);
+							float DY = Light.Center.y - std::min(std::max(Light.Center.y, Bounds.Min.y), Bounds.Max.y);
+							float DZ = Light.Center.z - std::min(std::max(Light.Center.z, Bounds.Min.z), Bounds.Max.z);
+							if (DX * DX + DY * DY + DZ * DZ <= RadiusSquared)
+								ClusterLights[Cluster].push_back((uint16_t)Light.Index);
+						}
+					}
+				}
+			}
+		});
+	}
+
+	// Concatenate the cluster lists
+	{
+		PROFILE_SCOPE("Pack clusters");
+
+		int IndexCount = 0;
+		int NonEmptyClusterCount = 0;
+		for (int Cluster = 0; Cluster < CLUSTER_COUNT; ++Cluster)
+		{
+			int Count = (int)ClusterLights[Cluster].size();
+			Stats.MaxClusterLights = std::max(Stats.MaxClusterLights, Count);
+			NonEmptyClusterCount += Count > 0;
+
+			// Texture buffer size limit: clusters lose their last lights
+			int Kept = std::min(Count, std::max(MaxIndexCount - IndexCount, 0));
+			Stats.DroppedIndexCount += Count - Kept;
+
+			ClusterRanges[Cluster * 2 + 0] = (uint32_t)IndexCount;
+			ClusterRanges[Cluster * 2 + 1] = (uint32_t)Kept;
+			IndexCount += Kept;
+		}
+		Stats.IndexCount = IndexCount;
+		Stats.AvgClusterLights = NonEmptyClusterCount > 0 ? (float)IndexCount / NonEmptyClusterCount : 0.f;
+
+		Indices.resize(IndexCount);
+		Jobs::ParallelFor(CLUSTER_COUNT, 256, [this](int Begin, int End)
+		{
+			for (int Cluster = Begin; Cluster < End; ++Cluster)
+				std::copy_n(ClusterLights[Cluster].begin(), ClusterRanges[Cluster * 2 + 1], Indices.begin() + ClusterRanges[Cluster * 2 + 0]);
+		});
+	}
+
+	size_t CPUBytes = LightTexels.capacity() * sizeof(v4) + LocalLights.capacity() * sizeof(local_light) + Indices.capacity() * sizeof(uint16_t);
+	for (const std::vector<uint16_t>& List : ClusterLights)
+		CPUBytes += List.capacity() * sizeof(uint16_t);
+	GL::TrackCPUMemory(this, "GL::light_clusters", CPUBytes);
+
+	Upload();
+
+	Stats.BuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count();
+}
+
+void light_clusters::Upload()
+{
+	PROFILE_FUNCTION();
+
+	memory_owner_scope MemoryOwner("GL::light_clusters");
+
+	// Texture buffers are never empty
+	v4 NoLight[4] = {};
+	uint16_t NoIndex = 0;
+
+	// Orphaned every frame
+	glBindBuffer(GL_TEXTURE_BUFFER, LightsBuffer);
+	if (LightTexels.empty())
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(NoLight), NoLight, GL_STREAM_DRAW);
+	else
+		glBufferData(GL_TEXTURE_BUFFER, LightTexels.size() * sizeof(v4), LightTexels.data(), GL_STREAM_DRAW);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, RangesBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, ClusterRanges.size() * sizeof(uint32_t), ClusterRanges.data(), GL_STREAM_DRAW);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, IndicesBuffer);
+	if (Indices.empty())
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(NoIndex), &NoIndex, GL_STREAM_DRAW);
+	else
+		glBufferData(GL_TEXTURE_BUFFER, Indices.size() * sizeof(uint16_t), Indices.data(), GL_STREAM_DRAW);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void light_clusters::Bind(GLuint Program, int FirstTextureUnit) const
+{
+	glActiveTexture(GL_TEXTURE0 + FirstTextureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, LightsTexture);
+	glActiveTexture(GL_TEXTURE0 + FirstTextureUnit + 1);
+	glBindTexture(GL_TEXTURE_BUFFER, RangesTexture);
+	glActiveTexture(GL_TEXTURE0 + FirstTextureUnit + 2);
+	glBindTexture(GL_TEXTURE_BUFFER, IndicesTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	glUniform1i(glGetUniformLocation(Program, "uClusterLights"), FirstTextureUnit);
+	glUniform1i(glGetUniformLocation(Program, "uClusterRanges"), FirstTextureUnit + 1);
+	glUniform1i(glGetUniformLocation(Program, "uClusterIndices"), FirstTextureUnit + 2);
+	glUniform1i(glGetUniformLocation(Program, "uClusterGlobalLightCount"), Stats.GlobalLightCount);
+	glUniform3i(glGetUniformLocation(Program, "uClusterGrid"), TILE_COUNT_X, TILE_COUNT_Y, SLICE_COUNT);
+	glUniform2f(glGetUniformLocation(Program, "uClusterTileSize"), TileSize[0], TileSize[1]);
+	glUniform2f(glGetUniformLocation(Program, "uClusterDepthScaleBias"), DepthScale, DepthBias);
+}
+
+void light_clusters::DisplayStats() const
+{
+	ImGui::Text("Grid: %dx%dx%d clusters", TILE_COUNT_X, TILE_COUNT_Y, SLICE_COUNT);
+	ImGui::Text("Lights: %d (%d global, %d local in view)", Stats.LightCount, Stats.GlobalLightCount, Stats.VisibleLightCount);
+	ImGui::Text("Lights per cluster: %.1f avg (non empty), %d max", Stats.AvgClusterLights, Stats.MaxClusterLights);
+	ImGui::Text("Indices: %d (%d dropped)", Stats.IndexCount, Stats.DroppedIndexCount);
+	ImGui::Text("Build: %.3f ms (%d threads)", Stats.BuildMs, Jobs::GetThreadCount());
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "types.h"
+
+#include "opengl_headers.h"
+#include "opengl_helpers.h"
+
+namespace GL
+{
+	enum class light_culling
+	{
+		NONE,     // Every light is global (reference)
+		CLUSTERS, // Local lights listed per cluster
+		VOLUMES,  // Local lights only classified, drawn as light volumes by the caller (clusters are empty)
+	};
+
+	// Light radius where the attenuation of light_shade() falls under its cutoff, INFINITY for directional lights
+	float GetLightRadius(const light& Light);
+
+	// Clustered light culling: the view frustum is split in TILE_COUNT_X * TILE_COUNT_Y screen tiles and SLICE_COUNT
+	// exponential depth slices, the CPU lists the point lights touching each cluster and the shader only loops over the list of its cluster
+	// Light radius is where light_shade() attenuation falls under its 0.001 cutoff, so the shading matches the loop over every light
+	// Directional lights and lights covering the whole frustum are global: shaded on every pixel without cluster
+	class light_clusters
+	{
+	public:
+		static const int TILE_COUNT_X = 16;
+		static const int TILE_COUNT_Y = 9;
+		static const int SLICE_COUNT = 24;
+		static const int CLUSTER_COUNT = TILE_COUNT_X * TILE_COUNT_Y * SLICE_COUNT;
+		// Light indices are 16 bits
+		static const int MAX_LIGHT_COUNT = 65536;
+
+		struct local_light
+		{
+			int Index;  // In the lights texture buffer
+			v3 Center;  // View space, z = depth (positive)
+			float Radius;
+			int MinTile[2];
+			int MaxTile[2];
+			int MinSlice;
+			int MaxSlice;
+		};
+
+		struct stats
+		{
+			int LightCount;        // Enabled
+			int GlobalLightCount;
+			int VisibleLightCount; // Local lights touching at least one cluster
+			int IndexCount;
+			int MaxClusterLights;
+			float AvgClusterLights; // Over non empty clusters
+			int DroppedIndexCount;  // Over the texture buffer size limit
+			double BuildMs;
+		};
+
+		light_clusters();
+		~light_clusters();
+		light_clusters(const light_clusters&) = delete;
+		light_clusters& operator=(const light_clusters&) = delete;
+
+		// Lights in world space, projection from Mat4::Perspective()
+		void Build(const light* Lights, int LightCount, const mat4& ViewMatrix, float FovY, float AspectRatio, float Near, float Far,
+			int ViewportWidth, int ViewportHeight, light_culling Culling = light_culling::CLUSTERS);
+
+		// Bind the cluster data to Program (current program) on 3 texture units from FirstTextureUnit
+		void Bind(GLuint Program, int FirstTextureUnit) const;
+
+		// Fragment shader code to insert after the injected light shading code, gives:
+		// light_shade_result clustered_lights_shade(float shininess, vec3 eyePosition, vec3 position, vec3 normal, vec2 fragCoord, float viewDepth);
+		// viewDepth: positive distance along the view axis (1.0 / gl_FragCoord.w when rasterizing the scene)
+		static const char* GetShaderStr();
+
+		GLuint GetLightsBuffer() const { return LightsBuffer; }
+		// Lights of the texture buffer after the global ones, in the view and under MAX_LIGHT_COUNT
+		const std::vector<local_light>& GetLocalLights() const { return LocalLights; }
+		const stats& GetStats() const { return Stats; }
+		light_culling GetCulling() const { return Culling; }
+		void DisplayStats() const;
+
+	private:
+		struct aabb
+		{
+			v3 Min;
+			v3 Max;
+		};
+
+		void UpdateClusterBounds(float FovY, float AspectRatio, float Near, float Far, int ViewportWidth, int ViewportHeight);
+		void Upload();
+
+		// Cluster bounds (view space, z = depth) valid for these parameters
+		float BoundsParams[6] = {};
+		std::vector<aabb> ClusterBounds;
+
+		std::vector<v4> LightTexels; // 4 per light, global lights first
+		std::vector<local_light> LocalLights;
+		std::vector<std::vector<uint16_t>> ClusterLights;
+		std::vector<uint32_t> ClusterRanges; // First index, count
+		std::vector<uint16_t> Indices;
+
+		float TileSize[2] = { 1.f, 1.f };
+		float DepthScale = 0.f;
+		float DepthBias = 0.f;
+		int MaxIndexCount = 0;
+		stats Stats = {};
+		light_culling Culling = light_culling::CLUSTERS;
+
+		GLuint LightsBuffer = 0;
+		GLuint RangesBuffer = 0;
+		GLuint IndicesBuffer = 0;
+		GLuint LightsTexture = 0;
+		GLuint RangesTexture = 0;
+		GLuint IndicesTexture = 0;
+	};
+}
@@ -0,0 +1,446 @@
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+
+#include <imgui.h>
+
+#include "opengl_helpers_memory.h"
+
+using namespace GL;
+
+namespace
+{
+	struct allocation
+	{
+		memory_category Category;
+		std::string Owner;
+		std::string Name;
+		int64_t Bytes = 0;
+
+		// Textures: size per (face, level), glGenerateMipmap estimate
+		std::map<int, int64_t> ImageBytes;
+		int64_t MipmapBytes = 0;
+	};
+
+	memory_totals Totals = {};
+	std::vector<const char*> OwnerStack;
+
+	// GL objects keyed on (category, name), CPU allocations on their key
+	std::unordered_map<uint64_t, allocation> GLAllocations;
+	std::unordered_map<const void*, allocation> CPUAllocations;
+
+	bool HooksInstalled = false;
+
+	const char* GetCategoryName(memory_category Category)
+	{
+		switch (Category)
+		{
+		case memory_category::TEXTURE:      return "texture";
+		case memory_category::RENDERBUFFER: return "renderbuffer";
+		case memory_category::BUFFER:       return "buffer";
+		case memory_category::CPU:          return "cpu";
+		default:                            return "unknown";
+		}
+	}
+
+	const char* GetCurrentOwner()
+	{
+		return OwnerStack.empty() ? "app" : OwnerStack.back();
+	}
+
+	void SetAllocationBytes(allocation& Allocation, int64_t Bytes)
+	{
+		int Category = (int)Allocation.Category;
+		Totals.LiveBytes[Category] += Bytes - Allocation.Bytes;
+		Totals.LiveTotal += Bytes - Allocation.Bytes;
+		Allocation.Bytes = Bytes;
+
+		Totals.HighWaterBytes[Category] = std::max(Totals.HighWaterBytes[Category], Totals.LiveBytes[Category]);
+		Totals.HighWaterTotal = std::max(Totals.HighWaterTotal, Totals.LiveTotal);
+	}
+
+	allocation& GetGLAllocation(memory_category Category, GLuint Name)
+	{
+		uint64_t Key = ((uint64_t)Category << 32) | Name;
+		auto Found = GLAllocations.find(Key);
+		if (Found != GLAllocations.end())
+			return Found->second;
+
+		// Owned by the scope of the first allocation
+		allocation& Allocation = GLAllocations[Key];
+		Allocation.Category = Category;
+		Allocation.Owner = GetCurrentOwner();
+		Allocation.Name = std::to_string(Name);
+		return Allocation;
+	}
+
+	void DeleteGLAllocations(memory_category Category, GLsizei Count, const GLuint* Names)
+	{
+		for (int i = 0; i < Count; ++i)
+		{
+			auto Found = GLAllocations.find(((uint64_t)Category << 32) | Names[i]);
+			if (Found == GLAllocations.end())
+				continue;
+			SetAllocationBytes(Found->second, 0);
+			GLAllocations.erase(Found);
+		}
+	}
+
+	// Estimated size of a texel in GPU memory
+	int64_t GetInternalFormatSize(GLint InternalFormat)
+	{
+		switch (InternalFormat)
+		{
+		case GL_RED:
+		case GL_R8:
+		case GL_R8_SNORM:
+		case GL_R8I:
+		case GL_R8UI:
+			return 1;
+		case GL_RG:
+		case GL_RG8:
+		case GL_RG8_SNORM:
+		case GL_R16:
+		case GL_R16F:
+		case GL_R16I:
+		case GL_R16UI:
+		case GL_DEPTH_COMPONENT16:
+			return 2;
+		case GL_RGB16F:
+		case GL_RGB16:
+		case GL_RGBA16:
+		case GL_RGBA16F:
+		case GL_RGBA16I:
+		case GL_RGBA16UI:
+		case GL_RG32F:
+		case GL_RG32I:
+		case GL_RG32UI:
+		case GL_DEPTH32F_STENCIL8:
+			return 8;
+		case GL_RGB32F:
+		case GL_RGB32I:
+		case GL_RGB32UI:
+			return 12;
+		case GL_RGBA32F:
+		case GL_RGBA32I:
+		case GL_RGBA32UI:
+			return 16;
+		default:
+			// 8 bit RGB(A) (RGB is padded), 32 bit formats, depth 24/32
+			return 4;
+		}
+	}
+
+	GLenum GetTextureBinding(GLenum Target)
+	{
+		if (Target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && Target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z)
+			return GL_TEXTURE_BINDING_CUBE_MAP;
+
+		switch (Target)
+		{
+		case GL_TEXTURE_1D:             return GL_TEXTURE_BINDING_1D;
+		case GL_TEXTURE_2D:             return GL_TEXTURE_BINDING_2D;
+		case GL_TEXTURE_3D:             return GL_TEXTURE_BINDING_3D;
+		case GL_TEXTURE_1D_ARRAY:       return GL_TEXTURE_BINDING_1D_ARRAY;
+		case GL_TEXTURE_2D_ARRAY:       return GL_TEXTURE_BINDING_2D_ARRAY;
+		case GL_TEXTURE_RECTANGLE:      return GL_TEXTURE_BINDING_RECTANGLE;
+		case GL_TEXTURE_CUBE_MAP:       return GL_TEXTURE_BINDING_CUBE_MAP;
+		case GL_TEXTURE_2D_MULTISAMPLE: return GL_TEXTURE_BINDING_2D_MULTISAMPLE;
+		default:                        return 0; // Proxy targets
+		}
+	}
+
+	GLenum GetBufferBinding(GLenum Target)
+	{
+		switch (Target)
+		{
+		case GL_ARRAY_BUFFER:              return GL_ARRAY_BUFFER_BINDING;
+		case GL_ELEMENT_ARRAY_BUFFER:      return GL_ELEMENT_ARRAY_BUFFER_BINDING;
+		case GL_UNIFORM_BUFFER:            return GL_UNIFORM_BUFFER_BINDING;
+		case GL_PIXEL_PACK_BUFFER:         return GL_PIXEL_PACK_BUFFER_BINDING;
+		case GL_PIXEL_UNPACK_BUFFER:       return GL_PIXEL_UNPACK_BUFFER_BINDING;
+		case GL_TRANSFORM_FEEDBACK_BUFFER: return GL_TRANSFORM_FEEDBACK_BUFFER_BINDING;
+		default:                           return Target; // Copy and texture buffers are queried with their target
+		}
+	}
+
+	// Texture bound to Target, 0 if the target is not tracked
+	GLuint GetBoundTexture(GLenum Target)
+	{
+		GLenum Binding = GetTextureBinding(Target);
+		if (Binding == 0)
+			return 0;
+		GLint Texture = 0;
+		glGetIntegerv(Binding, &Texture);
+		return (GLuint)Texture;
+	}
+
+	void SetTextureImageBytes(GLenum Target, GLint Level, int64_t Bytes)
+	{
+		GLuint Texture = GetBoundTexture(Target);
+		if (Texture == 0)
+			return;
+
+		int Face = (Target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && Target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z) ? Target - GL_TEXTURE_CUBE_MAP_POSITIVE_X : 0;
+
+		allocation& Allocation = GetGLAllocation(memory_category::TEXTURE, Texture);
+		Allocation.ImageBytes[Face * 32 + Level] = Bytes;
+
+		int64_t Total = Allocation.MipmapBytes;
+		for (const auto& Image : Allocation.ImageBytes)
+			Total += Image.second;
+		SetAllocationBytes(Allocation, Total);
+	}
+
+	void TrackRenderbuffer(GLenum InternalFormat, GLsizei Width, GLsizei Height, GLsizei Samples)
+	{
+		GLint Renderbuffer = 0;
+		glGetIntegerv(GL_RENDERBUFFER_BINDING, &Renderbuffer);
+		if (Renderbuffer == 0)
+			return;
+
+		allocation& Allocation = GetGLAllocation(memory_category::RENDERBUFFER, (GLuint)Renderbuffer);
+		SetAllocationBytes(Allocation, (int64_t)Width * Height * std::max(Samples, 1) * GetInternalFormatSize(InternalFormat));
+	}
+
+	void TrackBuffer(GLenum Target, GLsizeiptr Size)
+	{
+		GLint Buffer = 0;
+		glGetIntegerv(GetBufferBinding(Target), &Buffer);
+		if (Buffer == 0)
+			return;
+
+		SetAllocationBytes(GetGLAllocation(memory_category::BUFFER, (GLuint)Buffer), Size);
+	}
+
+	// The generated mip chain replaces the levels allocated explicitly and adds about a third of the base levels
+	void TrackMipmaps(GLenum Target)
+	{
+		GLuint Texture = GetBoundTexture(Target);
+		if (Texture == 0)
+			return;
+
+		allocation& Allocation = GetGLAllocation(memory_category::TEXTURE, Texture);
+		int64_t BaseBytes = 0;
+		for (auto It = Allocation.ImageBytes.begin(); It != Allocation.ImageBytes.end();)
+		{
+			if (It->first % 32 == 0)
+			{
+				BaseBytes += It->second;
+				++It;
+			}
+			else
+			{
+				It = Allocation.ImageBytes.erase(It);
+			}
+		}
+		Allocation.MipmapBytes = BaseBytes / 3;
+		SetAllocationBytes(Allocation, BaseBytes + Allocation.MipmapBytes);
+	}
+
+	// Original entry point and its tracking wrapper
+#define MEMORY_HOOK(Name, Params, Args, Track) \
+	decltype(glad_##Name) Original_##Name = nullptr; \
+	void APIENTRY Hook_##Name Params { Original_##Name Args; Track; }
+
+	MEMORY_HOOK(glTexImage2D, (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels),
+		(target, level, internalformat, width, height, border, format, type, pixels), SetTextureImageBytes(target, level, (int64_t)width * height * GetInternalFormatSize(internalformat)))
+	MEMORY_HOOK(glTexImage3D, (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void* pixels),
+		(target, level, internalformat, width, height, depth, border, format, type, pixels), SetTextureImageBytes(target, level, (int64_t)width * height * depth * GetInternalFormatSize(internalformat)))
+	MEMORY_HOOK(glTexImage2DMultisample, (GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height, GLboolean fixedsamplelocations),
+		(target, samples, internalformat, width, height, fixedsamplelocations), SetTextureImageBytes(target, 0, (int64_t)width * height * samples * GetInternalFormatSize(internalformat)))
+	MEMORY_HOOK(glDeleteTextures, (GLsizei n, const GLuint* textures), (n, textures), DeleteGLAllocations(memory_category::TEXTURE, n, textures))
+
+	MEMORY_HOOK(glRenderbufferStorage, (GLenum target, GLenum internalformat, GLsizei width, GLsizei height), (target, internalformat, width, height),
+		TrackRenderbuffer(internalformat, width, height, 1))
+	MEMORY_HOOK(glRenderbufferStorageMultisample, (GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height), (target, samples, internalformat, width, height),
+		TrackRenderbuffer(internalformat, width, height, samples))
+	MEMORY_HOOK(glDeleteRenderbuffers, (GLsizei n, const GLuint* renderbuffers), (n, renderbuffers), DeleteGLAllocations(memory_category::RENDERBUFFER, n, renderbuffers))
+
+	MEMORY_HOOK(glBufferData, (GLenum target, GLsizeiptr size, const void* data, GLenum usage), (target, size, data, usage), TrackBuffer(target, size))
+	MEMORY_HOOK(glDeleteBuffers, (GLsizei n, const GLuint* buffers), (n, buffers), DeleteGLAllocations(memory_category::BUFFER, n, buffers))
+
+	MEMORY_HOOK(glGenerateMipmap, (GLenum target), (target), TrackMipmaps(target))
+
+#undef MEMORY_HOOK
+}
+
+void GL::InstallMemoryHooks()
+{
+	if (HooksInstalled)
+		return;
+	HooksInstalled = true;
+
+#define INSTALL_HOOK(Name) \
+	if (glad_##Name) \
+	{ \
+		Original_##Name = glad_##Name; \
+		glad_##Name = Hook_##Name; \
+	}
+
+	INSTALL_HOOK(glTexImage2D);
+	INSTALL_HOOK(glTexImage3D);
+	INSTALL_HOOK(glTexImage2DMultisample);
+	INSTALL_HOOK(glDeleteTextures);
+	INSTALL_HOOK(glRenderbufferStorage);
+	INSTALL_HOOK(glRenderbufferStorageMultisample);
+	INSTALL_HOOK(glDeleteRenderbuffers);
+	INSTALL_HOOK(glBufferData);
+	INSTALL_HOOK(glDeleteBuffers);
+	INSTALL_HOOK(glGenerateMipmap);
+
+#undef INSTALL_HOOK
+}
+
+memory_owner_scope::memory_owner_scope(const char* Owner)
+{
+	OwnerStack.push_back(Owner);
+}
+
+memory_owner_scope::~memory_owner_scope()
+{
+	OwnerStack.pop_back();
+}
+
+void GL::TrackCPUMemory(const void* Key, const char* Name, size_t Bytes)
+{
+	auto Found = CPUAllocations.find(Key);
+	if (Bytes == 0)
+	{
+		if (Found != CPUAllocations.end())
+		{
+			SetAllocationBytes(Found->second, 0);
+			CPUAllocations.erase(Found);
+		}
+		return;
+	}
+
+	if (Found == CPUAllocations.end())
+	{
+		allocation& Allocation = CPUAllocations[Key];
+		Allocation.Category = memory_category::CPU;
+		Allocation.Owner = GetCurrentOwner();
+		Allocation.Name = Name;
+		SetAllocationBytes(Allocation, (int64_t)Bytes);
+	}
+	else
+	{
+		SetAllocationBytes(Found->second, (int64_t)Bytes);
+	}
+}
+
+const memory_totals& GL::GetMemoryTotals()
+{
+	return Totals;
+}
+
+void GL::ResetMemoryHighWater()
+{
+	for (int i = 0; i < (int)memory_category::COUNT; ++i)
+		Totals.HighWaterBytes[i] = Totals.LiveBytes[i];
+	Totals.HighWaterTotal = Totals.LiveTotal;
+}
+
+// Live bytes per owner and category
+static std::map<std::string, std::vector<int64_t>> GetOwnerTotals()
+{
+	std::map<std::string, std::vector<int64_t>> OwnerTotals;
+	auto Add = [&](const allocation& Allocation)
+	{
+		std::vector<int64_t>& Bytes = OwnerTotals[Allocation.Owner];
+		Bytes.resize((int)memory_category::COUNT);
+		Bytes[(int)Allocation.Category] += Allocation.Bytes;
+	};
+
+	for (const auto& KeyValue : GLAllocations)
+		Add(KeyValue.second);
+	for (const auto& KeyValue : CPUAllocations)
+		Add(KeyValue.second);
+	return OwnerTotals;
+}
+
+void GL::DisplayMemoryUI()
+{
+	const double MB = 1024.0 * 1024.0;
+
+	ImGui::Text("Total: %.2f MB (high-water %.2f MB)", Totals.LiveTotal / MB, Totals.HighWaterTotal / MB);
+	for (int i = 0; i < (int)memory_category::COUNT; ++i)
+		ImGui::BulletText("%s: %.2f MB (high-water %.2f MB)", GetCategoryName((memory_category)i), Totals.LiveBytes[i] / MB, Totals.HighWaterBytes[i] / MB);
+
+	ImGui::Columns((int)memory_category::COUNT + 1, "memory_owners");
+	ImGui::Text("Owner (MB)"); ImGui::NextColumn();
+	for (int i = 0; i < (int)memory_category::COUNT; ++i)
+	{
+		ImGui::Text("%s", GetCategoryName((memory_category)i));
+		ImGui::NextColumn();
+	}
+	ImGui::Separator();
+
+	for (const auto& KeyValue : GetOwnerTotals())
+	{
+		ImGui::Text("%s", KeyValue.first.c_str());
+		ImGui::NextColumn();
+		for (int64_t Bytes : KeyValue.second)
+		{
+			ImGui::Text("%.2f", Bytes / MB);
+			ImGui::NextColumn();
+		}
+	}
+	ImGui::Columns(1);
+
+	if (ImGui::Button("Write memory.json"))
+		WriteMemoryReport("memory.json");
+}
+
+bool GL::WriteMemoryReport(const char* Filename)
+{
+	FILE* File = fopen(Filename, "w");
+	if (File == nullptr)
+	{
+		fprintf(stderr, "Cannot write memory report '%s'\n", Filename);
+		return false;
+	}
+
+	fprintf(File, "{\n  \"live_bytes\": %lld,\n  \"high_water_bytes\": %lld,\n  \"categories\": {\n", (long long)Totals.LiveTotal, (long long)Totals.HighWaterTotal);
+	for (int i = 0; i < (int)memory_category::COUNT; ++i)
+	{
+		fprintf(File, "    \"%s\": { \"live_bytes\": %lld, \"high_water_bytes\": %lld }%s\n", GetCategoryName((memory_category)i),
+			(long long)Totals.LiveBytes[i], (long long)Totals.HighWaterBytes[i], i + 1 < (int)memory_category::COUNT ? "," : "");
+	}
+
+	fprintf(File, "  },\n  \"owners\": {\n");
+	std::map<std::string, std::vector<int64_t>> OwnerTotals = GetOwnerTotals();
+	int OwnerIndex = 0;
+	for (const auto& KeyValue : OwnerTotals)
+	{
+		fprintf(File, "    \"%s\": {", KeyValue.first.c_str());
+		for (int i = 0; i < (int)memory_category::COUNT; ++i)
+			fprintf(File, " \"%s\": %lld%s", GetCategoryName((memory_category)i), (long long)KeyValue.second[i], i + 1 < (int)memory_category::COUNT ? "," : "");
+		fprintf(File, " }%s\n", ++OwnerIndex < (int)OwnerTotals.size() ? "," : "");
+	}
+
+	// Largest allocations first
+	std::vector<const allocation*> Allocations;
+	for (const auto& KeyValue : GLAllocations)
+		Allocations.push_back(&KeyValue.second);
+	for (const auto& KeyValue : CPUAllocations)
+		Allocations.push_back(&KeyValue.second);
+	std::sort(Allocations.begin(), Allocations.end(), [](const allocation* A, const allocation* B) { return A->Bytes > B->Bytes; });
+
+	fprintf(File, "  },\n  \"allocations\": [\n");
+	for (size_t i = 0; i < Allocations.size(); ++i)
+	{
+		const allocation& Allocation = *Allocations[i];
+		fprintf(File, "    { \"category\": \"%s\", \"name\": \"%s\", \"owner\": \"%s\", \"bytes\": %lld }%s\n", GetCategoryName(Allocation.Category),
+			Allocation.Name.c_str(), Allocation.Owner.c_str(), (long long)Allocation.Bytes, i + 1 < Allocations.size() ? "," : "");
+	}
+	fprintf(File, "  ]\n}\n");
+	fclose(File);
+
+	printf("Memory report written to '%s'\n", Filename);
+	return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "opengl_headers.h"
+
+namespace GL
+{
+	enum class memory_category
+	{
+		TEXTURE,
+		RENDERBUFFER,
+		BUFFER,
+		CPU,
+		COUNT,
+	};
+
+	struct memory_totals
+	{
+		int64_t LiveBytes[(int)memory_category::COUNT];
+		int64_t HighWaterBytes[(int)memory_category::COUNT];
+		int64_t LiveTotal;
+		int64_t HighWaterTotal;
+	};
+
+	// Replace the glad entry points allocating or deleting textures, renderbuffers and buffers by wrappers
+	// that keep an estimated size per object (computed from the internal format, driver padding and compression are ignored)
+	// Call once after gladLoadGL(), main thread only like every GL call
+	void InstallMemoryHooks();
+
+	// GL allocations and CPU reports made inside the scope are attributed to Owner (innermost scope wins)
+	// Owner must outlive the scope (string literal or typeid name)
+	class memory_owner_scope
+	{
+	public:
+		memory_owner_scope(const char* Owner);
+		~memory_owner_scope();
+		memory_owner_scope(const memory_owner_scope&) = delete;
+		memory_owner_scope& operator=(const memory_owner_scope&) = delete;
+	};
+
+	// CPU allocations (large std::vector...) are reported by their owner after each resize, Bytes = 0 forgets Key
+	void TrackCPUMemory(const void* Key, const char* Name, size_t Bytes);
+
+	const memory_totals& GetMemoryTotals();
+	// High-water marks restart from the live bytes (per demo peaks)
+	void ResetMemoryHighWater();
+
+	// Totals, high-water marks and live bytes per owner
+	void DisplayMemoryUI();
+	// Same data plus every live allocation
+	bool WriteMemoryReport(const char* Filename);
+}
@@ -0,0 +1,279 @@
+#include <cmath>
+#include <algorithm>
+
+#include <imgui.h>
+
+#include "opengl_helpers.h"
+#include "cpu_profiler.h"
+#include "culling.h"
+
+#include "opengl_helpers_occlusion.h"
+
+using namespace GL;
+
+static const char* gProxyVertexShaderStr = R"GLSL(
+#version 330 core
+
+layout(location = 0) in vec3 aPosition; // Unit cube corners (-1..1)
+uniform mat4 uViewProjection;
+uniform vec3 uCenter;
+uniform vec3 uExtent;
+
+void main()
+{
+    gl_Position = uViewProjection * vec4(uCenter + aPosition * uExtent, 1.0);
+})GLSL";
+
+static const char* gProxyFragmentShaderStr = R"GLSL(
+#version 330 core
+
+out vec4 oColor;
+
+void main()
+{
+    oColor = vec4(1.0);
+})GLSL";
+
+// Boxes are enlarged so the faces of a proxy do not z-fight with the geometry it surrounds
+static const float PROXY_SCALE = 1.01f;
+static const float PROXY_MARGIN = 0.01f;
+
+occlusion_culler::occlusion_culler()
+{
+	ProxyProgram = GL::CreateProgram(gProxyVertexShaderStr, gProxyFragmentShaderStr);
+	ProxyViewProjectionLocation = glGetUniformLocation(ProxyProgram, "uViewProjection");
+	ProxyCenterLocation = glGetUniformLocation(ProxyProgram, "uCenter");
+	ProxyExtentLocation = glGetUniformLocation(ProxyProgram, "uExtent");
+
+	const float Corners[8][3] =
+	{
+		{ -1.f,-1.f,-1.f }, {  1.f,-1.f,-1.f }, { -1.f, 1.f,-1.f }, {  1.f, 1.f,-1.f },
+		{ -1.f,-1.f, 1.f }, {  1.f,-1.f, 1.f }, { -1.f, 1.f, 1.f }, {  1.f, 1.f, 1.f },
+	};
+	const uint8_t Indices[36] =
+	{
+		0, 2, 1, 1, 2, 3, // -Z
+		4, 5, 6, 5, 7, 6, // +Z
+		0, 4, 2, 2, 4, 6, // -X
+		1, 3, 5, 3, 7, 5, // +X
+		0, 1, 4, 1, 5, 4, // -Y
+		2, 6, 3, 3, 6, 7, // +Y
+	};
+
+	glGenVertexArrays(1, &ProxyVAO);
+	glBindVertexArray(ProxyVAO);
+	glGenBuffers(1, &ProxyVertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, ProxyVertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(Corners), Corners, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	glGenBuffers(1, &ProxyIndexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ProxyIndexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Indices), Indices, GL_STATIC_DRAW);
+	glBindVertexArray(0);
+}
+
+occlusion_culler::~occlusion_culler()
+{
+	for (const pending_query& Pending : PendingQueries)
+		FreeQueries.push_back(Pending.Query);
+	if (!FreeQueries.empty())
+		glDeleteQueries((GLsizei)FreeQueries.size(), FreeQueries.data());
+
+	glDeleteBuffers(1, &ProxyIndexBuffer);
+	glDeleteBuffers(1, &ProxyVertexBuffer);
+	glDeleteVertexArrays(1, &ProxyVAO);
+	glDeleteProgram(ProxyProgram);
+}
+
+void occlusion_culler::SetObjects(const Mesh::bounds* Bounds, int Count)
+{
+	Objects.resize(Count);
+	for (int i = 0; i < Count; ++i)
+	{
+		object& Object = Objects[i];
+		Object.Center = (Bounds[i].Min + Bounds[i].Max) * 0.5f;
+		Object.Extent = (Bounds[i].Max - Bounds[i].Min) * (0.5f * PROXY_SCALE) + v3{ PROXY_MARGIN, PROXY_MARGIN, PROXY_MARGIN };
+		// Unknown objects are visible: drawn and tested on the first frame
+		Object.Visible = true;
+		Object.NextTestFrame = 0;
+	}
+
+	// Results of the previous objects are dropped
+	for (const pending_query& Pending : PendingQueries)
+		FreeQueries.push_back(Pending.Query);
+	PendingQueries.clear();
+}
+
+GLuint occlusion_culler::NewQuery()
+{
+	if (FreeQueries.empty())
+	{
+		GLuint Query;
+		glGenQueries(1, &Query);
+		return Query;
+	}
+
+	GLuint Query = FreeQueries.back();
+	FreeQueries.pop_back();
+	return Query;
+}
+
+void occlusion_culler::ReadResults()
+{
+	// Queries complete in issue order, stop at the first one still in flight
+	while (!PendingQueries.empty())
+	{
+		const pending_query& Pending = PendingQueries.front();
+
+		GLint Available = 0;
+		glGetQueryObjectiv(Pending.Query, GL_QUERY_RESULT_AVAILABLE, &Available);
+		if (!Available)
+			break;
+
+		GLuint SamplesPassed = 0;
+		glGetQueryObjectuiv(Pending.Query, GL_QUERY_RESULT, &SamplesPassed);
+
+		object& Object = Objects[Pending.Object];
+		bool WasVisible = Object.Visible;
+		Object.Visible = SamplesPassed != 0;
+		// Newly visible objects keep being drawn without query for a while
+		if (Object.Visible && !WasVisible)
+			Object.NextTestFrame = Frame + VISIBLE_TEST_INTERVAL;
+
+		FreeQueries.push_back(Pending.Query);
+		PendingQueries.pop_front();
+	}
+}
+
+void occlusion_culler::RenderHiddenBatch(const int* Batch, int Count, const mat4& ViewProjection, const std::function<void(int)>& DrawObject)
+{
+	// Caller state
+	GLint Program = 0;
+	GLint VAO = 0;
+	GLboolean DepthMask = GL_TRUE;
+	GLboolean ColorMask[4] = { GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE };
+	glGetIntegerv(GL_CURRENT_PROGRAM, &Program);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &VAO);
+	glGetBooleanv(GL_DEPTH_WRITEMASK, &DepthMask);
+	glGetBooleanv(GL_COLOR_WRITEMASK, ColorMask);
+	GLboolean CullFace = glIsEnabled(GL_CULL_FACE);
+
+	// Query the proxies of the whole batch with a single state change
+	glUseProgram(ProxyProgram);
+	glUniformMatrix4fv(ProxyViewProjectionLocation, 1, GL_FALSE, ViewProjection.e);
+	glBindVertexArray(ProxyVAO);
+	glDepthMask(GL_FALSE);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDisable(GL_CULL_FACE);
+
+	BatchQueries.resize(Count);
+	for (int i = 0; i < Count; ++i)
+	{
+		const object& Object = Objects[Batch[i]];
+		glUniform3fv(ProxyCenterLocation, 1, Object.Center.e);
+		glUniform3fv(ProxyExtentLocation, 1, Object.Extent.e);
+
+		BatchQueries[i] = NewQuery();
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, BatchQueries[i]);
+		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, (void*)0);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+		PendingQueries.push_back({ BatchQueries[i], Batch[i] });
+	}
+	Stats.QueryCount += Count;
+
+	glUseProgram(Program);
+	glBindVertexArray(VAO);
+	glDepthMask(DepthMask);
+	glColorMask(ColorMask[0], ColorMask[1], ColorMask[2], ColorMask[3]);
+	if (CullFace)
+		glEnable(GL_CULL_FACE);
+
+	// The GPU waits for the proxy results (the CPU does not), the other proxies of the batch hide the latency
+	for (int i = 0; i < Count; ++i)
+	{
+		glBeginConditionalRender(BatchQueries[i], GL_QUERY_WAIT);
+		DrawObject(Batch[i]);
+		glEndConditionalRender();
+	}
+}
+
+void occlusion_culler::Render(const mat4& ViewProjection, const uint8_t* InFrustum, const std::function<void(int)>& DrawObject)
+{
+	PROFILE_FUNCTION();
+
+	++Frame;
+	Stats = {};
+	ReadResults();
+
+	// Distances along the near plane give the front to back order, boxes crossing it would be clipped by the rasterizer
+	Culling::frustum Frustum = Culling::ExtractFrustum(ViewProjection);
+	const int NEAR_PLANE = 4;
+	v3 NearNormal = { Frustum.X[NEAR_PLANE], Frustum.Y[NEAR_PLANE], Frustum.Z[NEAR_PLANE] };
+
+	VisibleOrder.clear();
+	HiddenOrder.clear();
+	Depths.resize(Objects.size());
+	for (int i = 0; i < (int)Objects.size(); ++i)
+	{
+		if (InFrustum && !InFrustum[i])
+			continue;
+
+		object& Object = Objects[i];
+		float Distance = Vec3::Dot(NearNormal, Object.Center) + Frustum.W[NEAR_PLANE];
+		float ProjectedRadius = std::fabs(NearNormal.x) * Object.Extent.x + std::fabs(NearNormal.y) * Object.Extent.y + std::fabs(NearNormal.z) * Object.Extent.z;
+		Depths[i] = Distance;
+
+		// The camera is (almost) inside: the proxy cannot be trusted
+		if (Distance - ProjectedRadius <= 0.f)
+		{
+			Object.Visible = true;
+			Object.NextTestFrame = Frame + VISIBLE_TEST_INTERVAL;
+		}
+
+		if (Object.Visible)
+			VisibleOrder.push_back(i);
+		else
+			HiddenOrder.push_back(i);
+	}
+
+	auto FrontToBack = [this](int A, int B) { return Depths[A] < Depths[B]; };
+	std::sort(VisibleOrder.begin(), VisibleOrder.end(), FrontToBack);
+	std::sort(HiddenOrder.begin(), HiddenOrder.end(), FrontToBack);
+
+	// Visible objects fill the depth buffer first, the query of a retested object wraps its own draw
+	for (int i : VisibleOrder)
+	{
+		object& Object = Objects[i];
+		if (Frame < Object.NextTestFrame)
+		{
+			DrawObject(i);
+			continue;
+		}
+
+		// Jittered interval so the retests of objects visible since the same frame are spread
+		Object.NextTestFrame = Frame + VISIBLE_TEST_INTERVAL + (int)(((uint32_t)i * 2654435761u) >> 29);
+
+		GLuint Query = NewQuery();
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, Query);
+		DrawObject(i);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+		PendingQueries.push_back({ Query, i });
+		Stats.QueryCount++;
+	}
+
+	// Hidden objects against the complete occluders
+	for (int First = 0; First < (int)HiddenOrder.size(); First += BATCH_SIZE)
+		RenderHiddenBatch(HiddenOrder.data() + First, std::min(BATCH_SIZE, (int)HiddenOrder.size() - First), ViewProjection, DrawObject);
+
+	Stats.TestedObjectCount = (int)(VisibleOrder.size() + HiddenOrder.size());
+	Stats.VisibleObjectCount = (int)VisibleOrder.size();
+	Stats.HiddenObjectCount = (int)HiddenOrder.size();
+	Stats.PendingQueryCount = (int)PendingQueries.size();
+}
+
+void occlusion_culler::DisplayStats() const
+{
+	ImGui::Text("Objects: %d in frustum, %d visible, %d hidden (conditional)", Stats.TestedObjectCount, Stats.VisibleObjectCount, Stats.HiddenObjectCount);
+	ImGui::Text("Queries: %d issued, %d pending", Stats.QueryCount, Stats.PendingQueryCount);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <functional>
+
+#include "types.h"
+#include "mesh.h"
+
+#include "opengl_headers.h"
+
+namespace GL
+{
+	// Occlusion culling with GL_ANY_SAMPLES_PASSED queries, after CHC++ (Mattausch et al. 2008) on a flat list of objects
+	// - Objects visible last frame are drawn front to back, a query wraps their draw every VISIBLE_TEST_INTERVAL frames (jittered)
+	// - Objects hidden last frame are tested in batches: the bounding box proxies of the batch are queried, then each object
+	//   is drawn under conditional rendering of its query, the GPU discards it when the proxy was hidden
+	// - Results are only read when GL_QUERY_RESULT_AVAILABLE, a frame or more later, to update the visibility of the next frames
+	// The image is never wrong: hidden objects are resolved on the GPU in the same frame, late results only cost efficiency
+	class occlusion_culler
+	{
+	public:
+		static const int BATCH_SIZE = 16;
+		static const int VISIBLE_TEST_INTERVAL = 8;
+
+		struct stats
+		{
+			int TestedObjectCount;   // In the frustum
+			int VisibleObjectCount;  // Drawn unconditionally
+			int HiddenObjectCount;   // Proxy + conditional draw
+			int QueryCount;          // Issued this frame
+			int PendingQueryCount;   // Waiting for their results
+		};
+
+		occlusion_culler();
+		~occlusion_culler();
+		occlusion_culler(const occlusion_culler&) = delete;
+		occlusion_culler& operator=(const occlusion_culler&) = delete;
+
+		// Bounds in the space of the ViewProjection given to Render(), resets the visibility history
+		void SetObjects(const Mesh::bounds* Bounds, int Count);
+
+		// Draw the objects with the depth test enabled, DrawObject(i) issues the draw calls of object i with the current GL state
+		// InFrustum: optional frustum culling result (Culling::CullBoxes()), objects with 0 are skipped
+		// The current program, VAO, depth and color masks are restored after the proxies
+		void Render(const mat4& ViewProjection, const uint8_t* InFrustum, const std::function<void(int)>& DrawObject);
+
+		const stats& GetStats() const { return Stats; }
+		void DisplayStats() const;
+
+	private:
+		struct object
+		{
+			v3 Center;
+			v3 Extent;
+			bool Visible;
+			int NextTestFrame;
+		};
+
+		struct pending_query
+		{
+			GLuint Query;
+			int Object;
+		};
+
+		GLuint NewQuery();
+		void ReadResults();
+		void RenderHiddenBatch(const int* Objects, int Count, const mat4& ViewProjection, const std::function<void(int)>& DrawObject);
+
+		std::vector<object> Objects;
+		std::vector<int> VisibleOrder; // Front to back
+		std::vector<int> HiddenOrder;
+		std::vector<float> Depths;
+		std::vector<GLuint> BatchQueries;
+
+		std::vector<GLuint> FreeQueries;
+		std::deque<pending_query> PendingQueries; // Issue order
+		int Frame = 0;
+		stats Stats = {};
+
+		GLuint ProxyProgram = 0;
+		GLuint ProxyVAO = 0;
+		GLuint ProxyVertexBuffer = 0;
+		GLuint ProxyIndexBuffer = 0;
+		GLint ProxyViewProjectionLocation = -1;
+		GLint ProxyCenterLocation = -1;
+		GLint ProxyExtentLocation = -1;
+	};
+}
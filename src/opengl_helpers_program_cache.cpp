@@ -0,0 +1,180 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <filesystem>
+
+#include "opengl_helpers_program_cache.h"
+
+static const char* ProgramCacheDirectory = "cache/programs";
+static const uint32_t ProgramCacheMagic = 0x47525050; // "PPRG"
+static const uint32_t ProgramCacheVersion = 1;
+
+// File header written before the driver blob
+struct program_binary_header
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint64_t Key;
+	uint32_t Format;
+	int32_t Length;
+};
+
+// FNV-1a (64 bits)
+static uint64_t HashBytes(uint64_t Hash, const void* Data, size_t Size)
+{
+	const uint8_t* Bytes = (const uint8_t*)Data;
+	for (size_t i = 0; i < Size; ++i)
+	{
+		Hash ^= Bytes[i];
+		Hash *= 0x100000001b3ull;
+	}
+	return Hash;
+}
+
+// Hash the null terminator too so that {"ab", "c"} and {"a", "bc"} give different keys
+static uint64_t HashString(uint64_t Hash, const char* Str)
+{
+	if (Str == nullptr)
+		Str = "";
+	return HashBytes(Hash, Str, strlen(Str) + 1);
+}
+
+static uint64_t HashSources(uint64_t Hash, const std::vector<const char*>& Sources)
+{
+	uint32_t Count = (uint32_t)Sources.size();
+	Hash = HashBytes(Hash, &Count, sizeof(Count));
+	for (const char* Source : Sources)
+		Hash = HashString(Hash, Source);
+	return Hash;
+}
+
+static std::string GetProgramBinaryPath(uint64_t Key)
+{
+	char Filename[64];
+	snprintf(Filename, sizeof(Filename), "/%016llx.bin", (unsigned long long)Key);
+	return std::string(ProgramCacheDirectory) + Filename;
+}
+
+bool GL::ProgramBinaryCacheSupported()
+{
+	static int Supported = -1;
+	if (Supported == -1)
+	{
+		// Some drivers expose the extension with zero formats (binary retrieval unsupported)
+		GLint FormatCount = 0;
+		if (GLAD_GL_ARB_get_program_binary)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &FormatCount);
+		Supported = (FormatCount > 0) ? 1 : 0;
+	}
+	return Supported == 1;
+}
+
+uint64_t GL::ProgramBinaryKey(const std::vector<const char*>& VSSources, const std::vector<const char*>& FSSources)
+{
+	uint64_t Hash = 0xcbf29ce484222325ull;
+
+	// Driver identity (a driver update must invalidate every binary)
+	Hash = HashString(Hash, (const char*)glGetString(GL_VENDOR));
+	Hash = HashString(Hash, (const char*)glGetString(GL_RENDERER));
+	Hash = HashString(Hash, (const char*)glGetString(GL_VERSION));
+
+	// Sources (defines are sent as source strings, so they are part of the key)
+	Hash = HashSources(Hash, VSSources);
+	Hash = HashSources(Hash, FSSources);
+
+	return Hash;
+}
+
+GLuint GL::LoadProgramBinary(uint64_t Key)
+{
+	if (!GL::ProgramBinaryCacheSupported())
+		return 0;
+
+	std::string Path = GetProgramBinaryPath(Key);
+	FILE* File = fopen(Path.c_str(), "rb");
+	if (File == nullptr)
+		return 0;
+
+	program_binary_header Header = {};
+	bool Valid = fread(&Header, sizeof(Header), 1, File) == 1
+		&& Header.Magic == ProgramCacheMagic
+		&& Header.Version == ProgramCacheVersion
+		&& Header.Key == Key
+		&& Header.Length > 0;
+
+	std::vector<uint8_t> Binary;
+	if (Valid)
+	{
+		Binary.resize(Header.Length);
+		Valid = fread(Binary.data(), 1, Binary.size(), File) == Binary.size();
+	}
+	fclose(File);
+
+	if (!Valid)
+	{
+		fprintf(stderr, "Corrupted program binary '%s', recompiling\n", Path.c_str());
+		remove(Path.c_str());
+		return 0;
+	}
+
+	GLuint Program = glCreateProgram();
+	glProgramBinary(Program, (GLenum)Header.Format, Binary.data(), (GLsizei)Header.Length);
+
+	// The driver is allowed to reject any binary (format no longer supported, etc.)
+	GLint LinkStatus;
+	glGetProgramiv(Program, GL_LINK_STATUS, &LinkStatus);
+	if (LinkStatus == GL_FALSE)
+	{
+		fprintf(stderr, "Program binary '%s' rejected by the driver, recompiling\n", Path.c_str());
+		glDeleteProgram(Program);
+		remove(Path.c_str());
+		return 0;
+	}
+
+	return Program;
+}
+
+void GL::SaveProgramBinary(uint64_t Key, GLuint Program)
+{
+	if (!GL::ProgramBinaryCacheSupported())
+		return;
+
+	GLint Length = 0;
+	glGetProgramiv(Program, GL_PROGRAM_BINARY_LENGTH, &Length);
+	if (Length <= 0)
+		return;
+
+	std::vector<uint8_t> Binary(Length);
+	GLsizei Written = 0;
+	GLenum Format = 0;
+	glGetProgramBinary(Program, Length, &Written, &Format, Binary.data());
+	if (Written <= 0)
+		return;
+
+	std::error_code Error;
+	std::filesystem::create_directories(ProgramCacheDirectory, Error);
+
+	std::string Path = GetProgramBinaryPath(Key);
+	FILE* File = fopen(Path.c_str(), "wb");
+	if (File == nullptr)
+	{
+		fprintf(stderr, "Cannot write program binary '%s'\n", Path.c_str());
+		return;
+	}
+
+	program_binary_header Header = {};
+	Header.Magic   = ProgramCacheMagic;
+	Header.Version = ProgramCacheVersion;
+	Header.Key     = Key;
+	Header.Format  = (uint32_t)Format;
+	Header.Length  = (int32_t)Written;
+	fwrite(&Header, sizeof(Header), 1, File);
+	fwrite(Binary.data(), 1, Written, File);
+	fclose(File);
+}
+
+void GL::ClearProgramBinaryCache()
+{
+	std::error_code Error;
+	std::filesystem::remove_all(ProgramCacheDirectory, Error);
+}
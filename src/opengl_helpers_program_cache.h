@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "opengl_headers.h"
+
+namespace GL
+{
+	// On-disk cache of linked programs (GL_ARB_get_program_binary)
+	// Binaries are keyed on every source string sent to the compiler and on the driver strings,
+	// so any change in the shaders, in the injected defines or in the driver misses the cache.
+	bool ProgramBinaryCacheSupported();
+	uint64_t ProgramBinaryKey(const std::vector<const char*>& VSSources, const std::vector<const char*>& FSSources);
+	GLuint LoadProgramBinary(uint64_t Key); // Returns 0 when the binary is missing or rejected by the driver
+	void SaveProgramBinary(uint64_t Key, GLuint Program);
+	// Delete every cached binary (cold start measurements)
+	void ClearProgramBinaryCache();
+}
@@ -0,0 +1,94 @@
+#include <cstdio>
+#include <cstring>
+
+#include "opengl_helpers_memory.h"
+
+#include "opengl_helpers_readback.h"
+
+using namespace GL;
+
+async_readback::~async_readback()
+{
+	if (Fence)
+		glDeleteSync(Fence);
+	glDeleteBuffers(1, &PBO);
+}
+
+void async_readback::Request(GLuint Framebuffer, int Width, int Height)
+{
+	if (Fence)
+		glDeleteSync(Fence);
+
+	this->Width = Width;
+	this->Height = Height;
+
+	GLsizei Size = Width * Height * 4;
+	if (PBO == 0)
+		glGenBuffers(1, &PBO);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, PBO);
+	if (Size != PBOSize)
+	{
+		memory_owner_scope MemoryOwner("async_readback");
+		glBufferData(GL_PIXEL_PACK_BUFFER, Size, nullptr, GL_STREAM_READ);
+		PBOSize = Size;
+	}
+
+	GLint PreviousReadFramebuffer;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &PreviousReadFramebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, Framebuffer);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	// Offset into the bound pack buffer: returns once the copy is queued
+	glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, PreviousReadFramebuffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	// Make sure the fence gets submitted, a later wait would never return otherwise
+	glFlush();
+}
+
+bool async_readback::IsReady()
+{
+	if (Fence == nullptr)
+		return false;
+
+	GLenum Status = glClientWaitSync(Fence, 0, 0);
+	return Status == GL_ALREADY_SIGNALED || Status == GL_CONDITION_SATISFIED;
+}
+
+bool async_readback::Resolve(std::vector<uint8_t>* Pixels)
+{
+	if (Fence == nullptr)
+		return false;
+
+	while (true)
+	{
+		GLenum Status = glClientWaitSync(Fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); // 1 s, in nanoseconds
+		if (Status == GL_ALREADY_SIGNALED || Status == GL_CONDITION_SATISFIED)
+			break;
+		if (Status == GL_WAIT_FAILED)
+		{
+			fprintf(stderr, "async_readback: fence wait failed\n");
+			break;
+		}
+	}
+	glDeleteSync(Fence);
+	Fence = nullptr;
+
+	size_t RowSize = (size_t)Width * 4;
+	Pixels->resize(RowSize * Height);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, PBO);
+	const uint8_t* Mapped = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, PBOSize, GL_MAP_READ_BIT);
+	if (Mapped)
+	{
+		// GL rows are bottom to top
+		for (int y = 0; y < Height; ++y)
+			memcpy(Pixels->data() + y * RowSize, Mapped + (Height - 1 - y) * RowSize, RowSize);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	return Mapped != nullptr;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "opengl_headers.h"
+
+namespace GL
+{
+	// Framebuffer readback through a pixel pack buffer and a fence
+	// Request() only queues the copy, the CPU keeps submitting frames until IsReady() (or blocks in Resolve())
+	class async_readback
+	{
+	public:
+		async_readback() = default;
+		~async_readback();
+		async_readback(const async_readback&) = delete;
+		async_readback& operator=(const async_readback&) = delete;
+
+		// Queue a copy of the color attachment 0 of Framebuffer, a pending request is dropped
+		void Request(GLuint Framebuffer, int Width, int Height);
+		bool IsPending() const { return Fence != nullptr; }
+		// Non blocking fence test
+		bool IsReady();
+		// RGBA8 pixels, top row first, waits for the copy if needed, false without request
+		bool Resolve(std::vector<uint8_t>* Pixels);
+
+		int GetWidth() const { return Width; }
+		int GetHeight() const { return Height; }
+
+	private:
+		GLuint PBO = 0;
+		GLsizei PBOSize = 0;
+		GLsync Fence = nullptr;
+		int Width = 0;
+		int Height = 0;
+	};
+}
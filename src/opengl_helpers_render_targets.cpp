@@ -0,0 +1,318 @@
+
+#include <cstdio>
+#include <algorithm>
+
+#include "opengl_helpers_render_targets.h"
+#include "opengl_helpers_memory.h"
+
+using namespace GL;
+
+// Targets not acquired during this many frames are deleted
+static const int UNUSED_FRAME_COUNT_BEFORE_DELETE = 8;
+
+struct pixel_format_info
+{
+	GLenum Format;
+	GLenum Type;
+	int BytesPerPixel; // Estimation, drivers usually pad 3 channels formats to 4
+};
+
+static pixel_format_info GetPixelFormatInfo(GLenum InternalFormat)
+{
+	switch (InternalFormat)
+	{
+	case GL_R8:                 return { GL_RED,             GL_UNSIGNED_BYTE,                  1 };
+	case GL_RG8:                return { GL_RG,              GL_UNSIGNED_BYTE,                  2 };
+	case GL_RGB:
+	case GL_RGB8:               return { GL_RGB,             GL_UNSIGNED_BYTE,                  4 };
+	case GL_RGBA:
+	case GL_RGBA8:
+	case GL_SRGB8_ALPHA8:       return { GL_RGBA,            GL_UNSIGNED_BYTE,                  4 };
+	case GL_RG16:               return { GL_RG,              GL_UNSIGNED_SHORT,                 4 };
+	case GL_RG16_SNORM:         return { GL_RG,              GL_SHORT,                          4 };
+	case GL_R16F:               return { GL_RED,             GL_FLOAT,                          2 };
+	case GL_RG16F:              return { GL_RG,              GL_FLOAT,                          4 };
+	case GL_RGB16F:             return { GL_RGB,             GL_FLOAT,                          8 };
+	case GL_RGBA16F:            return { GL_RGBA,            GL_FLOAT,                          8 };
+	case GL_R11F_G11F_B10F:     return { GL_RGB,             GL_FLOAT,                          4 };
+	case GL_R32F:               return { GL_RED,             GL_FLOAT,                          4 };
+	case GL_RG32F:              return { GL_RG,              GL_FLOAT,                          8 };
+	case GL_RGBA32F:            return { GL_RGBA,            GL_FLOAT,                         16 };
+	case GL_R32UI:              return { GL_RED_INTEGER,     GL_UNSIGNED_INT,                   4 };
+	case GL_RG32UI:             return { GL_RG_INTEGER,      GL_UNSIGNED_INT,                   8 };
+	case GL_RGBA32UI:           return { GL_RGBA_INTEGER,    GL_UNSIGNED_INT,                  16 };
+	case GL_DEPTH_COMPONENT16:  return { GL_DEPTH_COMPONENT, GL_FLOAT,                          2 };
+	case GL_DEPTH_COMPONENT:
+	case GL_DEPTH_COMPONENT24:
+	case GL_DEPTH_COMPONENT32F: return { GL_DEPTH_COMPONENT, GL_FLOAT,                          4 };
+	case GL_DEPTH24_STENCIL8:   return { GL_DEPTH_STENCIL,   GL_UNSIGNED_INT_24_8,              4 };
+	case GL_DEPTH32F_STENCIL8:  return { GL_DEPTH_STENCIL,   GL_FLOAT_32_UNSIGNED_INT_24_8_REV, 8 };
+	default:
+		fprintf(stderr, "Render target format 0x%x is not handled, using RGBA8 transfer format\n", InternalFormat);
+		return { GL_RGBA, GL_UNSIGNED_BYTE, 4 };
+	}
+}
+
+static bool IsDepthFormat(GLenum InternalFormat)
+{
+	return GetPixelFormatInfo(InternalFormat).Format == GL_DEPTH_COMPONENT || GetPixelFormatInfo(InternalFormat).Format == GL_DEPTH_STENCIL;
+}
+
+bool GL::IsIntegerFormat(GLenum InternalFormat)
+{
+	GLenum Format = GetPixelFormatInfo(InternalFormat).Format;
+	return Format == GL_RED_INTEGER || Format == GL_RG_INTEGER || Format == GL_RGBA_INTEGER;
+}
+
+render_target_pool::~render_target_pool()
+{
+	for (framebuffer& Framebuffer : Framebuffers)
+		glDeleteFramebuffers(1, &Framebuffer.FBO);
+
+	for (std::unique_ptr<render_target>& Target : Targets)
+	{
+		if (Target->IsRenderbuffer)
+			glDeleteRenderbuffers(1, &Target->Name);
+		else
+			glDeleteTextures(1, &Target->Name);
+	}
+}
+
+void render_target_pool::BeginFrame()
+{
+	FrameIndex++;
+
+	// Everything acquired last frame goes back to the pool
+	for (size_t i = Targets.size(); i-- > 0;)
+	{
+		Targets[i]->InUse = false;
+		if (FrameIndex - Targets[i]->LastUsedFrame > UNUSED_FRAME_COUNT_BEFORE_DELETE)
+			DeleteTarget(i);
+	}
+}
+
+const render_target* render_target_pool::AcquireTexture(GLenum InternalFormat, int Width, int Height, int Samples)
+{
+	return Acquire(false, InternalFormat, Width, Height, Samples);
+}
+
+const render_target* render_target_pool::AcquireRenderbuffer(GLenum InternalFormat, int Width, int Height, int Samples)
+{
+	return Acquire(true, InternalFormat, Width, Height, Samples);
+}
+
+const render_target* render_target_pool::Acquire(bool IsRenderbuffer, GLenum InternalFormat, int Width, int Height, int Samples)
+{
+	// Minimized window
+	Width = std::max(Width, 1);
+	Height = std::max(Height, 1);
+
+	auto IsCompatible = [&](const render_target& Target)
+	{
+		return !Target.InUse
+			&& Target.IsRenderbuffer == IsRenderbuffer
+			&& Target.InternalFormat == InternalFormat
+			&& Target.Samples == Samples;
+	};
+
+	// Free target with the same key
+	for (std::unique_ptr<render_target>& Target : Targets)
+	{
+		if (IsCompatible(*Target) && Target->Width == Width && Target->Height == Height)
+		{
+			Target->InUse = true;
+			Target->LastUsedFrame = FrameIndex;
+			return Target.get();
+		}
+	}
+
+	// Resize a target that was not used yet this frame (usually after a window resize)
+	for (std::unique_ptr<render_target>& Target : Targets)
+	{
+		if (IsCompatible(*Target) && Target->LastUsedFrame < FrameIndex)
+		{
+			Allocate(*Target, Width, Height);
+			Target->InUse = true;
+			Target->LastUsedFrame = FrameIndex;
+			return Target.get();
+		}
+	}
+
+	// Create a new one
+	std::unique_ptr<render_target> Target = std::make_unique<render_target>();
+	Target->IsRenderbuffer = IsRenderbuffer;
+	Target->InternalFormat = InternalFormat;
+	Target->Samples = Samples;
+	Target->InUse = true;
+	Target->LastUsedFrame = FrameIndex;
+
+	if (IsRenderbuffer)
+	{
+		glGenRenderbuffers(1, &Target->Name);
+	}
+	else
+	{
+		glGenTextures(1, &Target->Name);
+		if (Samples == 0)
+		{
+			GLint Filter = (IsDepthFormat(InternalFormat) || IsIntegerFormat(InternalFormat)) ? GL_NEAREST : GL_LINEAR;
+			GLint PreviousTexture = 0;
+			glGetIntegerv(GL_TEXTURE_BINDING_2D, &PreviousTexture);
+			glBindTexture(GL_TEXTURE_2D, Target->Name);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, Filter);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, Filter);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glBindTexture(GL_TEXTURE_2D, PreviousTexture);
+		}
+	}
+	Allocate(*Target, Width, Height);
+
+	Targets.push_back(std::move(Target));
+	return Targets.back().get();
+}
+
+void render_target_pool::Allocate(render_target& Target, int Width, int Height)
+{
+	// Pooled targets are shared between demos
+	GL::memory_owner_scope MemoryOwner("GL::render_target_pool");
+
+	Target.Width = Width;
+	Target.Height = Height;
+
+	// Acquire can run in the middle of a pass: the bindings of the active unit are restored
+	GLint Previous = 0;
+	if (Target.IsRenderbuffer)
+	{
+		glGetIntegerv(GL_RENDERBUFFER_BINDING, &Previous);
+		glBindRenderbuffer(GL_RENDERBUFFER, Target.Name);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, Target.Samples, Target.InternalFormat, Width, Height);
+		glBindRenderbuffer(GL_RENDERBUFFER, Previous);
+	}
+	else if (Target.Samples > 0)
+	{
+		glGetIntegerv(GL_TEXTURE_BINDING_2D_MULTISAMPLE, &Previous);
+		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, Target.Name);
+		glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, Target.Samples, Target.InternalFormat, Width, Height, GL_TRUE);
+		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, Previous);
+	}
+	else
+	{
+		pixel_format_info Info = GetPixelFormatInfo(Target.InternalFormat);
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &Previous);
+		glBindTexture(GL_TEXTURE_2D, Target.Name);
+		glTexImage2D(GL_TEXTURE_2D, 0, Target.InternalFormat, Width, Height, 0, Info.Format, Info.Type, NULL);
+		glBindTexture(GL_TEXTURE_2D, Previous);
+	}
+}
+
+void render_target_pool::Release(const render_target* Target)
+{
+	for (std::unique_ptr<render_target>& PoolTarget : Targets)
+	{
+		if (PoolTarget.get() == Target)
+		{
+			PoolTarget->InUse = false;
+			return;
+		}
+	}
+}
+
+void render_target_pool::DeleteTarget(size_t Index)
+{
+	render_target* Target = Targets[Index].get();
+
+	// Delete framebuffers using it
+	for (size_t i = Framebuffers.size(); i-- > 0;)
+	{
+		std::vector<const render_target*>& Attachments = Framebuffers[i].Attachments;
+		if (std::find(Attachments.begin(), Attachments.end(), Target) != Attachments.end())
+		{
+			glDeleteFramebuffers(1, &Framebuffers[i].FBO);
+			Framebuffers.erase(Framebuffers.begin() + i);
+		}
+	}
+
+	if (Target->IsRenderbuffer)
+		glDeleteRenderbuffers(1, &Target->Name);
+	else
+		glDeleteTextures(1, &Target->Name);
+
+	Targets.erase(Targets.begin() + Index);
+}
+
+static void AttachTarget(GLenum Attachment, const render_target* Target)
+{
+	if (Target->IsRenderbuffer)
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, Attachment, GL_RENDERBUFFER, Target->Name);
+	else
+		glFramebufferTexture2D(GL_FRAMEBUFFER, Attachment, Target->Samples > 0 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D, Target->Name, 0);
+}
+
+GLuint render_target_pool::GetFramebuffer(std::initializer_list<const render_target*> ColorTargets, const render_target* DepthTarget)
+{
+	return GetFramebuffer(std::vector<const render_target*>(ColorTargets), DepthTarget);
+}
+
+GLuint render_target_pool::GetFramebuffer(const std::vector<const render_target*>& ColorTargets, const render_target* DepthTarget)
+{
+	for (framebuffer& Framebuffer : Framebuffers)
+	{
+		if (Framebuffer.Attachments.size() == ColorTargets.size() + 1
+			&& std::equal(ColorTargets.begin(), ColorTargets.end(), Framebuffer.Attachments.begin())
+			&& Framebuffer.Attachments.back() == DepthTarget)
+			return Framebuffer.FBO;
+	}
+
+	framebuffer Framebuffer = {};
+	Framebuffer.Attachments.assign(ColorTargets.begin(), ColorTargets.end());
+	Framebuffer.Attachments.push_back(DepthTarget);
+
+	GLint PreviousFBO = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &PreviousFBO);
+
+	glGenFramebuffers(1, &Framebuffer.FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer.FBO);
+
+	std::vector<GLenum> DrawBuffers;
+	for (const render_target* ColorTarget : ColorTargets)
+	{
+		GLenum Attachment = GL_COLOR_ATTACHMENT0 + (GLenum)DrawBuffers.size();
+		if (ColorTarget)
+			AttachTarget(Attachment, ColorTarget);
+		DrawBuffers.push_back(ColorTarget ? Attachment : GL_NONE);
+	}
+
+	if (DepthTarget)
+	{
+		bool HasStencil = GetPixelFormatInfo(DepthTarget->InternalFormat).Format == GL_DEPTH_STENCIL;
+		AttachTarget(HasStencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, DepthTarget);
+	}
+
+	if (DrawBuffers.empty())
+	{
+		// Depth only
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+	else
+	{
+		glDrawBuffers((GLsizei)DrawBuffers.size(), DrawBuffers.data());
+	}
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		fprintf(stderr, "Render target pool framebuffer is not complete\n");
+
+	glBindFramebuffer(GL_FRAMEBUFFER, PreviousFBO);
+
+	Framebuffers.push_back(Framebuffer);
+	return Framebuffer.FBO;
+}
+
+size_t render_target_pool::GetAllocatedBytes() const
+{
+	size_t Bytes = 0;
+	for (const std::unique_ptr<render_target>& Target : Targets)
+		Bytes += (size_t)Target->Width * Target->Height * std::max(Target->Samples, 1) * GetPixelFormatInfo(Target->InternalFormat).BytesPerPixel;
+	return Bytes;
+}
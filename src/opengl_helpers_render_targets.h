@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <initializer_list>
+
+#include "opengl_headers.h"
+
+namespace GL
+{
+	struct render_target
+	{
+		GLuint Name = 0; // Texture or renderbuffer name
+		bool IsRenderbuffer = false;
+		GLenum InternalFormat = 0;
+		int Width = 0;
+		int Height = 0;
+		int Samples = 0;
+
+		// Pool bookkeeping
+		bool InUse = false;
+		int LastUsedFrame = 0;
+	};
+
+	// Integer color formats (GL_R32UI...): nearest sampling only, cleared with glClearBufferuiv
+	bool IsIntegerFormat(GLenum InternalFormat);
+
+	// Pool of transient render targets keyed on (format, size, samples)
+	// Targets are handed out for the current frame only: every target goes back to the pool in BeginFrame()
+	// and a pass can Release() a target as soon as it is done with it so a later pass of the same frame reuses its memory
+	// Targets are resized lazily when a request misses (window resize) and deleted when they stay unused for a few frames
+	class render_target_pool
+	{
+	public:
+		render_target_pool() = default;
+		~render_target_pool();
+		render_target_pool(const render_target_pool&) = delete;
+		render_target_pool& operator=(const render_target_pool&) = delete;
+
+		// Call once per frame before any Acquire
+		void BeginFrame();
+
+		// Default sampling is linear (nearest for depth and integer formats) and clamped to edge
+		// The texture and renderbuffer bindings of the active unit are left as they were
+		const render_target* AcquireTexture(GLenum InternalFormat, int Width, int Height, int Samples = 0);
+		// For depth/stencil attachments that are never sampled
+		const render_target* AcquireRenderbuffer(GLenum InternalFormat, int Width, int Height, int Samples = 0);
+		void Release(const render_target* Target);
+
+		// Cached framebuffer with the given color attachments (in draw buffer order) and an optional depth (stencil) attachment
+		// A null color target leaves its draw buffer to GL_NONE (fragment output discarded)
+		GLuint GetFramebuffer(std::initializer_list<const render_target*> ColorTargets, const render_target* DepthTarget = nullptr);
+		GLuint GetFramebuffer(const std::vector<const render_target*>& ColorTargets, const render_target* DepthTarget = nullptr);
+
+		int GetTargetCount() const { return (int)Targets.size(); }
+		size_t GetAllocatedBytes() const;
+
+	private:
+		struct framebuffer
+		{
+			GLuint FBO;
+			std::vector<const render_target*> Attachments; // Colors then depth (or nullptr)
+		};
+
+		const render_target* Acquire(bool IsRenderbuffer, GLenum InternalFormat, int Width, int Height, int Samples);
+		void Allocate(render_target& Target, int Width, int Height);
+		void DeleteTarget(size_t Index);
+
+		std::vector<std::unique_ptr<render_target>> Targets;
+		std::vector<framebuffer> Framebuffers;
+		int FrameIndex = 0;
+	};
+}
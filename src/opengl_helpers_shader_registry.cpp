@@ -0,0 +1,325 @@
+#include <cstdio>
+#include <cassert>
+#include <algorithm>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#include "platform.h"
+#include "opengl_helpers.h"
+#include "opengl_helpers_program_cache.h"
+
+#include "opengl_helpers_shader_registry.h"
+
+// Delay between two checks of the file write times (when inotify is not available)
+static const std::chrono::milliseconds PollInterval(250);
+
+static std::string NormalizePath(const std::string& Path)
+{
+	return std::filesystem::path(Path).lexically_normal().generic_string();
+}
+
+static std::filesystem::file_time_type GetLastWriteTime(const std::string& Path)
+{
+	std::error_code Error;
+	std::filesystem::file_time_type Time = std::filesystem::last_write_time(Path, Error);
+	return Error ? std::filesystem::file_time_type::min() : Time;
+}
+
+GL::shader_registry::shader_registry()
+{
+	ParallelCompile = GLAD_GL_KHR_parallel_shader_compile != 0;
+	if (ParallelCompile)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); // Let the driver choose the thread count
+
+#ifdef __linux__
+	NotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (NotifyFd < 0)
+		fprintf(stderr, "inotify_init1 failed, shader files will be polled\n");
+#endif
+
+	LastPollTime = std::chrono::steady_clock::now();
+}
+
+GL::shader_registry::~shader_registry()
+{
+	for (const entry& Entry : Entries)
+		assert(Entry.Pending.Program == 0 && Entry.Pending.VertexShader == 0 && Entry.Pending.FragmentShader == 0 && "CancelAll() not called before the context teardown");
+
+#ifdef __linux__
+	if (NotifyFd >= 0)
+		close(NotifyFd);
+#endif
+}
+
+void GL::shader_registry::Watch(GLuint* Program, const std::string& VSPath, const std::string& FSPath, bool InjectLightShading, std::function<void(GLuint)> OnReload)
+{
+	source_builder BuildSources = [VSPath, FSPath, InjectLightShading](std::vector<std::string>& VSSources, std::vector<std::string>& FSSources, std::vector<std::string>& Files)
+	{
+		const std::string VSString = GL::LoadShaderFromFile(VSPath);
+		const std::string FSString = GL::LoadShaderFromFile(FSPath);
+		const char* CVSString = VSString.c_str();
+		const char* CFSString = FSString.c_str();
+
+		for (const char* Source : GL::GetShaderSources(1, &CVSString, false))
+			VSSources.push_back(Source);
+		for (const char* Source : GL::GetShaderSources(1, &CFSString, InjectLightShading))
+			FSSources.push_back(Source);
+		Files = { VSPath, FSPath };
+	};
+
+	WatchEx(Program, VSPath + ", " + FSPath, BuildSources, OnReload);
+}
+
+void GL::shader_registry::WatchEx(GLuint* Program, const std::string& Name, source_builder BuildSources, std::function<void(GLuint)> OnReload)
+{
+	// Run the builder once to know which files to watch
+	std::vector<std::string> VSSources;
+	std::vector<std::string> FSSources;
+	std::vector<std::string> Files;
+	BuildSources(VSSources, FSSources, Files);
+
+	entry Entry;
+	Entry.Program = Program;
+	Entry.Name = Name;
+	Entry.BuildSources = BuildSources;
+	Entry.OnReload = OnReload;
+	WatchFiles(Entry, Files);
+
+	Entries.push_back(Entry);
+}
+
+void GL::shader_registry::WatchFiles(entry& Entry, const std::vector<std::string>& Files)
+{
+	Entry.Files.clear();
+	Entry.LastWriteTimes.clear();
+
+	for (const std::string& File : Files)
+	{
+		std::string NormalizedFile = NormalizePath(File);
+		Entry.Files.push_back(NormalizedFile);
+		Entry.LastWriteTimes.push_back(GetLastWriteTime(NormalizedFile));
+
+#ifdef __linux__
+		// Watch the directory rather than the file: most editors save by replacing the file
+		if (NotifyFd >= 0)
+		{
+			std::string Directory = std::filesystem::path(NormalizedFile).parent_path().generic_string();
+			if (Directory.empty())
+				Directory = ".";
+
+			int WatchDescriptor = inotify_add_watch(NotifyFd, Directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+			if (WatchDescriptor < 0)
+				fprintf(stderr, "Cannot watch directory '%s'\n", Directory.c_str());
+			else if (std::find(WatchedDirectories.begin(), WatchedDirectories.end(), std::make_pair(WatchDescriptor, Directory)) == WatchedDirectories.end())
+				WatchedDirectories.push_back({ WatchDescriptor, Directory });
+		}
+#endif
+	}
+}
+
+void GL::shader_registry::Unwatch(GLuint* Program)
+{
+	for (entry& Entry : Entries)
+	{
+		if (Entry.Program == Program)
+			CancelBuild(Entry);
+	}
+
+	Entries.erase(std::remove_if(Entries.begin(), Entries.end(), [Program](const entry& Entry) { return Entry.Program == Program; }), Entries.end());
+}
+
+void GL::shader_registry::Update()
+{
+	PollFileChanges();
+
+	for (entry& Entry : Entries)
+	{
+		// Restart the build if the files changed again while compiling
+		if (Entry.Dirty)
+		{
+			CancelBuild(Entry);
+			StartBuild(Entry);
+			Entry.Dirty = false;
+		}
+
+		if (Entry.Pending.Program && IsBuildComplete(Entry.Pending))
+			FinishBuild(Entry);
+	}
+}
+
+void GL::shader_registry::MarkDirty(const std::string& Path)
+{
+	std::string NormalizedPath = NormalizePath(Path);
+	for (entry& Entry : Entries)
+	{
+		if (std::find(Entry.Files.begin(), Entry.Files.end(), NormalizedPath) != Entry.Files.end())
+			Entry.Dirty = true;
+	}
+}
+
+void GL::shader_registry::PollFileChanges()
+{
+#ifdef __linux__
+	if (NotifyFd >= 0)
+	{
+		alignas(inotify_event) char Buffer[4096];
+		for (;;)
+		{
+			ssize_t Length = read(NotifyFd, Buffer, sizeof(Buffer));
+			if (Length <= 0)
+				break;
+
+			for (char* Ptr = Buffer; Ptr < Buffer + Length; )
+			{
+				const inotify_event* Event = (const inotify_event*)Ptr;
+				Ptr += sizeof(inotify_event) + Event->len;
+				if (Event->len == 0)
+					continue;
+
+				for (const auto& Watched : WatchedDirectories)
+				{
+					if (Watched.first == Event->wd)
+						MarkDirty(Watched.second + "/" + Event->name);
+				}
+			}
+		}
+		return;
+	}
+#endif
+
+	std::chrono::steady_clock::time_point Now = std::chrono::steady_clock::now();
+	if (Now - LastPollTime < PollInterval)
+		return;
+	LastPollTime = Now;
+
+	for (entry& Entry : Entries)
+	{
+		for (size_t i = 0; i < Entry.Files.size(); ++i)
+		{
+			std::filesystem::file_time_type WriteTime = GetLastWriteTime(Entry.Files[i]);
+			if (WriteTime != Entry.LastWriteTimes[i])
+			{
+				Entry.LastWriteTimes[i] = WriteTime;
+				Entry.Dirty = true;
+			}
+		}
+	}
+}
+
+void GL::shader_registry::StartBuild(entry& Entry)
+{
+	std::vector<std::string> VSStrings;
+	std::vector<std::string> FSStrings;
+	std::vector<std::string> Files;
+	Entry.BuildSources(VSStrings, FSStrings, Files);
+
+	// Includes may have changed
+	WatchFiles(Entry, Files);
+
+	std::vector<const char*> VSSources;
+	std::vector<const char*> FSSources;
+	for (const std::string& String : VSStrings)
+		VSSources.push_back(String.c_str());
+	for (const std::string& String : FSStrings)
+		FSSources.push_back(String.c_str());
+
+	// With KHR_parallel_shader_compile, these calls return immediately and the driver compiles in the background
+	pending_build& Build = Entry.Pending;
+	Build.VertexShader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(Build.VertexShader, (GLsizei)VSSources.size(), VSSources.data(), nullptr);
+	glCompileShader(Build.VertexShader);
+
+	Build.FragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(Build.FragmentShader, (GLsizei)FSSources.size(), FSSources.data(), nullptr);
+	glCompileShader(Build.FragmentShader);
+
+	Build.Program = glCreateProgram();
+	glAttachShader(Build.Program, Build.VertexShader);
+	glAttachShader(Build.Program, Build.FragmentShader);
+	if (GL::ProgramBinaryCacheSupported())
+		glProgramParameteri(Build.Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(Build.Program);
+
+	Build.BinaryKey = GL::ProgramBinaryKey(VSSources, FSSources);
+}
+
+bool GL::shader_registry::IsBuildComplete(const pending_build& Build) const
+{
+	// Without the extension, querying the link status below simply waits for the compiler
+	if (!ParallelCompile)
+		return true;
+
+	GLint Completed = GL_FALSE;
+	glGetProgramiv(Build.Program, GL_COMPLETION_STATUS_KHR, &Completed);
+	return Completed == GL_TRUE;
+}
+
+void GL::shader_registry::FinishBuild(entry& Entry)
+{
+	pending_build& Build = Entry.Pending;
+
+	GLint LinkStatus;
+	glGetProgramiv(Build.Program, GL_LINK_STATUS, &LinkStatus);
+	if (LinkStatus == GL_FALSE)
+	{
+		fprintf(stderr, "Shader reload failed (%s), keeping previous program\n", Entry.Name.c_str());
+
+		char Infolog[1024];
+		GLuint Shaders[] = { Build.VertexShader, Build.FragmentShader };
+		bool CompileFailed = false;
+		for (GLuint Shader : Shaders)
+		{
+			GLint CompileStatus;
+			glGetShaderiv(Shader, GL_COMPILE_STATUS, &CompileStatus);
+			if (CompileStatus == GL_FALSE)
+			{
+				glGetShaderInfoLog(Shader, ARRAY_SIZE(Infolog), nullptr, Infolog);
+				fprintf(stderr, "Shader error: %s\n", Infolog);
+				CompileFailed = true;
+			}
+		}
+
+		if (!CompileFailed)
+		{
+			glGetProgramInfoLog(Build.Program, ARRAY_SIZE(Infolog), nullptr, Infolog);
+			fprintf(stderr, "Program link error: %s\n", Infolog);
+		}
+
+		CancelBuild(Entry);
+		return;
+	}
+
+	GL::SaveProgramBinary(Build.BinaryKey, Build.Program);
+
+	// Swap (GL defers the deletion if the old program is still bound)
+	glDeleteProgram(*Entry.Program);
+	*Entry.Program = Build.Program;
+	Build.Program = 0;
+	CancelBuild(Entry);
+
+	printf("Reloaded program: %s\n", Entry.Name.c_str());
+
+	if (Entry.OnReload)
+		Entry.OnReload(*Entry.Program);
+}
+
+void GL::shader_registry::CancelAll()
+{
+	for (entry& Entry : Entries)
+		CancelBuild(Entry);
+}
+
+void GL::shader_registry::CancelBuild(entry& Entry)
+{
+	pending_build& Build = Entry.Pending;
+	if (Build.Program)
+		glDeleteProgram(Build.Program);
+	if (Build.VertexShader)
+		glDeleteShader(Build.VertexShader);
+	if (Build.FragmentShader)
+		glDeleteShader(Build.FragmentShader);
+	Build = {};
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <filesystem>
+
+#include "opengl_headers.h"
+
+namespace GL
+{
+	// Watch shader source files and rebuild the programs using them when they change
+	// Rebuilds are compiled in the background when KHR_parallel_shader_compile is available,
+	// the watched program is only replaced after a successful link (the old one keeps running otherwise)
+	class shader_registry
+	{
+	public:
+		shader_registry();
+		~shader_registry();
+
+		// Fill the source strings of each stage and the list of files they were built from
+		using source_builder = std::function<void(std::vector<std::string>& VSSources, std::vector<std::string>& FSSources, std::vector<std::string>& Files)>;
+
+		// *Program is replaced (and the old one deleted) on reload, OnReload is called after the swap
+		// to set the uniforms that were only set at setup
+		void Watch(GLuint* Program, const std::string& VSPath, const std::string& FSPath, bool InjectLightShading = false,
+			std::function<void(GLuint)> OnReload = nullptr);
+		void WatchEx(GLuint* Program, const std::string& Name, source_builder BuildSources, std::function<void(GLuint)> OnReload = nullptr);
+		void Unwatch(GLuint* Program);
+
+		// Poll file changes and pending builds (call once per frame)
+		void Update();
+
+		// Delete the builds still in flight, while the GL context is current (before it is destroyed)
+		// The destructor makes no GL call: it only asserts that nothing is pending
+		void CancelAll();
+
+	private:
+		struct pending_build
+		{
+			GLuint Program;
+			GLuint VertexShader;
+			GLuint FragmentShader;
+			uint64_t BinaryKey;
+		};
+
+		struct entry
+		{
+			GLuint* Program;
+			std::string Name; // For the log
+			source_builder BuildSources;
+			std::function<void(GLuint)> OnReload;
+
+			// Files the program depends on and their last known write time
+			std::vector<std::string> Files;
+			std::vector<std::filesystem::file_time_type> LastWriteTimes;
+
+			bool Dirty = false;
+			pending_build Pending = {};
+		};
+
+		void WatchFiles(entry& Entry, const std::vector<std::string>& Files);
+		void PollFileChanges();
+		void MarkDirty(const std::string& Path);
+		void StartBuild(entry& Entry);
+		bool IsBuildComplete(const pending_build& Build) const;
+		void FinishBuild(entry& Entry);
+		void CancelBuild(entry& Entry);
+
+		std::vector<entry> Entries;
+		bool ParallelCompile = false;
+
+		// inotify (linux only, other platforms poll the file write times)
+		int NotifyFd = -1;
+		std::vector<std::pair<int, std::string>> WatchedDirectories; // (watch descriptor, directory)
+		std::chrono::steady_clock::time_point LastPollTime;
+	};
+}
@@ -0,0 +1,222 @@
+#include <cstdio>
+#include <cassert>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+
+#include "opengl_helpers.h"
+#include "opengl_helpers_shader_registry.h"
+
+#include "opengl_helpers_shader_variants.h"
+
+static const int MaxIncludeDepth = 16;
+
+// Append the file to Output, IncludedFiles.back() must be Path
+// '#line <line> <file index>' directives keep compiler errors pointing to the right file and line
+static void PreprocessFile(const std::filesystem::path& Path, std::string& Output, std::vector<std::string>& IncludedFiles, int Depth)
+{
+	std::ifstream File(Path);
+	if (!File)
+	{
+		fprintf(stderr, "Cannot open shader file '%s'\n", Path.generic_string().c_str());
+		return;
+	}
+
+	const int FileIndex = (int)IncludedFiles.size() - 1;
+	int LineNumber = 0;
+	std::string Line;
+	while (std::getline(File, Line))
+	{
+		++LineNumber;
+
+		size_t First = Line.find_first_not_of(" \t");
+		if (First == std::string::npos || Line.compare(First, 8, "#include") != 0)
+		{
+			Output += Line;
+			Output += '\n';
+			continue;
+		}
+
+		size_t Open = Line.find('"', First + 8);
+		size_t Close = (Open != std::string::npos) ? Line.find('"', Open + 1) : std::string::npos;
+		if (Close == std::string::npos)
+		{
+			fprintf(stderr, "%s(%d): malformed #include\n", Path.generic_string().c_str(), LineNumber);
+			Output += '\n';
+			continue;
+		}
+
+		std::filesystem::path IncludePath = (Path.parent_path() / Line.substr(Open + 1, Close - Open - 1)).lexically_normal();
+		std::string IncludeName = IncludePath.generic_string();
+
+		// Files are only included once
+		if (std::find(IncludedFiles.begin(), IncludedFiles.end(), IncludeName) != IncludedFiles.end())
+		{
+			Output += '\n';
+			continue;
+		}
+
+		if (Depth >= MaxIncludeDepth)
+		{
+			fprintf(stderr, "%s(%d): #include depth limit reached\n", Path.generic_string().c_str(), LineNumber);
+			Output += '\n';
+			continue;
+		}
+
+		IncludedFiles.push_back(IncludeName);
+		Output += "#line 1 " + std::to_string(IncludedFiles.size() - 1) + "\n";
+		PreprocessFile(IncludePath, Output, IncludedFiles, Depth + 1);
+		Output += "#line " + std::to_string(LineNumber + 1) + " " + std::to_string(FileIndex) + "\n";
+	}
+}
+
+std::string GL::PreprocessShaderFile(const std::string& Path, std::vector<std::string>* IncludedFiles)
+{
+	std::vector<std::string> Files = { std::filesystem::path(Path).lexically_normal().generic_string() };
+
+	std::string Output;
+	PreprocessFile(Path, Output, Files, 0);
+
+	if (IncludedFiles)
+		*IncludedFiles = Files;
+	return Output;
+}
+
+// Split the source after the #version line (defines must come after it)
+static void InsertDefines(const std::string& Source, const std::string& Defines, std::vector<std::string>& Sources)
+{
+	size_t VersionStart = Source.find("#version");
+	if (VersionStart == std::string::npos)
+	{
+		Sources.push_back(Defines);
+		Sources.push_back("#line 1 0\n");
+		Sources.push_back(Source);
+		return;
+	}
+
+	size_t VersionEnd = Source.find('\n', VersionStart);
+	VersionEnd = (VersionEnd == std::string::npos) ? Source.size() : VersionEnd + 1;
+	int VersionLine = (int)std::count(Source.begin(), Source.begin() + VersionEnd, '\n');
+
+	Sources.push_back(Source.substr(0, VersionEnd));
+	Sources.push_back(Defines);
+	Sources.push_back("#line " + std::to_string(VersionLine + 1) + " 0\n");
+	Sources.push_back(Source.substr(VersionEnd));
+}
+
+GL::shader_variants::shader_variants(const std::string& VSPath, const std::string& FSPath, const std::vector<shader_keyword>& Keywords,
+	std::function<void(GLuint)> OnProgramCreated, GL::shader_registry* Registry)
+	: VSPath(VSPath), FSPath(FSPath), Keywords(Keywords), OnProgramCreated(OnProgramCreated), Registry(Registry)
+{
+	// Each keyword takes just enough bits to store its max value
+	int Shift = 0;
+	for (const shader_keyword& Keyword : Keywords)
+	{
+		KeywordShifts.push_back(Shift);
+		int Bits = 1;
+		while ((1 << Bits) <= Keyword.MaxValue)
+			++Bits;
+		Shift += Bits;
+	}
+	assert(Shift <= 64);
+}
+
+GL::shader_variants::~shader_variants()
+{
+	for (auto& KeyValue : Programs)
+	{
+		if (Registry)
+			Registry->Unwatch(&KeyValue.second);
+		glDeleteProgram(KeyValue.second);
+	}
+}
+
+GL::shader_variants::variant_key GL::shader_variants::GetKey(const std::vector<int>& Values) const
+{
+	assert(Values.size() == Keywords.size());
+
+	variant_key Key = 0;
+	for (size_t i = 0; i < Keywords.size(); ++i)
+	{
+		int Value = std::min(std::max(Values[i], 0), Keywords[i].MaxValue);
+		Key |= (variant_key)Value << KeywordShifts[i];
+	}
+	return Key;
+}
+
+int GL::shader_variants::GetKeywordValue(variant_key Key, int KeywordIndex) const
+{
+	int Bits = ((KeywordIndex + 1 < (int)Keywords.size()) ? KeywordShifts[KeywordIndex + 1] : 64) - KeywordShifts[KeywordIndex];
+	variant_key Mask = (Bits >= 64) ? ~(variant_key)0 : (((variant_key)1 << Bits) - 1);
+	return (int)((Key >> KeywordShifts[KeywordIndex]) & Mask);
+}
+
+std::string GL::shader_variants::GetDefines(variant_key Key) const
+{
+	std::string Defines;
+	for (int i = 0; i < (int)Keywords.size(); ++i)
+		Defines += "#define " + std::string(Keywords[i].Name) + " " + std::to_string(GetKeywordValue(Key, i)) + "\n";
+	return Defines;
+}
+
+void GL::shader_variants::BuildSources(variant_key Key, std::vector<std::string>& VSSources, std::vector<std::string>& FSSources, std::vector<std::string>& Files) const
+{
+	std::string Defines = GetDefines(Key);
+
+	std::vector<std::string> VSFiles;
+	std::vector<std::string> FSFiles;
+	InsertDefines(GL::PreprocessShaderFile(VSPath, &VSFiles), Defines, VSSources);
+	InsertDefines(GL::PreprocessShaderFile(FSPath, &FSFiles), Defines, FSSources);
+
+	Files = VSFiles;
+	Files.insert(Files.end(), FSFiles.begin(), FSFiles.end());
+}
+
+GLuint GL::shader_variants::GetProgram(variant_key Key)
+{
+	auto Found = Programs.find(Key);
+	if (Found != Programs.end())
+		return Found->second;
+
+	std::vector<std::string> VSStrings;
+	std::vector<std::string> FSStrings;
+	std::vector<std::string> Files;
+	BuildSources(Key, VSStrings, FSStrings, Files);
+
+	std::vector<const char*> VSSources;
+	std::vector<const char*> FSSources;
+	for (const std::string& String : VSStrings)
+		VSSources.push_back(String.c_str());
+	for (const std::string& String : FSStrings)
+		FSSources.push_back(String.c_str());
+
+	GLuint& Program = Programs[Key];
+	Program = GL::CreateProgramEx((int)VSSources.size(), VSSources.data(), (int)FSSources.size(), FSSources.data());
+
+	if (OnProgramCreated)
+		OnProgramCreated(Program);
+
+	if (Registry)
+	{
+		// Name the variant after its non-zero keywords in the log
+		std::string Name = FSPath;
+		for (int i = 0; i < (int)Keywords.size(); ++i)
+		{
+			if (int Value = GetKeywordValue(Key, i))
+				Name += std::string(" ") + Keywords[i].Name + "=" + std::to_string(Value);
+		}
+
+		Registry->WatchEx(&Program, Name, [this, Key](std::vector<std::string>& VSSources, std::vector<std::string>& FSSources, std::vector<std::string>& Files)
+		{
+			BuildSources(Key, VSSources, FSSources, Files);
+		}, OnProgramCreated);
+	}
+
+	return Program;
+}
+
+void GL::shader_variants::Precompile(const std::vector<variant_key>& Keys)
+{
+	for (variant_key Key : Keys)
+		GetProgram(Key);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+
+#include "opengl_headers.h"
+
+namespace GL
+{
+	class shader_registry;
+
+	// Load a shader file and expand its #include "file" directives (paths are relative to the including file)
+	// Each file is included once, IncludedFiles receives the main file followed by every included file
+	std::string PreprocessShaderFile(const std::string& Path, std::vector<std::string>* IncludedFiles = nullptr);
+
+	// Compile-time feature of a shader, exposed as '#define Name Value' with Value in [0, MaxValue]
+	struct shader_keyword
+	{
+		const char* Name;
+		int MaxValue; // 1 for on/off features
+	};
+
+	// Set of programs built from the same files with different keyword values
+	class shader_variants
+	{
+	public:
+		using variant_key = uint64_t;
+
+		// OnProgramCreated is called after each variant is created or reloaded (to set uniforms that won't change)
+		shader_variants(const std::string& VSPath, const std::string& FSPath, const std::vector<shader_keyword>& Keywords,
+			std::function<void(GLuint)> OnProgramCreated = nullptr, GL::shader_registry* Registry = nullptr);
+		~shader_variants();
+		shader_variants(const shader_variants&) = delete;
+		shader_variants& operator=(const shader_variants&) = delete;
+
+		// Pack one value per keyword (in declaration order), values are clamped to [0, MaxValue]
+		variant_key GetKey(const std::vector<int>& Values) const;
+
+		// Get (and build if needed) the program of a variant
+		GLuint GetProgram(variant_key Key);
+
+		// Build the variants that will be used up-front to avoid hitches when they are first drawn
+		void Precompile(const std::vector<variant_key>& Keys);
+
+		int GetVariantCount() const { return (int)Programs.size(); }
+
+	private:
+		int GetKeywordValue(variant_key Key, int KeywordIndex) const;
+		std::string GetDefines(variant_key Key) const;
+		void BuildSources(variant_key Key, std::vector<std::string>& VSSources, std::vector<std::string>& FSSources, std::vector<std::string>& Files) const;
+
+		std::string VSPath;
+		std::string FSPath;
+		std::vector<shader_keyword> Keywords;
+		std::vector<int> KeywordShifts;
+		std::function<void(GLuint)> OnProgramCreated;
+		GL::shader_registry* Registry;
+
+		std::map<variant_key, GLuint> Programs; // Map nodes are stable, the registry can swap programs in place
+	};
+}
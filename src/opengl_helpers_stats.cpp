@@ -0,0 +1,255 @@
+
+#include <imgui.h>
+
+#include "opengl_helpers_stats.h"
+
+using namespace GL;
+
+namespace
+{
+	frame_stats CurrentStats = {}; // Since the last ResetFrameStats()
+	bool HooksInstalled = false;
+
+	int64_t GetTriangleCount(GLenum Mode, int64_t Count)
+	{
+		switch (Mode)
+		{
+		case GL_TRIANGLES:                return Count / 3;
+		case GL_TRIANGLES_ADJACENCY:      return Count / 6;
+		case GL_TRIANGLE_STRIP:
+		case GL_TRIANGLE_FAN:             return Count >= 3 ? Count - 2 : 0;
+		case GL_TRIANGLE_STRIP_ADJACENCY: return Count >= 6 ? (Count - 4) / 2 : 0;
+		default:                          return 0; // Points and lines
+		}
+	}
+
+	void CountDraw(GLenum Mode, GLsizei Count, GLsizei InstanceCount)
+	{
+		CurrentStats.DrawCalls++;
+		CurrentStats.Instances += InstanceCount;
+		CurrentStats.Vertices += (int64_t)Count * InstanceCount;
+		CurrentStats.Triangles += GetTriangleCount(Mode, Count) * InstanceCount;
+	}
+
+	// Size of an uploaded pixel (GL_UNPACK_ALIGNMENT is ignored)
+	int64_t GetPixelSize(GLenum Format, GLenum Type)
+	{
+		switch (Type)
+		{
+		case GL_UNSIGNED_BYTE_3_3_2:
+		case GL_UNSIGNED_BYTE_2_3_3_REV:
+			return 1;
+		case GL_UNSIGNED_SHORT_5_6_5:
+		case GL_UNSIGNED_SHORT_5_6_5_REV:
+		case GL_UNSIGNED_SHORT_4_4_4_4:
+		case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+		case GL_UNSIGNED_SHORT_5_5_5_1:
+		case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+			return 2;
+		case GL_UNSIGNED_INT_8_8_8_8:
+		case GL_UNSIGNED_INT_8_8_8_8_REV:
+		case GL_UNSIGNED_INT_10_10_10_2:
+		case GL_UNSIGNED_INT_2_10_10_10_REV:
+		case GL_UNSIGNED_INT_24_8:
+		case GL_UNSIGNED_INT_10F_11F_11F_REV:
+		case GL_UNSIGNED_INT_5_9_9_9_REV:
+			return 4;
+		case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+			return 8;
+		}
+
+		int64_t ComponentSize = 1;
+		switch (Type)
+		{
+		case GL_SHORT:
+		case GL_UNSIGNED_SHORT:
+		case GL_HALF_FLOAT:
+			ComponentSize = 2; break;
+		case GL_INT:
+		case GL_UNSIGNED_INT:
+		case GL_FLOAT:
+			ComponentSize = 4; break;
+		}
+
+		switch (Format)
+		{
+		case GL_RG:
+		case GL_RG_INTEGER:
+		case GL_DEPTH_STENCIL:
+			return 2 * ComponentSize;
+		case GL_RGB:
+		case GL_BGR:
+		case GL_RGB_INTEGER:
+		case GL_BGR_INTEGER:
+			return 3 * ComponentSize;
+		case GL_RGBA:
+		case GL_BGRA:
+		case GL_RGBA_INTEGER:
+		case GL_BGRA_INTEGER:
+			return 4 * ComponentSize;
+		default:
+			return ComponentSize;
+		}
+	}
+
+	// Original entry point and its counting wrapper
+#define STATS_HOOK(Name, Params, Args, Count) \
+	decltype(glad_##Name) Original_##Name = nullptr; \
+	void APIENTRY Hook_##Name Params { Count; Original_##Name Args; }
+
+	// Draws
+	STATS_HOOK(glDrawArrays, (GLenum mode, GLint first, GLsizei count), (mode, first, count), CountDraw(mode, count, 1))
+	STATS_HOOK(glDrawElements, (GLenum mode, GLsizei count, GLenum type, const void* indices), (mode, count, type, indices), CountDraw(mode, count, 1))
+	STATS_HOOK(glDrawRangeElements, (GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const void* indices), (mode, start, end, count, type, indices), CountDraw(mode, count, 1))
+	STATS_HOOK(glDrawElementsBaseVertex, (GLenum mode, GLsizei count, GLenum type, const void* indices, GLint basevertex), (mode, count, type, indices, basevertex), CountDraw(mode, count, 1))
+	STATS_HOOK(glDrawArraysInstanced, (GLenum mode, GLint first, GLsizei count, GLsizei instancecount), (mode, first, count, instancecount), CountDraw(mode, count, instancecount))
+	STATS_HOOK(glDrawElementsInstanced, (GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount), (mode, count, type, indices, instancecount), CountDraw(mode, count, instancecount))
+	STATS_HOOK(glDrawElementsInstancedBaseVertex, (GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount, GLint basevertex), (mode, count, type, indices, instancecount, basevertex), CountDraw(mode, count, instancecount))
+
+	// Binds
+	STATS_HOOK(glUseProgram, (GLuint program), (program), CurrentStats.ProgramBinds++)
+	STATS_HOOK(glBindVertexArray, (GLuint array), (array), CurrentStats.VertexArrayBinds++)
+	STATS_HOOK(glBindTexture, (GLenum target, GLuint texture), (target, texture), CurrentStats.TextureBinds++)
+	STATS_HOOK(glBindFramebuffer, (GLenum target, GLuint framebuffer), (target, framebuffer), CurrentStats.FramebufferBinds++)
+
+	// Uploads
+	STATS_HOOK(glBufferData, (GLenum target, GLsizeiptr size, const void* data, GLenum usage), (target, size, data, usage), CurrentStats.BufferUploadBytes += data ? size : 0)
+	STATS_HOOK(glBufferSubData, (GLenum target, GLintptr offset, GLsizeiptr size, const void* data), (target, offset, size, data), CurrentStats.BufferUploadBytes += size)
+	STATS_HOOK(glTexImage2D, (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels),
+		(target, level, internalformat, width, height, border, format, type, pixels), CurrentStats.TextureUploadBytes += pixels ? (int64_t)width * height * GetPixelSize(format, type) : 0)
+	STATS_HOOK(glTexSubImage2D, (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels),
+		(target, level, xoffset, yoffset, width, height, format, type, pixels), CurrentStats.TextureUploadBytes += pixels ? (int64_t)width * height * GetPixelSize(format, type) : 0)
+
+	// Uniforms
+	STATS_HOOK(glUniform1f, (GLint location, GLfloat v0), (location, v0), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform1i, (GLint location, GLint v0), (location, v0), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform1ui, (GLint location, GLuint v0), (location, v0), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform2f, (GLint location, GLfloat v0, GLfloat v1), (location, v0, v1), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform2i, (GLint location, GLint v0, GLint v1), (location, v0, v1), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform2ui, (GLint location, GLuint v0, GLuint v1), (location, v0, v1), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform3f, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2), (location, v0, v1, v2), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform3i, (GLint location, GLint v0, GLint v1, GLint v2), (location, v0, v1, v2), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform3ui, (GLint location, GLuint v0, GLuint v1, GLuint v2), (location, v0, v1, v2), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform4f, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3), (location, v0, v1, v2, v3), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform4i, (GLint location, GLint v0, GLint v1, GLint v2, GLint v3), (location, v0, v1, v2, v3), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform4ui, (GLint location, GLuint v0, GLuint v1, GLuint v2, GLuint v3), (location, v0, v1, v2, v3), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform1fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform1iv, (GLint location, GLsizei count, const GLint* value), (location, count, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform1uiv, (GLint location, GLsizei count, const GLuint* value), (location, count, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform2fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform2iv, (GLint location, GLsizei count, const GLint* value), (location, count, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform2uiv, (GLint location, GLsizei count, const GLuint* value), (location, count, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform3fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform3iv, (GLint location, GLsizei count, const GLint* value), (location, count, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform3uiv, (GLint location, GLsizei count, const GLuint* value), (location, count, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform4fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform4iv, (GLint location, GLsizei count, const GLint* value), (location, count, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniform4uiv, (GLint location, GLsizei count, const GLuint* value), (location, count, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniformMatrix2fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniformMatrix3fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniformMatrix4fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniformMatrix2x3fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniformMatrix3x2fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniformMatrix2x4fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniformMatrix4x2fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniformMatrix3x4fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value), CurrentStats.UniformCalls++)
+	STATS_HOOK(glUniformMatrix4x3fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value), CurrentStats.UniformCalls++)
+
+#undef STATS_HOOK
+}
+
+void GL::InstallStatsHooks()
+{
+	if (HooksInstalled)
+		return;
+	HooksInstalled = true;
+
+#define INSTALL_HOOK(Name) \
+	if (glad_##Name) \
+	{ \
+		Original_##Name = glad_##Name; \
+		glad_##Name = Hook_##Name; \
+	}
+
+	INSTALL_HOOK(glDrawArrays);
+	INSTALL_HOOK(glDrawElements);
+	INSTALL_HOOK(glDrawRangeElements);
+	INSTALL_HOOK(glDrawElementsBaseVertex);
+	INSTALL_HOOK(glDrawArraysInstanced);
+	INSTALL_HOOK(glDrawElementsInstanced);
+	INSTALL_HOOK(glDrawElementsInstancedBaseVertex);
+
+	INSTALL_HOOK(glUseProgram);
+	INSTALL_HOOK(glBindVertexArray);
+	INSTALL_HOOK(glBindTexture);
+	INSTALL_HOOK(glBindFramebuffer);
+
+	INSTALL_HOOK(glBufferData);
+	INSTALL_HOOK(glBufferSubData);
+	INSTALL_HOOK(glTexImage2D);
+	INSTALL_HOOK(glTexSubImage2D);
+
+	INSTALL_HOOK(glUniform1f);
+	INSTALL_HOOK(glUniform1i);
+	INSTALL_HOOK(glUniform1ui);
+	INSTALL_HOOK(glUniform2f);
+	INSTALL_HOOK(glUniform2i);
+	INSTALL_HOOK(glUniform2ui);
+	INSTALL_HOOK(glUniform3f);
+	INSTALL_HOOK(glUniform3i);
+	INSTALL_HOOK(glUniform3ui);
+	INSTALL_HOOK(glUniform4f);
+	INSTALL_HOOK(glUniform4i);
+	INSTALL_HOOK(glUniform4ui);
+	INSTALL_HOOK(glUniform1fv);
+	INSTALL_HOOK(glUniform1iv);
+	INSTALL_HOOK(glUniform1uiv);
+	INSTALL_HOOK(glUniform2fv);
+	INSTALL_HOOK(glUniform2iv);
+	INSTALL_HOOK(glUniform2uiv);
+	INSTALL_HOOK(glUniform3fv);
+	INSTALL_HOOK(glUniform3iv);
+	INSTALL_HOOK(glUniform3uiv);
+	INSTALL_HOOK(glUniform4fv);
+	INSTALL_HOOK(glUniform4iv);
+	INSTALL_HOOK(glUniform4uiv);
+	INSTALL_HOOK(glUniformMatrix2fv);
+	INSTALL_HOOK(glUniformMatrix3fv);
+	INSTALL_HOOK(glUniformMatrix4fv);
+	INSTALL_HOOK(glUniformMatrix2x3fv);
+	INSTALL_HOOK(glUniformMatrix3x2fv);
+	INSTALL_HOOK(glUniformMatrix2x4fv);
+	INSTALL_HOOK(glUniformMatrix4x2fv);
+	INSTALL_HOOK(glUniformMatrix3x4fv);
+	INSTALL_HOOK(glUniformMatrix4x3fv);
+
+#undef INSTALL_HOOK
+}
+
+void GL::ResetFrameStats()
+{
+	CurrentStats = {};
+}
+
+void GL::CountCulling(int VisibleCount, int CulledCount)
+{
+	CurrentStats.VisibleObjects += VisibleCount;
+	CurrentStats.CulledObjects += CulledCount;
+}
+
+const frame_stats& GL::GetFrameStats()
+{
+	return CurrentStats;
+}
+
+void GL::DisplayFrameStats(const frame_stats& Stats)
+{
+	ImGui::Text("Draw calls: %d", Stats.DrawCalls);
+	ImGui::Text("Instances: %lld", (long long)Stats.Instances);
+	ImGui::Text("Vertices: %lld", (long long)Stats.Vertices);
+	ImGui::Text("Triangles: %lld", (long long)Stats.Triangles);
+	ImGui::Text("Binds: %d programs, %d VAOs, %d textures, %d FBOs", Stats.ProgramBinds, Stats.VertexArrayBinds, Stats.TextureBinds, Stats.FramebufferBinds);
+	ImGui::Text("Uniform calls: %d", Stats.UniformCalls);
+	ImGui::Text("Uploads: %.1f KB buffers, %.1f KB textures", Stats.BufferUploadBytes / 1024.0, Stats.TextureUploadBytes / 1024.0);
+	ImGui::Text("Culling: %d visible, %d culled", Stats.VisibleObjects, Stats.CulledObjects);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+#include "opengl_headers.h"
+
+namespace GL
+{
+	// GL calls submitted since the last ResetFrameStats()
+	struct frame_stats
+	{
+		int DrawCalls;
+		int64_t Instances;
+		int64_t Vertices;  // Vertices (or indices) fetched, instances included
+		int64_t Triangles; // Triangle primitives, instances included
+
+		int ProgramBinds;
+		int VertexArrayBinds;
+		int TextureBinds;
+		int FramebufferBinds;
+		int UniformCalls;
+
+		int64_t BufferUploadBytes;  // glBufferData/glBufferSubData with data
+		int64_t TextureUploadBytes; // glTexImage2D/glTexSubImage2D with data (estimated from format and type)
+
+		// Objects (or submeshes) tested by the demos before submission, reported with CountCulling()
+		int VisibleObjects;
+		int CulledObjects;
+	};
+
+	// Replace the glad entry points of the counted functions by wrappers that update the stats then forward the call
+	// Call once after gladLoadGL(), every GL call made through glad is counted (ImGui renderer included)
+	void InstallStatsHooks();
+
+	void ResetFrameStats();
+	void CountCulling(int VisibleCount, int CulledCount);
+	const frame_stats& GetFrameStats();
+
+	void DisplayFrameStats(const frame_stats& Stats);
+}
@@ -0,0 +1,138 @@
+#include <cstdio>
+
+#include "opengl_headers.h"
+
+#include "platform_headless.h"
+
+#if defined(__linux__)
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay Display = EGL_NO_DISPLAY;
+static EGLContext Context = EGL_NO_CONTEXT;
+
+static EGLDisplay GetSurfacelessDisplay()
+{
+    // Surfaceless platform first (no X/Wayland), default display otherwise
+    PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (eglGetPlatformDisplayEXT)
+    {
+        EGLDisplay SurfacelessDisplay = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (SurfacelessDisplay != EGL_NO_DISPLAY)
+            return SurfacelessDisplay;
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+bool HeadlessCreateContext()
+{
+    Display = GetSurfacelessDisplay();
+    EGLint Major, Minor;
+    if (Display == EGL_NO_DISPLAY || !eglInitialize(Display, &Major, &Minor))
+    {
+        fprintf(stderr, "EGL initialization failed (0x%x)\n", eglGetError());
+        return false;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        fprintf(stderr, "EGL does not support desktop OpenGL\n");
+        return false;
+    }
+
+    // No surface: any config with desktop GL works (EGL_KHR_no_config_context is not required)
+    const EGLint ConfigAttribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLConfig Config = nullptr;
+    EGLint ConfigCount = 0;
+    eglChooseConfig(Display, ConfigAttribs, &Config, 1, &ConfigCount);
+
+    const EGLint ContextAttribs[] =
+    {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+        EGL_NONE
+    };
+    Context = eglCreateContext(Display, ConfigCount > 0 ? Config : nullptr, EGL_NO_CONTEXT, ContextAttribs);
+    if (Context == EGL_NO_CONTEXT)
+    {
+        fprintf(stderr, "EGL context creation failed (0x%x)\n", eglGetError());
+        return false;
+    }
+
+    if (!eglMakeCurrent(Display, EGL_NO_SURFACE, EGL_NO_SURFACE, Context))
+    {
+        fprintf(stderr, "EGL surfaceless context not supported (0x%x)\n", eglGetError());
+        return false;
+    }
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+    {
+        fprintf(stderr, "gladLoadGLLoader failed.\n");
+        return false;
+    }
+
+    return true;
+}
+
+void HeadlessDestroyContext()
+{
+    if (Display == EGL_NO_DISPLAY)
+        return;
+
+    eglMakeCurrent(Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (Context != EGL_NO_CONTEXT)
+        eglDestroyContext(Display, Context);
+    eglTerminate(Display);
+    Display = EGL_NO_DISPLAY;
+    Context = EGL_NO_CONTEXT;
+}
+
+#else
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+// No surfaceless context: hidden window, its framebuffer is never presented
+static GLFWwindow* HiddenWindow = nullptr;
+
+bool HeadlessCreateContext()
+{
+    if (glfwInit() != GLFW_TRUE)
+        return false;
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    HiddenWindow = glfwCreateWindow(16, 16, "ibr headless", nullptr, nullptr);
+    if (HiddenWindow == nullptr)
+    {
+        fprintf(stderr, "Hidden window creation failed\n");
+        glfwTerminate();
+        return false;
+    }
+
+    glfwMakeContextCurrent(HiddenWindow);
+    glfwSwapInterval(0);
+    if (!gladLoadGL())
+    {
+        fprintf(stderr, "gladLoadGL failed.\n");
+        return false;
+    }
+
+    return true;
+}
+
+void HeadlessDestroyContext()
+{
+    if (HiddenWindow)
+        glfwDestroyWindow(HiddenWindow);
+    HiddenWindow = nullptr;
+    glfwTerminate();
+}
+
+#endif
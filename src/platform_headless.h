@@ -0,0 +1,8 @@
+#pragma once
+
+// OpenGL 3.3 core context without visible window
+// Linux: EGL surfaceless display, no display server needed (Mesa llvmpipe works on machines without GPU)
+// Other platforms: hidden GLFW window
+// Glad is loaded on success, the default framebuffer does not exist: render into GL::offscreen_backbuffer
+bool HeadlessCreateContext();
+void HeadlessDestroyContext();
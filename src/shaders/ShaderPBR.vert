@@ -7,6 +7,10 @@ layout(location = 2) in vec3 aNormal;
 layout(location = 3) in vec3 aTangent;
 layout(location = 4) in vec3 aBitangent;
 
+#ifndef HAS_NORMAL_MAP
+#define HAS_NORMAL_MAP 1
+#endif
+
 // Uniforms
 uniform mat4 uProjection;
 uniform mat4 uModel;
@@ -17,16 +21,21 @@ uniform mat4 uModelNormalMatrix;
 out vec2 vUV;
 out vec3 vPos;    // Vertex position in view-space
 out vec3 vNormal; // Vertex normal in view-space
+#if HAS_NORMAL_MAP
 out mat3 vTBN;
+#endif
 
 void main()
 {
-   vec3 T = normalize(mat3(uModel) * aTangent);
    vec3 N = normalize(mat3(uModel) * aNormal);
+
+#if HAS_NORMAL_MAP
+   vec3 T = normalize(mat3(uModel) * aTangent);
    T = normalize(T - dot(T, N) * N);
    vec3 B = cross(N, T);
    
    vTBN = mat3(T, B, N);
+#endif
 
    vUV = aUV;
    vec4 pos4 = (uModel * vec4(aPosition, 1.0));
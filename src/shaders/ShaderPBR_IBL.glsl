@@ -0,0 +1,44 @@
+// Image based lighting (included by ShaderPBR.frag when HAS_IBL is set)
+
+#include "ShaderPBR_BRDF.glsl"
+
+uniform samplerCube irradianceMap;
+uniform samplerCube prefilterMap;
+uniform sampler2D   brdfLUT;  
+
+//Specular IBL
+vec3 getIBLRadianceGGX(float NdotV, vec3 R, float roughness, vec3 F0, float specularWeight)
+{
+    vec2 brdfSamplePoint = clamp(vec2(NdotV, roughness), vec2(0.0, 0.0), vec2(1.0, 1.0));
+    vec2 envBRDF = texture(brdfLUT, brdfSamplePoint).rg;
+
+    const float MAX_REFLECTION_LOD = 4.0;
+    vec3 prefilteredColor = textureLod(prefilterMap, R,  roughness * MAX_REFLECTION_LOD).rgb;   
+
+    vec3 specularLight = prefilteredColor.rgb;
+
+    vec3 kS = FresnelSchlickRoughness(NdotV, F0, roughness);
+    vec3 FssEss = kS * envBRDF.x + envBRDF.y;
+
+    return specularWeight * specularLight * FssEss;
+}
+
+//Diffuse IBL
+vec3 getIBLRadianceLambertian(float NdotV, vec3 N, float roughness, vec3 albedo, vec3 F0, float specularWeight)
+{
+    vec2 brdfSamplePoint = clamp(vec2(NdotV, roughness), vec2(0.0, 0.0), vec2(1.0, 1.0));
+    vec2 envBRDF = texture(brdfLUT, brdfSamplePoint).rg;
+
+    vec3 irradiance = texture(irradianceMap, N).rgb;
+
+    vec3 kS = FresnelSchlickRoughness(NdotV, F0, roughness);
+    vec3 FssEss = specularWeight * kS * envBRDF.x + envBRDF.y;
+
+    // Multiple scattering, from Fdez-Aguera
+    float Ems = (1.0 - (envBRDF.x + envBRDF.y));
+    vec3 F_avg = specularWeight * (F0 + (1.0 - F0) / 21.0);
+    vec3 FmsEms = Ems * FssEss * F_avg / (1.0 - F_avg * Ems);
+    vec3 kD = albedo * (1.0 - FssEss + FmsEms);
+
+    return (FmsEms + kD) * irradiance;
+}
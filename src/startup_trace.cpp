@@ -0,0 +1,319 @@
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "startup_trace.h"
+#include "json_write.h"
+
+namespace
+{
+    struct phase
+    {
+        std::string Name;
+        std::string Detail;
+        int Depth;
+        double StartMs;
+        double DurationMs;
+    };
+
+    enum class cache_result
+    {
+        NONE, // Not cacheable
+        MISS,
+        HIT,
+    };
+
+    struct asset
+    {
+        StartupTrace::asset_kind Kind;
+        std::string Name;
+        double StartMs;
+        double DurationMs;
+        cache_result Cache;
+    };
+
+    struct history_entry
+    {
+        double TimeToFirstFrameMs;
+        double TimeToInteractiveMs;
+    };
+
+    const char* ASSET_KIND_NAMES[(int)StartupTrace::asset_kind::COUNT] = { "mesh", "texture", "program" };
+
+    // Runs of the same kind and demo compared with the current one, and slowdown reported as a regression
+    const int HISTORY_COMPARE_COUNT = 5;
+    const double HISTORY_REGRESSION_PERCENT = 10.0;
+
+    const std::chrono::steady_clock::time_point ProcessStart = std::chrono::steady_clock::now();
+
+    bool Active = false;
+    bool Interactive = false;
+    std::string Demo;
+
+    std::vector<phase> Phases;
+    int PhaseDepth = 0;
+    std::vector<asset> Assets;
+    std::vector<int> AssetStack;
+
+    int FrameCount = 0;
+    int FastFrameCount = 0;
+    double TimeToFirstFrameMs = -1.0;
+    double TimeToInteractiveMs = -1.0;
+    double StableRunStartMs = 0.0;
+    int InteractiveFrame = -1;
+
+    double NowMs()
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - ProcessStart).count();
+    }
+
+    void WriteReport(const char* Filename, const char* Kind, int CacheHits, int CacheMisses)
+    {
+        FILE* File = fopen(Filename, "w");
+        if (File == nullptr)
+        {
+            fprintf(stderr, "Cannot write startup report '%s'\n", Filename);
+            return;
+        }
+
+        fprintf(File, "{\n  \"kind\": \"%s\",\n  \"demo\": ", Kind);
+        WriteJSONString(File, Demo.c_str());
+        fprintf(File, ",\n  \"time_to_first_frame_ms\": %.3f,\n", TimeToFirstFrameMs);
+        if (Interactive)
+            fprintf(File, "  \"time_to_interactive_ms\": %.3f,\n  \"interactive_frame\": %d,\n", TimeToInteractiveMs, InteractiveFrame);
+        else
+            fprintf(File, "  \"time_to_interactive_ms\": null,\n  \"interactive_frame\": null,\n");
+        fprintf(File, "  \"cache_hits\": %d,\n  \"cache_misses\": %d,\n", CacheHits, CacheMisses);
+
+        fprintf(File, "  \"phases\": [\n");
+        for (size_t i = 0; i < Phases.size(); ++i)
+        {
+            const phase& Phase = Phases[i];
+            fprintf(File, "    { \"name\": ");
+            WriteJSONString(File, Phase.Name.c_str());
+            fprintf(File, ", \"detail\": ");
+            WriteJSONString(File, Phase.Detail.c_str());
+            fprintf(File, ", \"depth\": %d, \"start_ms\": %.3f, \"duration_ms\": %.3f }%s\n",
+                Phase.Depth, Phase.StartMs, Phase.DurationMs, i + 1 < Phases.size() ? "," : "");
+        }
+        fprintf(File, "  ],\n");
+
+        static const char* CACHE_NAMES[] = { "none", "miss", "hit" };
+        fprintf(File, "  \"assets\": [\n");
+        for (size_t i = 0; i < Assets.size(); ++i)
+        {
+            const asset& Asset = Assets[i];
+            fprintf(File, "    { \"kind\": \"%s\", \"name\": ", ASSET_KIND_NAMES[(int)Asset.Kind]);
+            WriteJSONString(File, Asset.Name.c_str());
+            fprintf(File, ", \"cache\": \"%s\", \"start_ms\": %.3f, \"duration_ms\": %.3f }%s\n",
+                CACHE_NAMES[(int)Asset.Cache], Asset.StartMs, Asset.DurationMs, i + 1 < Assets.size() ? "," : "");
+        }
+        fprintf(File, "  ]\n}\n");
+        fclose(File);
+
+        printf("Startup report written to '%s'\n", Filename);
+    }
+
+    // Previous runs of the same kind and demo, oldest first
+    std::vector<history_entry> ReadHistory(const char* Filename, const char* Kind)
+    {
+        std::vector<history_entry> Entries;
+        FILE* File = fopen(Filename, "r");
+        if (File == nullptr)
+            return Entries;
+
+        char Line[1024];
+        while (fgets(Line, sizeof(Line), File))
+        {
+            char Date[64], EntryKind[16], EntryDemo[64];
+            history_entry Entry;
+            if (sscanf(Line, "%63[^,],%15[^,],%63[^,],%lf,%lf", Date, EntryKind, EntryDemo, &Entry.TimeToFirstFrameMs, &Entry.TimeToInteractiveMs) != 5)
+                continue; // Header
+            if (strcmp(EntryKind, Kind) == 0 && Demo == EntryDemo)
+                Entries.push_back(Entry);
+        }
+        fclose(File);
+        return Entries;
+    }
+
+    void PrintComparison(const char* Name, double Current, std::vector<double> Previous, const char* Kind)
+    {
+        if (Previous.empty())
+        {
+            printf("  %-22s %10.1f ms (first %s run)\n", Name, Current, Kind);
+            return;
+        }
+
+        std::sort(Previous.begin(), Previous.end());
+        double Median = Previous[Previous.size() / 2];
+        double DeltaPercent = Median > 0.0 ? (Current - Median) / Median * 100.0 : 0.0;
+        printf("  %-22s %10.1f ms (median of the last %d %s runs %.1f ms, %+.1f%%)%s\n", Name, Current, (int)Previous.size(), Kind,
+            Median, DeltaPercent, DeltaPercent > HISTORY_REGRESSION_PERCENT ? " REGRESSION" : "");
+    }
+}
+
+bool StartupTrace::IsActive()
+{
+    return Active;
+}
+
+void StartupTrace::Start()
+{
+    Active = true;
+}
+
+void StartupTrace::ReportCacheHit(bool Hit)
+{
+    if (!Active || AssetStack.empty())
+        return;
+    Assets[AssetStack.back()].Cache = Hit ? cache_result::HIT : cache_result::MISS;
+}
+
+void StartupTrace::EndFrame(double FrameMs)
+{
+    if (!Active)
+        return;
+
+    double Now = NowMs();
+    FrameCount++;
+    if (FrameCount == 1)
+        TimeToFirstFrameMs = Now;
+
+    if (FrameMs > INTERACTIVE_FRAME_MS)
+    {
+        FastFrameCount = 0;
+        return;
+    }
+
+    if (FastFrameCount++ == 0)
+    {
+        StableRunStartMs = Now;
+        InteractiveFrame = FrameCount;
+    }
+
+    if (FastFrameCount == INTERACTIVE_FRAME_COUNT)
+    {
+        TimeToInteractiveMs = StableRunStartMs;
+        Interactive = true;
+        Active = false;
+    }
+}
+
+bool StartupTrace::IsInteractive()
+{
+    return Interactive;
+}
+
+void StartupTrace::Finish(const char* DemoName, const char* ReportFilename, const char* HistoryFilename)
+{
+    if (TimeToFirstFrameMs < 0.0)
+        return;
+    Active = false;
+    Demo = DemoName;
+
+    int CacheHits = 0;
+    int CacheMisses = 0;
+    double AssetMs[(int)asset_kind::COUNT] = {};
+    for (const asset& Asset : Assets)
+    {
+        CacheHits += Asset.Cache == cache_result::HIT ? 1 : 0;
+        CacheMisses += Asset.Cache == cache_result::MISS ? 1 : 0;
+        AssetMs[(int)Asset.Kind] += Asset.DurationMs;
+    }
+    const char* Kind = CacheMisses > 0 ? "cold" : "warm";
+
+    WriteReport(ReportFilename, Kind, CacheHits, CacheMisses);
+
+    printf("Startup (%s, %s): %d cache hits, %d misses\n", Kind, Demo.c_str(), CacheHits, CacheMisses);
+    for (const phase& Phase : Phases)
+    {
+        if (Phase.Depth == 0)
+            printf("  %-22s %10.1f ms %s\n", Phase.Name.c_str(), Phase.DurationMs, Phase.Detail.c_str());
+    }
+    for (int i = 0; i < (int)asset_kind::COUNT; ++i)
+        printf("  %-22s %10.1f ms\n", ASSET_KIND_NAMES[i], AssetMs[i]);
+
+    std::vector<history_entry> History = ReadHistory(HistoryFilename, Kind);
+    if (History.size() > HISTORY_COMPARE_COUNT)
+        History.erase(History.begin(), History.end() - HISTORY_COMPARE_COUNT);
+    std::vector<double> PreviousFirstFrame;
+    std::vector<double> PreviousInteractive;
+    for (const history_entry& Entry : History)
+    {
+        PreviousFirstFrame.push_back(Entry.TimeToFirstFrameMs);
+        PreviousInteractive.push_back(Entry.TimeToInteractiveMs);
+    }
+    PrintComparison("Time to first frame", TimeToFirstFrameMs, PreviousFirstFrame, Kind);
+    if (!Interactive)
+    {
+        printf("  Not interactive after %d frames, history not updated\n", FrameCount);
+        return;
+    }
+    PrintComparison("Time to interactive", TimeToInteractiveMs, PreviousInteractive, Kind);
+
+    bool NewFile = true;
+    if (FILE* Existing = fopen(HistoryFilename, "r"))
+    {
+        NewFile = false;
+        fclose(Existing);
+    }
+
+    FILE* File = fopen(HistoryFilename, "a");
+    if (File == nullptr)
+    {
+        fprintf(stderr, "Cannot write startup history '%s'\n", HistoryFilename);
+        return;
+    }
+    if (NewFile)
+        fprintf(File, "date,kind,demo,time_to_first_frame_ms,time_to_interactive_ms,interactive_frame,mesh_ms,texture_ms,program_ms,cache_hits,cache_misses\n");
+
+    char Date[64];
+    time_t Now = time(nullptr);
+    strftime(Date, sizeof(Date), "%Y-%m-%dT%H:%M:%S", localtime(&Now));
+    fprintf(File, "%s,%s,%s,%.3f,%.3f,%d,%.3f,%.3f,%.3f,%d,%d\n", Date, Kind, Demo.c_str(), TimeToFirstFrameMs, TimeToInteractiveMs, InteractiveFrame,
+        AssetMs[(int)asset_kind::MESH], AssetMs[(int)asset_kind::TEXTURE], AssetMs[(int)asset_kind::PROGRAM], CacheHits, CacheMisses);
+    fclose(File);
+}
+
+StartupTrace::phase_scope::phase_scope(const char* Name, const char* Detail)
+{
+    if (!Active)
+        return;
+
+    Index = (int)Phases.size();
+    Phases.push_back({ Name, Detail ? Detail : "", PhaseDepth, NowMs(), 0.0 });
+    PhaseDepth++;
+}
+
+StartupTrace::phase_scope::~phase_scope()
+{
+    // Stopped recording in between: the phase still ends
+    if (Index < 0)
+        return;
+
+    Phases[Index].DurationMs = NowMs() - Phases[Index].StartMs;
+    PhaseDepth--;
+}
+
+StartupTrace::asset_scope::asset_scope(asset_kind Kind, const char* Name)
+{
+    if (!Active)
+        return;
+
+    Index = (int)Assets.size();
+    Assets.push_back({ Kind, Name, NowMs(), 0.0, cache_result::NONE });
+    AssetStack.push_back(Index);
+}
+
+StartupTrace::asset_scope::~asset_scope()
+{
+    if (Index < 0)
+        return;
+
+    Assets[Index].DurationMs = NowMs() - Assets[Index].StartMs;
+    AssetStack.pop_back();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+
+// Startup tracer: phases (GL init, demo constructors, IBL precompute...) and asset loads (meshes, textures, programs)
+// from process start until the app is interactive, main thread only
+// A run is "warm" when every cacheable asset (.obj.cache, program binaries) hit its cache, "cold" otherwise
+// Reports go to a JSON file and one line per run is appended to a CSV history, compared with the previous runs of the same kind
+namespace StartupTrace
+{
+    enum class asset_kind
+    {
+        MESH,
+        TEXTURE,
+        PROGRAM,
+        COUNT,
+    };
+
+    // Interactive: first of INTERACTIVE_FRAME_COUNT consecutive frames under INTERACTIVE_FRAME_MS
+    const int INTERACTIVE_FRAME_COUNT = 5;
+    const double INTERACTIVE_FRAME_MS = 50.0;
+
+    // Recording stops once interactive (hot reloads and demo switches are not startup)
+    bool IsActive();
+    // Times are measured from the process start (static initialization), the phases before Start() are not recorded
+    void Start();
+
+    // Applies to the innermost asset scope (loader internals know about the caches, not the callers)
+    void ReportCacheHit(bool Hit);
+
+    // Call after each presented frame with its CPU time
+    void EndFrame(double FrameMs);
+    bool IsInteractive();
+
+    // Write the JSON report, append the run to the CSV history and print the comparison with the previous runs of Demo
+    // The history is left untouched if the app never became interactive
+    void Finish(const char* Demo, const char* ReportFilename, const char* HistoryFilename);
+
+    // Names and details are copied
+    class phase_scope
+    {
+    public:
+        phase_scope(const char* Name, const char* Detail = nullptr);
+        ~phase_scope();
+        phase_scope(const phase_scope&) = delete;
+        phase_scope& operator=(const phase_scope&) = delete;
+
+    private:
+        int Index = -1;
+    };
+
+    class asset_scope
+    {
+    public:
+        asset_scope(asset_kind Kind, const char* Name);
+        ~asset_scope();
+        asset_scope(const asset_scope&) = delete;
+        asset_scope& operator=(const asset_scope&) = delete;
+
+    private:
+        int Index = -1;
+    };
+}
+
+#define STARTUP_CONCAT_(A, B) A##B
+#define STARTUP_CONCAT(A, B) STARTUP_CONCAT_(A, B)
+#define STARTUP_PHASE(Name) StartupTrace::phase_scope STARTUP_CONCAT(StartupPhase, __LINE__)(Name)
+#define STARTUP_PHASE_DETAIL(Name, Detail) StartupTrace::phase_scope STARTUP_CONCAT(StartupPhase, __LINE__)(Name, Detail)
+#define STARTUP_ASSET(Kind, Name) StartupTrace::asset_scope STARTUP_CONCAT(StartupAsset, __LINE__)(StartupTrace::asset_kind::Kind, Name)
@@ -5,6 +5,7 @@
 #include "opengl_helpers.h"
 #include "platform.h"
 #include "mesh.h"
+#include "startup_trace.h"
 
 namespace RBS
 {
@@ -71,6 +72,7 @@ namespace RBS
         // Load and generate skybox faces
         for (unsigned int i = 0; i < 6; i++)
         {
+            STARTUP_ASSET(TEXTURE, facesStr[i].c_str());
             int dimX, dimY;
             unsigned char* data = stbi_load(facesStr[i].c_str(), &dimX, &dimY, &channel, 4);
 
@@ -1,14 +1,28 @@
 
+#include <cmath>
+#include <random>
+#include <algorithm>
+
 #include <imgui.h>
 
 #include "platform.h"
 
 #include "color.h"
+#include "maths.h"
+#include "cpu_profiler.h"
+#include "opengl_helpers_stats.h"
 
 #include "tavern_scene.h"
 
+int tavern_scene::DefaultExtraLightCount = 0;
+bool tavern_scene::DefaultClusteredLights = true;
+bool tavern_scene::DefaultOcclusionCulling = false;
+bool tavern_scene::DefaultSoftwareOcclusion = false;
+
 tavern_scene::tavern_scene(GL::cache& GLCache)
 {
+    PROFILE_FUNCTION();
+
     // Init lights
     {
         this->LightCount = 6;
@@ -43,12 +57,27 @@ tavern_scene::tavern_scene(GL::cache& GLCache)
         this->Lights[4].Position = {  0.012123f, 0.352532f,-2.302700f, 1.f }; // Candle 4
         this->Lights[5].Position = {  3.030360f, 0.352532f,-1.644170f, 1.f }; // Candle 5
 
+        this->ExtraLightCount = DefaultExtraLightCount;
+        this->ClusteredLights = DefaultClusteredLights;
     }
 
     // Create mesh
     {
         // Use vbo from GLCache
         MeshBuffer = GLCache.LoadObj("media/fantasy_game_inn.obj", 1.f, &this->MeshVertexCount);
+        const GL::mesh_info* MeshInfo = GLCache.FindMeshInfo("media/fantasy_game_inn.obj");
+        Submeshes = MeshInfo->Submeshes;
+        Occluders = MeshInfo->Occluders;
+        for (const Mesh::submesh& Submesh : Submeshes)
+            SubmeshBounds.Add(Submesh.Bounds);
+        SubmeshVisible.resize(Submeshes.size());
+
+        std::vector<Mesh::bounds> Bounds;
+        for (const Mesh::submesh& Submesh : Submeshes)
+            Bounds.push_back(Submesh.Bounds);
+        OcclusionCuller.SetObjects(Bounds.data(), (int)Bounds.size());
+        OcclusionCulling = DefaultOcclusionCulling;
+        SoftwareOcclusion = DefaultSoftwareOcclusion;
         
         MeshDesc.Stride = sizeof(vertex_full);
         MeshDesc.HasNormal = true;
@@ -81,6 +110,72 @@ tavern_scene::~tavern_scene()
     //glDeleteBuffers(1, &MeshBuffer); // From cache
 }
 
+bool tavern_scene::UpdateSubmeshVisibility(const mat4& ViewProjection)
+{
+    if (!Culling::Enabled && !SoftwareOcclusion)
+        return false;
+
+    if (Culling::Enabled)
+        Culling::CullBoxes(Culling::ExtractFrustum(ViewProjection), SubmeshBounds, SubmeshVisible.data());
+    else
+        std::fill(SubmeshVisible.begin(), SubmeshVisible.end(), 1);
+
+    // Only the submeshes in the frustum are tested
+    if (SoftwareOcclusion)
+    {
+        OcclusionRasterizer.Rasterize(ViewProjection, Occluders.data(), (int)Occluders.size() / 3);
+        OcclusionRasterizer.TestBoxes(ViewProjection, SubmeshBounds, SubmeshVisible.data());
+    }
+
+    int VisibleCount = 0;
+    for (uint8_t Visible : SubmeshVisible)
+        VisibleCount += Visible;
+    GL::CountCulling(VisibleCount, (int)Submeshes.size() - VisibleCount);
+    return true;
+}
+
+const std::vector<tavern_scene::draw_range>& tavern_scene::CullSubmeshes(const mat4& ViewProjection)
+{
+    PROFILE_FUNCTION();
+
+    DrawRanges.clear();
+    if (!UpdateSubmeshVisibility(ViewProjection))
+    {
+        DrawRanges.push_back({ 0, MeshVertexCount });
+        return DrawRanges;
+    }
+
+    for (size_t i = 0; i < Submeshes.size(); ++i)
+    {
+        if (!SubmeshVisible[i])
+            continue;
+
+        const Mesh::submesh& Submesh = Submeshes[i];
+        if (!DrawRanges.empty() && DrawRanges.back().FirstVertex + DrawRanges.back().VertexCount == Submesh.FirstVertex)
+            DrawRanges.back().VertexCount += Submesh.VertexCount;
+        else
+            DrawRanges.push_back({ Submesh.FirstVertex, Submesh.VertexCount });
+    }
+    return DrawRanges;
+}
+
+void tavern_scene::DrawSubmeshes(const mat4& ViewProjection)
+{
+    if (!OcclusionCulling)
+    {
+        for (const draw_range& Range : CullSubmeshes(ViewProjection))
+            glDrawArrays(GL_TRIANGLES, Range.FirstVertex, Range.VertexCount);
+        return;
+    }
+
+    // The occlusion queries only test the submeshes left by the CPU culling
+    const uint8_t* Candidates = UpdateSubmeshVisibility(ViewProjection) ? SubmeshVisible.data() : nullptr;
+    OcclusionCuller.Render(ViewProjection, Candidates, [this](int i)
+    {
+        glDrawArrays(GL_TRIANGLES, Submeshes[i].FirstVertex, Submeshes[i].VertexCount);
+    });
+}
+
 static bool EditLight(GL::light* Light)
 {
     bool Result =
@@ -106,6 +201,7 @@ void tavern_scene::InspectLights()
                 GL::light& Light = Lights[i];
                 if (EditLight(&Light))
                 {
+                    glBindBuffer(GL_UNIFORM_BUFFER, LightsUniformBuffer);
                     glBufferSubData(GL_UNIFORM_BUFFER, i * sizeof(GL::light), sizeof(GL::light), &Light);
                 }
 
@@ -125,3 +221,86 @@ void tavern_scene::InspectLights()
         ImGui::TreePop();
     }
 }
+
+void tavern_scene::GenerateExtraLights()
+{
+    // Same seed: the first lights do not change with the count
+    std::mt19937 Random(42);
+    std::uniform_real_distribution<float> Unit(0.f, 1.f);
+
+    ExtraLights.resize(ExtraLightCount);
+    for (extra_light& Light : ExtraLights)
+    {
+        // Inside the tavern (candles span x [-5, 3], z [-2.5, 5.5])
+        Light.Center = { -6.f + 10.f * Unit(Random), -0.5f + 2.5f * Unit(Random), -3.f + 9.f * Unit(Random) };
+        Light.OrbitRadius = 0.2f + 0.8f * Unit(Random);
+        Light.Speed = 0.5f + 1.5f * Unit(Random);
+        Light.Phase = 2.f * Math::Pi() * Unit(Random);
+
+        // Saturated random hue
+        float Hue = 6.f * Unit(Random);
+        Light.Color = {
+            Math::Clamp(fabsf(Hue - 3.f) - 1.f, 0.f, 1.f),
+            Math::Clamp(2.f - fabsf(Hue - 2.f), 0.f, 1.f),
+            Math::Clamp(2.f - fabsf(Hue - 4.f), 0.f, 1.f) };
+    }
+}
+
+void tavern_scene::UpdateLightClusters(const platform_io& IO, const mat4& ViewMatrix, float FovY, float AspectRatio, float Near, float Far, bool LightVolumes)
+{
+    PROFILE_FUNCTION();
+
+    if ((int)ExtraLights.size() != ExtraLightCount)
+        GenerateExtraLights();
+
+    if (AnimateExtraLights)
+        ExtraLightsTime += IO.DeltaTime;
+
+    // Small radius (1.1 units, see light_shade() cutoff) with a bright center
+    GL::light PointLight = {};
+    PointLight.Enabled = true;
+    PointLight.Attenuation = { 1.f, 0.f, 30.f };
+
+    ClusteredLightsData.resize(Lights.size() + ExtraLights.size());
+    std::copy(Lights.begin(), Lights.end(), ClusteredLightsData.begin());
+    for (int i = 0; i < (int)ExtraLights.size(); ++i)
+    {
+        const extra_light& Extra = ExtraLights[i];
+        float Angle = Extra.Phase + Extra.Speed * (float)ExtraLightsTime;
+
+        GL::light& Light = ClusteredLightsData[Lights.size() + i];
+        Light = PointLight;
+        Light.Position = { Extra.Center.x + Extra.OrbitRadius * cosf(Angle), Extra.Center.y + 0.3f * Extra.OrbitRadius * sinf(2.f * Angle), Extra.Center.z + Extra.OrbitRadius * sinf(Angle), 1.f };
+        Light.Diffuse = Extra.Color * 15.f;
+        Light.Specular = Extra.Color;
+    }
+
+    LightClusters.Build(ClusteredLightsData.data(), (int)ClusteredLightsData.size(), ViewMatrix, FovY, AspectRatio, Near, Far,
+        IO.WindowWidth, IO.WindowHeight, !ClusteredLights ? GL::light_culling::NONE : LightVolumes ? GL::light_culling::VOLUMES : GL::light_culling::CLUSTERS);
+}
+
+void tavern_scene::InspectLightClusters()
+{
+    if (ImGui::TreeNodeEx("Light clusters"))
+    {
+        ImGui::SliderInt("Extra lights", &ExtraLightCount, 0, 10000);
+        ImGui::Checkbox("Animate", &AnimateExtraLights);
+        ImGui::Checkbox("Culling (off: every light on every pixel)", &ClusteredLights);
+        LightClusters.DisplayStats();
+        ImGui::TreePop();
+    }
+}
+
+void tavern_scene::InspectOcclusionCulling()
+{
+    if (ImGui::TreeNodeEx("Occlusion culling"))
+    {
+        ImGui::Checkbox("GPU occlusion queries", &OcclusionCulling);
+        if (OcclusionCulling)
+            OcclusionCuller.DisplayStats();
+        ImGui::Checkbox("CPU occlusion rasterizer", &SoftwareOcclusion);
+        if (SoftwareOcclusion)
+            OcclusionRasterizer.DisplayStats();
+        ImGui::TreePop();
+    }
+}
@@ -3,6 +3,12 @@
 #include <vector>
 
 #include "opengl_helpers.h"
+#include "opengl_helpers_light_clusters.h"
+#include "opengl_helpers_occlusion.h"
+#include "culling.h"
+#include "occlusion_rasterizer.h"
+
+struct platform_io;
 
 // Tavern scene data (mapped on GPU)
 class tavern_scene
@@ -16,6 +22,30 @@ public:
     int MeshVertexCount = 0;
     vertex_descriptor MeshDesc;
 
+    // Vertex range of MeshBuffer for glDrawArrays()
+    struct draw_range
+    {
+        int FirstVertex;
+        int VertexCount;
+    };
+
+    // Ranges of the submeshes inside the frustum of ViewProjection (model space) and not hidden by the CPU occluders,
+    // contiguous ones merged, the whole mesh when Culling::Enabled and SoftwareOcclusion are off, counted in the frame stats
+    const std::vector<draw_range>& CullSubmeshes(const mat4& ViewProjection);
+
+    // Draw the submeshes with MeshBuffer bound: ranges of CullSubmeshes(), or its submeshes through the occlusion queries when OcclusionCulling is on
+    void DrawSubmeshes(const mat4& ViewProjection);
+
+    // Occlusion queries on the submeshes inside the frustum (demo_base, demo_deferred_shading)
+    static bool DefaultOcclusionCulling; // --occlusion-culling
+    bool OcclusionCulling = false;
+    GL::occlusion_culler OcclusionCuller;
+
+    // CPU occlusion culling of the submeshes against the largest triangles of the mesh, before the GL submission
+    static bool DefaultSoftwareOcclusion; // --software-occlusion
+    bool SoftwareOcclusion = false;
+    Culling::occlusion_rasterizer OcclusionRasterizer;
+
     // Lights buffer
     GLuint LightsUniformBuffer = 0;
     int LightCount = 8;
@@ -29,4 +59,46 @@ public:
 
     // Lights data
     std::vector<GL::light> Lights;
+
+    // Extra animated point lights (not in LightsUniformBuffer), lit through LightClusters with Lights
+    // Used by the demos calling UpdateLightClusters() (demo_base, demo_deferred_shading)
+    static int DefaultExtraLightCount;   // --tavern-lights
+    static bool DefaultClusteredLights;  // --no-light-clusters
+    int ExtraLightCount = 0;
+    bool AnimateExtraLights = true;
+    bool ClusteredLights = true;
+    GL::light_clusters LightClusters;
+
+    // Move the extra lights and cull every light into the clusters of the camera
+    // LightVolumes: local lights are left out of the clusters for the caller to draw them as volumes
+    void UpdateLightClusters(const platform_io& IO, const mat4& ViewMatrix, float FovY, float AspectRatio, float Near, float Far, bool LightVolumes = false);
+    // ImGui debug function to edit the extra lights and display the cluster stats
+    void InspectLightClusters();
+    // ImGui debug function to toggle the occlusion culling (GPU queries, CPU rasterizer) and display their stats
+    void InspectOcclusionCulling();
+
+private:
+    struct extra_light
+    {
+        v3 Center;
+        float OrbitRadius;
+        float Speed; // Radians per second
+        float Phase;
+        v3 Color;
+    };
+
+    void GenerateExtraLights();
+    // SubmeshVisible from the frustum and CPU occlusion culling, false when both are off
+    bool UpdateSubmeshVisibility(const mat4& ViewProjection);
+
+    // Submeshes of MeshBuffer (from GLCache) and their bounds
+    std::vector<Mesh::submesh> Submeshes;
+    Culling::bounds_soa SubmeshBounds;
+    std::vector<uint8_t> SubmeshVisible;
+    std::vector<draw_range> DrawRanges;
+    std::vector<v3> Occluders; // From GLCache, 3 vertices per triangle
+
+    std::vector<extra_light> ExtraLights;
+    std::vector<GL::light> ClusteredLightsData; // Lights then extra lights
+    double ExtraLightsTime = 0.0;
 };